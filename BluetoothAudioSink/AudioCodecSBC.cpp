@@ -273,66 +273,148 @@ namespace A2DP {
 
         ASSERT(inBuffer != nullptr);
         ASSERT(outBuffer != nullptr);
+        ASSERT(outSize >= sizeof(SBCHeader));
 
         uint16_t consumed = 0;
-        uint16_t produced = sizeof(SBCHeader);
         uint16_t count = 0;
 
         _lock.Lock();
 
-        if ((_inFrameSize != 0) && (_outFrameSize != 0)) {
+        if ((_inFrameSize != 0) && (_outFrameSize != 0) && (outSize >= sizeof(SBCHeader))) {
 
-            const uint8_t MAX_FRAMES = 15; // only a four bit number holds the number of frames in a packet
+            if (outSize != _packetSize) {
+                const uint16_t MAX_FRAMES = 15; // only a four bit number holds the number of frames in a packet
 
-            uint16_t frames = (inBufferSize / _inFrameSize);
-            uint16_t available = (outSize - produced);
-
-            ASSERT(outSize >= sizeof(SBCHeader));
-
-            if (frames > MAX_FRAMES) {
-                frames = MAX_FRAMES;
+                // All packets have the same size, so this is only worked out again after a configuration change.
+                _packetFrames = static_cast<uint8_t>(std::min(static_cast<uint16_t>((outSize - sizeof(SBCHeader)) / _outFrameSize), MAX_FRAMES));
+                _packetSize = outSize;
             }
 
-            while ((frames-- > 0)
-                    && (inBufferSize >= (consumed + _inFrameSize))
-                    && (available >= _outFrameSize)) {
-
-                ssize_t written = 0;
-                ssize_t read = ::sbc_encode(static_cast<::sbc_t*>(_sbcHandle),
-                                            (inBuffer + consumed), _inFrameSize,
-                                            (outBuffer + produced), available,
-                                            &written);
+            count = EncodeFrames(std::min(static_cast<uint16_t>(inBufferSize / _inFrameSize), static_cast<uint16_t>(_packetFrames)),
+                                 inBuffer, (outBuffer + sizeof(SBCHeader)));
 
-                if (read < 0) {
-                    TRACE_L1("Failed to encode an SBC frame!");
-                    break;
-                } else {
-                    consumed += read;
-                    available -= written;
-                    produced += written;
-                    count++;
-                }
-            }
+            consumed = (count * _inFrameSize);
         }
 
-        _lock.Unlock();
-
         if (count > 0) {
             SBCHeader* header = reinterpret_cast<SBCHeader*>(outBuffer);
             header->frameCount = (count & 0xF);
-            outSize = produced;
+            outSize = (sizeof(SBCHeader) + (count * _outFrameSize));
         } else {
             outSize = 0;
         }
 
+        _lock.Unlock();
+
         return (consumed);
     }
 
-    /* virtual */ uint16_t AudioCodecSBC::Decode(const uint16_t /* inBufferSize */, const uint8_t /* inBuffer */[],
-                                                 uint16_t& /* outBufferSize */, uint8_t /* outBuffer */[]) const
+    /* virtual */ uint16_t AudioCodecSBC::Decode(const uint16_t inBufferSize, const uint8_t inBuffer[],
+                                                 uint16_t& outSize, uint8_t outBuffer[]) const
+    {
+        ASSERT(inBuffer != nullptr);
+        ASSERT(outBuffer != nullptr);
+
+        uint16_t consumed = 0;
+        uint16_t produced = 0;
+
+        if (inBufferSize >= sizeof(SBCHeader)) {
+            const SBCHeader* header = reinterpret_cast<const SBCHeader*>(inBuffer);
+
+            consumed = sizeof(SBCHeader);
+
+            _lock.Lock();
+
+            if ((_inFrameSize != 0) && (_outFrameSize != 0)) {
+                // The frames of a stream all have the size of its configuration.
+                const uint16_t frames = std::min(std::min(static_cast<uint16_t>(header->frameCount & 0xF),
+                                                          static_cast<uint16_t>((inBufferSize - sizeof(SBCHeader)) / _outFrameSize)),
+                                                 static_cast<uint16_t>(outSize / _inFrameSize));
+
+                const uint16_t count = DecodeFrames(frames, (inBuffer + sizeof(SBCHeader)), outBuffer);
+
+                consumed += (count * _outFrameSize);
+                produced = (count * _inFrameSize);
+            }
+
+            _lock.Unlock();
+        }
+
+        outSize = produced;
+
+        return (consumed);
+    }
+
+    uint16_t AudioCodecSBC::EncodeFrames(const uint16_t frames, const uint8_t inBuffer[], uint8_t outBuffer[]) const
+    {
+        ASSERT(inBuffer != nullptr);
+        ASSERT(outBuffer != nullptr);
+
+        uint16_t count = 0;
+
+        _lock.Lock();
+
+        ::sbc_t* sbc = static_cast<::sbc_t*>(_sbcHandle);
+        const uint8_t* in = inBuffer;
+        uint8_t* out = outBuffer;
+
+        while (count < frames) {
+            ssize_t written = 0;
+            ssize_t read = ::sbc_encode(sbc, in, _inFrameSize, out, _outFrameSize, &written);
+
+            if ((read != _inFrameSize) || (written != _outFrameSize)) {
+                TRACE_L1("Failed to encode an SBC frame!");
+                break;
+            }
+
+            in += _inFrameSize;
+            out += _outFrameSize;
+            count++;
+        }
+
+        _lock.Unlock();
+
+        return (count);
+    }
+
+    uint16_t AudioCodecSBC::DecodeFrames(const uint16_t frames, const uint8_t inBuffer[], uint8_t outBuffer[]) const
     {
-        ASSERT(false && "SBC decode not implemented"); // TODO...?
-        return (0);
+        ASSERT(inBuffer != nullptr);
+        ASSERT(outBuffer != nullptr);
+
+        uint16_t count = 0;
+
+        _lock.Lock();
+
+        if (_sbcDecoderHandle == nullptr) {
+            // The decoder has state of its own, it takes the stream parameters from the frame headers.
+            _sbcDecoderHandle = static_cast<void*>(new ::sbc_t);
+            ASSERT(_sbcDecoderHandle != nullptr);
+
+            ::sbc_init(static_cast<::sbc_t*>(_sbcDecoderHandle), 0L);
+        }
+
+        ::sbc_t* sbc = static_cast<::sbc_t*>(_sbcDecoderHandle);
+        const uint8_t* in = inBuffer;
+        uint8_t* out = outBuffer;
+
+        while (count < frames) {
+            size_t written = 0;
+            ssize_t read = ::sbc_decode(sbc, in, _outFrameSize, out, _inFrameSize, &written);
+
+            if ((read != _outFrameSize) || (written != _inFrameSize)) {
+                TRACE_L1("Failed to decode an SBC frame!");
+                break;
+            }
+
+            in += _outFrameSize;
+            out += _inFrameSize;
+            count++;
+        }
+
+        _lock.Unlock();
+
+        return (count);
     }
 
     /* virtual */ uint32_t AudioCodecSBC::QOS(const int8_t policy)
@@ -414,6 +496,12 @@ namespace A2DP {
             _sbcHandle = nullptr;
         }
 
+        if (_sbcDecoderHandle != nullptr) {
+            ::sbc_finish(static_cast<::sbc_t*>(_sbcDecoderHandle));
+            delete static_cast<::sbc_t*>(_sbcDecoderHandle);
+            _sbcDecoderHandle = nullptr;
+        }
+
         _lock.Unlock();
     }
 
@@ -504,6 +592,7 @@ namespace A2DP {
         _frameDuration = ::sbc_get_frame_duration(sbc); /* microseconds */
         _inFrameSize = ::sbc_get_codesize(sbc); /* bytes */
         _outFrameSize = ::sbc_get_frame_length(sbc); /* bytes */
+        _packetSize = 0; /* frames per packet are worked out again on the next packet */
 
         _bitRate = ((8L * _outFrameSize * rate) / (bands * blocks)); /* bits per second */
         _channels = (sbc->mode == SBC_MODE_MONO? 1 : 2);
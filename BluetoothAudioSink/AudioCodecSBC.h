@@ -247,6 +247,7 @@ namespace A2DP {
             , _actuals()
             , _preset(COMPATIBLE)
             , _sbcHandle(nullptr)
+            , _sbcDecoderHandle(nullptr)
             , _preferredBitpool(0)
             , _bitpool(0)
             , _bitRate(0)
@@ -255,6 +256,8 @@ namespace A2DP {
             , _inFrameSize(0)
             , _outFrameSize(0)
             , _frameDuration(0)
+            , _packetSize(0)
+            , _packetFrames(0)
         {
             _supported.Deserialize(config);
             SBCInitialize();
@@ -305,7 +308,16 @@ namespace A2DP {
         uint16_t Decode(const uint16_t inBufferSize, const uint8_t inBuffer[],
                         uint16_t& outBufferSize, uint8_t outBuffer[]) const override;
 
-    private:
+    public:
+        // Encodes the given number of frames back to back, without a media payload header. The frame sizes follow
+        // from the configuration: the input holds frames * InFrameSize() bytes, the output receives frames *
+        // OutFrameSize() bytes. Returns the number of frames encoded.
+        uint16_t EncodeFrames(const uint16_t frames, const uint8_t inBuffer[], uint8_t outBuffer[]) const;
+
+        // The other way around, the input holds frames * OutFrameSize() bytes. Returns the number of frames decoded.
+        uint16_t DecodeFrames(const uint16_t frames, const uint8_t inBuffer[], uint8_t outBuffer[]) const;
+
+    protected:
         void Bitpool(uint8_t value);
 
     private:
@@ -323,6 +335,7 @@ namespace A2DP {
         Format _actuals;
         preset _preset;
         void* _sbcHandle;
+        mutable void* _sbcDecoderHandle;
         uint8_t _preferredBitpool;
         uint8_t _bitpool;
         uint32_t _bitRate;
@@ -331,6 +344,8 @@ namespace A2DP {
         uint16_t _inFrameSize;
         uint16_t _outFrameSize;
         uint32_t _frameDuration;
+        mutable uint16_t _packetSize; // the packet size _packetFrames was worked out for
+        mutable uint8_t _packetFrames;
 
     private:
         struct SBCHeader {
@@ -21,15 +21,21 @@
 
 #include "Module.h"
 #include "TransportChannel.h"
+#include "RingBuffer.h"
 #include "Tracing.h"
 
+#include <time.h>
+
 namespace WPEFramework {
 
 namespace Plugin {
 
-    class AudioPlayer : public Core::Thread {
+    // The transport is a parameter, so the pacing can also be driven without a Bluetooth link.
+    template <typename TRANSPORT>
+    class AudioPlayerType : public Core::Thread {
     private:
         static constexpr uint16_t WRITE_AHEAD_THRESHOLD = 10 /* miliseconds */;
+        static constexpr uint16_t STALL_TIMEOUT = 100 /* miliseconds */;
 
     private:
         class ReceiveBuffer : public Core::SharedBuffer {
@@ -46,44 +52,85 @@ namespace Plugin {
             ~ReceiveBuffer() = default;
 
         public:
-            uint32_t Get(const uint32_t length, uint8_t buffer[])
+            // Size of the chunk the producer offers, it stays in the shared buffer until Release().
+            uint32_t Acquire(const uint32_t waitTime)
             {
                 uint32_t result = 0;
 
                 if (IsValid() == true) {
-                    if (RequestConsume(100) == Core::ERROR_NONE) {
-                        ASSERT(BytesWritten() <= length);
-                        const uint32_t size = std::min(BytesWritten(), length);
-                        ::memcpy(buffer, Buffer(), size);
-                        result = size;
-                        Consumed();
+                    if (RequestConsume(waitTime) == Core::ERROR_NONE) {
+                        result = BytesWritten();
                     }
                 }
 
                 return (result);
             }
+            const uint8_t* Data() const
+            {
+                return (Buffer());
+            }
+            void Release()
+            {
+                Consumed();
+            }
         }; // class ReceiveBuffer
 
+        // Moves the chunks from the shared buffer into the ring, so the transmitter never waits on the producer.
+        class Receiver : public Core::Thread {
+        public:
+            Receiver() = delete;
+            Receiver(const Receiver&) = delete;
+            Receiver& operator=(const Receiver&) = delete;
+
+            Receiver(AudioPlayerType& parent)
+                : Core::Thread(Core::Thread::DefaultStackSize(), _T("BluetoothAudioReceiver"))
+                , _parent(parent)
+            {
+            }
+            ~Receiver() = default;
+
+        private:
+            uint32_t Worker() override
+            {
+                uint32_t delay = 0;
+
+                if (_parent._eos == true) {
+                    Thread::Block();
+                    delay = Core::infinite;
+                } else {
+                    delay = _parent.Receive();
+                }
+
+                return (delay);
+            }
+
+        private:
+            AudioPlayerType& _parent;
+        }; // class Receiver
+
     public:
-        AudioPlayer() = delete;
-        AudioPlayer(const AudioPlayer&) = delete;
-        AudioPlayer& operator=(const AudioPlayer&) = delete;
+        AudioPlayerType() = delete;
+        AudioPlayerType(const AudioPlayerType&) = delete;
+        AudioPlayerType& operator=(const AudioPlayerType&) = delete;
 
     public:
-        AudioPlayer(A2DP::TransportChannel& transport, const string& connector)
+        AudioPlayerType(TRANSPORT& transport, const string& connector)
             : _transport(transport)
             , _startTime(0)
             , _offset(0)
-            , _available(0)
             , _minFrameSize(0)
             , _maxFrameSize(0)
             , _preferredFrameSize(0)
             , _receiveBuffer(connector)
-            , _buffer(nullptr)
-            , _readCursor(nullptr)
-            , _bufferSize(0)
+            , _ring(nullptr)
+            , _pending(0)
+            , _starving(false)
+            , _dataAvailable(false, false)
             , _latency(0)
+            , _underruns(0)
+            , _jitter(0)
             , _eos(false)
+            , _receiver(*this)
         {
             _minFrameSize = _transport.MinFrameSize();
             _preferredFrameSize = _transport.PreferredFrameSize();
@@ -95,10 +142,9 @@ namespace Plugin {
             if (_receiveBuffer.IsValid() == true) {
                 _maxFrameSize = _receiveBuffer.Size();
                 if (_maxFrameSize != 0) {
-                    const uint32_t multiplier = (((2 * _preferredFrameSize) / _maxFrameSize) + 1);
-                    _bufferSize = multiplier * _maxFrameSize;
-                    _buffer = static_cast<uint8_t*>(::malloc(_bufferSize));
-                    ASSERT(_buffer != nullptr);
+                    // Room for a chunk from the producer while two packets worth are still waiting to go out.
+                    _ring = new RingBuffer((_maxFrameSize + (2 * _preferredFrameSize)), _preferredFrameSize);
+                    ASSERT(_ring != nullptr);
                 }
             }
 
@@ -106,16 +152,16 @@ namespace Plugin {
                 TRACE(Trace::Error, (_T("Shared buffer not available")));
             }
         }
-        ~AudioPlayer()
+        ~AudioPlayerType()
         {
             Stop();
-            ::free(_buffer);
+            delete _ring;
         }
 
     public:
         bool IsValid() const
         {
-            return ((_buffer != nullptr) && (_receiveBuffer.IsValid() == true) && (_transport.IsOpen() == true));
+            return ((_ring != nullptr) && (_ring->IsValid() == true) && (_receiveBuffer.IsValid() == true) && (_transport.IsOpen() == true));
         }
         uint32_t Play()
         {
@@ -123,9 +169,13 @@ namespace Plugin {
 
             if (IsValid() == true) {
                 _transport.Reset();
-                _readCursor = _buffer;
-                _available = 0;
-                _startTime = Core::Time::Now().Ticks();
+                _ring->Reset();
+                _pending = 0;
+                _underruns = 0;
+                _jitter = 0;
+                _eos = false;
+                _startTime = Now();
+                _receiver.Run();
                 Thread::Run();
             } else {
                 TRACE(Trace::Error, (_T("Transport channel is not open!")));
@@ -140,7 +190,17 @@ namespace Plugin {
 
             if (IsValid() == true) {
                 _eos = true;
+                _dataAvailable.SetEvent();
+                _receiver.Wait(BLOCKED, Core::infinite);
                 Thread::Wait(BLOCKED, Core::infinite);
+
+                if (_pending != 0) {
+                    // A chunk that did not fit the ring anymore, hand it back or the producer stays blocked.
+                    _receiveBuffer.Release();
+                    _pending = 0;
+                }
+
+                TRACE(A2DP::ProfileFlow, (_T("Playback statistics: %i underruns, %i us maximum transmit jitter"), _underruns, _jitter));
             } else {
                 result = Core::ERROR_ILLEGAL_STATE;
             }
@@ -166,12 +226,21 @@ namespace Plugin {
             _latency = ((_transport.ClockRate() * _transport.Channels() * latency) / 1000);
             TRACE(A2DP::ProfileFlow, (_T("Latency adjustment: +%i ms (%i samples)"), latency, _latency));
         }
+        uint32_t Underruns() const
+        {
+            return (_underruns);
+        }
+        // Maximum wake up delay, in microseconds.
+        uint32_t Jitter() const
+        {
+            return (_jitter);
+        }
         uint32_t Delay(uint32_t& delay /* samples */) const
         {
             uint32_t result = Core::ERROR_NONE;
 
             if (IsValid() == true) {
-                delay = (_latency + (_available) / (_transport.BytesPerSample())); // counting in samples here
+                delay = (_latency + (_ring->Available()) / (_transport.BytesPerSample())); // counting in samples here
             } else {
                 result = Core::ERROR_BAD_REQUEST;
             }
@@ -180,65 +249,129 @@ namespace Plugin {
         }
 
     private:
+        // Monotonic, in microseconds, so setting the system time does not disturb the pacing.
+        static uint64_t Now()
+        {
+            struct timespec now;
+            ::clock_gettime(CLOCK_MONOTONIC, &now);
+            return ((static_cast<uint64_t>(now.tv_sec) * 1000000ULL) + (now.tv_nsec / 1000));
+        }
+        // Sleeps until the given time, rather than for a while, so the time spent encoding does not add up.
+        static void SleepUntil(const uint64_t deadline /* us */)
+        {
+            struct timespec until;
+            until.tv_sec = static_cast<time_t>(deadline / 1000000ULL);
+            until.tv_nsec = static_cast<long>((deadline % 1000000ULL) * 1000);
+
+            while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR) {
+            }
+        }
         uint32_t PlayTime() const
         {
             return ((1000ULL * _transport.Timestamp()) / _transport.ClockRate());
         }
 
-        uint32_t Worker() override
+        // Runs on the receiver thread, returns the time to wait before the next attempt.
+        uint32_t Receive()
         {
             uint32_t delay = 0;
-            uint32_t transmitted = 0;
-
-            if ((_available < _minFrameSize) && (_eos != true)) {
-                // Have to replenish the local buffer...
-                // TODO: optimization opportunity
-                ::memmove(_buffer, _readCursor, _available);
 
-                // Make sure we have at least the encoder preferred frame size available.
-                while (_available < _preferredFrameSize) {
-                    ASSERT(_available + _maxFrameSize <= _bufferSize);
+            if (_pending == 0) {
+                _pending = _receiveBuffer.Acquire(STALL_TIMEOUT);
+                ASSERT(_pending <= _maxFrameSize);
+            }
 
-                    const uint16_t bytesRead =_receiveBuffer.Get(_maxFrameSize, (_buffer + _available));
-                    ASSERT(bytesRead <= _maxFrameSize);
+            if (_pending != 0) {
+                const uint32_t free = _ring->Free();
 
-                    _available += bytesRead;
+                if (free >= _pending) {
+                    _ring->Write(_pending, _receiveBuffer.Data());
+                    _receiveBuffer.Release();
+                    _pending = 0;
 
-                    if (bytesRead == 0) {
-                        // The audio source has problem providing more data at the moment...
-                        // We don't have the preferred data available, let's try to play out whatever there is left in the buffer anyway.
-                        if (_available < _minFrameSize) {
-                            // All data was used and no new is currently available, apparently the source has stalled.
-                            _offset += PlayTime();
-                            _startTime = Core::Time::Now().Ticks();
-                            _transport.Reset();
-                        }
-                        break;
+                    if (_starving.exchange(false) == true) {
+                        _dataAvailable.SetEvent();
                     }
+                } else {
+                    // The ring is full, the producer has to wait until the transmitter played out the difference.
+                    const uint32_t byteRate = (_transport.ClockRate() * _transport.Channels() * _transport.BytesPerSample());
+                    delay = ((1000ULL * (_pending - free)) / byteRate) + 1;
+                }
+            }
+
+            return (delay);
+        }
+
+        // Waits for the receiver to deliver at least a frame, returns what is available.
+        uint32_t Replenish()
+        {
+            const uint64_t deadline = Now() + (STALL_TIMEOUT * 1000ULL);
+            uint32_t available = _ring->Available();
+            uint64_t now = 0;
+
+            while ((available < _minFrameSize) && (_eos == false) && ((now = Now()) < deadline)) {
+                // Announce the wait before looking again, so a chunk written in between still wakes us up.
+                _dataAvailable.ResetEvent();
+                _starving = true;
+
+                available = _ring->Available();
+
+                if (available < _minFrameSize) {
+                    _dataAvailable.Lock(static_cast<uint32_t>(((deadline - now) + 999) / 1000));
+                    available = _ring->Available();
                 }
 
-                _readCursor = _buffer;
+                _starving = false;
             }
 
+            if ((available < _minFrameSize) && (_eos == false)) {
+                // No new data is currently available, apparently the source has stalled.
+                _underruns++;
+                _offset += PlayTime();
+                _startTime = Now();
+                _transport.Reset();
+            }
+
+            return (available);
+        }
+
+        uint32_t Worker() override
+        {
+            uint32_t delay = 0;
+            uint32_t transmitted = 0;
+
             if (_transport.IsOpen() == true) {
-                const uint32_t playTime = PlayTime();
-                const uint32_t elapsedTime = ((Core::Time::Now().Ticks() - _startTime) / 1000);
+                uint32_t available = _ring->Available();
 
-                if ((playTime > WRITE_AHEAD_THRESHOLD) && (playTime - WRITE_AHEAD_THRESHOLD > elapsedTime)) {
-                    // We're writing ahead of time, let's wait a bit, so the device's buffer does not overflow.
-                    ::SleepMs(playTime - elapsedTime);
+                if (available < _minFrameSize) {
+                    available = Replenish();
                 }
 
-                if (_available >= _minFrameSize) {
-                    transmitted = _transport.Transmit(_available, _readCursor);
+                if (available >= _minFrameSize) {
+                    const uint64_t playTime = ((1000000ULL * _transport.Timestamp()) / _transport.ClockRate());
+                    const uint64_t due = _startTime + playTime - std::min(playTime, static_cast<uint64_t>(WRITE_AHEAD_THRESHOLD * 1000));
+
+                    if (due > Now()) {
+                        // We're writing ahead of time, let's wait a bit, so the device's buffer does not overflow.
+                        SleepUntil(due);
+
+                        const uint32_t late = static_cast<uint32_t>(Now() - due);
+                        if (late > _jitter) {
+                            _jitter = late;
+                        }
+
+                        available = _ring->Available();
+                    }
+
+                    transmitted = _transport.Transmit(std::min(available, _preferredFrameSize), _ring->Peek());
 
 #ifdef __DEBUG__
+                    const uint32_t elapsedTime = ((Now() - _startTime) / 1000);
                     fprintf(stderr, "streaming; time %3i.%03i / %3i.%03i sec; delta %3i ms, frame %i bytes  \r",
-                            (playTime / 1000), (playTime % 1000), (elapsedTime / 1000), (elapsedTime % 1000), (playTime - elapsedTime), transmitted);
+                            static_cast<uint32_t>(playTime / 1000000), static_cast<uint32_t>((playTime / 1000) % 1000), (elapsedTime / 1000), (elapsedTime % 1000), (static_cast<uint32_t>(playTime / 1000) - elapsedTime), transmitted);
 #endif
 
-                    _readCursor += transmitted;
-                    _available -= transmitted;
+                    _ring->Consume(transmitted);
                 }
             } else {
                 TRACE(Trace::Error, (_T("Bluetooth transport link failure - terminating audio stream")));
@@ -255,21 +388,26 @@ namespace Plugin {
         }
 
     private:
-        A2DP::TransportChannel& _transport;
-        uint64_t _startTime;
+        TRANSPORT& _transport;
+        uint64_t _startTime; // monotonic, in microseconds
         uint32_t _offset;
-        uint32_t _available;
         uint32_t _minFrameSize;
         uint32_t _maxFrameSize;
         uint32_t _preferredFrameSize;
         ReceiveBuffer _receiveBuffer;
-        uint8_t* _buffer;
-        uint8_t* _readCursor;
-        uint32_t _bufferSize;
+        RingBuffer* _ring;
+        uint32_t _pending; // bytes waiting in the shared buffer for room in the ring
+        std::atomic<bool> _starving;
+        Core::Event _dataAvailable;
         uint32_t _latency; // in samples
-        bool _eos;
+        uint32_t _underruns;
+        uint32_t _jitter; // maximum wake up delay, in microseconds
+        std::atomic<bool> _eos;
+        Receiver _receiver;
     };
 
+    using AudioPlayer = AudioPlayerType<A2DP::TransportChannel>;
+
 } // namespace Plugin
 
-}
\ No newline at end of file
+}
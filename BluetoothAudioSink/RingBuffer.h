@@ -0,0 +1,140 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2021 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <atomic>
+
+namespace WPEFramework {
+
+namespace Plugin {
+
+    // Byte ring for exactly one producer and one consumer thread, without locks: the producer only moves the head,
+    // the consumer only the tail. The first bytes of the ring are mirrored behind its end, so the consumer can read
+    // up to that many bytes in one piece, also where the data wraps around.
+    class RingBuffer {
+    public:
+        RingBuffer() = delete;
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+
+        RingBuffer(const uint32_t capacity, const uint32_t contiguous)
+            : _capacity(Round(std::max(capacity, contiguous)))
+            , _mask(_capacity - 1)
+            , _contiguous(contiguous)
+            , _buffer(static_cast<uint8_t*>(::malloc(_capacity + _contiguous)))
+            , _head(0)
+            , _tail(0)
+        {
+            ASSERT(_buffer != nullptr);
+        }
+        ~RingBuffer()
+        {
+            ::free(_buffer);
+        }
+
+    public:
+        bool IsValid() const
+        {
+            return (_buffer != nullptr);
+        }
+        uint32_t Capacity() const
+        {
+            return (_capacity);
+        }
+        // Only while neither the producer nor the consumer is running.
+        void Reset()
+        {
+            _head.store(0, std::memory_order_relaxed);
+            _tail.store(0, std::memory_order_relaxed);
+        }
+
+    public:
+        // Producer side
+        uint32_t Free() const
+        {
+            return (_capacity - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire)));
+        }
+        uint32_t Write(const uint32_t length, const uint8_t data[])
+        {
+            const uint32_t head = _head.load(std::memory_order_relaxed);
+            const uint32_t offset = (head & _mask);
+            const uint32_t size = std::min(length, Free());
+            const uint32_t first = std::min(size, (_capacity - offset));
+
+            ::memcpy(&_buffer[offset], data, first);
+            ::memcpy(_buffer, &data[first], (size - first));
+
+            Mirror(offset, (offset + first));
+            Mirror(0, (size - first));
+
+            _head.store((head + size), std::memory_order_release);
+
+            return (size);
+        }
+
+    public:
+        // Consumer side
+        uint32_t Available() const
+        {
+            return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed));
+        }
+        // At least the smallest of Available() and the contiguous size given at construction can be read from here.
+        const uint8_t* Peek() const
+        {
+            return (&_buffer[_tail.load(std::memory_order_relaxed) & _mask]);
+        }
+        void Consume(const uint32_t length)
+        {
+            ASSERT(length <= Available());
+            _tail.store((_tail.load(std::memory_order_relaxed) + length), std::memory_order_release);
+        }
+
+    private:
+        void Mirror(const uint32_t begin, const uint32_t end)
+        {
+            if (begin < std::min(end, _contiguous)) {
+                ::memcpy(&_buffer[_capacity + begin], &_buffer[begin], (std::min(end, _contiguous) - begin));
+            }
+        }
+        static uint32_t Round(const uint32_t value)
+        {
+            uint32_t result = 1;
+
+            while (result < value) {
+                result <<= 1;
+            }
+
+            return (result);
+        }
+
+    private:
+        const uint32_t _capacity; // Power of two, so the free running head and tail can wrap
+        const uint32_t _mask;
+        const uint32_t _contiguous;
+        uint8_t* _buffer;
+        std::atomic<uint32_t> _head;
+        std::atomic<uint32_t> _tail;
+    };
+
+} // namespace Plugin
+
+}
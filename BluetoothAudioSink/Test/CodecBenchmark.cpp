@@ -0,0 +1,225 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2021 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the SBC codec at 44.1 kHz joint stereo, for the bitpools of the quality presets:
+//  - encoding into media packets, the way the transport channel does, and in one batch of frames;
+//  - decoding the packets again;
+//  - how close the round trip comes to the original, as a signal to noise ratio. The input is a sweep, so all
+//    sub-bands take part; the codec delay is found by looking for the best match.
+//
+// Usage: BluetoothAudioSinkCodecBenchmark [seconds of audio]
+
+#include "../AudioCodecSBC.h"
+
+#include <cmath>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    class Codec : public A2DP::AudioCodecSBC {
+    public:
+        Codec() = delete;
+        Codec(const Codec&) = delete;
+        Codec& operator=(const Codec&) = delete;
+
+        Codec(const Bluetooth::Buffer& capabilities)
+            : A2DP::AudioCodecSBC(capabilities)
+        {
+        }
+        ~Codec() override = default;
+
+    public:
+        void Select(const uint8_t bitpool)
+        {
+            Bitpool(bitpool);
+        }
+    };
+
+    static constexpr uint32_t SampleRate = 44100;
+    static constexpr uint16_t PacketSize = 672 - 12; // the A2DP MTU, without the RTP header
+
+    static double FramesPerSecond(const uint64_t start, const uint32_t frames)
+    {
+        return ((static_cast<double>(frames) * 1000.0 * Core::Time::TicksPerMillisecond) / std::max(static_cast<double>(Core::Time::Now().Ticks() - start), 1.0));
+    }
+
+    // Signal to noise ratio in dB of the decoded samples, at the delay where they match the original best.
+    static double RoundTrip(const std::vector<int16_t>& original, const std::vector<int16_t>& decoded, uint32_t& delay)
+    {
+        const uint32_t window = std::min(static_cast<uint32_t>(original.size() / 2), static_cast<uint32_t>(8192));
+        double best = -1;
+
+        delay = 0;
+
+        // In samples of both channels, so the delay is a multiple of two.
+        for (uint32_t lag = 0; lag < 1024; lag += 2) {
+            double correlation = 0;
+
+            for (uint32_t index = 0; (index < window) && ((index + lag) < decoded.size()); index++) {
+                correlation += static_cast<double>(original[index]) * decoded[index + lag];
+            }
+
+            if (correlation > best) {
+                best = correlation;
+                delay = lag;
+            }
+        }
+
+        double signal = 0;
+        double noise = 0;
+
+        for (uint32_t index = 0; (index + delay) < decoded.size(); index++) {
+            const double difference = static_cast<double>(original[index]) - decoded[index + delay];
+
+            signal += static_cast<double>(original[index]) * original[index];
+            noise += difference * difference;
+        }
+
+        return (10.0 * std::log10(signal / std::max(noise, 1.0)));
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t seconds = (argc > 1 ? ::atoi(argv[1]) : 20);
+    static const uint8_t Bitpools[] = { 19, 29, 35, 53, 76 };
+
+    A2DP::AudioCodecSBC::Format capabilities;
+    capabilities.SamplingFrequency(A2DP::AudioCodecSBC::Format::SF_44100_HZ);
+    capabilities.ChannelMode(A2DP::AudioCodecSBC::Format::CM_JOINT_STEREO);
+    capabilities.BlockLength(A2DP::AudioCodecSBC::Format::BL_16);
+    capabilities.SubBands(A2DP::AudioCodecSBC::Format::SB_8);
+    capabilities.AllocationMethod(A2DP::AudioCodecSBC::Format::AM_LOUDNESS);
+    capabilities.MinBitpool(A2DP::AudioCodecSBC::MIN_BITPOOL);
+    capabilities.MaxBitpool(A2DP::AudioCodecSBC::MAX_BITPOOL);
+
+    Bluetooth::Buffer buffer;
+    capabilities.Serialize(buffer);
+
+    Plugin::Codec codec(buffer);
+
+    A2DP::IAudioCodec::StreamFormat format;
+    format.SampleRate = Plugin::SampleRate;
+    format.FrameRate = 0;
+    format.Resolution = 16;
+    format.Channels = 2;
+
+    if (codec.Configure(format, _T("{\"LC-SBC\":\"{}\"}")) != Core::ERROR_NONE) {
+        printf(_T("Could not configure the SBC codec\n"));
+        return (1);
+    }
+
+    // A sweep from 20 Hz to 20 kHz, a bit softer on the right channel.
+    std::vector<int16_t> pcm(static_cast<size_t>(Plugin::SampleRate) * seconds * 2);
+    double phase = 0;
+    for (uint32_t index = 0; index < (pcm.size() / 2); index++) {
+        const double frequency = 20.0 * std::pow(1000.0, static_cast<double>(index) / (pcm.size() / 2));
+
+        phase += (2.0 * M_PI * frequency) / Plugin::SampleRate;
+        pcm[(2 * index) + 0] = static_cast<int16_t>(16000.0 * std::sin(phase));
+        pcm[(2 * index) + 1] = static_cast<int16_t>(12000.0 * std::sin(phase));
+    }
+
+    printf(_T("%u s of 44.1 kHz joint stereo, packets of %u bytes\n"), seconds, Plugin::PacketSize);
+    printf(_T("%8s %8s %10s %14s %14s %14s %8s %8s\n"), _T("bitpool"), _T("frame"), _T("kbit/s"), _T("packet fps"), _T("batch fps"), _T("decode fps"), _T("delay"), _T("SNR dB"));
+
+    for (const uint8_t bitpool : Bitpools) {
+        codec.Select(bitpool);
+
+        const uint16_t inFrameSize = codec.InFrameSize();
+        const uint16_t outFrameSize = codec.OutFrameSize();
+        const uint32_t frames = static_cast<uint32_t>((pcm.size() * sizeof(int16_t)) / inFrameSize);
+        const uint8_t* input = reinterpret_cast<const uint8_t*>(pcm.data());
+
+        // Encoded into packets, as they go out.
+        std::vector<uint8_t> packets;
+        std::vector<uint16_t> sizes;
+        uint8_t packet[Plugin::PacketSize];
+        uint32_t offset = 0;
+        uint32_t encoded = 0;
+
+        uint64_t start = Core::Time::Now().Ticks();
+        while (offset < (frames * inFrameSize)) {
+            uint16_t size = sizeof(packet);
+            const uint16_t consumed = codec.Encode(static_cast<uint16_t>(std::min((frames * inFrameSize) - offset, static_cast<uint32_t>(0xFFFF))), &input[offset], size, packet);
+
+            if (consumed == 0) {
+                break;
+            }
+
+            packets.insert(packets.end(), packet, packet + size);
+            sizes.push_back(size);
+            offset += consumed;
+            encoded += (consumed / inFrameSize);
+        }
+        const double packetRate = Plugin::FramesPerSecond(start, encoded);
+
+        // All frames in one go.
+        std::vector<uint8_t> batch(static_cast<size_t>(frames) * outFrameSize);
+        uint32_t batched = 0;
+
+        start = Core::Time::Now().Ticks();
+        while (batched < frames) {
+            const uint16_t count = static_cast<uint16_t>(std::min(frames - batched, static_cast<uint32_t>(0xFFFF / inFrameSize)));
+
+            if (codec.EncodeFrames(count, &input[batched * inFrameSize], &batch[batched * outFrameSize]) != count) {
+                break;
+            }
+
+            batched += count;
+        }
+        const double batchRate = Plugin::FramesPerSecond(start, batched);
+
+        // And back, packet by packet.
+        std::vector<int16_t> decoded(pcm.size());
+        uint8_t* output = reinterpret_cast<uint8_t*>(decoded.data());
+        uint32_t produced = 0;
+        uint32_t position = 0;
+
+        start = Core::Time::Now().Ticks();
+        for (const uint16_t size : sizes) {
+            uint16_t length = static_cast<uint16_t>(std::min(static_cast<uint32_t>((decoded.size() * sizeof(int16_t)) - produced), static_cast<uint32_t>(0xFFFF)));
+
+            codec.Decode(size, &packets[position], length, &output[produced]);
+
+            position += size;
+            produced += length;
+        }
+        const double decodeRate = Plugin::FramesPerSecond(start, produced / inFrameSize);
+
+        decoded.resize(produced / sizeof(int16_t));
+
+        uint32_t delay = 0;
+        const double snr = Plugin::RoundTrip(pcm, decoded, delay);
+
+        printf(_T("%8u %8u %10u %14.0f %14.0f %14.0f %8u %8.1f\n"), bitpool, outFrameSize, codec.BitRate() / 1000, packetRate, batchRate, decodeRate, delay / 2, snr);
+
+        if ((encoded != frames) || (batched != frames) || ((produced / inFrameSize) != frames)) {
+            printf(_T("  %u frames, %u encoded in packets, %u in a batch, %u decoded\n"), frames, encoded, batched, produced / inFrameSize);
+        }
+    }
+
+    Core::Singleton::Dispose();
+
+    return (0);
+}
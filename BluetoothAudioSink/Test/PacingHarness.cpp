@@ -0,0 +1,285 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2021 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Drives the audio player without a Bluetooth link:
+//  - the ring alone, filled and drained by two threads as fast as they can, checking every byte that comes out;
+//  - the player, fed through the shared buffer by a synthetic producer that delivers PCM in real time, with an
+//    occasional hiccup, and played into a sink that stands in for the transport channel. The sink measures how
+//    far every packet is off from its play time, and counts the packets that came too late for the device.
+//
+// Usage: BluetoothAudioSinkPacingHarness [seconds] [chunk size in bytes] [hiccup in ms, once a second]
+
+#include "../AudioPlayer.h"
+
+#include <thread>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // 16-bit stereo at 44.1 kHz, in SBC sized frames of 128 samples, five of them in a packet.
+    class Sink {
+    public:
+        static constexpr uint32_t SampleRate = 44100;
+        static constexpr uint8_t SampleChannels = 2;
+        static constexpr uint16_t FrameSize = 128 * SampleChannels * 2;
+        static constexpr uint16_t PacketSize = 5 * FrameSize;
+        static constexpr uint32_t DeviceBuffer = 10; // ms the device can play on without new packets
+
+    public:
+        Sink(const Sink&) = delete;
+        Sink& operator=(const Sink&) = delete;
+
+        Sink()
+            : _timestamp(0)
+            , _position(0)
+            , _start(0)
+            , _packets(0)
+            , _corrupted(0)
+            , _late(0)
+            , _restarts(0)
+            , _deviation(0)
+            , _maximum(0)
+        {
+        }
+        ~Sink() = default;
+
+    public:
+        bool IsOpen() const
+        {
+            return (true);
+        }
+        uint32_t Timestamp() const
+        {
+            return (_timestamp);
+        }
+        uint32_t ClockRate() const
+        {
+            return (SampleRate);
+        }
+        uint8_t Channels() const
+        {
+            return (SampleChannels);
+        }
+        uint8_t BytesPerSample() const
+        {
+            return (2);
+        }
+        uint16_t MinFrameSize() const
+        {
+            return (FrameSize);
+        }
+        uint16_t PreferredFrameSize() const
+        {
+            return (PacketSize);
+        }
+        void Reset()
+        {
+            if (_start != 0) {
+                _restarts++;
+            }
+            _timestamp = 0;
+            _start = 0;
+        }
+        uint32_t Transmit(const uint16_t length, const uint8_t data[])
+        {
+            const uint32_t consumed = ((std::min(length, static_cast<uint16_t>(PacketSize)) / FrameSize) * FrameSize);
+
+            if (consumed > 0) {
+                const uint64_t now = Core::Time::Now().Ticks();
+
+                if (_start == 0) {
+                    // The device starts playing once the first packet is in.
+                    _start = now;
+                } else {
+                    const uint64_t playTime = _start + ((static_cast<uint64_t>(_timestamp) * 1000 * Core::Time::TicksPerMillisecond) / SampleRate);
+                    const uint64_t offset = (now > playTime ? (now - playTime) : (playTime - now));
+
+                    _deviation += offset;
+                    _maximum = std::max(_maximum, offset);
+
+                    if (now > (playTime + (DeviceBuffer * Core::Time::TicksPerMillisecond))) {
+                        _late++;
+                    }
+                }
+
+                // Every frame carries the number of its first sample, so a mix up in the ring shows.
+                for (uint32_t offset = 0; offset < consumed; offset += FrameSize) {
+                    uint32_t sample;
+                    ::memcpy(&sample, &data[offset], sizeof(sample));
+
+                    if (sample != (_position + (offset / (SampleChannels * 2)))) {
+                        _corrupted++;
+                    }
+                }
+
+                _timestamp += (consumed / (SampleChannels * 2));
+                _position += (consumed / (SampleChannels * 2));
+                _packets++;
+            }
+
+            return (consumed);
+        }
+
+    public:
+        void Report() const
+        {
+            const double scale = 1000.0 / static_cast<double>(Core::Time::TicksPerMillisecond);
+
+            printf(_T("%-10s %8u packets %8u late %8u restarts %8u corrupted %10.1f us mean %10.1f us max deviation\n"), _T("player"),
+                _packets, _late, _restarts, _corrupted, (static_cast<double>(_deviation) * scale) / std::max(_packets, static_cast<uint32_t>(1)), static_cast<double>(_maximum) * scale);
+        }
+
+    private:
+        uint32_t _timestamp;
+        uint32_t _position; // samples played since the start, not reset on a restart
+        uint64_t _start; // ticks, when the device started playing
+        uint32_t _packets;
+        uint32_t _corrupted;
+        uint32_t _late;
+        uint32_t _restarts;
+        uint64_t _deviation;
+        uint64_t _maximum;
+    };
+
+    // Fills the ring in odd sized chunks and drains it in packets, checking the bytes that come out.
+    static void Ring(const uint32_t megabytes)
+    {
+        RingBuffer ring((3 * Sink::PacketSize), Sink::PacketSize);
+        const uint64_t total = static_cast<uint64_t>(megabytes) * 1024 * 1024;
+        bool valid = true;
+
+        const uint64_t start = Core::Time::Now().Ticks();
+
+        std::thread producer([&ring, total]() {
+            uint8_t chunk[1000];
+            uint64_t written = 0;
+
+            while (written < total) {
+                const uint32_t size = static_cast<uint32_t>(std::min(static_cast<uint64_t>(sizeof(chunk)), total - written));
+
+                for (uint32_t index = 0; index < size; index++) {
+                    chunk[index] = static_cast<uint8_t>((written + index) % 251);
+                }
+
+                uint32_t offset = 0;
+                while (offset < size) {
+                    offset += ring.Write(size - offset, &chunk[offset]);
+                }
+
+                written += size;
+            }
+        });
+
+        uint64_t read = 0;
+        while (read < total) {
+            const uint32_t available = std::min(ring.Available(), static_cast<uint32_t>(Sink::PacketSize));
+            const uint8_t* data = ring.Peek();
+
+            for (uint32_t index = 0; index < available; index++) {
+                valid = valid && (data[index] == static_cast<uint8_t>((read + index) % 251));
+            }
+
+            ring.Consume(available);
+            read += available;
+        }
+
+        producer.join();
+
+        const double seconds = static_cast<double>(Core::Time::Now().Ticks() - start) / (static_cast<double>(Core::Time::TicksPerMillisecond) * 1000.0);
+
+        printf(_T("%-10s %8.1f MB/s, %s\n"), _T("ring"), (static_cast<double>(total) / (1024.0 * 1024.0)) / seconds, (valid == true ? _T("all data intact") : _T("DATA CORRUPTED")));
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t seconds = (argc > 1 ? ::atoi(argv[1]) : 10);
+    const uint32_t chunkSize = std::max(static_cast<uint32_t>(argc > 2 ? ::atoi(argv[2]) : 4096), static_cast<uint32_t>(Plugin::Sink::FrameSize));
+    const uint32_t hiccup = (argc > 3 ? ::atoi(argv[3]) : 0);
+    const string connector(_T("/tmp/BluetoothAudioSinkPacingHarness.") + Core::NumberType<uint32_t>(::getpid()).Text());
+
+    Plugin::Ring(256);
+
+    Core::SharedBuffer buffer(connector.c_str(), (Core::File::USER_READ | Core::File::USER_WRITE | Core::File::SHAREABLE), chunkSize, 0);
+    Plugin::Sink sink;
+    Plugin::AudioPlayerType<Plugin::Sink> player(sink, connector);
+
+    if ((buffer.IsValid() == false) || (player.IsValid() == false)) {
+        printf(_T("Could not set up the shared buffer %s\n"), connector.c_str());
+        return (1);
+    }
+
+    printf(_T("%u s of %u Hz stereo in chunks of %u bytes, %u ms hiccup every second\n"), seconds, Plugin::Sink::SampleRate, chunkSize, hiccup);
+
+    player.Play();
+
+    // The producer delivers in real time, every frame marked with the number of its first sample.
+    const uint32_t bytesPerSecond = (Plugin::Sink::SampleRate * Plugin::Sink::SampleChannels * 2);
+    const uint64_t start = Core::Time::Now().Ticks();
+    uint64_t produced = 0;
+    uint32_t second = 0;
+
+    while (produced < (static_cast<uint64_t>(bytesPerSecond) * seconds)) {
+        const uint64_t due = start + ((produced * 1000 * Core::Time::TicksPerMillisecond) / bytesPerSecond);
+        const uint64_t now = Core::Time::Now().Ticks();
+
+        if (due > now) {
+            ::usleep(static_cast<useconds_t>(((due - now) * 1000) / Core::Time::TicksPerMillisecond));
+        }
+
+        if ((hiccup != 0) && ((produced / bytesPerSecond) != second)) {
+            second = static_cast<uint32_t>(produced / bytesPerSecond);
+            ::usleep(hiccup * 1000);
+        }
+
+        if (buffer.RequestProduce(1000) == Core::ERROR_NONE) {
+            const uint32_t size = ((chunkSize / Plugin::Sink::FrameSize) * Plugin::Sink::FrameSize);
+            uint8_t* data = buffer.Buffer();
+
+            ::memset(data, 0, size);
+
+            for (uint32_t offset = 0; offset < size; offset += Plugin::Sink::FrameSize) {
+                const uint32_t sample = static_cast<uint32_t>((produced + offset) / (Plugin::Sink::SampleChannels * 2));
+                ::memcpy(&data[offset], &sample, sizeof(sample));
+            }
+
+            buffer.BytesWritten(size);
+            buffer.Produced();
+
+            produced += size;
+        } else {
+            printf(_T("The player did not take a chunk for a second\n"));
+            break;
+        }
+    }
+
+    player.Stop();
+
+    sink.Report();
+    printf(_T("%-10s %8u underruns %10u us maximum wake up delay\n"), _T("reported"), player.Underruns(), player.Jitter());
+
+    Core::File(connector).Destroy();
+    Core::Singleton::Dispose();
+
+    return (0);
+}
@@ -31,6 +31,15 @@ ENUM_CONVERSION_BEGIN(Plugin::Commander::state)
 
     ENUM_CONVERSION_END(Plugin::Commander::state);
 
+ENUM_CONVERSION_BEGIN(Plugin::Commander::progress)
+
+    { Plugin::Commander::progress::WAITING, _TXT("waiting") },
+    { Plugin::Commander::progress::EXECUTING, _TXT("executing") },
+    { Plugin::Commander::progress::COMPLETED, _TXT("completed") },
+    { Plugin::Commander::progress::SKIPPED, _TXT("skipped") },
+
+    ENUM_CONVERSION_END(Plugin::Commander::progress);
+
 namespace Plugin {
 
     SERVICE_REGISTRATION(Commander, 1, 0);
@@ -77,7 +86,8 @@ namespace Plugin {
                 Core::ProxyType<Sequencer>::Create(
                     index.Current().Value(),
                     &_commandAdministrator,
-                    _service)));
+                    _service,
+                    config.Concurrency.Value())));
         }
 
         // On succes return "".
@@ -97,6 +107,7 @@ namespace Plugin {
 
             index->second->Abort();
             Core::IWorkerPool::Instance().Revoke(job);
+            index->second->Revoke(Core::infinite);
 
             index++;
         }
@@ -208,7 +219,7 @@ namespace Plugin {
                 if (sequencer->Abort() != Core::ERROR_NONE) {
                     response->ErrorCode = Web::STATUS_NO_CONTENT;
                     response->Message = _T("Sequencer was not in a running state");
-                } else if (Core::IWorkerPool::Instance().Revoke(job, 2000) == Core::ERROR_NONE) {
+                } else if ((Core::IWorkerPool::Instance().Revoke(job, 2000) == Core::ERROR_NONE) && (sequencer->Revoke(2000) == Core::ERROR_NONE)) {
                     response->ErrorCode = Web::STATUS_OK;
                     response->Message = _T("Sequencer available for next sequence");
                 } else {
@@ -230,8 +241,10 @@ namespace Plugin {
                 if (sequencer->IsActive() == true) {
                     response->ErrorCode = Web::STATUS_TEMPORARY_REDIRECT;
                     response->Message = _T("Sequencer already running");
+                } else if (sequencer->Load(*(request.Body<Web::JSONBodyType<Core::JSON::ArrayType<Commander::Command>>>())) == 0) {
+                    response->ErrorCode = Web::STATUS_BAD_REQUEST;
+                    response->Message = _T("No valid commands, unknown or ambiguous dependencies or a dependency cycle");
                 } else {
-                    sequencer->Load(*(request.Body<Web::JSONBodyType<Core::JSON::ArrayType<Commander::Command>>>()));
                     sequencer->Execute();
 
                     Core::IWorkerPool::Instance().Submit(job);
@@ -260,6 +273,9 @@ namespace Plugin {
             data.Index = sequencer.Index();
         }
 
+        data.Elapsed = sequencer.Elapsed();
+        sequencer.Steps(data.Steps);
+
         return (data);
     }
 
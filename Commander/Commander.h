@@ -34,6 +34,12 @@ namespace Plugin {
             RUNNING,
             ABORTING
         };
+        enum progress {
+            WAITING,
+            EXECUTING,
+            COMPLETED,
+            SKIPPED
+        };
         class Command : public Core::JSON::Container {
         public:
             Command()
@@ -41,20 +47,24 @@ namespace Plugin {
                 , Item()
                 , Label()
                 , Parameters(false)
+                , Dependencies()
             {
                 Add(_T("command"), &Item);
                 Add(_T("label"), &Label);
                 Add(_T("parameters"), &Parameters);
+                Add(_T("dependencies"), &Dependencies);
             }
             Command(const Command& copy)
                 : Core::JSON::Container()
                 , Item(copy.Item)
                 , Label(copy.Label)
                 , Parameters(copy.Parameters)
+                , Dependencies(copy.Dependencies)
             {
                 Add(_T("command"), &Item);
                 Add(_T("label"), &Label);
                 Add(_T("parameters"), &Parameters);
+                Add(_T("dependencies"), &Dependencies);
             }
             ~Command()
             {
@@ -65,6 +75,7 @@ namespace Plugin {
                 Item = RHS.Item;
                 Label = RHS.Label;
                 Parameters = RHS.Parameters;
+                Dependencies = RHS.Dependencies;
 
                 return (*this);
             }
@@ -73,6 +84,67 @@ namespace Plugin {
             Core::JSON::String Item;
             Core::JSON::String Label;
             Core::JSON::String Parameters;
+            // Labels of the steps that have to be completed before this one can start. As soon as one step in a
+            // sequence has dependencies, the sequence is run as a graph instead of one step after the other.
+            Core::JSON::ArrayType<Core::JSON::String> Dependencies;
+        };
+
+        class Step : public Core::JSON::Container {
+        public:
+            Step()
+                : Core::JSON::Container()
+            {
+                Add(_T("index"), &Index);
+                Add(_T("label"), &Label);
+                Add(_T("command"), &Command);
+                Add(_T("state"), &State);
+                Add(_T("start"), &Start);
+                Add(_T("duration"), &Duration);
+                Add(_T("result"), &Result);
+            }
+            Step(const Step& copy)
+                : Core::JSON::Container()
+                , Index(copy.Index)
+                , Label(copy.Label)
+                , Command(copy.Command)
+                , State(copy.State)
+                , Start(copy.Start)
+                , Duration(copy.Duration)
+                , Result(copy.Result)
+            {
+                Add(_T("index"), &Index);
+                Add(_T("label"), &Label);
+                Add(_T("command"), &Command);
+                Add(_T("state"), &State);
+                Add(_T("start"), &Start);
+                Add(_T("duration"), &Duration);
+                Add(_T("result"), &Result);
+            }
+            ~Step()
+            {
+            }
+
+            Step& operator=(const Step& RHS)
+            {
+                Index = RHS.Index;
+                Label = RHS.Label;
+                Command = RHS.Command;
+                State = RHS.State;
+                Start = RHS.Start;
+                Duration = RHS.Duration;
+                Result = RHS.Result;
+
+                return (*this);
+            }
+
+        public:
+            Core::JSON::DecUInt32 Index;
+            Core::JSON::String Label;
+            Core::JSON::String Command;
+            Core::JSON::EnumType<progress> State;
+            Core::JSON::DecUInt32 Start; // Milliseconds after the start of the sequence
+            Core::JSON::DecUInt32 Duration; // Milliseconds
+            Core::JSON::String Result;
         };
 
         class Data : public Core::JSON::Container {
@@ -85,6 +157,8 @@ namespace Plugin {
                 Add(_T("index"), &Index);
                 Add(_T("label"), &Label);
                 Add(_T("command"), &Command);
+                Add(_T("elapsed"), &Elapsed);
+                Add(_T("steps"), &Steps);
             }
             Data(const string& name, const state actualState, const uint32_t index, const string& label)
                 : Core::JSON::Container()
@@ -94,6 +168,8 @@ namespace Plugin {
                 Add(_T("index"), &Index);
                 Add(_T("label"), &Label);
                 Add(_T("command"), &Command);
+                Add(_T("elapsed"), &Elapsed);
+                Add(_T("steps"), &Steps);
 
                 Sequencer = name;
                 State = actualState;
@@ -107,12 +183,16 @@ namespace Plugin {
                 , Index(copy.Index)
                 , Label(copy.Label)
                 , Command(copy.Command)
+                , Elapsed(copy.Elapsed)
+                , Steps(copy.Steps)
             {
                 Add(_T("sequencer"), &Sequencer);
                 Add(_T("state"), &State);
                 Add(_T("index"), &Index);
                 Add(_T("label"), &Label);
-                Add(_T("Command"), &Command);
+                Add(_T("command"), &Command);
+                Add(_T("elapsed"), &Elapsed);
+                Add(_T("steps"), &Steps);
             }
             ~Data()
             {
@@ -125,6 +205,8 @@ namespace Plugin {
                 Index = RHS.Index;
                 Label = RHS.Label;
                 Command = RHS.Command;
+                Elapsed = RHS.Elapsed;
+                Steps = RHS.Steps;
 
                 return (*this);
             }
@@ -135,6 +217,8 @@ namespace Plugin {
             Core::JSON::DecUInt32 Index;
             Core::JSON::String Label;
             Core::JSON::String Command;
+            Core::JSON::DecUInt32 Elapsed; // Milliseconds since the start of the (last) sequence
+            Core::JSON::ArrayType<Step> Steps;
         };
 
     private:
@@ -146,8 +230,11 @@ namespace Plugin {
         public:
             Config()
                 : Core::JSON::Container()
+                , Sequencers()
+                , Concurrency(4)
             {
                 Add(_T("sequencers"), &Sequencers);
+                Add(_T("concurrency"), &Concurrency);
             }
             ~Config()
             {
@@ -155,6 +242,7 @@ namespace Plugin {
 
         public:
             Core::JSON::ArrayType<Core::JSON::String> Sequencers;
+            Core::JSON::DecUInt8 Concurrency; // Steps of one sequence that may be executed at the same time
         };
         class Administrator {
         private:
@@ -243,8 +331,68 @@ namespace Plugin {
             Sequencer(const Sequencer& copy) = delete;
             Sequencer& operator=(const Sequencer&) = delete;
 
+            // Bookkeeping of a step, kept after the sequence completed so its timing can still be reported.
+            struct Entry {
+                Entry(const string& command, const string& label)
+                    : Command(command)
+                    , Label(label)
+                    , Dependents()
+                    , Pending(0)
+                    , State(Commander::WAITING)
+                    , Start(0)
+                    , Stop(0)
+                    , Result()
+                {
+                }
+
+                string Command;
+                string Label;
+                std::vector<uint32_t> Dependents;
+                uint32_t Pending; // Dependencies that did not complete yet
+                progress State;
+                uint64_t Start;
+                uint64_t Stop;
+                string Result;
+            };
+
+            // Executes the steps of a graph that are ready, one of these per step that may run concurrently.
+            class Runner : public Core::IDispatch {
+            private:
+                Runner() = delete;
+                Runner(const Runner&) = delete;
+                Runner& operator=(const Runner&) = delete;
+
+            public:
+                Runner(Sequencer* parent)
+                    : _parent(*parent)
+                    , _busy(false)
+                {
+                }
+                ~Runner()
+                {
+                }
+
+            public:
+                inline bool IsBusy() const
+                {
+                    return (_busy);
+                }
+                inline void Busy(const bool busy)
+                {
+                    _busy = busy;
+                }
+                void Dispatch() override
+                {
+                    _parent.Run(*this);
+                }
+
+            private:
+                Sequencer& _parent;
+                bool _busy; // Guarded by the lock of the sequencer
+            };
+
         public:
-            Sequencer(const string& name, Administrator* commandFactory, PluginHost::IShell* service)
+            Sequencer(const string& name, Administrator* commandFactory, PluginHost::IShell* service, const uint8_t concurrency)
                 : _commandFactory(commandFactory)
                 , _adminLock()
                 , _currentIndex(0)
@@ -252,12 +400,24 @@ namespace Plugin {
                 , _name(name)
                 , _service(service)
                 , _sequenceList(5)
+                , _entries()
+                , _ready()
+                , _runners()
+                , _active(0)
+                , _executing(0)
+                , _graph(false)
+                , _started(0)
+                , _stopped(0)
             {
                 ASSERT(service != nullptr);
 
                 if (_service != nullptr) {
                     _service->AddRef();
                 }
+
+                for (uint8_t index = 0; index < std::max(concurrency, static_cast<uint8_t>(1)); index++) {
+                    _runners.push_back(Core::ProxyType<Runner>::Create(this));
+                }
             }
             ~Sequencer()
             {
@@ -291,7 +451,7 @@ namespace Plugin {
 
                 if ((_state != Commander::IDLE) && (_state != Commander::LOADED)) {
 
-                    result = _currentIndex;
+                    result = Current();
                 }
 
                 _adminLock.Unlock();
@@ -305,15 +465,59 @@ namespace Plugin {
 
                 _adminLock.Lock();
 
-                if ((_state != Commander::IDLE) && (_state != Commander::LOADED) && (_currentIndex < _sequenceList.Count())) {
+                if ((_state != Commander::IDLE) && (_state != Commander::LOADED) && (Current() < _entries.size())) {
 
-                    result = _sequenceList[_currentIndex]->Label();
+                    result = _entries[Current()].Label;
                 }
 
                 _adminLock.Unlock();
 
                 return (result);
             }
+            // Time since the start of the sequence, or the time it took if it is no longer running, in milliseconds.
+            uint32_t Elapsed() const
+            {
+                uint32_t result = 0;
+
+                _adminLock.Lock();
+
+                if (_started != 0) {
+                    const uint64_t end = ((_stopped != 0) ? _stopped : Core::Time::Now().Ticks());
+                    result = static_cast<uint32_t>((end - _started) / Core::Time::TicksPerMillisecond);
+                }
+
+                _adminLock.Unlock();
+
+                return (result);
+            }
+            void Steps(Core::JSON::ArrayType<Commander::Step>& steps) const
+            {
+                _adminLock.Lock();
+
+                for (uint32_t index = 0; index < _entries.size(); index++) {
+                    const Entry& entry(_entries[index]);
+                    Commander::Step step;
+
+                    step.Index = index;
+                    step.Label = entry.Label;
+                    step.Command = entry.Command;
+                    step.State = entry.State;
+
+                    if (entry.Start != 0) {
+                        const uint64_t end = ((entry.Stop != 0) ? entry.Stop : Core::Time::Now().Ticks());
+
+                        step.Start = static_cast<uint32_t>((entry.Start - _started) / Core::Time::TicksPerMillisecond);
+                        step.Duration = static_cast<uint32_t>((end - entry.Start) / Core::Time::TicksPerMillisecond);
+                    }
+                    if (entry.State == Commander::COMPLETED) {
+                        step.Result = entry.Result;
+                    }
+
+                    steps.Add(step);
+                }
+
+                _adminLock.Unlock();
+            }
             uint32_t Load(const Core::JSON::ArrayType<Command>& commandList)
             {
 
@@ -330,6 +534,15 @@ namespace Plugin {
                         _sequenceList.Clear(0, _sequenceList.Count());
                     }
 
+                    _entries.clear();
+                    _graph = false;
+                    _started = 0;
+                    _stopped = 0;
+
+                    // Dependencies are given by label, only resolve them once all steps are known.
+                    std::list<std::pair<uint32_t, string>> dependencies;
+                    std::map<string, uint32_t> labels;
+
                     Core::JSON::ArrayType<Command>::ConstIterator index(commandList.Elements());
 
                     while (index.Next() == true) {
@@ -341,13 +554,41 @@ namespace Plugin {
                         Core::ProxyType<Exchange::ICommand> newCommand(_commandFactory->Create(label, className, parameters));
 
                         if (newCommand.IsValid() == true) {
+                            const uint32_t step = static_cast<uint32_t>(_entries.size());
+
                             _sequenceList.Add(newCommand);
+                            _entries.emplace_back(className, label);
+
+                            if (label.empty() == false) {
+                                // A label that is used more than once can not be depended on.
+                                std::pair<std::map<string, uint32_t>::iterator, bool> result(labels.insert(std::pair<string, uint32_t>(label, step)));
+                                if (result.second == false) {
+                                    result.first->second = static_cast<uint32_t>(~0);
+                                }
+                            }
+
+                            if (index.Current().Dependencies.IsSet() == true) {
+                                Core::JSON::ArrayType<Core::JSON::String>::ConstIterator loop(index.Current().Dependencies.Elements());
+
+                                _graph = true;
+
+                                while (loop.Next() == true) {
+                                    dependencies.emplace_back(step, loop.Current().Value());
+                                }
+                            }
                         }
                     }
 
+                    if ((_graph == true) && (Resolve(dependencies, labels) == false)) {
+                        _sequenceList.Clear(0, _sequenceList.Count());
+                        _entries.clear();
+                    }
+
                     if (_sequenceList.Count() > 0) {
                         _state = Commander::LOADED;
                         _currentIndex = 0;
+                    } else {
+                        _state = Commander::IDLE;
                     }
                 }
 
@@ -380,7 +621,16 @@ namespace Plugin {
                 if (_state == Commander::RUNNING) {
                     result = Core::ERROR_NONE;
                     _state = Commander::ABORTING;
-                    _sequenceList[_currentIndex]->Abort();
+
+                    if (_graph == false) {
+                        _sequenceList[_currentIndex]->Abort();
+                    } else {
+                        for (uint32_t index = 0; index < _entries.size(); index++) {
+                            if (_entries[index].State == Commander::EXECUTING) {
+                                _sequenceList[index]->Abort();
+                            }
+                        }
+                    }
                 }
 
                 _adminLock.Unlock();
@@ -388,16 +638,72 @@ namespace Plugin {
                 // Wait for the sequencer to reaach a safe positon..
                 return (result);
             }
+            // Waits for the steps of a graph that are still executing, call after Abort. Runners that were still
+            // queued are taken out of the queue and never run, so they are accounted for here.
+            uint32_t Revoke(const uint32_t waitTime)
+            {
+                uint32_t result = Core::ERROR_NONE;
+
+                for (Core::ProxyType<Runner>& runner : _runners) {
+                    if (Core::IWorkerPool::Instance().Revoke(Core::ProxyType<Core::IDispatch>(runner), waitTime) == Core::ERROR_TIMEDOUT) {
+                        result = Core::ERROR_TIMEDOUT;
+                    } else {
+                        _adminLock.Lock();
+
+                        // A runner that did run, cleared this itself.
+                        if (runner->IsBusy() == true) {
+                            runner->Busy(false);
+                            _active--;
+                        }
+
+                        _adminLock.Unlock();
+                    }
+                }
+
+                _adminLock.Lock();
+
+                // Nothing is left that could finish the sequence, also not if the sequence itself never got to run.
+                if ((result == Core::ERROR_NONE) && (_active == 0) && (_state == Commander::ABORTING)) {
+                    Completed();
+                }
+
+                _adminLock.Unlock();
+
+                return (result);
+            }
 
         private:
             virtual void Dispatch()
             {
                 _adminLock.Lock();
 
+                _started = Core::Time::Now().Ticks();
+
+                if (_graph == true) {
+
+                    // Start with all steps that do not depend on anything, the runners take it from there.
+                    for (uint32_t index = 0; index < _entries.size(); index++) {
+                        if (_entries[index].Pending == 0) {
+                            _ready.push_back(index);
+                        }
+                    }
+
+                    Activate();
+
+                    _adminLock.Unlock();
+
+                    return;
+                }
+
                 // See if we still need to take some "next steps"
                 while ((_currentIndex < _sequenceList.Count()) && (_state == Commander::RUNNING)) {
 
                     Core::ProxyType<Exchange::ICommand> step(_sequenceList[_currentIndex]);
+                    Entry& entry(_entries[_currentIndex]);
+
+                    entry.State = Commander::EXECUTING;
+                    entry.Start = Core::Time::Now().Ticks();
+                    entry.Stop = 0;
 
                     _adminLock.Unlock();
 
@@ -405,6 +711,10 @@ namespace Plugin {
 
                     _adminLock.Lock();
 
+                    entry.State = Commander::COMPLETED;
+                    entry.Stop = Core::Time::Now().Ticks();
+                    entry.Result = result;
+
                     if (result.empty() == true) {
                         _currentIndex++;
                     } else {
@@ -437,12 +747,151 @@ namespace Plugin {
                     }
                 }
 
+                Completed();
+
+                _adminLock.Unlock();
+            }
+            void Run(Runner& runner)
+            {
+                _adminLock.Lock();
+
+                while ((_state == Commander::RUNNING) && (_ready.empty() == false)) {
+
+                    const uint32_t index = _ready.front();
+                    Core::ProxyType<Exchange::ICommand> step(_sequenceList[index]);
+                    Entry& entry(_entries[index]);
+
+                    _ready.pop_front();
+                    _executing++;
+
+                    entry.State = Commander::EXECUTING;
+                    entry.Start = Core::Time::Now().Ticks();
+
+                    // Whatever is left in the ready list is for the other runners.
+                    Activate();
+
+                    _adminLock.Unlock();
+
+                    const string result = step->Execute(_service);
+
+                    _adminLock.Lock();
+
+                    _executing--;
+
+                    entry.State = Commander::COMPLETED;
+                    entry.Stop = Core::Time::Now().Ticks();
+                    entry.Result = result;
+
+                    for (const uint32_t dependent : entry.Dependents) {
+                        ASSERT(_entries[dependent].Pending > 0);
+
+                        if (--(_entries[dependent].Pending) == 0) {
+                            _ready.push_back(dependent);
+                        }
+                    }
+                }
+
+                runner.Busy(false);
+                _active--;
+
+                if (_active == 0) {
+                    // Nothing is running and nothing can start anymore, the sequence is done.
+                    Completed();
+                }
+
+                _adminLock.Unlock();
+            }
+            // Makes sure there is a runner for every step that is executing or ready, as far as the concurrency allows.
+            void Activate()
+            {
+                const uint32_t needed = std::min(static_cast<uint32_t>(_executing + _ready.size()), static_cast<uint32_t>(_runners.size()));
+                std::vector<Core::ProxyType<Runner>>::iterator index(_runners.begin());
+
+                while ((_active < needed) && (index != _runners.end())) {
+                    if ((*index)->IsBusy() == false) {
+                        (*index)->Busy(true);
+                        _active++;
+                        Core::IWorkerPool::Instance().Submit(Core::ProxyType<Core::IDispatch>(*index));
+                    }
+                    index++;
+                }
+            }
+            void Completed()
+            {
                 ASSERT((_state == Commander::RUNNING) || (_state == Commander::ABORTING));
                 _state = IDLE;
 
+                _stopped = Core::Time::Now().Ticks();
+
+                for (Entry& entry : _entries) {
+                    if (entry.State != Commander::COMPLETED) {
+                        entry.State = Commander::SKIPPED;
+                    }
+                }
+
+                _ready.clear();
                 _sequenceList.Clear(0, _sequenceList.Count());
+            }
+            bool Resolve(const std::list<std::pair<uint32_t, string>>& dependencies, const std::map<string, uint32_t>& labels)
+            {
+                bool result = true;
+                std::list<std::pair<uint32_t, string>>::const_iterator index(dependencies.begin());
 
-                _adminLock.Unlock();
+                while ((result == true) && (index != dependencies.end())) {
+                    std::map<string, uint32_t>::const_iterator label(labels.find(index->second));
+
+                    if ((label == labels.end()) || (label->second >= _entries.size())) {
+                        result = false;
+                    } else {
+                        _entries[label->second].Dependents.push_back(index->first);
+                        _entries[index->first].Pending++;
+                        index++;
+                    }
+                }
+
+                if (result == true) {
+                    // Walk the graph like it will be executed, if not every step is reached there is a cycle.
+                    std::vector<uint32_t> pending;
+                    std::list<uint32_t> ready;
+                    uint32_t reached = 0;
+
+                    for (uint32_t step = 0; step < _entries.size(); step++) {
+                        pending.push_back(_entries[step].Pending);
+                        if (_entries[step].Pending == 0) {
+                            ready.push_back(step);
+                        }
+                    }
+
+                    while (ready.empty() == false) {
+                        const uint32_t step = ready.front();
+                        ready.pop_front();
+                        reached++;
+
+                        for (const uint32_t dependent : _entries[step].Dependents) {
+                            if (--pending[dependent] == 0) {
+                                ready.push_back(dependent);
+                            }
+                        }
+                    }
+
+                    result = (reached == _entries.size());
+                }
+
+                return (result);
+            }
+            inline uint32_t Current() const
+            {
+                uint32_t result = _currentIndex;
+
+                if (_graph == true) {
+                    // Several steps may be executing, report the first one.
+                    result = 0;
+                    while ((result < _entries.size()) && (_entries[result].State != Commander::EXECUTING)) {
+                        result++;
+                    }
+                }
+
+                return (result);
             }
 
         private:
@@ -453,6 +902,14 @@ namespace Plugin {
             string _name;
             PluginHost::IShell* _service;
             Core::ProxyList<Exchange::ICommand> _sequenceList;
+            std::vector<Entry> _entries;
+            std::list<uint32_t> _ready;
+            std::vector<Core::ProxyType<Runner>> _runners;
+            uint32_t _active; // Runners that are submitted or running
+            uint32_t _executing;
+            bool _graph;
+            uint64_t _started;
+            uint64_t _stopped;
         };
 
         Commander(const Commander&) = delete;
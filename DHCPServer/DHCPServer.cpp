@@ -34,6 +34,9 @@ namespace Plugin {
     DHCPServer::DHCPServer()
         : _skipURL(0)
         , _servers()
+        , _stores()
+        , _persistentPath()
+        , _job(*this)
     {
         RegisterAll();
     }
@@ -97,6 +100,9 @@ namespace Plugin {
             index++;
         }
 
+        _job.Revoke();
+
+        _stores.clear();
         _servers.clear();
     }
 
@@ -186,29 +192,28 @@ namespace Plugin {
         return result;
     }
 
-    void DHCPServer::SaveLeases(const string& interface, const DHCPServerImplementation& dhcpServer) const
+    void DHCPServer::SaveLease(const string& interface, const DHCPServerImplementation::Lease& lease, const DHCPServerImplementation& dhcpServer)
     {
+        std::map<const string, LeaseStore>::iterator store(_stores.find(interface));
 
-        if (_persistentPath.empty() == false) {
-            Core::JSON::ArrayType<Data::Server::Lease> leasesList;
-
-            // Saving to file might take a while, and lifetime of DHCPServerImplementation::Iterator
-            // object must be deterministic and short (<10ms), so we scope it 
-            {
-                DHCPServerImplementation::Iterator leases = dhcpServer.Leases();
-                while(leases.Next() && (leases.IsValid() == true)) {
-                    leasesList.Add().Set(leases.Current());
-                }        
-            }
+        // Called with the leases locked, so the compaction, which walks them, is left to the job.
+        if ((store != _stores.end()) && (store->second.Append(lease, dhcpServer.Count()) == true)) {
+            _job.Submit();
+        }
+    }
 
-            Core::File leasesFile(_persistentPath + interface + ".json");
+    void DHCPServer::Dispatch()
+    {
+        std::map<const string, LeaseStore>::iterator store(_stores.begin());
 
-            if (leasesFile.Create() == true) {
-                leasesList.IElement::ToFile(leasesFile);
-                leasesFile.Close();
-            } else {
-                TRACE(Trace::Error, (_T("Could not save leases in permanent storage area.\n")));
+        while (store != _stores.end()) {
+            std::map<const string, DHCPServerImplementation>::const_iterator server(_servers.find(store->first));
+
+            if ((server != _servers.end()) && (store->second.IsDue(server->second.Count()) == true)) {
+                store->second.Compact(server->second);
             }
+
+            store++;
         }
     }
 
@@ -216,9 +221,13 @@ namespace Plugin {
     {
 
         if (_persistentPath.empty() == false) {
+            const string storeName(_persistentPath + interface + _T(".leases"));
             Core::File leasesFile(_persistentPath + interface + ".json");
 
-            if (leasesFile.Open(true) == true) {
+            uint32_t records = LeaseStore::Load(storeName, dhcpServer);
+
+            if ((records == 0) && (leasesFile.Open(true) == true)) {
+                // Leases saved before there was a lease store, take them over once.
                 Core::JSON::ArrayType<Data::Server::Lease> leases;
 
                 Core::OptionalType<Core::JSON::Error> error;
@@ -231,8 +240,20 @@ namespace Plugin {
                 auto iterator = leases.Elements();
                 while ((iterator.Next() == true) && (iterator.IsValid() == true)) {
                     dhcpServer.AddLease(iterator.Current().Get());
+                    records++;
                 }
             } 
+
+            // Start the log from a compacted copy of what was loaded.
+            if (_stores[interface].Open(storeName, dhcpServer) == true) {
+                if (leasesFile.Exists() == true) {
+                    leasesFile.Destroy();
+                }
+            } else {
+                TRACE(Trace::Error, (_T("Could not open the lease store %s"), storeName.c_str()));
+            }
+
+            TRACE(Trace::Information, (_T("Loaded %d lease records for interface %s"), records, interface.c_str()));
         }
     }
 
@@ -242,7 +263,7 @@ namespace Plugin {
 
         auto dhcpServer = _servers.find(interface);
         if (dhcpServer != _servers.end()) {
-            SaveLeases(interface, dhcpServer->second);
+            SaveLease(interface, *lease, dhcpServer->second);
         }
     }
 
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "DHCPServerImplementation.h"
+#include "LeaseStore.h"
 #include <interfaces/json/JsonData_DHCPServer.h>
 #include "Module.h"
 
@@ -280,15 +281,22 @@ namespace Plugin {
 
         // Lease permanent storage
         // -------------------------------------------------------------------------------------------------------
-        void SaveLeases(const string& interface, const DHCPServerImplementation& dhcpServer) const;
+        void SaveLease(const string& interface, const DHCPServerImplementation::Lease& lease, const DHCPServerImplementation& dhcpServer);
         void LoadLeases(const string& interface, DHCPServerImplementation& dhcpServer);
 
         // Callbacks
         void OnNewIPRequest(const string& interface, const DHCPServerImplementation::Lease* lease);
+
+        // Compacts the lease stores that grew too large, off the thread that grants the leases.
+        friend class Core::ThreadPool::JobType<DHCPServer&>;
+        void Dispatch();
+
     private:
         uint16_t _skipURL;
         std::map<const string, DHCPServerImplementation> _servers;
+        std::map<const string, LeaseStore> _stores;
         std::string _persistentPath;
+        Core::WorkerPool::JobType<DHCPServer&> _job;
     };
 
 } // namespace Plugin
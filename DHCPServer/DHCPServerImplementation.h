@@ -22,6 +22,10 @@
 
 #include "Module.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 namespace WPEFramework {
 
 namespace Plugin {
@@ -259,6 +263,23 @@ namespace Plugin {
                 Core::ToHexString(Id(), _length, text);
                 return (text);
             }
+        public:
+            // FNV-1a over the identifier bytes, to index the leases on.
+            class Hash {
+            public:
+                size_t operator()(const Identifier& id) const
+                {
+                    uint32_t result = 2166136261;
+                    const uint8_t* data = id.Id();
+
+                    for (uint8_t index = 0; index < id.Length(); index++) {
+                        result = (result ^ data[index]) * 16777619;
+                    }
+
+                    return (result);
+                }
+            };
+
         public:
             static constexpr uint16_t maxLength = 16;
         private:
@@ -440,14 +461,116 @@ namespace Plugin {
             uint32_t _preferred;
             classifications _classification;
         };
+        // Addresses of the pool that were never leased, one bit per address. The summary holds a bit per word
+        // that still has a free address in it, so the first free address is found with two bit scans.
+        class AddressMap {
+        private:
+            AddressMap(const AddressMap&) = delete;
+            AddressMap& operator=(const AddressMap&) = delete;
+
+        public:
+            AddressMap()
+                : _base(0)
+                , _size(0)
+                , _words()
+                , _summary()
+            {
+            }
+            ~AddressMap()
+            {
+            }
+
+        public:
+            inline bool Contains(const uint32_t address) const
+            {
+                return ((address >= _base) && ((address - _base) < _size));
+            }
+            void Reset(const uint32_t base, const uint32_t size)
+            {
+                _base = base;
+                _size = size;
+                _words.assign((size + 63) / 64, ~static_cast<uint64_t>(0));
+                _summary.assign((_words.size() + 63) / 64, ~static_cast<uint64_t>(0));
+
+                // The bits beyond the end of the pool are never free.
+                if ((size % 64) != 0) {
+                    _words.back() = (static_cast<uint64_t>(1) << (size % 64)) - 1;
+                }
+                if ((_words.size() % 64) != 0) {
+                    _summary.back() = (static_cast<uint64_t>(1) << (_words.size() % 64)) - 1;
+                }
+            }
+            void Take(const uint32_t address)
+            {
+                if (Contains(address) == true) {
+                    const uint32_t offset = address - _base;
+                    uint64_t& word(_words[offset / 64]);
+
+                    word &= ~(static_cast<uint64_t>(1) << (offset % 64));
+
+                    if (word == 0) {
+                        _summary[offset / 4096] &= ~(static_cast<uint64_t>(1) << ((offset / 64) % 64));
+                    }
+                }
+            }
+            // The lowest free address, 0 if all have been taken.
+            uint32_t First() const
+            {
+                uint32_t result = 0;
+                uint32_t index = 0;
+
+                while ((index < _summary.size()) && (_summary[index] == 0)) {
+                    index++;
+                }
+
+                if (index < _summary.size()) {
+                    const uint32_t word = (index * 64) + FirstSet(_summary[index]);
+
+                    ASSERT(_words[word] != 0);
+
+                    result = _base + (word * 64) + FirstSet(_words[word]);
+                }
+
+                return (result);
+            }
+
+        private:
+            static inline uint32_t FirstSet(const uint64_t value)
+            {
+#ifdef __WINDOWS__
+                unsigned long index;
+                _BitScanForward64(&index, value);
+                return (static_cast<uint32_t>(index));
+#else
+                return (static_cast<uint32_t>(__builtin_ctzll(value)));
+#endif
+            }
+
+        private:
+            uint32_t _base;
+            uint32_t _size;
+            std::vector<uint64_t> _words;
+            std::vector<uint64_t> _summary;
+        };
+
+        // The leases, indexed by client and by address. The expiry heap holds an entry for every expiration that
+        // was set, entries that no longer match the lease they point to are dropped when they surface.
         class LeaseList : public std::list<Lease> {
         private:
             LeaseList(const LeaseList&) = delete;
             LeaseList& operator=(const LeaseList&) = delete;
 
+            typedef std::pair<uint64_t, uint32_t> Timer; // Expiration and address of a lease
+            typedef std::unordered_map<Identifier, Lease*, Identifier::Hash> IdentifierMap;
+            typedef std::unordered_map<uint32_t, Lease*> AddressIndex;
+
         public:
             LeaseList()
                 : std::list<Lease>()
+                , _identifiers()
+                , _addresses()
+                , _free()
+                , _expiry()
             {
             }
             ~LeaseList()
@@ -472,8 +595,118 @@ namespace Plugin {
                 _adminLock.Unlock();
             }
 
+            // NOTE:
+            // All methods below need to be executed within the lock.
+            inline Lease* Find(const uint32_t address)
+            {
+                AddressIndex::iterator index(_addresses.find(address));
+
+                return (index != _addresses.end() ? index->second : nullptr);
+            }
+            inline Lease* Find(const Identifier& id)
+            {
+                IdentifierMap::iterator index(_identifiers.find(id));
+
+                return (index != _identifiers.end() ? index->second : nullptr);
+            }
+            Lease* Create(const Identifier& id, const uint32_t address, const uint64_t expiration = 0)
+            {
+                push_back(Lease(id, address, expiration));
+
+                Lease* result = &(back());
+
+                // On duplicates (an old leases file) the first lease wins, like it did when the list was searched.
+                _identifiers.emplace(id, result);
+                _addresses.emplace(address, result);
+                _free.Take(address);
+                Schedule(*result);
+
+                return (result);
+            }
+            void Assign(Lease& lease, const Identifier& id)
+            {
+                IdentifierMap::iterator index(_identifiers.find(lease.Id()));
+
+                if ((index != _identifiers.end()) && (index->second == &lease)) {
+                    _identifiers.erase(index);
+                }
+
+                lease.Update(id);
+                _identifiers[id] = &lease;
+            }
+            void Expiration(Lease& lease, const uint64_t time)
+            {
+                lease.Expiration(time);
+                Schedule(lease);
+            }
+            // (Re)define the pool, first and last are inclusive.
+            void Pool(const uint32_t first, const uint32_t last)
+            {
+                _free.Reset(first, (last >= first ? (last - first + 1) : 0));
+
+                for (const Lease& lease : *this) {
+                    _free.Take(lease.Raw());
+                }
+
+                Rebuild();
+            }
+            // An address in the pool that was never leased, 0 if there is none.
+            inline uint32_t Free() const
+            {
+                return (_free.First());
+            }
+            // The lease in the pool that expired first, nullptr if none of them has expired.
+            Lease* Expired()
+            {
+                Lease* result = nullptr;
+
+                while ((result == nullptr) && (_expiry.empty() == false)) {
+                    const Timer& timer(_expiry.front());
+                    Lease* lease = Find(timer.second);
+
+                    if ((lease == nullptr) || (lease->Expiration() != timer.first) || (_free.Contains(timer.second) == false)) {
+                        // Stale entry, the expiration of this lease changed since.
+                        std::pop_heap(_expiry.begin(), _expiry.end(), std::greater<Timer>());
+                        _expiry.pop_back();
+                    } else if (lease->IsExpired() == true) {
+                        result = lease;
+                    } else {
+                        // The first one to expire has not, so none has.
+                        break;
+                    }
+                }
+
+                return (result);
+            }
+
+        private:
+            void Schedule(const Lease& lease)
+            {
+                _expiry.emplace_back(lease.Expiration(), lease.Raw());
+                std::push_heap(_expiry.begin(), _expiry.end(), std::greater<Timer>());
+
+                // Stale entries are only dropped when they reach the top, do not let them pile up.
+                if (_expiry.size() > ((2 * size()) + 64)) {
+                    Rebuild();
+                }
+            }
+            void Rebuild()
+            {
+                _expiry.clear();
+
+                for (const Lease& lease : *this) {
+                    _expiry.emplace_back(lease.Expiration(), lease.Raw());
+                }
+
+                std::make_heap(_expiry.begin(), _expiry.end(), std::greater<Timer>());
+            }
+
         private:
             mutable Core::CriticalSection _adminLock;
+            IdentifierMap _identifiers;
+            AddressIndex _addresses;
+            AddressMap _free;
+            std::vector<Timer> _expiry;
         };
 
         class Response {
@@ -678,7 +911,6 @@ namespace Plugin {
             , _poolSize(poolSize)
             , _minAddress(0)
             , _maxAddress(0)
-            , _nextFreeIp(0)
             , _server(0)
             , _router(router)
             , _dns(~0)
@@ -724,12 +956,32 @@ namespace Plugin {
             return (Core::NodeId(info));
         }
 
+        // Adds the lease, or if there is one for the address already, updates it to the given one.
         inline void AddLease(const Lease& lease)
         {
             _leases.Lock();
-            _leases.push_back(lease);
+
+            Lease* current = _leases.Find(lease.Raw());
+
+            if (current == nullptr) {
+                _leases.Create(lease.Id(), lease.Raw(), lease.Expiration());
+            } else {
+                if (current->Id() != lease.Id()) {
+                    _leases.Assign(*current, lease.Id());
+                }
+                _leases.Expiration(*current, lease.Expiration());
+            }
+
             _leases.Unlock();
         }
+        inline uint32_t Count() const
+        {
+            _leases.ReadLock();
+            const uint32_t result = static_cast<uint32_t>(_leases.size());
+            _leases.ReadUnlock();
+
+            return (result);
+        }
 
         // IMPORTANT NOTE !!!!
         // The Leases() method will lock the lease list. Lifetime
@@ -743,48 +995,26 @@ namespace Plugin {
         uint32_t Open();
         uint32_t Close();
 
-    private:
-        // NOTE:
-        // The next three methods, Find,Find and Create need to be executed within the lock.
-        inline Lease* Find(const uint32_t address)
-        {
-            LeaseList::iterator index(_leases.begin());
-            while ((index != _leases.end()) && (index->Raw() != address)) {
-                index++;
-            }
-
-            return (index != _leases.end() ? &(*index) : nullptr);
-        }
-        inline Lease* Find(const Identifier& id)
-        {
-            LeaseList::iterator index(_leases.begin());
-            while ((index != _leases.end()) && (index->Id() != id)) {
-                index++;
-            }
+    protected:
+        // Derives the pool, router and DNS server from the address (network order) and netmask of the server.
+        void Network(const uint32_t server, const uint8_t maskBits);
 
-            return (index != _leases.end() ? &(*index) : nullptr);
-        }
-        inline Lease* Create(const Identifier& id, const uint32_t address)
-        {
-            _leases.push_back(Lease(id, address));
-            return &(_leases.back());
-        }
         void Discover(Response& response, const ScratchPad& scratchPad)
         {
             _leases.Lock();
-            Lease* result = Find(scratchPad.Id());
+            Lease* result = _leases.Find(scratchPad.Id());
 
             // RFC 2131 section 4.3.1
             if ((result == nullptr) && (scratchPad.RequestedIP() != 0)) {
                 // Make sure the preferred IP address is within the pool, otherwise offer a correct one anyway
                 if ((scratchPad.RequestedIP() >= _minAddress) && (scratchPad.RequestedIP() <= _maxAddress)) {
-                    result = Find(scratchPad.RequestedIP());
+                    result = _leases.Find(scratchPad.RequestedIP());
 
                     if (result == nullptr) {
                         // Ip address has not been taken yet, time to "assign" it to this client.
-                        result = Create(scratchPad.Id(), scratchPad.RequestedIP());
+                        result = _leases.Create(scratchPad.Id(), scratchPad.RequestedIP());
                     } else if (result->IsExpired() == true) {
-                        result->Update(scratchPad.Id());
+                        _leases.Assign(*result, scratchPad.Id());
                     } else {
                         // IP address is taken
                         result = nullptr;
@@ -794,24 +1024,16 @@ namespace Plugin {
 
             if (result == nullptr) {
                 // First look in previously unallocated IP slots
-                uint32_t ip;
-                for (ip = _nextFreeIp; ip <= _maxAddress; ip++) {
-                    if (Find(ip) == nullptr) {
-                        result = Create(scratchPad.Id(), ip);
-                        _nextFreeIp = (ip + 1);
-                        break;
-                    }
-                }
+                const uint32_t ip = _leases.Free();
 
-                if (result == nullptr) {
-                    // Still not found a free IP slot, attempt picking up one of the expired ones
-                    for (ip = _minAddress; ip <= _maxAddress ; ip++) {
-                        Lease* lease = Find(ip);
-                        if ((lease != nullptr) && (lease->IsExpired() == true)) {
-                            result = lease;
-                            result->Update(scratchPad.Id());
-                            break;
-                        }
+                if (ip != 0) {
+                    result = _leases.Create(scratchPad.Id(), ip);
+                } else {
+                    // Still not found a free IP slot, attempt picking up the one that expired first
+                    result = _leases.Expired();
+
+                    if (result != nullptr) {
+                        _leases.Assign(*result, scratchPad.Id());
                     }
                 }
             }
@@ -823,7 +1045,7 @@ namespace Plugin {
                     // Temporarily lock out the offered IP address until the client actually requests it
                     Core::Time timeout = Core::Time::Now();
                     timeout.Add(60 /* sec */ * 1000);
-                    result->Expiration(timeout.Ticks());
+                    _leases.Expiration(*result, timeout.Ticks());
                 }
 
                 response.Offer(result->Raw());
@@ -837,7 +1059,7 @@ namespace Plugin {
             _leases.Lock();
 
             // RFC 2131 section 4.3.2 Determine requested IP address
-            Lease* result = Find(scratchPad.Id());
+            Lease* result = _leases.Find(scratchPad.Id());
             uint32_t serverId = scratchPad.ServerIdentifier();
             uint32_t requested = scratchPad.RequestedIP();
             
@@ -848,11 +1070,11 @@ namespace Plugin {
                 Core::Time leaseExp = Core::Time::Now();
                 leaseExp.Add(DefaultLeaseTime * (60 /* min */ * 60 * 1000));
                 response.LeaseTime(DefaultLeaseTime);
-                result->Expiration(leaseExp.Ticks());
+                _leases.Expiration(*result, leaseExp.Ticks());
                 _ipRequestCallback(_interfaceName, result);
             } else {
                 if (result != nullptr) {
-                    result->Expiration(0); // Invalidate
+                    _leases.Expiration(*result, 0); // Invalidate
                 }
             }
 
@@ -956,7 +1178,6 @@ namespace Plugin {
         uint32_t _poolSize;
         uint32_t _minAddress;
         uint32_t _maxAddress;
-        uint32_t _nextFreeIp;
         uint32_t _server;
         uint32_t _router;
         uint32_t _dns;
@@ -0,0 +1,363 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+#include "DHCPServerImplementation.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __WINDOWS__
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Lease database of one DHCP server: a magic word followed by an append only log of records
+    //     [length:4][checksum:4][address:4][expiration:8][identifier length:1][identifier]
+    // where length and checksum cover everything after the checksum. Every granted lease is appended, on load the
+    // last record of an address wins. Once the log holds far more records than there are leases, it is rewritten
+    // with one record per lease, to a temporary file that is renamed, so the file is always complete.
+    // Records are appended while the lease list is locked, so that only hands a record to the kernel. Rewriting
+    // the log is left to the owner, to do on another thread; whatever is appended meanwhile is kept in memory and
+    // follows the rewritten records.
+    class LeaseStore {
+    private:
+        static constexpr uint32_t Magic = 0x50434844; // "DHCP"
+        static constexpr uint32_t HeaderSize = 2 * sizeof(uint32_t);
+        static constexpr uint32_t Slack = 256; // Records the log may grow beyond twice the leases
+
+    public:
+        LeaseStore(const LeaseStore&) = delete;
+        LeaseStore& operator=(const LeaseStore&) = delete;
+
+        LeaseStore()
+            : _lock()
+            , _fileName()
+            , _fd(-1)
+            , _records(0)
+            , _record()
+            , _compacting(false)
+            , _backlog()
+            , _backlogRecords(0)
+        {
+        }
+        ~LeaseStore()
+        {
+            Close();
+        }
+
+    public:
+        inline bool IsOpen() const
+        {
+            return (_fd != -1);
+        }
+        inline uint32_t Records() const
+        {
+            return (_records);
+        }
+        // The log holds so many outdated records that it is time to compact it.
+        inline bool IsDue(const uint32_t leases) const
+        {
+            _lock.Lock();
+            const bool result = ((_compacting == false) && (_records > ((2 * leases) + Slack)));
+            _lock.Unlock();
+
+            return (result);
+        }
+        // Start from the leases the server has now, normally right after they were loaded.
+        bool Open(const string& fileName, const DHCPServerImplementation& server)
+        {
+            ASSERT(_fd == -1);
+
+            _fileName = fileName;
+
+            return (Compact(server));
+        }
+        void Close()
+        {
+            _lock.Lock();
+
+            if (_fd != -1) {
+                SyncFile(_fd);
+                CloseFile(_fd);
+                _fd = -1;
+            }
+
+            _lock.Unlock();
+        }
+        // The record is handed to the kernel right away, so it survives a restart of the plugin or framework.
+        // Returns true if the log is due for compaction.
+        bool Append(const DHCPServerImplementation::Lease& lease, const uint32_t leases)
+        {
+            bool result = false;
+
+            _lock.Lock();
+
+            _record.clear();
+            Encode(_record, lease);
+
+            if (_compacting == true) {
+                _backlog += _record;
+                _backlogRecords++;
+            } else if (_fd != -1) {
+                if (WriteFile(_fd, _record) == true) {
+                    _records++;
+                    result = (_records > ((2 * leases) + Slack));
+                } else {
+                    TRACE_L1("Could not write to the lease store [%s]", _fileName.c_str());
+                }
+            }
+
+            _lock.Unlock();
+
+            return (result);
+        }
+        // Writes and syncs a complete new log, do not call with the lease list locked.
+        bool Compact(const DHCPServerImplementation& server)
+        {
+            const string temporary(_fileName + _T(".tmp"));
+            string records;
+            uint32_t count = 0;
+            bool result = false;
+
+            _lock.Lock();
+
+            if (_compacting == true) {
+                _lock.Unlock();
+                return (false);
+            }
+
+            _compacting = true;
+            _backlog.clear();
+            _backlogRecords = 0;
+
+            _lock.Unlock();
+
+            {
+                // Lifetime of the iterator must be short, the server is blocked while it exists.
+                DHCPServerImplementation::Iterator leases(server.Leases());
+
+                while (leases.Next() == true) {
+                    Encode(records, leases.Current());
+                    count++;
+                }
+            }
+
+            int fd = OpenFile(temporary, true);
+
+            if (fd != -1) {
+                const uint32_t magic(Magic);
+
+                result = (WriteFile(fd, string(reinterpret_cast<const char*>(&magic), sizeof(magic))) == true) && (WriteFile(fd, records) == true) && (SyncFile(fd) == true);
+
+                CloseFile(fd);
+
+                if (result == true) {
+                    result = ReplaceFile(temporary, _fileName);
+                } else {
+                    Core::File(temporary).Destroy();
+                }
+            }
+
+            _lock.Lock();
+
+            if (_fd != -1) {
+                CloseFile(_fd);
+            }
+
+            // Even if the rewrite failed, keep on logging to whatever is there.
+            _fd = OpenFile(_fileName, false);
+
+            if (result == true) {
+                _records = count;
+            } else {
+                TRACE_L1("Could not rewrite the lease store [%s]", _fileName.c_str());
+            }
+
+            // What was granted while the log was rewritten goes after it.
+            if ((_fd != -1) && (_backlog.empty() == false) && (WriteFile(_fd, _backlog) == true)) {
+                _records += _backlogRecords;
+            }
+
+            _backlog.clear();
+            _backlogRecords = 0;
+            _compacting = false;
+
+            result = ((result == true) && (_fd != -1));
+
+            _lock.Unlock();
+
+            return (result);
+        }
+
+    public:
+        // Adds the leases in the file to the server, returns the number of records read.
+        static uint32_t Load(const string& fileName, DHCPServerImplementation& server)
+        {
+            uint32_t count = 0;
+            Core::DataElementFile file(fileName, Core::File::USER_READ, 0);
+
+            if ((file.IsValid() == true) && (file.Size() >= sizeof(uint32_t))) {
+                const uint8_t* data(file.Buffer());
+                const uint64_t size(file.Size());
+                uint32_t magic;
+                uint64_t offset(sizeof(magic));
+
+                ::memcpy(&magic, data, sizeof(magic));
+
+                if (magic != Magic) {
+                    TRACE_L1("Lease store [%s] has an unknown format, ignored.", fileName.c_str());
+                    offset = size;
+                }
+
+                while ((offset + HeaderSize) <= size) {
+                    uint32_t length, checksum;
+
+                    ::memcpy(&length, &data[offset], sizeof(length));
+                    ::memcpy(&checksum, &data[offset + sizeof(length)], sizeof(checksum));
+
+                    if (((offset + HeaderSize + length) > size) || (Checksum(&data[offset + HeaderSize], length) != checksum) || (Decode(&data[offset + HeaderSize], length, server) == false)) {
+                        TRACE_L1("Lease store [%s] ends in an incomplete record, %d records loaded.", fileName.c_str(), count);
+                        break;
+                    }
+
+                    offset += HeaderSize + length;
+                    count++;
+                }
+            }
+
+            return (count);
+        }
+
+    private:
+#ifdef __WINDOWS__
+        static int OpenFile(const string& fileName, const bool truncate)
+        {
+            return (::_open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | _O_NOINHERIT | (truncate == true ? _O_TRUNC : _O_APPEND), _S_IREAD | _S_IWRITE));
+        }
+        static bool WriteFile(const int fd, const string& data)
+        {
+            return (::_write(fd, data.data(), static_cast<unsigned int>(data.length())) == static_cast<int>(data.length()));
+        }
+        static bool SyncFile(const int fd)
+        {
+            return (::_commit(fd) == 0);
+        }
+        static void CloseFile(const int fd)
+        {
+            ::_close(fd);
+        }
+        // A rename does not replace an existing file on Windows.
+        static bool ReplaceFile(const string& from, const string& to)
+        {
+            return (::MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE);
+        }
+#else
+        static int OpenFile(const string& fileName, const bool truncate)
+        {
+            return (::open(fileName.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate == true ? O_TRUNC : O_APPEND), S_IRUSR | S_IWUSR | S_IRGRP));
+        }
+        static bool WriteFile(const int fd, const string& data)
+        {
+            return (::write(fd, data.data(), data.length()) == static_cast<ssize_t>(data.length()));
+        }
+        static bool SyncFile(const int fd)
+        {
+            return (::fdatasync(fd) == 0);
+        }
+        static void CloseFile(const int fd)
+        {
+            ::close(fd);
+        }
+        static bool ReplaceFile(const string& from, const string& to)
+        {
+            return (::rename(from.c_str(), to.c_str()) == 0);
+        }
+#endif
+        static void Encode(string& buffer, const DHCPServerImplementation::Lease& lease)
+        {
+            const uint32_t start(static_cast<uint32_t>(buffer.length()));
+            const uint32_t address(lease.Raw());
+            const uint64_t expiration(lease.Expiration());
+            const uint8_t idLength(lease.Id().Length());
+
+            buffer.append(HeaderSize, '\0');
+            buffer.append(reinterpret_cast<const char*>(&address), sizeof(address));
+            buffer.append(reinterpret_cast<const char*>(&expiration), sizeof(expiration));
+            buffer.append(reinterpret_cast<const char*>(&idLength), sizeof(idLength));
+            buffer.append(reinterpret_cast<const char*>(lease.Id().Id()), idLength);
+
+            const uint32_t length(static_cast<uint32_t>(buffer.length()) - start - HeaderSize);
+            const uint32_t checksum(Checksum(reinterpret_cast<const uint8_t*>(&buffer[start + HeaderSize]), length));
+
+            ::memcpy(&buffer[start], &length, sizeof(length));
+            ::memcpy(&buffer[start + sizeof(length)], &checksum, sizeof(checksum));
+        }
+        static bool Decode(const uint8_t record[], const uint32_t length, DHCPServerImplementation& server)
+        {
+            uint32_t address;
+            uint64_t expiration;
+            uint8_t idLength;
+            bool result = false;
+
+            if (length >= (sizeof(address) + sizeof(expiration) + sizeof(idLength))) {
+                ::memcpy(&address, &record[0], sizeof(address));
+                ::memcpy(&expiration, &record[sizeof(address)], sizeof(expiration));
+                ::memcpy(&idLength, &record[sizeof(address) + sizeof(expiration)], sizeof(idLength));
+
+                if ((sizeof(address) + sizeof(expiration) + sizeof(idLength) + idLength) == length) {
+                    const DHCPServerImplementation::Identifier id(&record[sizeof(address) + sizeof(expiration) + sizeof(idLength)], idLength);
+
+                    server.AddLease(DHCPServerImplementation::Lease(id, address, expiration));
+                    result = true;
+                }
+            }
+
+            return (result);
+        }
+        // FNV-1a, good enough to detect a torn write.
+        static uint32_t Checksum(const uint8_t data[], const uint32_t length)
+        {
+            uint32_t hash = 2166136261u;
+
+            for (uint32_t index = 0; index < length; index++) {
+                hash = (hash ^ data[index]) * 16777619u;
+            }
+
+            return (hash);
+        }
+
+    private:
+        mutable Core::CriticalSection _lock;
+        string _fileName;
+        int _fd;
+        uint32_t _records;
+        string _record;
+        bool _compacting;
+        string _backlog; // Records appended while compacting
+        uint32_t _backlogRecords;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,132 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures what the lease store costs a DHCP server with many leases, from start to restart:
+//  - opening the store, which writes a compacted log of all leases;
+//  - appending a record for every renewed lease, the work done while the leases are locked. Every lease is
+//    renewed a few times, so the log is compacted along the way, as the plugin does on its worker job;
+//  - restarting, which loads the log, with all outdated records in it, into a fresh server.
+//
+// Usage: DHCPServerRestartBenchmark [leases] [renewals per lease]
+
+#include "../LeaseStore.h"
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    class Server : public DHCPServerImplementation {
+    public:
+        Server() = delete;
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        Server(const uint32_t poolSize)
+            : DHCPServerImplementation(_T("Benchmark"), _T("eth0"), 2, poolSize, 0, Core::NodeId(), [](const string&, Lease*) {})
+        {
+            // A /16, as if the server runs on 10.0.0.1, the pool starts right after it.
+            Network(::inet_addr("10.0.0.1"), 16);
+        }
+        ~Server() override
+        {
+        }
+
+    public:
+        static Lease Client(const uint32_t client, const uint64_t expiration)
+        {
+            const uint8_t hardware[] = { 0x02, 0x00, static_cast<uint8_t>(client >> 24), static_cast<uint8_t>(client >> 16), static_cast<uint8_t>(client >> 8), static_cast<uint8_t>(client) };
+
+            return (Lease(Identifier(hardware, sizeof(hardware)), 0x0A000002 + client, expiration));
+        }
+    };
+
+    static double MilliSeconds(const uint64_t start)
+    {
+        return (static_cast<double>(Core::Time::Now().Ticks() - start) / static_cast<double>(Core::Time::TicksPerMillisecond));
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t leases = std::min(static_cast<uint32_t>(argc > 1 ? ::atoi(argv[1]) : 10000), static_cast<uint32_t>(65000));
+    const uint32_t renewals = (argc > 2 ? ::atoi(argv[2]) : 4);
+    const string fileName(_T("/tmp/DHCPServerRestartBenchmark.") + Core::NumberType<uint32_t>(::getpid()).Text() + _T(".leases"));
+    const uint64_t expiration = Core::Time::Now().Add(3600 * 1000).Ticks();
+
+    Plugin::Server server(leases);
+
+    for (uint32_t client = 0; client < leases; client++) {
+        server.AddLease(Plugin::Server::Client(client, expiration));
+    }
+
+    printf(_T("%u leases, %u renewals per lease\n"), leases, renewals);
+
+    uint32_t compactions = 0;
+    double compactTime = 0;
+    double appendTime = 0;
+    {
+        Plugin::LeaseStore store;
+
+        uint64_t start = Core::Time::Now().Ticks();
+        if (store.Open(fileName, server) == false) {
+            printf(_T("Could not open %s\n"), fileName.c_str());
+            return (1);
+        }
+        printf(_T("%-24s %10.2f ms\n"), _T("open (compact)"), Plugin::MilliSeconds(start));
+
+        for (uint32_t round = 0; round < renewals; round++) {
+            for (uint32_t client = 0; client < leases; client++) {
+                const Plugin::Server::Lease lease(Plugin::Server::Client(client, expiration + round + 1));
+
+                start = Core::Time::Now().Ticks();
+                const bool due = store.Append(lease, leases);
+                appendTime += Plugin::MilliSeconds(start);
+
+                if (due == true) {
+                    start = Core::Time::Now().Ticks();
+                    store.Compact(server);
+                    compactTime += Plugin::MilliSeconds(start);
+                    compactions++;
+                }
+            }
+        }
+
+        printf(_T("%-24s %10.2f us/record\n"), _T("append"), (appendTime * 1000.0) / std::max(leases * renewals, static_cast<uint32_t>(1)));
+        printf(_T("%-24s %10.2f ms, %u times\n"), _T("compact"), compactTime / std::max(compactions, static_cast<uint32_t>(1)), compactions);
+        printf(_T("%-24s %10u records\n"), _T("log"), store.Records());
+    }
+
+    {
+        Plugin::Server restarted(leases);
+
+        const uint64_t start = Core::Time::Now().Ticks();
+        const uint32_t records = Plugin::LeaseStore::Load(fileName, restarted);
+        printf(_T("%-24s %10.2f ms, %u records, %u leases\n"), _T("restart (load)"), Plugin::MilliSeconds(start), records, restarted.Count());
+    }
+
+    Core::File(fileName).Destroy();
+    Core::Singleton::Dispose();
+
+    return (0);
+}
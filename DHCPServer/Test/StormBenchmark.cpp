@@ -0,0 +1,188 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how fast the DHCP server hands out addresses when a large number of clients shows up at once. The
+// frames are fed straight into the server, without a socket, so only the handling of the messages is measured:
+//  - every client sends a DISCOVER and gets an offer, until the pool is used up;
+//  - half of the clients accept their offer with a REQUEST, the other half send one without server identifier,
+//    which is refused and gives the address back;
+//  - as many new clients send a DISCOVER, they can only get the addresses that were given back.
+//
+// Usage: DHCPServerStormBenchmark [clients]
+
+#include "../DHCPServerImplementation.h"
+
+#include <arpa/inet.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    class Storm : public DHCPServerImplementation {
+    private:
+        static constexpr uint16_t CoreSize = 236;
+        static constexpr uint16_t OptionsOffset = CoreSize + 4;
+
+    public:
+        Storm() = delete;
+        Storm(const Storm&) = delete;
+        Storm& operator=(const Storm&) = delete;
+
+        Storm(const uint32_t poolSize)
+            : DHCPServerImplementation(_T("Benchmark"), _T("eth0"), 2, poolSize, 0, Core::NodeId(), [this](const string&, Lease*) { _acknowledged++; })
+            , _acknowledged(0)
+        {
+            // A /16, as if the server runs on 10.0.0.1, the pool starts right after it.
+            Network(::inet_addr("10.0.0.1"), 16);
+        }
+        ~Storm() override
+        {
+        }
+
+    public:
+        uint32_t Acknowledged() const
+        {
+            return (_acknowledged);
+        }
+        // Returns the address offered to the client, 0 if it got nothing.
+        uint32_t Discover(const uint32_t client)
+        {
+            uint8_t frame[512];
+            const uint16_t length = Frame(frame, client, 1, false);
+
+            return (Exchange(frame, length, 2));
+        }
+        // Returns the address acknowledged to the client, 0 if it was refused.
+        uint32_t Request(const uint32_t client, const bool accept)
+        {
+            uint8_t frame[512];
+            const uint16_t length = Frame(frame, client, 3, accept);
+
+            return (Exchange(frame, length, 5));
+        }
+
+    private:
+        // A BOOTREQUEST from an Ethernet client, identified by its hardware address only.
+        static uint16_t Frame(uint8_t frame[], const uint32_t client, const uint8_t type, const bool serverIdentifier)
+        {
+            static const uint8_t cookie[] = { 99, 130, 83, 99 };
+            uint16_t length = OptionsOffset;
+
+            ::memset(frame, 0, OptionsOffset);
+
+            frame[0] = 1; // BOOTREQUEST
+            frame[1] = 1; // Ethernet
+            frame[2] = 6;
+            ::memcpy(&frame[4], &client, sizeof(client)); // Transaction
+            frame[28] = 0x02; // Locally administered hardware address
+            frame[30] = static_cast<uint8_t>(client >> 24);
+            frame[31] = static_cast<uint8_t>(client >> 16);
+            frame[32] = static_cast<uint8_t>(client >> 8);
+            frame[33] = static_cast<uint8_t>(client);
+            ::memcpy(&frame[CoreSize], cookie, sizeof(cookie));
+
+            frame[length++] = 53; // Message type
+            frame[length++] = 1;
+            frame[length++] = type;
+
+            if (serverIdentifier == true) {
+                frame[length++] = 54;
+                frame[length++] = 4;
+                frame[length++] = 10;
+                frame[length++] = 0;
+                frame[length++] = 0;
+                frame[length++] = 1;
+            }
+
+            frame[length++] = 255;
+
+            return (length);
+        }
+        uint32_t Exchange(uint8_t frame[], const uint16_t length, const uint8_t expected)
+        {
+            uint8_t reply[1024];
+            uint32_t result = 0;
+
+            ReceiveData(frame, length);
+
+            // The reply is queued for the socket, take it from there.
+            if ((SendData(reply, sizeof(reply)) > (OptionsOffset + 2)) && (reply[OptionsOffset + 2] == expected)) {
+                uint32_t address;
+
+                ::memcpy(&address, &reply[16], sizeof(address));
+                result = ntohl(address);
+            }
+
+            return (result);
+        }
+
+    private:
+        uint32_t _acknowledged;
+    };
+
+    static double MicroSeconds(const uint64_t start, const uint32_t operations)
+    {
+        return ((static_cast<double>(Core::Time::Now().Ticks() - start) * 1000.0) / (static_cast<double>(Core::Time::TicksPerMillisecond) * std::max(operations, static_cast<uint32_t>(1))));
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t maximum = std::min(static_cast<uint32_t>(argc > 1 ? ::atoi(argv[1]) : 65000), static_cast<uint32_t>(65000));
+    static const uint32_t Steps[] = { 1000, 4000, 16000, 65000 };
+
+    printf(_T("%8s %14s %14s %14s %10s %10s %10s\n"), _T("clients"), _T("discover us"), _T("request us"), _T("reuse us"), _T("offered"), _T("acked"), _T("reused"));
+
+    for (const uint32_t clients : Steps) {
+        if (clients > maximum) {
+            break;
+        }
+
+        // The pool is exactly large enough for the first wave.
+        Plugin::Storm server(clients);
+        uint32_t offered = 0;
+        uint32_t reused = 0;
+
+        uint64_t start = Core::Time::Now().Ticks();
+        for (uint32_t client = 0; client < clients; client++) {
+            offered += (server.Discover(client) != 0 ? 1 : 0);
+        }
+        const double discoverTime = Plugin::MicroSeconds(start, clients);
+
+        start = Core::Time::Now().Ticks();
+        for (uint32_t client = 0; client < clients; client++) {
+            server.Request(client, ((client & 1) == 0));
+        }
+        const double requestTime = Plugin::MicroSeconds(start, clients);
+
+        start = Core::Time::Now().Ticks();
+        for (uint32_t client = clients; client < (clients + (clients / 2)); client++) {
+            reused += (server.Discover(client) != 0 ? 1 : 0);
+        }
+        const double reuseTime = Plugin::MicroSeconds(start, clients / 2);
+
+        printf(_T("%8u %14.2f %14.2f %14.2f %10u %10u %10u\n"), clients, discoverTime, requestTime, reuseTime, offered, server.Acknowledged(), reused);
+    }
+
+    Core::Singleton::Dispose();
+
+    return (0);
+}
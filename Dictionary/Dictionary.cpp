@@ -34,6 +34,7 @@ namespace Plugin {
     SERVICE_REGISTRATION(Dictionary, 1, 0);
 
     static Core::ProxyPoolType<Web::JSONBodyType<Dictionary::NameSpace>> jsonBodyDataFactory(4);
+    static Core::ProxyPoolType<Web::JSONBodyType<Dictionary::NameSpace::Entry>> jsonEntryDataFactory(2);
     static Core::ProxyPoolType<Web::TextBody> textBodyDataFactory(4);
 
     static bool IsValidName(const string& value)
@@ -41,18 +42,24 @@ namespace Plugin {
         return ((value.empty() == false) && (value.find_first_of(Dictionary::NameSpaceDelimiter, 0) == static_cast<size_t>(~0)));
     }
 
+    // Names that do not fit the journal records are refused, instead of being stored truncated.
+    static bool IsStorable(const string& value)
+    {
+        return (value.length() <= Journal::MaxNameLength);
+    }
+
     bool Dictionary::CreateInternalDictionary(const string& currentSpace, const NameSpace& current)
     {
         bool correctStructure(true);
         Core::JSON::ArrayType<NameSpace::Entry>::ConstIterator keyIndex(current.Dictionary.Elements());
         Core::JSON::ArrayType<NameSpace>::ConstIterator spaceIndex(current.Spaces.Elements());
-        std::list<RuntimeEntry>* currentList = NULL;
+        Space* currentList = NULL;
 
         // Fill in the keys from this name space...
         while ((correctStructure == true) && (keyIndex.Next() == true)) {
             const string& key(keyIndex.Current().Key.Value());
 
-            correctStructure = IsValidName(key);
+            correctStructure = (IsValidName(key) && IsStorable(key));
 
             if (correctStructure == true) {
                 if (currentList == NULL) {
@@ -61,13 +68,13 @@ namespace Plugin {
                     ASSERT(currentList != NULL);
                 }
 
-                currentList->push_back(RuntimeEntry(key, keyIndex.Current().Value.Value(), keyIndex.Current().Type.Value()));
+                currentList->Add(key, keyIndex.Current().Value.Value(), keyIndex.Current().Type.Value());
             }
         }
 
         while ((correctStructure == true) && (spaceIndex.Next() == true)) {
             string nameSpace(spaceIndex.Current().Name.Value());
-            correctStructure = IsValidName(nameSpace);
+            correctStructure = (IsValidName(nameSpace) && IsStorable(currentSpace + NameSpaceDelimiter + nameSpace));
             correctStructure = correctStructure && CreateInternalDictionary(currentSpace + NameSpaceDelimiter + nameSpace, spaceIndex.Current());
         }
 
@@ -86,7 +93,7 @@ namespace Plugin {
                 NameSpace& blockToFill(current[index->first]);
 
                 // No we got the namespace bloc, fill in the keys..
-                const std::list<RuntimeEntry>& keyList(index->second);
+                const std::list<RuntimeEntry>& keyList(index->second.Entries());
                 std::list<RuntimeEntry>::const_iterator keyIndex(keyList.begin());
 
                 while (keyIndex != keyList.end()) {
@@ -109,16 +116,35 @@ namespace Plugin {
     {
         _config.FromString(service->ConfigLine());
 
-        Core::File dictionaryFile(service->PersistentPath() + _config.Storage.Value());
+        _storage = service->PersistentPath() + _config.Storage.Value();
 
-        if (dictionaryFile.Open(true) == true) {
-            NameSpace dictionary;
-            Core::OptionalType<Core::JSON::Error> error;
-            dictionary.IElement::FromFile(dictionaryFile, error);
-            if (error.IsSet() == true) {
-                SYSLOG(Logging::ParsingError, (_T("Parsing failed with %s"), ErrorDisplayMessage(error.Value()).c_str()));
+        Loader loader(_dictionary);
+        const string snapshot(_storage + _T(".snapshot"));
+
+        if (Core::File(snapshot).Exists() == true) {
+            Journal::Replay(snapshot, true, loader);
+        } else {
+            // No snapshot yet, start from the JSON file written by previous versions.
+            Core::File dictionaryFile(_storage);
+
+            if (dictionaryFile.Open(true) == true) {
+                NameSpace dictionary;
+                Core::OptionalType<Core::JSON::Error> error;
+                dictionary.IElement::FromFile(dictionaryFile, error);
+                if (error.IsSet() == true) {
+                    SYSLOG(Logging::ParsingError, (_T("Parsing failed with %s"), ErrorDisplayMessage(error.Value()).c_str()));
+                }
+                CreateInternalDictionary(EMPTY_STRING, dictionary);
             }
-            CreateInternalDictionary(EMPTY_STRING, dictionary);
+        }
+
+        // The journals hold the changes made after the snapshot was taken, oldest first.
+        uint32_t validSize = 0;
+        Journal::Replay(_storage + _T(".journal.old"), false, loader);
+        Journal::Replay(_storage + _T(".journal"), false, loader, validSize);
+
+        if ((Core::Directory(service->PersistentPath().c_str()).CreatePath() == false) || (_journal.Open(_storage + _T(".journal"), validSize) == false)) {
+            SYSLOG(Logging::Startup, (_T("Could not open the journal, persistent keys are only stored on deactivation.")));
         }
 
         _skipURL = static_cast<uint8_t>(service->WebPrefix().length());
@@ -127,16 +153,28 @@ namespace Plugin {
         return (_T(""));
     }
 
-    /* virtual */ void Dictionary::Deinitialize(PluginHost::IShell* service)
+    /* virtual */ void Dictionary::Deinitialize(PluginHost::IShell* service VARIABLE_IS_NOT_USED)
     {
+        // From here on, changes are only kept in memory, so they all end up in the snapshot.
+        _journalLock.Lock();
+        _journal.Close();
+        _journalLock.Unlock();
 
-        Core::File dictionaryFile(service->PersistentPath() + _config.Storage.Value());
+        _job.Revoke();
 
-        if (dictionaryFile.Open(true) == true) {
-            NameSpace dictionary;
-            CreateExternalDictionary(EMPTY_STRING, dictionary);
-            dictionary.IElement::ToFile(dictionaryFile);
+        if (Snapshot(false) == true) {
+            Core::File(_storage + _T(".journal.old")).Destroy();
+            Core::File(_storage + _T(".journal")).Destroy();
         }
+
+        _scheduled = false;
+
+        _notifier.Revoke();
+
+        _notifyLock.Lock();
+        _pending.clear();
+        _notifying = false;
+        _notifyLock.Unlock();
     }
 
     /* virtual */ string Dictionary::Information() const
@@ -147,12 +185,25 @@ namespace Plugin {
 
     /* virtual */ void Dictionary::Inbound(Web::Request& request)
     {
-        // There are no requests coming in with a body that require a JSON body. So continue without action here.
-        request.Body(Core::ProxyType<Web::IBody>(textBodyDataFactory.Element()));
+        // A batch of keys is posted as a JSON namespace, a single value as plain text or as a JSON entry.
+        if ((request.ContentType.IsSet() == true) && (request.ContentType.Value() == Web::MIME_JSON)) {
+            const bool single((request.Path.length() > _skipURL) && (request.Path[request.Path.length() - 1] != '/'));
+
+            if (single == true) {
+                request.Body(Core::ProxyType<Web::IBody>(jsonEntryDataFactory.Element()));
+            } else {
+                request.Body(Core::ProxyType<Web::IBody>(jsonBodyDataFactory.Element()));
+            }
+        } else {
+            request.Body(Core::ProxyType<Web::IBody>(textBodyDataFactory.Element()));
+        }
     }
 
     // <GET> ../[namespace/]{Key}
+    // <GET> ../[namespace/] returns all keys of the namespace as JSON
     // <PUT> ../[namespace/]{Key}?Type=[persistent|volatile|closure]
+    // <PUT> ../[namespace/]{Key} with a JSON body { "value": ..., "type": ... }, the type is optional
+    // <PUT> ../[namespace/]?Type=[persistent|volatile|closure] with a JSON body sets all keys in its dictionary
     /* virtual */ Core::ProxyType<Web::Response> Dictionary::Process(const Web::Request& request)
     {
         ASSERT(_skipURL <= request.Path.length());
@@ -178,7 +229,41 @@ namespace Plugin {
             key = index.Current().Text();
         }
 
-        if (request.Verb == Web::Request::HTTP_GET) {
+        Dictionary::enumType keyType(Dictionary::enumType::VOLATILE);
+        Core::TextSegmentIterator typeIterator(Core::TextSegmentIterator(Core::TextFragment(request.Query), true, '='));
+
+        if ((typeIterator.Next() == true) && (typeIterator.Current() == _T("Type")) && (typeIterator.Next() == true)) {
+            // Seems we have a type specifier
+            keyType = Core::EnumerateType<Dictionary::enumType>(typeIterator.Current(), false).Value();
+        }
+
+        if ((request.Verb == Web::Request::HTTP_GET) && (key.empty() == true)) {
+            Core::ProxyType<Web::JSONBodyType<NameSpace>> spaceBody(jsonBodyDataFactory.Element());
+
+            spaceBody->Name = nameSpace;
+            spaceBody->Spaces.Clear();
+            spaceBody->Dictionary.Clear();
+
+            _adminLock.ReadLock();
+
+            DictionaryMap::const_iterator space(_dictionary.find(nameSpace));
+
+            if (space != _dictionary.end()) {
+                std::list<RuntimeEntry>::const_iterator entry(space->second.Entries().begin());
+
+                while (entry != space->second.Entries().end()) {
+                    spaceBody->Dictionary.Add(NameSpace::Entry(entry->Key(), entry->Value(), entry->Type()));
+                    entry++;
+                }
+            }
+
+            _adminLock.ReadUnlock();
+
+            result->Body(Core::ProxyType<Web::IBody>(spaceBody));
+            result->ContentType = Web::MIME_JSON;
+            result->ErrorCode = Web::STATUS_OK;
+            result->Message = _T("OK");
+        } else if (request.Verb == Web::Request::HTTP_GET) {
             string value;
             Core::ProxyType<Web::TextBody> valueBody(textBodyDataFactory.Element());
 
@@ -186,21 +271,44 @@ namespace Plugin {
             *valueBody = value;
 
             result->Body(Core::ProxyType<Web::IBody>(valueBody));
+            result->ErrorCode = Web::STATUS_OK;
+            result->Message = _T("OK");
+        } else if ((request.Verb == Web::Request::HTTP_POST) && (key.empty() == true) && (request.HasBody() == true) && (request.Body<Web::JSONBodyType<NameSpace>>().IsValid() == true)) {
+            Core::ProxyType<const Web::JSONBodyType<NameSpace>> spaceBody(request.Body<Web::JSONBodyType<NameSpace>>());
+            Core::JSON::ArrayType<NameSpace::Entry>::ConstIterator index(spaceBody->Dictionary.Elements());
+            KeyValues entries;
+
+            while (index.Next() == true) {
+                if (IsValidName(index.Current().Key.Value()) == true) {
+                    entries.emplace_back(index.Current().Key.Value(), index.Current().Value.Value());
+                }
+            }
+
+            TRACE(Trace::Information, (_T("SetKeys ( %s, %d keys, %s)"), nameSpace.c_str(), static_cast<uint32_t>(entries.size()), Core::EnumerateType<Dictionary::enumType>(keyType).Data()));
+            MultiSet(nameSpace, entries, keyType);
+
             result->ErrorCode = Web::STATUS_OK;
             result->Message = _T("OK");
         } else if ((request.Verb == Web::Request::HTTP_POST) && (key.empty() == false) && (request.HasBody() == true)) {
-            Dictionary::enumType keyType(Dictionary::enumType::VOLATILE);
-            Core::ProxyType<const Web::TextBody> valueBody(request.Body<Web::TextBody>());
-            const string value(valueBody.IsValid() == true ? string(*valueBody) : string());
-            Core::TextSegmentIterator typeIterator(Core::TextSegmentIterator(Core::TextFragment(request.Query), true, '='));
-
-            if ((typeIterator.Next() == true) && (typeIterator.Current() == _T("Type")) && (typeIterator.Next() == true)) {
-                // Seems we have a type specifier
-                keyType = Core::EnumerateType<Dictionary::enumType>(typeIterator.Current(), false).Value();
+            Core::ProxyType<const Web::JSONBodyType<NameSpace::Entry>> entryBody(request.Body<Web::JSONBodyType<NameSpace::Entry>>());
+            string value;
+
+            if (entryBody.IsValid() == true) {
+                value = entryBody->Value.Value();
+
+                if (entryBody->Type.IsSet() == true) {
+                    keyType = entryBody->Type.Value();
+                }
+            } else {
+                Core::ProxyType<const Web::TextBody> valueBody(request.Body<Web::TextBody>());
+
+                if (valueBody.IsValid() == true) {
+                    value = *valueBody;
+                }
             }
 
             TRACE(Trace::Information, (_T("SetKey ( %s, %s, %s)"), key.c_str(), value.c_str(), Core::EnumerateType<Dictionary::enumType>(keyType).Data()));
-            Set(nameSpace, key, value);
+            Set(nameSpace, key, value, keyType);
 
             result->ErrorCode = Web::STATUS_OK;
             result->Message = _T("OK");
@@ -216,25 +324,20 @@ namespace Plugin {
     {
         bool result = false;
 
-        _adminLock.Lock();
+        _adminLock.ReadLock();
 
         DictionaryMap::const_iterator index(_dictionary.find(nameSpace));
 
         if (index != _dictionary.end()) {
-            const std::list<RuntimeEntry>& container(index->second);
-            std::list<RuntimeEntry>::const_iterator listIndex(container.begin());
-
-            while ((listIndex != container.end()) && (listIndex->Key() != key)) {
-                listIndex++;
-            }
+            const RuntimeEntry* entry(index->second.Find(key));
 
-            if (listIndex != container.end()) {
+            if (entry != nullptr) {
                 result = true;
-                value = listIndex->Value();
+                value = entry->Value();
             }
         }
 
-        _adminLock.Unlock();
+        _adminLock.ReadUnlock();
 
         return (result);
     }
@@ -246,20 +349,20 @@ namespace Plugin {
 
         Exchange::IDictionary::IIterator* result = nullptr;
 
-        _adminLock.Lock();
+        _adminLock.ReadLock();
 
         DictionaryMap::const_iterator index(_dictionary.find(nameSpace));
 
         if (index != _dictionary.end()) {
             Core::ProxyType<Iterator> entries(iterators.Element());
 
-            entries->Load(InternalIterator(index->second));
+            entries->Load(InternalIterator(index->second.Entries()));
 
             result = &(*entries);
             result->AddRef();
         }
 
-        _adminLock.Unlock();
+        _adminLock.ReadUnlock();
 
         return (result);
     }
@@ -268,46 +371,188 @@ namespace Plugin {
     // NameSpace and key MUST be filled.
     /* virtual */ bool Dictionary::Set(const string& nameSpace, const string& key, const string& value)
     {
-        // Direct method to Set a value for a key in a certain namespace from the dictionary.
+        return (Set(nameSpace, key, value, VOLATILE));
+    }
+
+    // The type is only used when the key is created, an existing key keeps its type.
+    bool Dictionary::Set(const string& nameSpace, const string& key, const string& value, const enumType type)
+    {
         bool result = false;
 
-        _adminLock.Lock();
+        if (IsStorable(nameSpace) == false) {
+            TRACE(Trace::Error, (_T("Namespace of %d characters is too long to be stored"), static_cast<uint32_t>(nameSpace.length())));
+        } else {
+            _adminLock.Lock();
 
-        std::list<RuntimeEntry>& container(_dictionary[nameSpace]);
-        std::list<RuntimeEntry>::iterator listIndex(container.begin());
+            result = Update(nameSpace, _dictionary[nameSpace], key, value, type);
 
-        while ((listIndex != container.end()) && (listIndex->Key() != key)) {
-            listIndex++;
+            if (result == true) {
+                Changed(nameSpace, KeyValues(1, KeyValues::value_type(key, value)));
+            }
+
+            _adminLock.Unlock();
         }
 
-        if (listIndex == container.end()) {
-            result = true;
-            container.push_back(RuntimeEntry(key, value, VOLATILE));
-        } else if (listIndex->Value() != value) {
-            result = true;
-            listIndex->Value(value);
+        return (result);
+    }
+
+    uint32_t Dictionary::MultiGet(const string& nameSpace, KeyValues& entries) const
+    {
+        uint32_t result = 0;
+
+        _adminLock.ReadLock();
+
+        DictionaryMap::const_iterator index(_dictionary.find(nameSpace));
+
+        if (index != _dictionary.end()) {
+            if (entries.empty() == true) {
+                std::list<RuntimeEntry>::const_iterator entry(index->second.Entries().begin());
+
+                while (entry != index->second.Entries().end()) {
+                    entries.emplace_back(entry->Key(), entry->Value());
+                    entry++;
+                }
+
+                result = static_cast<uint32_t>(entries.size());
+            } else {
+                KeyValues::iterator loop(entries.begin());
+
+                while (loop != entries.end()) {
+                    const RuntimeEntry* entry(index->second.Find(loop->first));
+
+                    if (entry != nullptr) {
+                        loop->second = entry->Value();
+                        result++;
+                    }
+                    loop++;
+                }
+            }
         }
 
-        if (result == true) {
-            ObserverMap::iterator index(_observers.begin());
+        _adminLock.ReadUnlock();
 
-            // Right, we updated send out the modification !!!
-            while (index != _observers.end()) {
-                if (index->first == nameSpace) {
-                    index->second->Modified(nameSpace, key, value);
+        return (result);
+    }
+
+    uint32_t Dictionary::MultiSet(const string& nameSpace, const KeyValues& entries, const enumType type)
+    {
+        KeyValues changes;
+
+        if (IsStorable(nameSpace) == false) {
+            TRACE(Trace::Error, (_T("Namespace of %d characters is too long to be stored"), static_cast<uint32_t>(nameSpace.length())));
+        } else {
+            _adminLock.Lock();
+
+            Space& container(_dictionary[nameSpace]);
+            KeyValues::const_iterator index(entries.begin());
+
+            while (index != entries.end()) {
+                if (Update(nameSpace, container, index->first, index->second, type) == true) {
+                    changes.push_back(*index);
                 }
                 index++;
             }
+
+            if (changes.empty() == false) {
+                Changed(nameSpace, changes);
+            }
+
+            _adminLock.Unlock();
         }
 
-        _adminLock.Unlock();
+        return (static_cast<uint32_t>(changes.size()));
+    }
+
+    // Should be called with the dictionary locked for writing.
+    bool Dictionary::Update(const string& nameSpace, Space& container, const string& key, const string& value, const enumType type)
+    {
+        bool result = false;
+        RuntimeEntry* entry(container.Find(key));
+
+        if (IsStorable(key) == false) {
+            TRACE(Trace::Error, (_T("Key of %d characters is too long to be stored"), static_cast<uint32_t>(key.length())));
+        } else if ((entry == nullptr) || (entry->Value() != value)) {
+            result = true;
+
+            if (container.Add(key, value, type).Type() == PERSISTENT) {
+                _journalLock.Lock();
+
+                if (_journal.IsOpen() == true) {
+                    _journal.Append(nameSpace, key, value, PERSISTENT);
+
+                    if (_scheduled == false) {
+                        _scheduled = true;
+                        _job.Schedule(Core::Time::Now().Add(_config.FlushInterval.Value()));
+                    }
+                }
+
+                _journalLock.Unlock();
+            }
+        }
 
         return (result);
     }
 
+    // Should be called with the dictionary locked for writing, so the changes are queued in the order they are made.
+    void Dictionary::Changed(const string& nameSpace, const KeyValues& entries)
+    {
+        _notifyLock.Lock();
+
+        Changes& pending(_pending[nameSpace]);
+        KeyValues::const_iterator index(entries.begin());
+
+        while (index != entries.end()) {
+            pending.Add(index->first, index->second);
+            index++;
+        }
+
+        if (_notifying == false) {
+            _notifying = true;
+            _notifier.Schedule(_config.NotifyDelay.Value());
+        }
+
+        _notifyLock.Unlock();
+    }
+
+    void Dictionary::Notify()
+    {
+        PendingMap pending;
+
+        _notifyLock.Lock();
+        pending.swap(_pending);
+        _notifying = false;
+        _notifyLock.Unlock();
+
+        _observerLock.Lock();
+
+        // A sink might (un)register while it is called, so walk a copy of the observers.
+        const ObserverMap observers(_observers);
+        PendingMap::const_iterator space(pending.begin());
+
+        while (space != pending.end()) {
+            ObserverMap::const_iterator index(observers.begin());
+
+            // Right, we updated send out the modification !!!
+            while (index != observers.end()) {
+                if (index->first == space->first) {
+                    KeyValues::const_iterator entry(space->second.Entries().begin());
+
+                    while ((entry != space->second.Entries().end()) && (std::find(_observers.begin(), _observers.end(), *index) != _observers.end())) {
+                        index->second->Modified(space->first, entry->first, entry->second);
+                        entry++;
+                    }
+                }
+                index++;
+            }
+            space++;
+        }
+
+        _observerLock.Unlock();
+    }
+
     /* virtual */ void Dictionary::Register(const string& nameSpace, struct Exchange::IDictionary::INotification* sink)
     {
-        _adminLock.Lock();
+        _observerLock.Lock();
 
 #ifdef __DEBUG__
         ObserverMap::iterator index(_observers.begin());
@@ -322,14 +567,14 @@ namespace Plugin {
 
         _observers.push_back(std::pair<string, struct Exchange::IDictionary::INotification*>(nameSpace, sink));
 
-        _adminLock.Unlock();
+        _observerLock.Unlock();
     }
 
     /* virtual */ void Dictionary::Unregister(const string& nameSpace, struct Exchange::IDictionary::INotification* sink)
     {
         bool found = false;
 
-        _adminLock.Lock();
+        _observerLock.Lock();
 
         ObserverMap::iterator index(_observers.begin());
 
@@ -344,7 +589,65 @@ namespace Plugin {
             _observers.erase(index);
         }
 
-        _adminLock.Unlock();
+        _observerLock.Unlock();
+    }
+
+    // Writes the whole dictionary to a new snapshot. With rotate set, the journal starts over at the moment
+    // the dictionary is captured, the old journal is removed once the snapshot is on disk. Replaying a journal
+    // that is older than the snapshot is harmless, the last value it holds for a key is the one in the snapshot.
+    bool Dictionary::Snapshot(const bool rotate)
+    {
+        const string oldJournal(_storage + _T(".journal.old"));
+        string records;
+
+        _adminLock.ReadLock();
+
+        DictionaryMap::const_iterator index(_dictionary.begin());
+
+        while (index != _dictionary.end()) {
+            std::list<RuntimeEntry>::const_iterator entry(index->second.Entries().begin());
+
+            while (entry != index->second.Entries().end()) {
+                Journal::Encode(records, index->first, entry->Key(), entry->Value(), static_cast<uint8_t>(entry->Type()));
+                entry++;
+            }
+            index++;
+        }
+
+        // If a previous snapshot failed, the old journal is still needed, keep adding to the current one.
+        if ((rotate == true) && (Core::File(oldJournal).Exists() == false)) {
+            _journalLock.Lock();
+            _journal.Rotate(oldJournal);
+            _journalLock.Unlock();
+        }
+
+        _adminLock.ReadUnlock();
+
+        bool result = Journal::WriteSnapshot(_storage + _T(".snapshot"), records);
+
+        if (result == false) {
+            TRACE(Trace::Error, (_T("Could not write the dictionary snapshot [%s.snapshot]"), _storage.c_str()));
+        } else if (rotate == true) {
+            Core::File(oldJournal).Destroy();
+        }
+
+        return (result);
+    }
+
+    void Dictionary::Dispatch()
+    {
+        _journalLock.Lock();
+
+        _journal.Sync();
+        _scheduled = false;
+
+        const bool compact = (_journal.Size() >= (_config.CompactSize.Value() * 1024));
+
+        _journalLock.Unlock();
+
+        if (compact == true) {
+            Snapshot(true);
+        }
     }
 }
 }
@@ -20,8 +20,11 @@
 #ifndef __DICTIONARY_H
 #define __DICTIONARY_H
 
+#include "Journal.h"
 #include "Module.h"
 #include <interfaces/IDictionary.h>
+#include <map>
+#include <unordered_map>
 
 namespace WPEFramework {
 namespace Plugin {
@@ -34,6 +37,7 @@ namespace Plugin {
             PERSISTENT,
             CLOSURE
         };
+        typedef std::list<std::pair<string, string>> KeyValues;
 
     private:
         Dictionary(const Dictionary&) = delete;
@@ -101,8 +105,201 @@ namespace Plugin {
             bool _dirty;
         };
 
-        typedef std::map<const string, std::list<RuntimeEntry>> DictionaryMap;
+        // The entries of one namespace. The list keeps the entries (and is what the iterators walk), the index
+        // finds an entry by key without walking the list.
+        class Space {
+        private:
+            Space(const Space&) = delete;
+            Space& operator=(const Space&) = delete;
+
+            typedef std::unordered_map<string, std::list<RuntimeEntry>::iterator> Index;
+
+        public:
+            Space()
+                : _entries()
+                , _index()
+            {
+            }
+            ~Space()
+            {
+            }
+
+        public:
+            inline const std::list<RuntimeEntry>& Entries() const
+            {
+                return (_entries);
+            }
+            inline const RuntimeEntry* Find(const string& key) const
+            {
+                Index::const_iterator index(_index.find(key));
+
+                return (index != _index.end() ? &(*(index->second)) : nullptr);
+            }
+            inline RuntimeEntry* Find(const string& key)
+            {
+                Index::iterator index(_index.find(key));
+
+                return (index != _index.end() ? &(*(index->second)) : nullptr);
+            }
+            // Adding a key that already exists, overwrites its value.
+            RuntimeEntry& Add(const string& key, const string& value, const enumType type)
+            {
+                Index::iterator index(_index.find(key));
+
+                if (index != _index.end()) {
+                    index->second->Value(value);
+                } else {
+                    _entries.emplace_back(key, value, type);
+                    index = _index.emplace(key, std::prev(_entries.end())).first;
+                }
+
+                return (*(index->second));
+            }
+
+        private:
+            std::list<RuntimeEntry> _entries;
+            Index _index;
+        };
+
+        // Many readers (Get) can be served at the same time, writers (Set/Register/Unregister) are exclusive.
+        class ReadWriteLock {
+        private:
+            ReadWriteLock(const ReadWriteLock&) = delete;
+            ReadWriteLock& operator=(const ReadWriteLock&) = delete;
+
+        public:
+#ifdef __WINDOWS__
+            ReadWriteLock()
+            {
+                ::InitializeSRWLock(&_lock);
+            }
+            ~ReadWriteLock()
+            {
+            }
+
+            inline void ReadLock() const
+            {
+                ::AcquireSRWLockShared(&_lock);
+            }
+            inline void ReadUnlock() const
+            {
+                ::ReleaseSRWLockShared(&_lock);
+            }
+            inline void Lock() const
+            {
+                ::AcquireSRWLockExclusive(&_lock);
+            }
+            inline void Unlock() const
+            {
+                ::ReleaseSRWLockExclusive(&_lock);
+            }
+
+        private:
+            mutable SRWLOCK _lock;
+#else
+            ReadWriteLock()
+            {
+                ::pthread_rwlock_init(&_lock, nullptr);
+            }
+            ~ReadWriteLock()
+            {
+                ::pthread_rwlock_destroy(&_lock);
+            }
+
+            inline void ReadLock() const
+            {
+                ::pthread_rwlock_rdlock(&_lock);
+            }
+            inline void ReadUnlock() const
+            {
+                ::pthread_rwlock_unlock(&_lock);
+            }
+            inline void Lock() const
+            {
+                ::pthread_rwlock_wrlock(&_lock);
+            }
+            inline void Unlock() const
+            {
+                ::pthread_rwlock_unlock(&_lock);
+            }
+
+        private:
+            mutable pthread_rwlock_t _lock;
+#endif
+        };
+
+        typedef std::unordered_map<string, Space> DictionaryMap;
+
+        // Fills the dictionary from a snapshot or journal, no notifications are sent.
+        class Loader : public Journal::ICallback {
+        private:
+            Loader() = delete;
+            Loader(const Loader&) = delete;
+            Loader& operator=(const Loader&) = delete;
+
+        public:
+            Loader(DictionaryMap& dictionary)
+                : _dictionary(dictionary)
+            {
+            }
+            ~Loader() override
+            {
+            }
+
+        public:
+            void Load(const string& nameSpace, const string& key, const string& value, const uint8_t type) override
+            {
+                _dictionary[nameSpace].Add(key, value, static_cast<enumType>(type));
+            }
+
+        private:
+            DictionaryMap& _dictionary;
+        };
+
+        // The changes of one namespace that are not reported yet, in the order they were made. A key that changes
+        // again before it is reported, moves to the end with its new value, so only the last value is reported.
+        class Changes {
+        private:
+            typedef std::unordered_map<string, KeyValues::iterator> Index;
+
+        public:
+            Changes(const Changes&) = delete;
+            Changes& operator=(const Changes&) = delete;
+
+            Changes()
+                : _entries()
+                , _index()
+            {
+            }
+            ~Changes()
+            {
+            }
+
+        public:
+            inline const KeyValues& Entries() const
+            {
+                return (_entries);
+            }
+            void Add(const string& key, const string& value)
+            {
+                Index::iterator index(_index.find(key));
+
+                if (index != _index.end()) {
+                    index->second->second = value;
+                    _entries.splice(_entries.end(), _entries, index->second);
+                } else {
+                    _entries.emplace_back(key, value);
+                    _index.emplace(key, std::prev(_entries.end()));
+                }
+            }
+
+        private:
+            KeyValues _entries;
+            Index _index;
+        };
+
         typedef std::list<std::pair<const string, struct Exchange::IDictionary::INotification*>> ObserverMap;
+        typedef std::unordered_map<string, Changes> PendingMap;
         typedef Core::IteratorType<const std::list<RuntimeEntry>, const RuntimeEntry&, std::list<RuntimeEntry>::const_iterator> InternalIterator;
 
     public:
@@ -328,9 +525,15 @@ namespace Plugin {
                 : Core::JSON::Container()
                 , Storage(_T("dictionary.json"))
                 , LingerTime(10)
+                , FlushInterval(1000)
+                , CompactSize(256)
+                , NotifyDelay(0)
             { // Time in minutes.
                 Add(_T("storage"), &Storage);
                 Add(_T("lingertime"), &LingerTime);
+                Add(_T("flushinterval"), &FlushInterval);
+                Add(_T("compactsize"), &CompactSize);
+                Add(_T("notifydelay"), &NotifyDelay);
             }
             ~Config()
             {
@@ -339,6 +542,56 @@ namespace Plugin {
         public:
             Core::JSON::String Storage;
             Core::JSON::DecUInt16 LingerTime;
+            Core::JSON::DecUInt16 FlushInterval; // Time in milliseconds between syncs of the journal to disk.
+            Core::JSON::DecUInt32 CompactSize; // Size in KB of the journal that triggers a new snapshot.
+            Core::JSON::DecUInt16 NotifyDelay; // Time in milliseconds changes are collected before they are reported.
+        };
+
+        using Job = Core::WorkerPool::JobType<Dictionary&>;
+
+        // Delivers the queued change notifications from the worker pool.
+        class Notifier {
+        private:
+            Notifier() = delete;
+            Notifier(const Notifier&) = delete;
+            Notifier& operator=(const Notifier&) = delete;
+
+        public:
+            Notifier(Dictionary& parent)
+                : _parent(parent)
+                , _job(*this)
+            {
+            }
+            ~Notifier()
+            {
+                _job.Revoke();
+            }
+
+        public:
+            void Schedule(const uint16_t delay)
+            {
+                if (delay == 0) {
+                    _job.Submit();
+                } else {
+                    _job.Schedule(Core::Time::Now().Add(delay));
+                }
+            }
+            void Revoke()
+            {
+                _job.Revoke();
+            }
+
+        private:
+            friend class Core::ThreadPool::JobType<Notifier&>;
+
+            void Dispatch()
+            {
+                _parent.Notify();
+            }
+
+        private:
+            Dictionary& _parent;
+            Core::WorkerPool::JobType<Notifier&> _job;
         };
 
     public:
@@ -347,6 +600,17 @@ namespace Plugin {
             , _skipURL(0)
             , _config()
             , _dictionary()
+            , _observerLock()
+            , _observers()
+            , _journalLock()
+            , _journal()
+            , _storage()
+            , _scheduled(false)
+            , _job(*this)
+            , _notifyLock()
+            , _pending()
+            , _notifying(false)
+            , _notifier(*this)
         {
         }
         virtual ~Dictionary()
@@ -406,16 +670,49 @@ namespace Plugin {
         virtual void Register(const string& nameSpace, struct Exchange::IDictionary::INotification* sink);
         virtual void Unregister(const string& nameSpace, struct Exchange::IDictionary::INotification* sink);
 
+        // Batched variants of Get and Set, the whole batch is handled with a single lock of the dictionary.
+        // MultiGet fills in the values of the requested keys (all keys of the namespace if none are requested)
+        // and returns the number of keys found. MultiSet returns the number of values that changed.
+        uint32_t MultiGet(const string& nameSpace, KeyValues& entries) const;
+        uint32_t MultiSet(const string& nameSpace, const KeyValues& entries, const enumType type = VOLATILE);
+
     private:
         bool CreateInternalDictionary(const string& currentSpace, const NameSpace& data);
         void CreateExternalDictionary(const string& currentSpace, NameSpace& data) const;
+        bool Set(const string& nameSpace, const string& key, const string& value, const enumType type);
+        bool Update(const string& nameSpace, Space& container, const string& key, const string& value, const enumType type);
+        void Changed(const string& nameSpace, const KeyValues& entries);
+        void Notify();
+        bool Snapshot(const bool rotate);
+
+        friend class Core::ThreadPool::JobType<Dictionary&>;
+        void Dispatch();
 
     private:
-        mutable Core::CriticalSection _adminLock;
+        ReadWriteLock _adminLock;
         uint8_t _skipURL;
         Config _config;
         DictionaryMap _dictionary;
+        Core::CriticalSection _observerLock;
         ObserverMap _observers;
+
+        // Changes of persistent keys are appended to the journal right away and synced to disk every
+        // FlushInterval. If the journal grows beyond CompactSize, the dictionary is written to a new snapshot
+        // and the journal starts over. On start the snapshot is loaded and the journal(s) replayed on top of it.
+        Core::CriticalSection _journalLock;
+        Journal _journal;
+        string _storage;
+        bool _scheduled;
+        Job _job;
+
+        // Changes are reported from the worker pool, outside the dictionary lock. Per namespace only the last value
+        // of a key is kept, and everything that changed within NotifyDelay is reported in one go, in the order the
+        // changes were made within the namespace. The observers are guarded by their own lock, held while
+        // reporting, so no sink is called after it is unregistered.
+        Core::CriticalSection _notifyLock;
+        PendingMap _pending;
+        bool _notifying;
+        Notifier _notifier;
     };
 }
 }
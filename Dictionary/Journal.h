@@ -0,0 +1,374 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __WINDOWS__
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Append only log of dictionary changes, and the binary snapshot format it is compacted into. Both files are
+    // a sequence of records:
+    //     [length:4][checksum:4][type:1][namespace length:2][namespace][key length:2][key][value length:4][value]
+    // where length and checksum cover everything after the checksum. A record that is incomplete or does not
+    // match its checksum (a write interrupted by a crash) ends the replay, and is cut off the journal before
+    // anything is appended to it, otherwise all that follows would be lost on the next replay. Snapshots start with a magic word and
+    // are written to a temporary file that is renamed, so a snapshot is either complete or not there.
+    // Names (namespaces and keys) are stored with a 16 bit length, longer names can not be stored.
+    class Journal {
+    public:
+        static constexpr uint32_t MaxNameLength = 0xFFFF;
+
+        struct ICallback {
+            virtual ~ICallback() {}
+
+            virtual void Load(const string& nameSpace, const string& key, const string& value, const uint8_t type) = 0;
+        };
+
+    private:
+        static constexpr uint32_t SnapshotMagic = 0x54434944; // "DICT"
+        static constexpr uint32_t HeaderSize = 2 * sizeof(uint32_t);
+
+    public:
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        Journal()
+            : _fileName()
+            , _fd(-1)
+            , _size(0)
+            , _dirty(false)
+            , _record()
+        {
+        }
+        ~Journal()
+        {
+            Close();
+        }
+
+    public:
+        inline bool IsOpen() const
+        {
+            return (_fd != -1);
+        }
+        inline uint32_t Size() const
+        {
+            return (_size);
+        }
+        // Anything in the file beyond the given size, a torn record found by Replay(), is dropped.
+        bool Open(const string& fileName, const uint32_t validSize = ~0)
+        {
+            ASSERT(_fd == -1);
+
+            _fileName = fileName;
+            _fd = OpenFile(_fileName, false);
+            _size = (_fd != -1 ? FileSize(_fd) : 0);
+
+            if ((_fd != -1) && (_size > validSize)) {
+                TRACE_L1("Dropping %d bytes of incomplete records from the dictionary journal [%s]", (_size - validSize), _fileName.c_str());
+
+                if (TruncateFile(_fd, validSize) == true) {
+                    _size = validSize;
+                } else {
+                    // Appending behind the torn record would lose whatever is appended.
+                    CloseFile(_fd);
+                    _fd = -1;
+                    _size = 0;
+                }
+            }
+
+            return (_fd != -1);
+        }
+        void Close()
+        {
+            if (_fd != -1) {
+                Sync();
+                CloseFile(_fd);
+                _fd = -1;
+            }
+        }
+        // The record is handed to the kernel right away, it is only forced to disk on the next Sync.
+        void Append(const string& nameSpace, const string& key, const string& value, const uint8_t type)
+        {
+            ASSERT(_fd != -1);
+
+            _record.clear();
+
+            if (Encode(_record, nameSpace, key, value, type) == false) {
+                TRACE_L1("Name too long for the dictionary journal [%s]", _fileName.c_str());
+            } else if (WriteFile(_fd, _record) == true) {
+                _size += static_cast<uint32_t>(_record.length());
+                _dirty = true;
+            } else {
+                TRACE_L1("Could not write to the dictionary journal [%s]", _fileName.c_str());
+            }
+        }
+        void Sync()
+        {
+            if ((_dirty == true) && (_fd != -1)) {
+                SyncFile(_fd);
+                _dirty = false;
+            }
+        }
+        // Continue in an empty journal, the current one is moved to the given name. Whatever was in it, must be
+        // part of the next snapshot.
+        bool Rotate(const string& oldFileName)
+        {
+            Close();
+
+            ReplaceFile(_fileName, oldFileName);
+
+            return (Open(_fileName));
+        }
+
+    public:
+        // Returns false, and leaves the buffer as is, if the names are too long to be stored.
+        static bool Encode(string& buffer, const string& nameSpace, const string& key, const string& value, const uint8_t type)
+        {
+            if ((nameSpace.length() > MaxNameLength) || (key.length() > MaxNameLength)) {
+                return (false);
+            }
+
+            const uint32_t start(static_cast<uint32_t>(buffer.length()));
+            const uint16_t nameSpaceLength(static_cast<uint16_t>(nameSpace.length()));
+            const uint16_t keyLength(static_cast<uint16_t>(key.length()));
+            const uint32_t valueLength(static_cast<uint32_t>(value.length()));
+
+            buffer.append(HeaderSize, '\0');
+            buffer.append(reinterpret_cast<const char*>(&type), sizeof(type));
+            buffer.append(reinterpret_cast<const char*>(&nameSpaceLength), sizeof(nameSpaceLength));
+            buffer.append(nameSpace.c_str(), nameSpaceLength);
+            buffer.append(reinterpret_cast<const char*>(&keyLength), sizeof(keyLength));
+            buffer.append(key.c_str(), keyLength);
+            buffer.append(reinterpret_cast<const char*>(&valueLength), sizeof(valueLength));
+            buffer.append(value.c_str(), valueLength);
+
+            const uint32_t length(static_cast<uint32_t>(buffer.length()) - start - HeaderSize);
+            const uint32_t checksum(Checksum(reinterpret_cast<const uint8_t*>(&buffer[start + HeaderSize]), length));
+
+            ::memcpy(&buffer[start], &length, sizeof(length));
+            ::memcpy(&buffer[start + sizeof(length)], &checksum, sizeof(checksum));
+
+            return (true);
+        }
+        static bool WriteSnapshot(const string& fileName, const string& records)
+        {
+            const string temporary(fileName + _T(".tmp"));
+            bool result = false;
+            int fd = OpenFile(temporary, true);
+
+            if (fd != -1) {
+                const uint32_t magic(SnapshotMagic);
+
+                result = (WriteFile(fd, string(reinterpret_cast<const char*>(&magic), sizeof(magic))) == true) && (WriteFile(fd, records) == true) && (SyncFile(fd) == true);
+
+                CloseFile(fd);
+
+                if (result == true) {
+                    result = ReplaceFile(temporary, fileName);
+                } else {
+                    Core::File(temporary).Destroy();
+                }
+            }
+
+            return (result);
+        }
+        // Returns the number of records loaded.
+        static uint32_t Replay(const string& fileName, const bool snapshot, ICallback& callback)
+        {
+            uint32_t validSize;
+
+            return (Replay(fileName, snapshot, callback, validSize));
+        }
+        // Also returns the size of the part of the file that holds complete records.
+        static uint32_t Replay(const string& fileName, const bool snapshot, ICallback& callback, uint32_t& validSize)
+        {
+            uint32_t count = 0;
+            Core::DataElementFile file(fileName, Core::File::USER_READ, 0);
+
+            validSize = 0;
+
+            if ((file.IsValid() == true) && (file.Size() > 0)) {
+                const uint8_t* data(file.Buffer());
+                const uint64_t size(file.Size());
+                uint64_t offset(0);
+
+                if (snapshot == true) {
+                    uint32_t magic = 0;
+
+                    if (size >= sizeof(magic)) {
+                        ::memcpy(&magic, data, sizeof(magic));
+                    }
+
+                    offset = (magic == SnapshotMagic ? sizeof(magic) : size);
+                }
+
+                while ((offset + HeaderSize) <= size) {
+                    uint32_t length, checksum;
+
+                    ::memcpy(&length, &data[offset], sizeof(length));
+                    ::memcpy(&checksum, &data[offset + sizeof(length)], sizeof(checksum));
+
+                    if (((offset + HeaderSize + length) > size) || (Checksum(&data[offset + HeaderSize], length) != checksum) || (Decode(&data[offset + HeaderSize], length, callback) == false)) {
+                        TRACE_L1("Dictionary file [%s] ends in an incomplete record, %d records loaded.", fileName.c_str(), count);
+                        break;
+                    }
+
+                    offset += HeaderSize + length;
+                    count++;
+                }
+
+                validSize = static_cast<uint32_t>(std::min(offset, size));
+            }
+
+            return (count);
+        }
+
+    private:
+#ifdef __WINDOWS__
+        static int OpenFile(const string& fileName, const bool truncate)
+        {
+            return (::_open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | _O_NOINHERIT | (truncate == true ? _O_TRUNC : _O_APPEND), _S_IREAD | _S_IWRITE));
+        }
+        static uint32_t FileSize(const int fd)
+        {
+            const __int64 size(::_filelengthi64(fd));
+
+            return (size > 0 ? static_cast<uint32_t>(size) : 0);
+        }
+        static bool WriteFile(const int fd, const string& data)
+        {
+            return (::_write(fd, data.data(), static_cast<unsigned int>(data.length())) == static_cast<int>(data.length()));
+        }
+        static bool SyncFile(const int fd)
+        {
+            return (::_commit(fd) == 0);
+        }
+        static bool TruncateFile(const int fd, const uint32_t size)
+        {
+            return (::_chsize_s(fd, size) == 0);
+        }
+        static void CloseFile(const int fd)
+        {
+            ::_close(fd);
+        }
+        // A rename does not replace an existing file on Windows.
+        static bool ReplaceFile(const string& from, const string& to)
+        {
+            return (::MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE);
+        }
+#else
+        static int OpenFile(const string& fileName, const bool truncate)
+        {
+            return (::open(fileName.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate == true ? O_TRUNC : O_APPEND), S_IRUSR | S_IWUSR | S_IRGRP));
+        }
+        static uint32_t FileSize(const int fd)
+        {
+            struct stat info;
+
+            return (::fstat(fd, &info) == 0 ? static_cast<uint32_t>(info.st_size) : 0);
+        }
+        static bool WriteFile(const int fd, const string& data)
+        {
+            return (::write(fd, data.data(), data.length()) == static_cast<ssize_t>(data.length()));
+        }
+        static bool SyncFile(const int fd)
+        {
+            return (::fdatasync(fd) == 0);
+        }
+        static bool TruncateFile(const int fd, const uint32_t size)
+        {
+            return (::ftruncate(fd, size) == 0);
+        }
+        static void CloseFile(const int fd)
+        {
+            ::close(fd);
+        }
+        static bool ReplaceFile(const string& from, const string& to)
+        {
+            return (::rename(from.c_str(), to.c_str()) == 0);
+        }
+#endif
+        static bool Decode(const uint8_t record[], const uint32_t length, ICallback& callback)
+        {
+            uint8_t type;
+            uint16_t nameSpaceLength, keyLength;
+            uint32_t valueLength;
+            uint32_t offset = 0;
+            bool result = false;
+
+            if (length >= (sizeof(type) + sizeof(nameSpaceLength))) {
+                ::memcpy(&type, &record[offset], sizeof(type));
+                offset += sizeof(type);
+                ::memcpy(&nameSpaceLength, &record[offset], sizeof(nameSpaceLength));
+                offset += sizeof(nameSpaceLength);
+
+                if ((offset + nameSpaceLength + sizeof(keyLength)) <= length) {
+                    const string nameSpace(reinterpret_cast<const char*>(&record[offset]), nameSpaceLength);
+                    offset += nameSpaceLength;
+                    ::memcpy(&keyLength, &record[offset], sizeof(keyLength));
+                    offset += sizeof(keyLength);
+
+                    if ((offset + keyLength + sizeof(valueLength)) <= length) {
+                        const string key(reinterpret_cast<const char*>(&record[offset]), keyLength);
+                        offset += keyLength;
+                        ::memcpy(&valueLength, &record[offset], sizeof(valueLength));
+                        offset += sizeof(valueLength);
+
+                        if ((offset + valueLength) == length) {
+                            callback.Load(nameSpace, key, string(reinterpret_cast<const char*>(&record[offset]), valueLength), type);
+                            result = true;
+                        }
+                    }
+                }
+            }
+
+            return (result);
+        }
+        // FNV-1a, good enough to detect a torn write.
+        static uint32_t Checksum(const uint8_t data[], const uint32_t length)
+        {
+            uint32_t hash = 2166136261u;
+
+            for (uint32_t index = 0; index < length; index++) {
+                hash = (hash ^ data[index]) * 16777619u;
+            }
+
+            return (hash);
+        }
+
+    private:
+        string _fileName;
+        int _fd;
+        uint32_t _size;
+        bool _dirty;
+        string _record;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,146 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures Get and Set throughput of the Dictionary for a growing number of keys in a namespace and a growing
+// number of threads calling it at the same time. Every thread does 90% Get and 10% Set on random keys, the way
+// clients use the dictionary. The dictionary is used as is, without a framework around it, so the notifications
+// are dispatched by a worker pool of our own.
+//
+// Usage: DictionaryBenchmark [operations per thread]
+
+#include "../Dictionary.h"
+
+#include <thread>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    class WorkerPoolImplementation : public Core::WorkerPool {
+    private:
+        class Dispatcher : public Core::ThreadPool::IDispatcher {
+        public:
+            Dispatcher(const Dispatcher&) = delete;
+            Dispatcher& operator=(const Dispatcher&) = delete;
+
+            Dispatcher() = default;
+            ~Dispatcher() override = default;
+
+        private:
+            void Initialize() override
+            {
+            }
+            void Deinitialize() override
+            {
+            }
+            void Dispatch(Core::IDispatch* job) override
+            {
+                job->Dispatch();
+            }
+        };
+
+    public:
+        WorkerPoolImplementation(const WorkerPoolImplementation&) = delete;
+        WorkerPoolImplementation& operator=(const WorkerPoolImplementation&) = delete;
+
+        WorkerPoolImplementation()
+            : Core::WorkerPool(2, Core::Thread::DefaultStackSize(), 16, &_dispatch)
+            , _dispatch()
+        {
+            Run();
+        }
+        ~WorkerPoolImplementation()
+        {
+            Stop();
+        }
+
+    private:
+        Dispatcher _dispatch;
+    };
+
+    static string KeyName(const uint32_t index)
+    {
+        return (_T("Key") + Core::NumberType<uint32_t>(index).Text());
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t operations = (argc > 1 ? ::atoi(argv[1]) : 200000);
+    static const uint32_t KeyCounts[] = { 10, 100, 1000, 10000 };
+    static const uint32_t ThreadCounts[] = { 1, 2, 4, 8 };
+
+    Plugin::WorkerPoolImplementation workerPool;
+    Core::IWorkerPool::Assign(&workerPool);
+
+    printf(_T("%4u cores, %u operations per thread, 90%% Get / 10%% Set\n"), std::thread::hardware_concurrency(), operations);
+    printf(_T("%8s %8s %16s\n"), _T("keys"), _T("threads"), _T("operations/s"));
+
+    for (const uint32_t keys : KeyCounts) {
+        Exchange::IDictionary* dictionary = Core::Service<Plugin::Dictionary>::Create<Exchange::IDictionary>();
+        std::vector<string> names;
+
+        for (uint32_t index = 0; index < keys; index++) {
+            names.push_back(Plugin::KeyName(index));
+            dictionary->Set(_T("/Benchmark"), names.back(), _T("Initial value"));
+        }
+
+        for (const uint32_t threads : ThreadCounts) {
+            std::vector<std::thread> workers;
+            const uint64_t start = Core::Time::Now().Ticks();
+
+            for (uint32_t thread = 0; thread < threads; thread++) {
+                workers.emplace_back([dictionary, &names, operations, thread]() {
+                    uint32_t seed = (thread + 1) * 2654435761U;
+                    string value;
+
+                    for (uint32_t index = 0; index < operations; index++) {
+                        seed = (seed * 1103515245U) + 12345U;
+
+                        const string& key(names[(seed >> 8) % names.size()]);
+
+                        if ((seed % 10) == 0) {
+                            dictionary->Set(_T("/Benchmark"), key, Core::NumberType<uint32_t>(index).Text());
+                        } else {
+                            dictionary->Get(_T("/Benchmark"), key, value);
+                        }
+                    }
+                });
+            }
+
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+
+            const double seconds = static_cast<double>(Core::Time::Now().Ticks() - start) / (static_cast<double>(Core::Time::TicksPerMillisecond) * 1000.0);
+
+            printf(_T("%8u %8u %16.0f\n"), keys, threads, (static_cast<double>(operations) * threads) / seconds);
+        }
+
+        dictionary->Release();
+    }
+
+    Core::IWorkerPool::Assign(nullptr);
+    Core::Singleton::Dispose();
+
+    return (0);
+}
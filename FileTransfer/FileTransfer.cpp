@@ -29,20 +29,48 @@ namespace Plugin {
         Config config;
         config.FromString(service->ConfigLine());
 
+        _logOutput.Configure(config.DatagramSize.Value(), config.BufferSize.Value() * 1024, config.ByteRate.Value(), config.LineRate.Value());
         _logOutput.SetDestination(config.Destination.Binding.Value(), config.Destination.Port.Value());
-        _observer.Register(config.FilePath.Value(), &_fileUpdate, config.FullFile.Value());
+
+        if (config.FilePath.Value().empty() == false) {
+            _observers.emplace_back();
+            _observers.back().Register(config.FilePath.Value(), &_fileUpdate, config.FullFile.Value());
+        }
+
+        Core::JSON::ArrayType<Core::JSON::String>::ConstIterator index(config.FilePaths.Elements());
+
+        while (index.Next() == true) {
+            _observers.emplace_back();
+            _observers.back().Register(index.Current().Value(), &_fileUpdate, config.FullFile.Value());
+        }
 
         return string();
     }
 
     void FileTransfer::Deinitialize(PluginHost::IShell* service)
     {
-        _observer.Unregister();
+        while (_observers.empty() == false) {
+            _observers.front().Unregister();
+            _observers.pop_front();
+        }
     }
 
     string FileTransfer::Information() const
     {
-        return string();
+        TextChannel::Statistics info;
+        Statistics data;
+        string result;
+
+        _logOutput.Snapshot(info);
+
+        data.Lines = info.Lines;
+        data.Datagrams = info.Datagrams;
+        data.Throttled = info.Throttled;
+        data.Overflows = info.Overflows;
+        data.Splits = info.Splits;
+        data.ToString(result);
+
+        return (result);
     }
 } // namespace Plugin
 } // namespace WPEFramework
@@ -19,13 +19,15 @@
  
 #pragma once
 #include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unordered_map>
-#include <iostream>
-#include <fstream>
 #include "../FileTransfer/Module.h"
 
 namespace WPEFramework {
 namespace Core {
+    // Files are observed through a watch on the directory they live in, so a file that is rotated (moved away
+    // and recreated) or only created later, is still reported. All directories share one inotify descriptor.
     class FileSystemMonitor : public Core::IResource {
         public:
             struct ICallback
@@ -76,13 +78,17 @@ namespace Core {
                     std::list<ICallback *> _callbacks;
             };
 
-            typedef std::unordered_map<int, Observer> Observers;
-            typedef std::unordered_map<string, int> Files;
+            // All observed files in one directory, by name.
+            typedef std::unordered_map<string, Observer> Names;
+            typedef std::unordered_map<int, Names> Observers;
+            typedef std::unordered_map<string, int> Directories;
+
+            static constexpr uint32_t WatchMask = (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO);
 
             FileSystemMonitor()
                 : _adminLock()
                 , _notifyFd(inotify_init1(IN_NONBLOCK))
-                , _files()
+                , _directories()
                 , _observers()
             {
             }
@@ -113,33 +119,42 @@ namespace Core {
                 ASSERT(_notifyFd != -1);
                 ASSERT(callback != nullptr);
 
-                _adminLock.Lock();
+                string directory, name;
+                Split(filename, directory, name);
 
-                Files::iterator index = _files.find(filename);
-                if (index != _files.end()) {
-                    Observers::iterator loop = _observers.find(index->second);
-                    ASSERT(loop != _observers.end());
+                _adminLock.Lock();
 
-                    loop->second.Register(callback);
-                }
-                else
-                {
-                    int fileFd = inotify_add_watch(_notifyFd, filename.c_str(), IN_CLOSE_WRITE);
-                    if (fileFd >= 0) {
-                        _files.emplace(std::piecewise_construct,
-                                       std::forward_as_tuple(filename),
-                                       std::forward_as_tuple(fileFd));
+                Directories::iterator index = _directories.find(directory);
+                if (index == _directories.end()) {
+                    int dirFd = inotify_add_watch(_notifyFd, directory.c_str(), WatchMask);
+                    if (dirFd >= 0) {
+                        index = _directories.emplace(directory, dirFd).first;
                         _observers.emplace(std::piecewise_construct,
-                                          std::forward_as_tuple(fileFd),
-                                          std::forward_as_tuple(callback));
+                                          std::forward_as_tuple(dirFd),
+                                          std::forward_as_tuple());
 
-                        if (_files.size() == 1) {
+                        if (_directories.size() == 1) {
                             // This is the first entry, lets start monitoring
                             Core::ResourceMonitor::Instance().Register(*this);
                         }
                     }
                 }
 
+                if (index != _directories.end()) {
+                    Observers::iterator loop = _observers.find(index->second);
+                    ASSERT(loop != _observers.end());
+
+                    Names::iterator entry = loop->second.find(name);
+                    if (entry != loop->second.end()) {
+                        entry->second.Register(callback);
+                    }
+                    else {
+                        loop->second.emplace(std::piecewise_construct,
+                                             std::forward_as_tuple(name),
+                                             std::forward_as_tuple(callback));
+                    }
+                }
+
                 _adminLock.Unlock();
 
                 return (IsValid());
@@ -149,25 +164,37 @@ namespace Core {
                 ASSERT(_notifyFd != -1);
                 ASSERT(callback != nullptr);
 
+                string directory, name;
+                Split(filename, directory, name);
+
                 _adminLock.Lock();
 
-                Files::iterator index = _files.find(filename);
-                ASSERT(index != _files.end());
+                Directories::iterator index = _directories.find(directory);
+                ASSERT(index != _directories.end());
 
-                if (index != _files.end()) {
+                if (index != _directories.end()) {
                     Observers::iterator loop = _observers.find(index->second);
                     ASSERT(loop != _observers.end());
 
-                    loop->second.Unregister(callback);
-                    if (loop->second.HasCallbacks() == false) {
+                    Names::iterator entry = loop->second.find(name);
+                    ASSERT(entry != loop->second.end());
+
+                    if (entry != loop->second.end()) {
+                        entry->second.Unregister(callback);
+                        if (entry->second.HasCallbacks() == false) {
+                            loop->second.erase(entry);
+                        }
+                    }
+
+                    if (loop->second.empty() == true) {
                         if (inotify_rm_watch(_notifyFd, index->second) < 0) {
                             TRACE(Trace::Error, (_T("Invoke of inotify_rm_watch failed")));
                         }
                         // Clear this index, we are no longer observing
-                        _files.erase(index);
+                        _directories.erase(index);
                         _observers.erase(loop);
-                        if (_files.size() == 0) {
-                            // This is the first entry, lets start monitoring
+                        if (_directories.size() == 0) {
+                            // This was the last entry, stop monitoring
                             Core::ResourceMonitor::Instance().Unregister(*this);
                         }
                     }
@@ -177,6 +204,18 @@ namespace Core {
             }
 
         private:
+            static void Split(const string& filename, string& directory, string& name)
+            {
+                string::size_type slash = filename.rfind('/');
+
+                if (slash == string::npos) {
+                    directory = _T(".");
+                    name = filename;
+                } else {
+                    directory = (slash == 0 ? string(_T("/")) : filename.substr(0, slash));
+                    name = filename.substr(slash + 1);
+                }
+            }
             Core::IResource::handle Descriptor() const override
             {
                 return (_notifyFd);
@@ -188,24 +227,34 @@ namespace Core {
             void Handle(const uint16_t events) override
             {
                 if ((events & POLLIN) != 0) {
-                    uint8_t eventBuffer[(sizeof(struct inotify_event) + NAME_MAX + 1)];
+                    // One read can return multiple events, make sure there is room for a few of them.
+                    uint8_t eventBuffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)] __attribute__((aligned(__alignof__(struct inotify_event))));
                     int length;
                     do
                     {
                         length = ::read(_notifyFd, eventBuffer, sizeof(eventBuffer));
-                        if (length > 0) {
-                            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(eventBuffer);
 
-                            _adminLock.Lock();
+                        int offset = 0;
+
+                        _adminLock.Lock();
+
+                        while (offset < length) {
+                            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(&eventBuffer[offset]);
 
                             // Check if we have this entry..
                             Observers::iterator loop = _observers.find(event->wd);
-                            if (loop != _observers.end()) {
-                                loop->second.Notify();
+                            if ((loop != _observers.end()) && (event->len > 0)) {
+                                Names::iterator entry = loop->second.find(string(event->name));
+                                if (entry != loop->second.end()) {
+                                    entry->second.Notify();
+                                }
                             }
 
-                            _adminLock.Unlock();
+                            offset += sizeof(struct inotify_event) + event->len;
                         }
+
+                        _adminLock.Unlock();
+
                     } while (length > 0);
                 }
             }
@@ -213,15 +262,20 @@ namespace Core {
         private:
             Core::CriticalSection _adminLock;
             int _notifyFd;
-            Files _files;
+            Directories _directories;
             Observers _observers;
         };
 } // namespace Core
 
 namespace Plugin
 {
+    // Tails a file. The file is read in large blocks with pread, complete lines are found with memchr and reported
+    // from a reused buffer. The descriptor of the file is kept open, so if the file is rotated, the remainder of
+    // the old file is read before switching to the new file. A file that shrinks is read again from the start.
     class FileObserver {
         private:
+            static constexpr uint32_t BlockSize = 64 * 1024;
+
             class Sink : public Core::FileSystemMonitor::ICallback, public Core::IDispatch {
                 public:
                     Sink() = delete;
@@ -264,6 +318,11 @@ namespace Plugin
                 , _callback(nullptr)
                 , _position(0)
                 , _path()
+                , _fd(-1)
+                , _inode(0)
+                , _buffer(nullptr)
+                , _pending(0)
+                , _line()
             {
             }
             ~FileObserver()
@@ -281,13 +340,21 @@ namespace Plugin
             {
                 ASSERT((_callback == nullptr) && (callback != nullptr));
 
-                if (fullFile == false) {
-                    _position = GetCurrentPosition(entry);
-                } else {
-                    _position = 0;
+                _path = entry;
+                _buffer = new char[BlockSize];
+                _pending = 0;
+                _position = 0;
+
+                if (Reopen() == true) {
+                    if (fullFile == false) {
+                        struct stat info;
+
+                        if (::fstat(_fd, &info) == 0) {
+                            _position = info.st_size;
+                        }
+                    }
                 }
 
-                _path = entry;
                 _callback = callback;
                 Core::FileSystemMonitor::Instance().Register(&(*_job), _path);
             }
@@ -301,34 +368,121 @@ namespace Plugin
                 // Potentially the Job might still be waiting, let’s kill it
                 Core::IWorkerPool::Instance().Revoke(Core::ProxyType<Core::IDispatchType<void> >(_job));
 
+                if (_fd != -1) {
+                    ::close(_fd);
+                    _fd = -1;
+                }
+                if (_buffer != nullptr) {
+                    delete[] _buffer;
+                    _buffer = nullptr;
+                }
+
                 _path = EMPTY_STRING;
                 _position = 0;
+                _inode = 0;
+                _pending = 0;
                 _callback = nullptr;
             }
 
         private:
-            long int GetCurrentPosition(const string &filePath) const
+            bool Reopen()
             {
-                long int pos = 0;
-                std::ifstream file(filePath.c_str());
-                if (file) {
-                    file.seekg(0, file.end);
-                    pos = file.tellg();
+                int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+                if (fd != -1) {
+                    struct stat info;
+
+                    if (::fstat(fd, &info) == 0) {
+                        if (_fd != -1) {
+                            ::close(_fd);
+                        }
+                        _fd = fd;
+                        _inode = info.st_ino;
+                    } else {
+                        ::close(fd);
+                        fd = -1;
+                    }
                 }
-                return pos;
+
+                return (fd != -1);
+            }
+            // Is the file at our path still the one we have open?
+            bool IsRotated() const
+            {
+                struct stat info;
+
+                return ((::stat(_path.c_str(), &info) == 0) && (info.st_ino != _inode));
             }
             void Dispatch()
             {
-                std::ifstream file(_path);
-                if (file) {
-                    file.seekg(_position, file.beg);
-                    std::string str;
-                    while ((std::getline(file, str)) && (str.size() > 0)) {
-                        ASSERT(_callback != nullptr);
-                        _callback->NewLine(str);
+                ASSERT(_callback != nullptr);
+
+                if ((_fd == -1) && (Reopen() == true)) {
+                    // The file did not exist when we started, so everything in it is new.
+                    _position = 0;
+                    _pending = 0;
+                }
+
+                if (_fd != -1) {
+                    struct stat info;
+
+                    if ((::fstat(_fd, &info) == 0) && (static_cast<off_t>(_position) > info.st_size)) {
+                        // Truncated, start all over again.
+                        _position = 0;
+                        _pending = 0;
+                    }
+
+                    Drain();
+
+                    if ((IsRotated() == true) && (Reopen() == true)) {
+                        // Whatever was left of the old file is reported, continue with the new one.
+                        if (_pending > 0) {
+                            Report(_buffer, _pending);
+                        }
+                        _position = 0;
+                        _pending = 0;
+
+                        Drain();
+                    }
+                }
+            }
+            void Drain()
+            {
+                ssize_t loaded;
+
+                while ((loaded = ::pread(_fd, &(_buffer[_pending]), BlockSize - _pending, _position)) > 0) {
+                    const char* start = _buffer;
+                    const char* end = &(_buffer[_pending + loaded]);
+                    const char* marker;
+
+                    _position += loaded;
+
+                    while ((marker = static_cast<const char*>(::memchr(start, '\n', end - start))) != nullptr) {
+                        Report(start, static_cast<uint32_t>(marker - start));
+                        start = marker + 1;
+                    }
+
+                    _pending = static_cast<uint32_t>(end - start);
+
+                    if (_pending == BlockSize) {
+                        // A line that does not fit the block, report what we have.
+                        Report(_buffer, _pending);
+                        _pending = 0;
+                    } else if ((_pending > 0) && (start != _buffer)) {
+                        ::memmove(_buffer, start, _pending);
                     }
                 }
-                _position = GetCurrentPosition(_path);
+            }
+            void Report(const char line[], uint32_t length)
+            {
+                if ((length > 0) && (line[length - 1] == '\r')) {
+                    length--;
+                }
+                if (length > 0) {
+                    // Assign reuses the capacity of the line, so no allocation per line.
+                    _line.assign(line, length);
+                    _callback->NewLine(_line);
+                }
             }
             void Updated()
             {
@@ -338,30 +492,71 @@ namespace Plugin
         private:
             const Core::ProxyType<Sink> _job;
             ICallback *_callback;
-            long int _position;
+            uint64_t _position;
             string _path;
+            int _fd;
+            ino_t _inode;
+            char* _buffer;
+            uint32_t _pending;
+            string _line;
         };
 
     class FileTransfer : public PluginHost::IPlugin {
         private:
 
-            static constexpr uint16_t MAX_BUFFER_LENGHT = 1024;
+            static constexpr uint16_t MAX_DATAGRAM_SIZE = 8192;
+            static constexpr uint32_t MIN_BUFFER_SIZE = 2 * MAX_DATAGRAM_SIZE;
             static constexpr uint16_t TIMEOUT_MS = 0;
 
+            // Lines are queued in a fixed size ring buffer and packed, as many as fit, into one datagram. Nothing is
+            // allocated per line. Lines that exceed the configured rate, or do not fit in the buffer anymore, are
+            // dropped and counted. A line longer than a length prefix can describe is split up, and send as
+            // multiple lines.
             class TextChannel : public Core::SocketDatagram
             {
+                private:
+                    // Every line in the ring is preceded by its length.
+                    using LineLength = uint16_t;
+
+                public:
+                    struct Statistics {
+                        uint32_t Lines;
+                        uint32_t Datagrams;
+                        uint32_t Throttled;
+                        uint32_t Overflows;
+                        uint32_t Splits;
+                    };
+
                 public:
+                    TextChannel(const TextChannel&) = delete;
+                    TextChannel& operator=(const TextChannel&) = delete;
+
                     TextChannel()
-                        : Core::SocketDatagram(false, Core::NodeId().Origin(), Core::NodeId(), MAX_BUFFER_LENGHT, 0)
-                        , _sendQueue()
+                        : Core::SocketDatagram(false, Core::NodeId().Origin(), Core::NodeId(), MAX_DATAGRAM_SIZE, 0)
+                        , _adminLock()
+                        , _datagramSize(MAX_DATAGRAM_SIZE)
+                        , _buffer(nullptr)
+                        , _capacity(0)
+                        , _head(0)
+                        , _filled(0)
                         , _offset(0)
+                        , _byteRate(0)
+                        , _lineRate(0)
+                        , _byteBudget(0)
+                        , _lineBudget(0)
+                        , _lastRefill(0)
+                        , _statistics()
+                        , _terminator()
                     {
+                        ::memset(&_statistics, 0, sizeof(_statistics));
                     }
-                    virtual ~TextChannel()
+                    ~TextChannel() override
                     {
-                        _sendQueue.clear();
-                        _offset = 0;
                         Close(Core::infinite);
+
+                        if (_buffer != nullptr) {
+                            delete[] _buffer;
+                        }
                     }
 
                     void SetDestination(const string& binding, const uint16_t &port)
@@ -372,13 +567,72 @@ namespace Plugin
 
                         Open(TIMEOUT_MS);
                     }
+                    // A rate of 0 means unlimited.
+                    void Configure(const uint16_t datagramSize, const uint32_t bufferSize, const uint32_t byteRate, const uint32_t lineRate)
+                    {
+                        _adminLock.Lock();
+
+                        ASSERT(_filled == 0);
+
+                        _datagramSize = std::min(std::max(datagramSize, static_cast<uint16_t>(64)), static_cast<uint16_t>(MAX_DATAGRAM_SIZE));
+
+                        if (_buffer != nullptr) {
+                            delete[] _buffer;
+                        }
+
+                        _capacity = std::max(bufferSize, static_cast<uint32_t>(MIN_BUFFER_SIZE));
+                        _buffer = new uint8_t[_capacity];
+                        _head = 0;
+                        _filled = 0;
+                        _offset = 0;
+                        _byteRate = byteRate;
+                        _lineRate = lineRate;
+                        _byteBudget = byteRate;
+                        _lineBudget = lineRate;
+                        _lastRefill = Core::Time::Now().Ticks();
+
+                        _adminLock.Unlock();
+                    }
+                    void Snapshot(Statistics& info) const
+                    {
+                        _adminLock.Lock();
+                        info = _statistics;
+                        _adminLock.Unlock();
+                    }
 
                     void NewLine(const string& text)
                     {
+                        static constexpr uint32_t MaxPart = std::numeric_limits<LineLength>::max();
+
+                        const uint32_t length(static_cast<uint32_t>(text.length() * sizeof(TCHAR)));
+                        const uint32_t parts(length > MaxPart ? ((length + MaxPart - 1) / MaxPart) : 1);
+                        const uint8_t* data(reinterpret_cast<const uint8_t*>(text.c_str()));
+
                         _adminLock.Lock();
 
-                        _sendQueue.emplace_back(text);
-                        bool trigger = (_sendQueue.size() == 1);
+                        bool trigger = (_filled == 0);
+
+                        // A line is queued as a whole or not at all, also if it has to be split up.
+                        if (Allowed(length) == false) {
+                            _statistics.Throttled++;
+                            trigger = false;
+                        } else if ((_capacity - _filled) < (length + (parts * sizeof(LineLength)))) {
+                            _statistics.Overflows++;
+                            trigger = false;
+                        } else {
+                            uint32_t offset = 0;
+
+                            do {
+                                const LineLength size(static_cast<LineLength>(std::min(length - offset, MaxPart)));
+
+                                Write(reinterpret_cast<const uint8_t*>(&size), sizeof(size));
+                                Write(&data[offset], size);
+                                offset += size;
+                            } while (offset < length);
+
+                            _statistics.Lines++;
+                            _statistics.Splits += (parts > 1 ? 1 : 0);
+                        }
 
                         _adminLock.Unlock();
 
@@ -388,46 +642,94 @@ namespace Plugin
                         }
                     }
                 private:
+                    // Token bucket, refilled every second.
+                    bool Allowed(const uint32_t length)
+                    {
+                        if ((_byteRate != 0) || (_lineRate != 0)) {
+                            const uint64_t now(Core::Time::Now().Ticks());
+
+                            if ((now - _lastRefill) >= (Core::Time::TicksPerMillisecond * 1000)) {
+                                _byteBudget = _byteRate;
+                                _lineBudget = _lineRate;
+                                _lastRefill = now;
+                            }
+                        }
+
+                        bool allowed = (((_byteRate == 0) || (_byteBudget >= length)) && ((_lineRate == 0) || (_lineBudget > 0)));
+
+                        if (allowed == true) {
+                            _byteBudget -= (_byteRate != 0 ? length : 0);
+                            _lineBudget -= (_lineRate != 0 ? 1 : 0);
+                        }
+
+                        return (allowed);
+                    }
+                    void Write(const uint8_t data[], const uint32_t length)
+                    {
+                        const uint32_t tail((_head + _filled) % _capacity);
+                        const uint32_t first(std::min(length, _capacity - tail));
+
+                        ::memcpy(&_buffer[tail], data, first);
+                        ::memcpy(_buffer, &data[first], length - first);
+
+                        _filled += length;
+                    }
+                    void Read(uint8_t data[], const uint32_t offset, const uint32_t length) const
+                    {
+                        const uint32_t start((_head + offset) % _capacity);
+                        const uint32_t first(std::min(length, _capacity - start));
+
+                        ::memcpy(data, &_buffer[start], first);
+                        ::memcpy(&data[first], _buffer, length - first);
+                    }
+                    void Consume(const uint32_t length)
+                    {
+                        _head = (_head + length) % _capacity;
+                        _filled -= length;
+                    }
+
                     // Methods to extract and insert data into the socket buffers
-                    uint16_t SendData(uint8_t *dataFrame, const uint16_t maxSendSize) override
+                    uint16_t SendData(uint8_t *dataFrame, const uint16_t maxFrameSize) override
                     {
+                        const uint16_t markerSize(static_cast<uint16_t>(_terminator.SizeOf() * sizeof(TCHAR)));
                         uint16_t result = 0;
+                        bool full = false;
 
                         _adminLock.Lock();
 
-                        if (_offset == static_cast<uint32_t>(~0)) {
-                            // We are done with this entry it has been sent!!! discard it.
-                            _sendQueue.pop_front();
-                            _offset = 0;
-                        }
+                        const uint16_t maxSendSize(std::min(maxFrameSize, _datagramSize));
 
-                        if (_sendQueue.size() > 0) {
-                            const string& sendObject = _sendQueue.front();
+                        while ((full == false) && (_filled > 0)) {
+                            LineLength length;
 
-                            // Do we still need to send data from the text..
-                            if (_offset < (sendObject.size() * sizeof(TCHAR))) {
-                                result = (((sendObject.size() * sizeof(TCHAR)) - _offset) > maxSendSize ? maxSendSize : ((sendObject.size() * sizeof(TCHAR)) - _offset));
+                            Read(reinterpret_cast<uint8_t*>(&length), 0, sizeof(length));
 
-                                _offset += SendCharacters(dataFrame, &(sendObject.c_str()[(_offset / sizeof(TCHAR))]), (_offset % sizeof(TCHAR)), result);
-                            }
+                            const uint32_t remaining(length - _offset);
 
-                            // See if we can write the closing marker
-                            if ((maxSendSize != result) && (_offset >= (sendObject.size() * sizeof(TCHAR))) && (_offset < ((sendObject.size() + (_terminator.SizeOf())) * sizeof(TCHAR)))) {
-                                uint8_t markerSize = (static_cast<uint8_t>(_terminator.SizeOf()) * sizeof(TCHAR));
-                                uint8_t markerOffset = ((sendObject.size() * sizeof(TCHAR)) - _offset);
-                                uint16_t size = ((markerSize - markerOffset) > (maxSendSize - result) ? (maxSendSize - result) : (markerSize - markerOffset));
+                            if ((result + remaining + markerSize) <= maxSendSize) {
+                                // The (rest of the) line fits, add it including its terminator.
+                                Read(&dataFrame[result], sizeof(length) + _offset, remaining);
+                                result += static_cast<uint16_t>(remaining);
+                                ::memcpy(&dataFrame[result], _terminator.Marker(), markerSize);
+                                result += markerSize;
 
-                                _offset += SendCharacters(&(dataFrame[result]), &(_terminator.Marker()[(markerOffset / sizeof(TCHAR))]), (markerOffset % sizeof(TCHAR)), size);
-                                result += size;
+                                Consume(sizeof(length) + length);
+                                _offset = 0;
+                            } else if (result == 0) {
+                                // The line does not even fit an empty datagram, send it in parts.
+                                const uint16_t part(maxSendSize - markerSize);
 
-                                if ((size + markerOffset) == markerSize) {
-                                    // Report as completed on the next run
-                                    _offset = static_cast<uint32_t>(~0);
-                                }
+                                Read(dataFrame, sizeof(length) + _offset, part);
+                                result = part;
+                                _offset += part;
+                                full = true;
+                            } else {
+                                full = true;
                             }
+                        }
 
-                            // If we went through this entry we must have processed something....
-                            ASSERT(result != 0);
+                        if (result != 0) {
+                            _statistics.Datagrams++;
                         }
 
                         _adminLock.Unlock();
@@ -444,18 +746,20 @@ namespace Plugin
                     {
                     }
 
-                    uint16_t SendCharacters(uint8_t *dataFrame, const TCHAR stream[], const uint8_t delta, const uint16_t total)
-                    {
-                        ASSERT(delta == 0);
-                        // Copying from an aligned position..
-                        ::memcpy(dataFrame, stream, total);
-                        return (total);
-                    }
-
                 private:
-                    Core::CriticalSection _adminLock;
-                    std::list<string> _sendQueue;
+                    mutable Core::CriticalSection _adminLock;
+                    uint16_t _datagramSize;
+                    uint8_t* _buffer;
+                    uint32_t _capacity;
+                    uint32_t _head;
+                    uint32_t _filled;
                     uint32_t _offset;
+                    uint32_t _byteRate;
+                    uint32_t _lineRate;
+                    uint32_t _byteBudget;
+                    uint32_t _lineBudget;
+                    uint64_t _lastRefill;
+                    Statistics _statistics;
                     Core::TerminatorCarriageReturn _terminator;
             };
 
@@ -487,6 +791,31 @@ namespace Plugin
                TextChannel &_parent;
             };
 
+            class Statistics : public Core::JSON::Container {
+                private:
+                    Statistics(const Statistics &) = delete;
+                    Statistics &operator=(const Statistics &) = delete;
+
+                public:
+                    Statistics()
+                        : Lines(0), Datagrams(0), Throttled(0), Overflows(0), Splits(0)
+                    {
+                        Add(_T("lines"), &Lines);
+                        Add(_T("datagrams"), &Datagrams);
+                        Add(_T("throttled"), &Throttled);
+                        Add(_T("overflows"), &Overflows);
+                        Add(_T("splits"), &Splits);
+                    }
+                    ~Statistics() override {}
+
+                public:
+                    Core::JSON::DecUInt32 Lines;
+                    Core::JSON::DecUInt32 Datagrams;
+                    Core::JSON::DecUInt32 Throttled;
+                    Core::JSON::DecUInt32 Overflows;
+                    Core::JSON::DecUInt32 Splits;
+            };
+
             class Config : public Core::JSON::Container {
                 private:
                     Config(const Config &) = delete;
@@ -525,18 +854,28 @@ namespace Plugin
 
                 public:
                     Config()
-                        : FilePath(_T("/var/log/messages")), FullFile(false), Destination()
+                        : FilePath(_T("/var/log/messages")), FilePaths(), FullFile(false), Destination(), DatagramSize(1400), BufferSize(64), ByteRate(0), LineRate(0)
                     {
                         Add(_T("filepath"), &FilePath);
+                        Add(_T("filepaths"), &FilePaths);
                         Add(_T("fullfile"), &FullFile);
                         Add(_T("destination"), &Destination);
+                        Add(_T("datagramsize"), &DatagramSize);
+                        Add(_T("buffersize"), &BufferSize);
+                        Add(_T("byterate"), &ByteRate);
+                        Add(_T("linerate"), &LineRate);
                     }
                     ~Config() override {}
 
                 public:
                     Core::JSON::String FilePath;
+                    Core::JSON::ArrayType<Core::JSON::String> FilePaths; // Additional files to tail.
                     Core::JSON::Boolean FullFile;
                     NetworkNode Destination;
+                    Core::JSON::DecUInt16 DatagramSize; // Maximum payload of a datagram, keep it below the MTU.
+                    Core::JSON::DecUInt32 BufferSize; // In KB, at least 16, lines that do not fit anymore are dropped.
+                    Core::JSON::DecUInt32 ByteRate; // Bytes per second, 0 is unlimited.
+                    Core::JSON::DecUInt32 LineRate; // Lines per second, 0 is unlimited.
             };
 
             public:
@@ -544,7 +883,7 @@ namespace Plugin
                 FileTransfer &operator=(const FileTransfer &) = delete;
                 FileTransfer()
                     : _logOutput()
-                    , _observer()
+                    , _observers()
                     , _fileUpdate(&_logOutput)
                 {
                 }
@@ -563,7 +902,7 @@ namespace Plugin
 
             private:
                 TextChannel _logOutput;
-                FileObserver _observer;
+                std::list<FileObserver> _observers;
                 OnChangeFile _fileUpdate;
     };
 } // namespace Plugin
@@ -0,0 +1,241 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Latency histogram with logarithmic buckets, in the spirit of HdrHistogram. Every power of two is split in
+    // SubBuckets linear buckets, so any recorded value is known within 1/SubBuckets (~3%), whatever its
+    // magnitude. Values below SubBuckets are counted exactly. Recording is a handful of shifts and an increment,
+    // the memory is fixed (Buckets counters) and does not depend on the number of samples.
+    class Histogram {
+    private:
+        static constexpr uint8_t SubBits = 5;
+        static constexpr uint32_t SubBuckets = (1 << SubBits);
+        // Anything above 2^MaxBits microseconds (~67 seconds) ends up in the last bucket.
+        static constexpr uint8_t MaxBits = 26;
+        static constexpr uint32_t Buckets = (MaxBits - SubBits + 2) * SubBuckets;
+
+    public:
+        Histogram(const Histogram&) = delete;
+        Histogram& operator=(const Histogram&) = delete;
+
+        Histogram()
+        {
+            Reset();
+        }
+        ~Histogram()
+        {
+        }
+
+    public:
+        inline uint32_t Count() const
+        {
+            return (_count);
+        }
+        inline uint32_t Minimum() const
+        {
+            return (_count != 0 ? _minimum : 0);
+        }
+        inline uint32_t Maximum() const
+        {
+            return (_maximum);
+        }
+        void Reset()
+        {
+            ::memset(_buckets, 0, sizeof(_buckets));
+            _count = 0;
+            _minimum = ~0;
+            _maximum = 0;
+        }
+        void Add(const uint32_t value)
+        {
+            _buckets[Index(value)]++;
+            _count++;
+
+            if (value < _minimum) {
+                _minimum = value;
+            }
+            if (value > _maximum) {
+                _maximum = value;
+            }
+        }
+        // Merge the samples of another histogram into this one.
+        void Add(const Histogram& other)
+        {
+            for (uint32_t index = 0; index < Buckets; index++) {
+                _buckets[index] += other._buckets[index];
+            }
+
+            _count += other._count;
+
+            if (other._minimum < _minimum) {
+                _minimum = other._minimum;
+            }
+            if (other._maximum > _maximum) {
+                _maximum = other._maximum;
+            }
+        }
+        // The value below which the given fraction (in per mille) of the samples lies. The upper bound of the
+        // bucket is reported, so the result is never below the real percentile.
+        uint32_t Percentile(const uint16_t perMille) const
+        {
+            uint32_t result = 0;
+
+            if (_count != 0) {
+                const uint32_t threshold = static_cast<uint32_t>(((static_cast<uint64_t>(_count) * perMille) + 999) / 1000);
+                uint32_t total = 0;
+                uint32_t index = 0;
+
+                while ((index < (Buckets - 1)) && ((total + _buckets[index]) < threshold)) {
+                    total += _buckets[index];
+                    index++;
+                }
+
+                // The last bucket is open ended, the maximum is the best estimate there.
+                result = (index == (Buckets - 1) ? _maximum : std::min(UpperBound(index), _maximum));
+            }
+
+            return (result);
+        }
+
+    private:
+        static uint8_t MostSignificantBit(uint32_t value)
+        {
+            uint8_t result = 0;
+
+            while (value >>= 1) {
+                result++;
+            }
+
+            return (result);
+        }
+        static uint32_t Index(const uint32_t value)
+        {
+            uint32_t result;
+
+            if (value < SubBuckets) {
+                result = value;
+            } else {
+                const uint8_t shift = std::min(MostSignificantBit(value), static_cast<uint8_t>(MaxBits)) - SubBits;
+
+                result = std::min(((shift + 1) * SubBuckets) + ((value >> shift) - SubBuckets), Buckets - 1);
+            }
+
+            return (result);
+        }
+        static uint32_t UpperBound(const uint32_t index)
+        {
+            uint32_t result;
+
+            if (index < SubBuckets) {
+                result = index;
+            } else {
+                const uint32_t shift = (index / SubBuckets) - 1;
+
+                result = (((index % SubBuckets) + SubBuckets + 1) << shift) - 1;
+            }
+
+            return (result);
+        }
+
+    private:
+        uint32_t _buckets[Buckets];
+        uint32_t _count;
+        uint32_t _minimum;
+        uint32_t _maximum;
+    };
+
+    // Summary of a histogram as reported over JSON-RPC, all values in microseconds.
+    class PercentileData : public Core::JSON::Container {
+    public:
+        PercentileData()
+            : Core::JSON::Container()
+        {
+            Init();
+        }
+        PercentileData(const PercentileData& copy)
+            : Core::JSON::Container()
+            , Count(copy.Count)
+            , Minimum(copy.Minimum)
+            , Maximum(copy.Maximum)
+            , P50(copy.P50)
+            , P90(copy.P90)
+            , P99(copy.P99)
+            , P999(copy.P999)
+        {
+            Init();
+        }
+        ~PercentileData() override
+        {
+        }
+
+        PercentileData& operator=(const PercentileData& rhs)
+        {
+            Count = rhs.Count;
+            Minimum = rhs.Minimum;
+            Maximum = rhs.Maximum;
+            P50 = rhs.P50;
+            P90 = rhs.P90;
+            P99 = rhs.P99;
+            P999 = rhs.P999;
+
+            return (*this);
+        }
+
+    private:
+        void Init()
+        {
+            Add(_T("count"), &Count);
+            Add(_T("minimum"), &Minimum);
+            Add(_T("maximum"), &Maximum);
+            Add(_T("p50"), &P50);
+            Add(_T("p90"), &P90);
+            Add(_T("p99"), &P99);
+            Add(_T("p999"), &P999);
+        }
+
+    public:
+        void Set(const Histogram& histogram)
+        {
+            Count = histogram.Count();
+            Minimum = histogram.Minimum();
+            Maximum = histogram.Maximum();
+            P50 = histogram.Percentile(500);
+            P90 = histogram.Percentile(900);
+            P99 = histogram.Percentile(990);
+            P999 = histogram.Percentile(999);
+        }
+
+    public:
+        Core::JSON::DecUInt32 Count;
+        Core::JSON::DecUInt32 Minimum;
+        Core::JSON::DecUInt32 Maximum;
+        Core::JSON::DecUInt32 P50;
+        Core::JSON::DecUInt32 P90;
+        Core::JSON::DecUInt32 P99;
+        Core::JSON::DecUInt32 P999;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,558 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LoadGenerator.h"
+
+#include <interfaces/json/JsonData_PerformanceMonitor.h>
+#include <websocket/websocket.h>
+
+#include <cmath>
+#include <sys/resource.h>
+
+namespace WPEFramework {
+
+ENUM_CONVERSION_BEGIN(Plugin::LoadGenerator::transport)
+
+    { Plugin::LoadGenerator::transport::JSONRPC, _TXT("jsonrpc") },
+    { Plugin::LoadGenerator::transport::COMRPC, _TXT("comrpc") },
+
+    ENUM_CONVERSION_END(Plugin::LoadGenerator::transport);
+
+ENUM_CONVERSION_BEGIN(Plugin::LoadGenerator::distribution)
+
+    { Plugin::LoadGenerator::distribution::FIXED, _TXT("fixed") },
+    { Plugin::LoadGenerator::distribution::UNIFORM, _TXT("uniform") },
+    { Plugin::LoadGenerator::distribution::LOGARITHMIC, _TXT("logarithmic") },
+
+    ENUM_CONVERSION_END(Plugin::LoadGenerator::distribution);
+
+namespace Plugin {
+
+    enum echo {
+        SEND,
+        RECEIVE,
+        EXCHANGE,
+        NONE
+    };
+
+    static echo EchoMethod(const string& method)
+    {
+        return (method == _T("send") ? SEND : method == _T("receive") ? RECEIVE : method == _T("exchange") ? EXCHANGE : NONE);
+    }
+
+    static void Fill(std::vector<uint8_t>& buffer, const uint32_t size)
+    {
+        static const uint8_t pattern[] = { 0x00, 0x66, 0xBB, 0xEE };
+
+        buffer.resize(size);
+
+        for (uint32_t index = 0; index < size; index++) {
+            buffer[index] = pattern[index % sizeof(pattern)];
+        }
+    }
+
+    static uint64_t ProcessTime()
+    {
+        struct rusage usage;
+
+        ::getrusage(RUSAGE_SELF, &usage);
+
+        return ((static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000) + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+    }
+
+    // Every client has a WebSocket connection of its own to the given endpoint. The JSON-RPC link of the framework
+    // is not used: it shares a single connection between all links in the process, so the clients would queue
+    // behind each other, and it only finds the framework through the environment.
+    class LoadGenerator::JSONRPCTarget : public LoadGenerator::ITarget {
+    private:
+        class Factory {
+        public:
+            Factory(const Factory&) = delete;
+            Factory& operator=(const Factory&) = delete;
+
+            Factory()
+                : _messages(2)
+            {
+            }
+            ~Factory()
+            {
+            }
+
+        public:
+            Core::ProxyType<Core::JSON::IElement> Element(const string& identifier VARIABLE_IS_NOT_USED)
+            {
+                return (Core::ProxyType<Core::JSON::IElement>(_messages.Element()));
+            }
+
+        private:
+            Core::ProxyPoolType<Core::JSONRPC::Message> _messages;
+        };
+
+        class Channel : public Core::StreamJSONType<Web::WebSocketClientType<Core::SocketStream>, Factory&, Core::JSON::IElement> {
+        private:
+            typedef Core::StreamJSONType<Web::WebSocketClientType<Core::SocketStream>, Factory&, Core::JSON::IElement> BaseClass;
+
+        public:
+            Channel() = delete;
+            Channel(const Channel&) = delete;
+            Channel& operator=(const Channel&) = delete;
+
+            Channel(JSONRPCTarget& parent, const Core::NodeId& remoteNode)
+                : BaseClass(5, parent._factory, _T("/jsonrpc"), _T("JSON"), _T(""), _T(""), false, false, false, remoteNode.AnyInterface(), remoteNode, 256, 256)
+                , _parent(parent)
+            {
+            }
+            ~Channel() override
+            {
+                this->Close(Core::infinite);
+            }
+
+        public:
+            void Received(Core::ProxyType<Core::JSON::IElement>& element) override
+            {
+                _parent.Received(element);
+            }
+            void Send(Core::ProxyType<Core::JSON::IElement>& element VARIABLE_IS_NOT_USED) override
+            {
+            }
+            void StateChange() override
+            {
+            }
+            bool IsIdle() const override
+            {
+                return (true);
+            }
+
+        private:
+            JSONRPCTarget& _parent;
+        };
+
+    public:
+        JSONRPCTarget() = delete;
+        JSONRPCTarget(const JSONRPCTarget&) = delete;
+        JSONRPCTarget& operator=(const JSONRPCTarget&) = delete;
+
+        JSONRPCTarget(const Core::NodeId& remoteNode, const string& callsign, const string& method, const string& parameters, const uint32_t timeout)
+            : _lock()
+            , _factory()
+            , _channel(*this, remoteNode)
+            , _designator(callsign + '.' + method)
+            , _echo(EchoMethod(method))
+            , _timeout(timeout)
+            , _sequence(0)
+            , _message(Core::ProxyType<Core::JSONRPC::Message>::Create())
+            , _answer()
+            , _answered(false, true)
+            , _buffer()
+            , _request()
+            , _response()
+            , _size()
+            , _parameters()
+            , _result(false)
+        {
+            if (parameters.empty() == false) {
+                _parameters.FromString(parameters);
+            }
+        }
+        ~JSONRPCTarget() override
+        {
+        }
+
+    public:
+        void Prepare(const uint32_t size) override
+        {
+            // Connecting is not part of the measured time.
+            if (_channel.IsOpen() == false) {
+                _channel.Open(_timeout);
+            }
+
+            if ((_echo == SEND) || (_echo == EXCHANGE)) {
+                string encoded;
+
+                Fill(_buffer, size);
+                Core::ToString(_buffer.data(), size, false, encoded);
+
+                _request.Data = encoded;
+                _request.Length = static_cast<uint16_t>(encoded.length());
+                _request.Duration = 0;
+            } else if (_echo == RECEIVE) {
+                _size = size;
+            }
+        }
+        uint32_t Call() override
+        {
+            uint32_t result;
+
+            switch (_echo) {
+            case SEND: {
+                Core::JSON::DecUInt32 received;
+                result = Invoke(_request, received);
+                break;
+            }
+            case RECEIVE:
+                result = Invoke(_size, _response);
+                break;
+            case EXCHANGE:
+                result = Invoke(_request, _response);
+                break;
+            default:
+                result = Invoke(_parameters, _result);
+                break;
+            }
+
+            return (result);
+        }
+
+    private:
+        uint32_t Invoke(const Core::JSON::IElement& parameters, Core::JSON::IElement& response)
+        {
+            uint32_t result = Core::ERROR_CONNECTION_CLOSED;
+
+            if (_channel.IsOpen() == true) {
+                string text;
+
+                parameters.ToString(text);
+
+                _lock.Lock();
+                _message->Clear();
+                _message->Id = ++_sequence;
+                _message->Designator = _designator;
+                _message->Parameters = text;
+                _answer.Release();
+                _answered.ResetEvent();
+                _lock.Unlock();
+
+                _channel.Submit(Core::ProxyType<Core::JSON::IElement>(_message));
+
+                if (_answered.Lock(_timeout) != Core::ERROR_NONE) {
+                    result = Core::ERROR_TIMEDOUT;
+                } else {
+                    _lock.Lock();
+
+                    if (_answer->Error.IsSet() == true) {
+                        result = Core::ERROR_GENERAL;
+                    } else {
+                        response.FromString(_answer->Result.Value());
+                        result = Core::ERROR_NONE;
+                    }
+
+                    _answer.Release();
+
+                    _lock.Unlock();
+                }
+            }
+
+            return (result);
+        }
+        void Received(Core::ProxyType<Core::JSON::IElement>& element)
+        {
+            Core::ProxyType<Core::JSONRPC::Message> message(element);
+
+            _lock.Lock();
+
+            // Answers to calls that already timed out are dropped.
+            if ((message.IsValid() == true) && (message->Id.IsSet() == true) && (message->Id.Value() == _sequence)) {
+                _answer = message;
+                _answered.SetEvent();
+            }
+
+            _lock.Unlock();
+        }
+
+    private:
+        Core::CriticalSection _lock;
+        Factory _factory;
+        Channel _channel;
+        const string _designator;
+        const echo _echo;
+        const uint32_t _timeout;
+        uint32_t _sequence;
+        Core::ProxyType<Core::JSONRPC::Message> _message;
+        Core::ProxyType<Core::JSONRPC::Message> _answer;
+        Core::Event _answered;
+        std::vector<uint8_t> _buffer;
+        JsonData::PerformanceMonitor::BufferInfo _request;
+        JsonData::PerformanceMonitor::BufferInfo _response;
+        Core::JSON::DecUInt32 _size;
+        Core::JSON::VariantContainer _parameters;
+        // Not quoted, so it takes any JSON value as the result.
+        Core::JSON::String _result;
+    };
+
+    class LoadGenerator::COMRPCTarget : public LoadGenerator::ITarget {
+    public:
+        COMRPCTarget() = delete;
+        COMRPCTarget(const COMRPCTarget&) = delete;
+        COMRPCTarget& operator=(const COMRPCTarget&) = delete;
+
+        COMRPCTarget(Exchange::IPerformance* target, const string& method)
+            : _target(target)
+            , _echo(EchoMethod(method))
+            , _buffer()
+            , _size(0)
+        {
+            ASSERT(_target != nullptr);
+            ASSERT(_echo != NONE);
+        }
+        ~COMRPCTarget() override
+        {
+            _target->Release();
+        }
+
+    public:
+        void Prepare(const uint32_t size) override
+        {
+            // The interface carries at most 64KB per call.
+            _size = static_cast<uint16_t>(std::min(size, static_cast<uint32_t>(0xFFFF)));
+
+            Fill(_buffer, _size);
+        }
+        uint32_t Call() override
+        {
+            uint32_t result = Core::ERROR_NONE;
+            uint16_t length = _size;
+
+            switch (_echo) {
+            case SEND:
+                // Returns the number of bytes received, not an error code.
+                _target->Send(_size, _buffer.data());
+                break;
+            case RECEIVE:
+                result = _target->Receive(length, _buffer.data());
+                break;
+            default:
+                result = _target->Exchange(length, _buffer.data(), _size);
+                break;
+            }
+
+            return (result);
+        }
+
+    private:
+        Exchange::IPerformance* _target;
+        const echo _echo;
+        std::vector<uint8_t> _buffer;
+        uint16_t _size;
+    };
+
+    uint32_t LoadGenerator::Client::Worker()
+    {
+        for (uint32_t call = 0; (call < _parent._calls) && (_parent._aborted == false); call++) {
+            const uint32_t size = _parent.Size(Random());
+
+            _target->Prepare(size);
+
+            const uint64_t start = Core::Time::Now().Ticks();
+
+            if (_target->Call() == Core::ERROR_NONE) {
+                _latency.Add(static_cast<uint32_t>(Core::Time::Now().Ticks() - start));
+                _bytes += size;
+            } else {
+                _errors++;
+            }
+        }
+
+        // Report before blocking: once blocked, the client may be deleted at any moment.
+        _parent.Completed();
+
+        Block();
+
+        return (Core::infinite);
+    }
+
+    LoadGenerator::LoadGenerator(ICallback& callback)
+        : _adminLock()
+        , _callback(callback)
+        , _clients()
+        , _report()
+        , _calls(0)
+        , _minimum(0)
+        , _maximum(0)
+        , _distribution(FIXED)
+        , _pending(0)
+        , _aborted(false)
+        , _start(0)
+        , _cpu(0)
+    {
+    }
+
+    LoadGenerator::~LoadGenerator()
+    {
+        Stop();
+    }
+
+    uint32_t LoadGenerator::Start(PluginHost::IShell* service, const Settings& settings)
+    {
+        uint32_t result = Core::ERROR_NONE;
+        const string callsign(settings.Callsign.IsSet() == true ? settings.Callsign.Value() : service->Callsign());
+        const string& method(settings.Method.Value());
+        const uint8_t clients(settings.Clients.Value());
+
+        _adminLock.Lock();
+
+        if (_pending != 0) {
+            result = Core::ERROR_INPROGRESS;
+        } else if ((clients == 0) || (settings.Calls.Value() == 0) || (settings.Minimum.Value() > settings.Maximum.Value()) || ((settings.Transport.Value() == COMRPC) && (EchoMethod(method) == NONE))) {
+            result = Core::ERROR_BAD_REQUEST;
+        } else {
+            Clear();
+
+            if (settings.Transport.Value() == JSONRPC) {
+                // The framework this plugin runs in.
+                Core::URL url(service->Accessor());
+                const string host(url.Host().IsSet() == true ? url.Host().Value() : string(_T("127.0.0.1")));
+                const Core::NodeId endpoint(host.c_str(), (url.Port().IsSet() == true ? url.Port().Value() : 80));
+
+                for (uint8_t index = 0; index < clients; index++) {
+                    _clients.push_back(new Client(*this, new JSONRPCTarget(endpoint, callsign, method, settings.Parameters.Value(), settings.Timeout.Value()), index + 1));
+                }
+            } else {
+                for (uint8_t index = 0; (index < clients) && (result == Core::ERROR_NONE); index++) {
+                    Exchange::IPerformance* target = service->QueryInterfaceByCallsign<Exchange::IPerformance>(callsign);
+
+                    if (target == nullptr) {
+                        result = Core::ERROR_UNAVAILABLE;
+                    } else {
+                        _clients.push_back(new Client(*this, new COMRPCTarget(target, method), index + 1));
+                    }
+                }
+
+                if (result != Core::ERROR_NONE) {
+                    Clear();
+                }
+            }
+        }
+
+        if (result == Core::ERROR_NONE) {
+            _calls = settings.Calls.Value();
+            _minimum = settings.Minimum.Value();
+            _maximum = settings.Maximum.Value();
+            _distribution = settings.Distribution.Value();
+            _pending = clients;
+            _aborted = false;
+
+            _report.Clear();
+            _report.Running = true;
+            _report.Transport = settings.Transport.Value();
+            _report.Callsign = callsign;
+            _report.Method = method;
+            _report.Clients = clients;
+
+            _cpu = ProcessTime();
+            _start = Core::Time::Now().Ticks();
+
+            for (Client* client : _clients) {
+                client->Run();
+            }
+        }
+
+        _adminLock.Unlock();
+
+        return (result);
+    }
+
+    void LoadGenerator::Stop()
+    {
+        _adminLock.Lock();
+        _aborted = true;
+        _adminLock.Unlock();
+
+        // The clients finish their current call, and are gone after this.
+        Clear();
+    }
+
+    void LoadGenerator::Get(Report& report) const
+    {
+        _adminLock.Lock();
+
+        report.FromString(_report.ToString());
+
+        _adminLock.Unlock();
+    }
+
+    uint32_t LoadGenerator::Size(const uint32_t random) const
+    {
+        uint32_t result = _minimum;
+
+        if (_minimum != _maximum) {
+            if (_distribution == UNIFORM) {
+                result = _minimum + (random % (_maximum - _minimum + 1));
+            } else if (_distribution == LOGARITHMIC) {
+                // Uniform over the exponent: as many calls between 16 and 32 bytes as between 16KB and 32KB.
+                const double low = std::log(static_cast<double>(std::max(_minimum, static_cast<uint32_t>(1))));
+                const double high = std::log(static_cast<double>(_maximum));
+                const double fraction = static_cast<double>(random) / static_cast<double>(~static_cast<uint32_t>(0));
+
+                result = std::min(static_cast<uint32_t>(std::exp(low + ((high - low) * fraction))), _maximum);
+            }
+        }
+
+        return (result);
+    }
+
+    void LoadGenerator::Completed()
+    {
+        _adminLock.Lock();
+
+        ASSERT(_pending != 0);
+
+        if (--_pending == 0) {
+            const uint64_t duration = Core::Time::Now().Ticks() - _start;
+            const uint64_t cpu = ProcessTime() - _cpu;
+            Histogram latency;
+            uint32_t errors = 0;
+            uint64_t bytes = 0;
+
+            for (const Client* client : _clients) {
+                latency.Add(client->Latency());
+                errors += client->Errors();
+                bytes += client->Bytes();
+            }
+
+            _report.Running = false;
+            _report.Calls = latency.Count();
+            _report.Errors = errors;
+            _report.Bytes = bytes;
+            _report.Duration = static_cast<uint32_t>(duration / Core::Time::TicksPerMillisecond);
+            _report.Throughput = static_cast<uint32_t>(duration != 0 ? (static_cast<uint64_t>(latency.Count()) * 1000 * Core::Time::TicksPerMillisecond) / duration : 0);
+            _report.Cpu = static_cast<uint32_t>((latency.Count() + errors) != 0 ? cpu / (latency.Count() + errors) : 0);
+            _report.Latency.Set(latency);
+
+            if (_aborted == false) {
+                _callback.Completed(_report);
+            }
+        }
+
+        _adminLock.Unlock();
+    }
+
+    void LoadGenerator::Clear()
+    {
+        _adminLock.Lock();
+        ClientList clients;
+        clients.swap(_clients);
+        _adminLock.Unlock();
+
+        for (Client* client : clients) {
+            delete client;
+        }
+    }
+
+} // namespace Plugin
+} // namespace WPEFramework
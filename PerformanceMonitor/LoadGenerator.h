@@ -0,0 +1,249 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Histogram.h"
+#include "Module.h"
+
+#include <atomic>
+#include <interfaces/IPerformance.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Drives a number of concurrent clients, each on its own thread, calling a method as fast as it is answered.
+    // Over JSON-RPC every client has its own link to the framework WebSocket, over COM-RPC every client uses the
+    // Exchange::IPerformance interface of the target (a real COM-RPC proxy if that plugin runs out of process).
+    // The echo methods (send, receive, exchange) get a payload drawn from the configured size distribution; any
+    // other JSON-RPC method is called with the fixed parameters given.
+    class LoadGenerator {
+    public:
+        enum transport {
+            JSONRPC,
+            COMRPC
+        };
+        enum distribution {
+            FIXED,
+            UNIFORM,
+            LOGARITHMIC
+        };
+
+        class Settings : public Core::JSON::Container {
+        public:
+            Settings(const Settings&) = delete;
+            Settings& operator=(const Settings&) = delete;
+
+            Settings()
+                : Core::JSON::Container()
+                , Transport(JSONRPC)
+                , Callsign()
+                , Method(_T("exchange"))
+                , Parameters()
+                , Clients(4)
+                , Calls(1000)
+                , Minimum(64)
+                , Maximum(64)
+                , Distribution(FIXED)
+                , Timeout(1000)
+            {
+                Add(_T("transport"), &Transport);
+                Add(_T("callsign"), &Callsign);
+                Add(_T("method"), &Method);
+                Add(_T("parameters"), &Parameters);
+                Add(_T("clients"), &Clients);
+                Add(_T("calls"), &Calls);
+                Add(_T("minimum"), &Minimum);
+                Add(_T("maximum"), &Maximum);
+                Add(_T("distribution"), &Distribution);
+                Add(_T("timeout"), &Timeout);
+            }
+            ~Settings() override
+            {
+            }
+
+        public:
+            Core::JSON::EnumType<transport> Transport;
+            Core::JSON::String Callsign; // Defaults to this plugin
+            Core::JSON::String Method;
+            Core::JSON::String Parameters; // JSON parameters for methods other than the echo methods
+            Core::JSON::DecUInt8 Clients;
+            Core::JSON::DecUInt32 Calls; // Per client
+            Core::JSON::DecUInt32 Minimum; // Payload size in bytes
+            Core::JSON::DecUInt32 Maximum;
+            Core::JSON::EnumType<distribution> Distribution;
+            Core::JSON::DecUInt32 Timeout; // Time in milliseconds to wait for an answer
+        };
+
+        class Report : public Core::JSON::Container {
+        public:
+            Report(const Report&) = delete;
+            Report& operator=(const Report&) = delete;
+
+            Report()
+                : Core::JSON::Container()
+            {
+                Add(_T("running"), &Running);
+                Add(_T("transport"), &Transport);
+                Add(_T("callsign"), &Callsign);
+                Add(_T("method"), &Method);
+                Add(_T("clients"), &Clients);
+                Add(_T("calls"), &Calls);
+                Add(_T("errors"), &Errors);
+                Add(_T("bytes"), &Bytes);
+                Add(_T("duration"), &Duration);
+                Add(_T("throughput"), &Throughput);
+                Add(_T("cpu"), &Cpu);
+                Add(_T("latency"), &Latency);
+            }
+            ~Report() override
+            {
+            }
+
+        public:
+            Core::JSON::Boolean Running;
+            Core::JSON::EnumType<transport> Transport;
+            Core::JSON::String Callsign;
+            Core::JSON::String Method;
+            Core::JSON::DecUInt8 Clients;
+            Core::JSON::DecUInt32 Calls; // Calls answered, all clients together
+            Core::JSON::DecUInt32 Errors;
+            Core::JSON::DecUInt64 Bytes; // Payload bytes of the answered calls
+            Core::JSON::DecUInt32 Duration; // Time in milliseconds
+            Core::JSON::DecUInt32 Throughput; // Calls per second
+            Core::JSON::DecUInt32 Cpu; // CPU time of the whole process in microseconds, per call
+            PercentileData Latency; // Round trip as seen by the clients
+        };
+
+        struct ICallback {
+            virtual ~ICallback() {}
+
+            virtual void Completed(const Report& report) = 0;
+        };
+
+    private:
+        struct ITarget {
+            virtual ~ITarget() {}
+
+            // Prepare the payload for the next call, outside of the measured time.
+            virtual void Prepare(const uint32_t size) = 0;
+            virtual uint32_t Call() = 0;
+        };
+
+        class JSONRPCTarget;
+        class COMRPCTarget;
+
+        class Client : public Core::Thread {
+        public:
+            Client() = delete;
+            Client(const Client&) = delete;
+            Client& operator=(const Client&) = delete;
+
+            Client(LoadGenerator& parent, ITarget* target, const uint32_t seed)
+                : Core::Thread(Core::Thread::DefaultStackSize(), _T("LoadGenerator"))
+                , _parent(parent)
+                , _target(target)
+                , _seed(seed | 1)
+                , _latency()
+                , _errors(0)
+                , _bytes(0)
+            {
+            }
+            ~Client() override
+            {
+                Stop();
+                Wait(Core::Thread::STOPPED, Core::infinite);
+
+                delete _target;
+            }
+
+        public:
+            inline const Histogram& Latency() const
+            {
+                return (_latency);
+            }
+            inline uint32_t Errors() const
+            {
+                return (_errors);
+            }
+            inline uint64_t Bytes() const
+            {
+                return (_bytes);
+            }
+
+        private:
+            uint32_t Worker() override;
+
+            // xorshift, every client has its own sequence, so no locking is needed.
+            inline uint32_t Random()
+            {
+                _seed ^= (_seed << 13);
+                _seed ^= (_seed >> 17);
+                _seed ^= (_seed << 5);
+
+                return (_seed);
+            }
+
+        private:
+            LoadGenerator& _parent;
+            ITarget* _target;
+            uint32_t _seed;
+            Histogram _latency;
+            uint32_t _errors;
+            uint64_t _bytes;
+        };
+
+        typedef std::list<Client*> ClientList;
+
+    public:
+        LoadGenerator() = delete;
+        LoadGenerator(const LoadGenerator&) = delete;
+        LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+        LoadGenerator(ICallback& callback);
+        ~LoadGenerator();
+
+    public:
+        // Starts a run in the background, ICallback::Completed is called with the report once all clients are done.
+        uint32_t Start(PluginHost::IShell* service, const Settings& settings);
+        void Stop();
+        void Get(Report& report) const;
+
+    private:
+        uint32_t Size(const uint32_t random) const;
+        void Completed();
+        void Clear();
+
+    private:
+        mutable Core::CriticalSection _adminLock;
+        ICallback& _callback;
+        ClientList _clients;
+        Report _report;
+        uint32_t _calls;
+        uint32_t _minimum;
+        uint32_t _maximum;
+        distribution _distribution;
+        uint8_t _pending;
+        std::atomic<bool> _aborted; // Polled by the client threads
+        uint64_t _start;
+        uint64_t _cpu;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
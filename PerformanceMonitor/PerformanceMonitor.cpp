@@ -31,12 +31,21 @@ namespace Plugin {
 
         ASSERT(service != nullptr);
         _skipURL = static_cast<uint8_t>(service->WebPrefix().length());
+        _service = service;
+        _maxSeries = config.MaxSeries.Value();
+        _maxBufferSize = config.MaxBufferSize.Value();
+
+        Window(config.Window.Value());
 
         return string();
     }
 
     /* virtual */ void PerformanceMonitor::Deinitialize(PluginHost::IShell* service)
     {
+        _loadGenerator.Stop();
+        _service = nullptr;
+
+        ClearLatency();
     }
 
     /* virtual */ string PerformanceMonitor::Information() const
@@ -57,69 +66,270 @@ namespace Plugin {
         return Core::ERROR_NONE;
     }
 
-    uint32_t PerformanceMonitor::Send(const JsonData::PerformanceMonitor::BufferInfo& data, Core::JSON::DecUInt32& result)
+    void PerformanceMonitor::Measure(const string& method, const uint32_t packageSize, const Sample& sample)
     {
-        uint16_t length = static_cast<uint16_t>(((data.Data.Value().length() * 6) + 7) / 8);
-        uint8_t* buffer = static_cast<uint8_t*>(ALLOCA(length));
-        Core::FromString(data.Data.Value(), buffer, length);
-        result = length;
+        uint8_t sizeClass = 0;
 
-        return Core::ERROR_NONE;
+        while ((sizeClass < 32) && ((static_cast<uint64_t>(1) << sizeClass) < packageSize)) {
+            sizeClass++;
+        }
+
+        _adminLock.Lock();
+
+        Expire();
+
+        SeriesMap::iterator index(_series.find(SeriesKey(method, sizeClass)));
+
+        if ((index == _series.end()) && (_series.size() < _maxSeries)) {
+            index = _series.emplace(std::piecewise_construct,
+                std::forward_as_tuple(method, sizeClass),
+                std::forward_as_tuple()).first;
+        }
+
+        if (index == _series.end()) {
+            _dropped++;
+        } else {
+            for (uint8_t which = 0; which < PHASES; which++) {
+                if (sample.IsSet(static_cast<phase>(which)) == true) {
+                    index->second[static_cast<phase>(which)].Add(sample.Duration(static_cast<phase>(which)));
+                }
+            }
+        }
+
+        _adminLock.Unlock();
     }
 
-    uint32_t PerformanceMonitor::Receive(const Core::JSON::DecUInt32& maxSize, JsonData::PerformanceMonitor::BufferInfo& data)
+    void PerformanceMonitor::Latency(const string& method, Core::JSON::ArrayType<LatencyData>& latencies) const
     {
-        string convertedBuffer;
+        _adminLock.Lock();
 
-        uint32_t length = maxSize.Value();
-        uint8_t* buffer = static_cast<uint8_t*>(ALLOCA(length));
+        Expire();
 
-        static uint8_t pattern[] = { 0x00, 0x66, 0xBB, 0xEE };
-        uint8_t patternLength = sizeof(pattern);
-        uint32_t index = 0;
-        uint8_t patternIndex = 0;
+        SeriesMap::const_iterator index(_series.begin());
 
-        while (index < length) {
+        while (index != _series.end()) {
+            if ((method.empty() == true) || (method == index->first.first)) {
+                LatencyData& data(latencies.Add());
 
-            buffer[index++] = pattern[patternIndex++];
+                data.Method = index->first.first;
+                data.Size = static_cast<uint32_t>(std::min(static_cast<uint64_t>(1) << index->first.second, static_cast<uint64_t>(~static_cast<uint32_t>(0))));
 
-            patternIndex %= (patternLength - 1);
+                data.Serialization.Set(index->second[SERIALIZATION]);
+                data.Deserialization.Set(index->second[DESERIALIZATION]);
+                data.Execution.Set(index->second[EXECUTION]);
+                data.Total.Set(index->second[TOTAL]);
+            }
+            index++;
         }
 
-        Core::ToString(buffer, length, false, convertedBuffer);
-        data.Data = convertedBuffer;
-        data.Length = static_cast<uint16_t>(convertedBuffer.length());
-        data.Duration = static_cast<uint16_t>(convertedBuffer.length()) + 1; //Dummy
+        if (_dropped != 0) {
+            TRACE(Trace::Information, (_T("%d samples dropped, the maximum of %d series is reached"), _dropped, _maxSeries));
+        }
 
-        return Core::ERROR_NONE;
+        _adminLock.Unlock();
     }
 
-    uint32_t PerformanceMonitor::Exchange(const JsonData::PerformanceMonitor::BufferInfo& data, JsonData::PerformanceMonitor::BufferInfo& result)
+    void PerformanceMonitor::Window(const uint32_t seconds)
     {
-        string convertedBuffer;
+        _adminLock.Lock();
 
-        uint16_t length = static_cast<uint16_t>(data.Data.Value().length());
-        uint8_t* buffer = static_cast<uint8_t*>(ALLOCA(length));
-        Core::FromString(data.Data.Value(), buffer, length);
+        _window = static_cast<uint64_t>(seconds) * 1000 * Core::Time::TicksPerMillisecond;
+        _windowStart = Core::Time::Now().Ticks();
+        _series.clear();
+        _dropped = 0;
 
-        static uint8_t pattern[] = { 0x00, 0x77, 0xCC, 0x88 };
-        uint8_t patternLength = sizeof(pattern);
-        uint16_t index = 0;
-        uint8_t patternIndex = 0;
+        _adminLock.Unlock();
+    }
 
-        while (index < data.Length.Value()) {
+    void PerformanceMonitor::ClearLatency()
+    {
+        _adminLock.Lock();
 
-            buffer[index++] = pattern[patternIndex++];
+        _windowStart = Core::Time::Now().Ticks();
+        _series.clear();
+        _dropped = 0;
+
+        _adminLock.Unlock();
+    }
+
+    // Should be called with the lock taken. Once the window has passed, all histograms start over.
+    void PerformanceMonitor::Expire() const
+    {
+        if (_window != 0) {
+            const uint64_t now = Core::Time::Now().Ticks();
+
+            if ((now - _windowStart) >= _window) {
+                _windowStart = now;
+                _series.clear();
+            }
+        }
+    }
+
+    static void Pattern(const uint8_t pattern[], const uint8_t patternLength, uint8_t buffer[], const uint32_t length)
+    {
+        uint8_t patternIndex = 0;
+
+        for (uint32_t index = 0; index < length; index++) {
+            buffer[index] = pattern[patternIndex++];
 
             patternIndex %= (patternLength - 1);
         }
+    }
 
-        Core::ToString(buffer, length, false, convertedBuffer);
-        result.Data = convertedBuffer;
-        result.Length = static_cast<uint16_t>(convertedBuffer.length());
-        result.Duration = static_cast<uint16_t>(convertedBuffer.length()) + 1; //Dummy
+    // The base64 conversions of the framework handle at most 64KB at a time, larger buffers are converted in pieces.
+    // A piece of text is a multiple of 4 characters and a piece of data a multiple of 3 bytes, so the pieces line up.
+    static uint32_t Decode(const string& text, uint8_t buffer[], const uint32_t maxLength)
+    {
+        static constexpr uint32_t Characters = (0xFFFF / 3) * 4;
+        uint32_t loaded = 0;
 
-        return Core::ERROR_NONE;
+        if (text.length() <= Characters) {
+            uint16_t length = static_cast<uint16_t>(std::min(maxLength, static_cast<uint32_t>(0xFFFF)));
+
+            Core::FromString(text, buffer, length);
+            loaded = length;
+        } else {
+            for (uint32_t offset = 0; (offset < text.length()) && (loaded < maxLength); offset += Characters) {
+                uint16_t length = static_cast<uint16_t>(std::min(maxLength - loaded, static_cast<uint32_t>(0xFFFF)));
+
+                Core::FromString(text.substr(offset, Characters), &buffer[loaded], length);
+                loaded += length;
+            }
+        }
+
+        return (loaded);
+    }
+
+    static void Encode(const uint8_t buffer[], const uint32_t length, string& text)
+    {
+        static constexpr uint32_t Bytes = (0xFFFF / 3) * 3;
+
+        text.clear();
+
+        if (length <= Bytes) {
+            Core::ToString(buffer, static_cast<uint16_t>(length), false, text);
+        } else {
+            for (uint32_t offset = 0; offset < length; offset += Bytes) {
+                string piece;
+
+                Core::ToString(&buffer[offset], static_cast<uint16_t>(std::min(length - offset, static_cast<uint32_t>(Bytes))), false, piece);
+                text += piece;
+            }
+        }
+    }
+
+    uint32_t PerformanceMonitor::Send(const JsonData::PerformanceMonitor::BufferInfo& data, Core::JSON::DecUInt32& result, Sample& sample)
+    {
+        uint32_t status = Core::ERROR_BAD_REQUEST;
+        const uint32_t required = static_cast<uint32_t>(((data.Data.Value().length() * 6) + 7) / 8);
+
+        if (required <= _maxBufferSize) {
+            uint64_t start = Core::Time::Now().Ticks();
+            Core::ProxyType<Buffer> buffer(_buffers.Element());
+            uint8_t* content = buffer->Allocate(required);
+
+            sample.Set(EXECUTION, Elapsed(start));
+
+            start = Core::Time::Now().Ticks();
+            const uint32_t length = Decode(data.Data.Value(), content, required);
+            sample.Set(DESERIALIZATION, Elapsed(start));
+
+            result = length;
+            status = Core::ERROR_NONE;
+        }
+
+        return status;
+    }
+
+    uint32_t PerformanceMonitor::Receive(const Core::JSON::DecUInt32& maxSize, JsonData::PerformanceMonitor::BufferInfo& data, Sample& sample)
+    {
+        static const uint8_t pattern[] = { 0x00, 0x66, 0xBB, 0xEE };
+        uint32_t status = Core::ERROR_BAD_REQUEST;
+        const uint32_t length = maxSize.Value();
+
+        if (length <= _maxBufferSize) {
+            uint64_t start = Core::Time::Now().Ticks();
+            Core::ProxyType<Buffer> buffer(_buffers.Element());
+            string convertedBuffer;
+
+            Pattern(pattern, sizeof(pattern), buffer->Allocate(length), length);
+            sample.Set(EXECUTION, Elapsed(start));
+
+            start = Core::Time::Now().Ticks();
+            Encode(buffer->Data(), length, convertedBuffer);
+            sample.Set(SERIALIZATION, Elapsed(start));
+
+            data.Data = convertedBuffer;
+            data.Length = static_cast<uint16_t>(convertedBuffer.length());
+            data.Duration = static_cast<uint16_t>(convertedBuffer.length()) + 1; //Dummy
+            status = Core::ERROR_NONE;
+        }
+
+        return status;
+    }
+
+    uint32_t PerformanceMonitor::Exchange(const JsonData::PerformanceMonitor::BufferInfo& data, JsonData::PerformanceMonitor::BufferInfo& result, Sample& sample)
+    {
+        static const uint8_t pattern[] = { 0x00, 0x77, 0xCC, 0x88 };
+        uint32_t status = Core::ERROR_BAD_REQUEST;
+        const uint32_t received = static_cast<uint32_t>(((data.Data.Value().length() * 6) + 7) / 8);
+        const uint32_t length = std::max(received, static_cast<uint32_t>(data.Length.Value()));
+
+        if (length <= _maxBufferSize) {
+            uint64_t start = Core::Time::Now().Ticks();
+            Core::ProxyType<Buffer> buffer(_buffers.Element());
+            uint8_t* content = buffer->Allocate(length);
+            string convertedBuffer;
+            uint32_t execution = Elapsed(start);
+
+            start = Core::Time::Now().Ticks();
+            Decode(data.Data.Value(), content, received);
+            sample.Set(DESERIALIZATION, Elapsed(start));
+
+            start = Core::Time::Now().Ticks();
+            Pattern(pattern, sizeof(pattern), content, data.Length.Value());
+            sample.Set(EXECUTION, execution + Elapsed(start));
+
+            start = Core::Time::Now().Ticks();
+            Encode(content, length, convertedBuffer);
+            sample.Set(SERIALIZATION, Elapsed(start));
+
+            result.Data = convertedBuffer;
+            result.Length = static_cast<uint16_t>(convertedBuffer.length());
+            result.Duration = static_cast<uint16_t>(convertedBuffer.length()) + 1; //Dummy
+            status = Core::ERROR_NONE;
+        }
+
+        return status;
+    }
+
+    //   Exchange::IPerformance methods
+    // -------------------------------------------------------------------------------------------------------
+    // The binary counterparts of send, receive and exchange. Over COM-RPC the buffers are copied straight into
+    // and out of the message frames, no base64 or JSON is involved, so the difference with the JSON-RPC methods
+    // is the cost of the encoding.
+    uint32_t PerformanceMonitor::Send(const uint16_t sendSize, const uint8_t buffer[] VARIABLE_IS_NOT_USED) /* override */
+    {
+        return (sendSize);
+    }
+
+    uint32_t PerformanceMonitor::Receive(uint16_t& bufferSize, uint8_t buffer[]) const /* override */
+    {
+        static const uint8_t pattern[] = { 0x00, 0x66, 0xBB, 0xEE };
+
+        Pattern(pattern, sizeof(pattern), buffer, bufferSize);
+
+        return (Core::ERROR_NONE);
+    }
+
+    uint32_t PerformanceMonitor::Exchange(uint16_t& bufferSize, uint8_t buffer[], const uint16_t maxBufferSize) /* override */
+    {
+        static const uint8_t pattern[] = { 0x00, 0x77, 0xCC, 0x88 };
+
+        Pattern(pattern, sizeof(pattern), buffer, maxBufferSize);
+        bufferSize = maxBufferSize;
+
+        return (Core::ERROR_NONE);
     }
 } // namespace Plugin
 } // namespace WPEFramework
@@ -19,21 +19,248 @@
  
 #pragma once
 
+#include "Histogram.h"
+#include "LoadGenerator.h"
 #include "Module.h"
 
+#include <interfaces/IPerformance.h>
 #include <interfaces/json/JsonData_PerformanceMonitor.h>
+#include <map>
 
 namespace WPEFramework {
 namespace Plugin {
 
-    class PerformanceMonitor : public PluginHost::IPlugin, public PluginHost::JSONRPC {
+    class PerformanceMonitor : public PluginHost::IPlugin, public PluginHost::JSONRPC, public Exchange::IPerformance {
     public:
-        PerformanceMonitor(const PerformanceMonitor&) = delete;
-        PerformanceMonitor& operator=(const PerformanceMonitor&) = delete;
+        // The phases of a call that can be measured from within the plugin. The time spent in the framework, waiting
+        // for a thread or on the wire, is not visible here and is not reported. The framework itself does measure
+        // those phases, for every JSON-RPC call but only per package size, see the measurement property.
+        enum phase : uint8_t {
+            SERIALIZATION, // Encoding the result
+            DESERIALIZATION, // Decoding the parameters
+            EXECUTION, // The work in between
+            TOTAL, // The handler as a whole
+            PHASES
+        };
+
+        // The durations, in microseconds, measured for a single call. Not every source can measure every phase,
+        // only the phases that are set are recorded.
+        class Sample {
+        public:
+            Sample()
+                : _mask(0)
+            {
+            }
+            ~Sample()
+            {
+            }
+
+        public:
+            inline void Set(const phase which, const uint32_t duration)
+            {
+                ASSERT(which < PHASES);
+
+                _duration[which] = duration;
+                _mask |= (1 << which);
+            }
+            inline bool IsSet(const phase which) const
+            {
+                return ((_mask & (1 << which)) != 0);
+            }
+            inline uint32_t Duration(const phase which) const
+            {
+                ASSERT(IsSet(which) == true);
+
+                return (_duration[which]);
+            }
+
+        private:
+            uint32_t _duration[PHASES];
+            uint8_t _mask;
+        };
+
+        class Config : public Core::JSON::Container {
+        public:
+            Config(const Config&) = delete;
+            Config& operator=(const Config&) = delete;
+
+            Config()
+                : Core::JSON::Container()
+                , Window(0)
+                , MaxSeries(64)
+                , MaxBufferSize(64 * 1024)
+            {
+                Add(_T("window"), &Window);
+                Add(_T("maxseries"), &MaxSeries);
+                Add(_T("maxbuffersize"), &MaxBufferSize);
+            }
+            ~Config()
+            {
+            }
+
+        public:
+            Core::JSON::DecUInt32 Window; // Time in seconds after which the histograms start over, 0 is never.
+            Core::JSON::DecUInt16 MaxSeries;
+            Core::JSON::DecUInt32 MaxBufferSize; // Largest payload in bytes accepted by send, receive and exchange.
+        };
+
+        class LatencyData : public Core::JSON::Container {
+        public:
+            LatencyData()
+                : Core::JSON::Container()
+            {
+                Init();
+            }
+            LatencyData(const LatencyData& copy)
+                : Core::JSON::Container()
+                , Method(copy.Method)
+                , Size(copy.Size)
+                , Serialization(copy.Serialization)
+                , Deserialization(copy.Deserialization)
+                , Execution(copy.Execution)
+                , Total(copy.Total)
+            {
+                Init();
+            }
+            ~LatencyData() override
+            {
+            }
+
+            LatencyData& operator=(const LatencyData& rhs)
+            {
+                Method = rhs.Method;
+                Size = rhs.Size;
+                Serialization = rhs.Serialization;
+                Deserialization = rhs.Deserialization;
+                Execution = rhs.Execution;
+                Total = rhs.Total;
+
+                return (*this);
+            }
+
+        private:
+            void Init()
+            {
+                Add(_T("method"), &Method);
+                Add(_T("size"), &Size);
+                Add(_T("serialization"), &Serialization);
+                Add(_T("deserialization"), &Deserialization);
+                Add(_T("execution"), &Execution);
+                Add(_T("total"), &Total);
+            }
+
+        public:
+            Core::JSON::String Method;
+            Core::JSON::DecUInt32 Size; // Upper bound of the package size class
+            PercentileData Serialization;
+            PercentileData Deserialization;
+            PercentileData Execution;
+            PercentileData Total;
+        };
+
+    private:
+        // Scratch space for the payload of a single call. Buffers are recycled through a pool and only grow, so
+        // after warming up no call allocates.
+        class Buffer {
+        public:
+            Buffer(const Buffer&) = delete;
+            Buffer& operator=(const Buffer&) = delete;
+
+            Buffer()
+                : _data()
+            {
+            }
+            ~Buffer()
+            {
+            }
+
+        public:
+            inline uint8_t* Allocate(const uint32_t size)
+            {
+                if (_data.size() < size) {
+                    _data.resize(size);
+                }
+
+                return (_data.data());
+            }
+            inline uint8_t* Data()
+            {
+                return (_data.data());
+            }
+
+        private:
+            std::vector<uint8_t> _data;
+        };
+
+        // All histograms of one method and package size class.
+        class Series {
+        public:
+            Series(const Series&) = delete;
+            Series& operator=(const Series&) = delete;
+
+            Series()
+            {
+            }
+            ~Series()
+            {
+            }
+
+        public:
+            inline Histogram& operator[](const phase which)
+            {
+                return (_phases[which]);
+            }
+            inline const Histogram& operator[](const phase which) const
+            {
+                return (_phases[which]);
+            }
+
+        private:
+            Histogram _phases[PHASES];
+        };
+
+        class Sink : public LoadGenerator::ICallback {
+        public:
+            Sink() = delete;
+            Sink(const Sink&) = delete;
+            Sink& operator=(const Sink&) = delete;
+
+            Sink(PerformanceMonitor& parent)
+                : _parent(parent)
+            {
+            }
+            ~Sink() override
+            {
+            }
+
+        public:
+            void Completed(const LoadGenerator::Report& report) override
+            {
+                _parent.event_benchmarkcompleted(report);
+            }
+
+        private:
+            PerformanceMonitor& _parent;
+        };
+
+        // Method and package size class (log2 of the size, rounded up)
+        typedef std::pair<string, uint8_t> SeriesKey;
+        typedef std::map<SeriesKey, Series> SeriesMap;
 
     public:
         PerformanceMonitor()
             : _skipURL(0)
+            , _adminLock()
+            , _series()
+            , _window(0)
+            , _windowStart(0)
+            , _maxSeries(0)
+            , _dropped(0)
+            , _maxBufferSize(0)
+            , _buffers(2)
+            , _service(nullptr)
+            , _sink(*this)
+            , _loadGenerator(_sink)
         {
             RegisterAll();
         }
@@ -46,6 +273,7 @@ namespace Plugin {
         BEGIN_INTERFACE_MAP(PerformanceMonitor)
         INTERFACE_ENTRY(PluginHost::IPlugin)
         INTERFACE_ENTRY(PluginHost::IDispatcher)
+        INTERFACE_ENTRY(Exchange::IPerformance)
         END_INTERFACE_MAP
 
         //   IPlugin methods
@@ -54,6 +282,12 @@ namespace Plugin {
         virtual void Deinitialize(PluginHost::IShell* service) override;
         virtual string Information() const override;
 
+        //   Exchange::IPerformance methods
+        // -------------------------------------------------------------------------------------------------------
+        uint32_t Send(const uint16_t sendSize, const uint8_t buffer[]) override;
+        uint32_t Receive(uint16_t& bufferSize, uint8_t buffer[]) const override;
+        uint32_t Exchange(uint16_t& bufferSize, uint8_t buffer[], const uint16_t maxBufferSize) override;
+
     private:
         void RegisterAll();
         void UnregisterAll();
@@ -62,11 +296,30 @@ namespace Plugin {
         uint32_t endpoint_receive(const Core::JSON::DecUInt32& params, JsonData::PerformanceMonitor::BufferInfo& response);
         uint32_t endpoint_exchange(const JsonData::PerformanceMonitor::BufferInfo& params, JsonData::PerformanceMonitor::BufferInfo& response);
         uint32_t get_measurement(const string& index, JsonData::PerformanceMonitor::MeasurementData& response) const;
+        uint32_t get_latency(const string& index, Core::JSON::ArrayType<LatencyData>& response) const;
+        uint32_t get_window(Core::JSON::DecUInt32& response) const;
+        uint32_t set_window(const Core::JSON::DecUInt32& param);
+        uint32_t endpoint_benchmark(const LoadGenerator::Settings& params);
+        uint32_t get_report(LoadGenerator::Report& response) const;
+        void event_benchmarkcompleted(const LoadGenerator::Report& report);
 
         uint32_t RetrieveInfo(const uint32_t packageSize, JsonData::PerformanceMonitor::MeasurementData& measurementData) const;
-        uint32_t Send(const JsonData::PerformanceMonitor::BufferInfo& data, Core::JSON::DecUInt32& result);
-        uint32_t Receive(const Core::JSON::DecUInt32& maxSize, JsonData::PerformanceMonitor::BufferInfo& data);
-        uint32_t Exchange(const JsonData::PerformanceMonitor::BufferInfo& data, JsonData::PerformanceMonitor::BufferInfo& result);
+        uint32_t Send(const JsonData::PerformanceMonitor::BufferInfo& data, Core::JSON::DecUInt32& result, Sample& sample);
+        uint32_t Receive(const Core::JSON::DecUInt32& maxSize, JsonData::PerformanceMonitor::BufferInfo& data, Sample& sample);
+        uint32_t Exchange(const JsonData::PerformanceMonitor::BufferInfo& data, JsonData::PerformanceMonitor::BufferInfo& result, Sample& sample);
+        // Record the durations of a call to one of the methods of this plugin. The JSON-RPC dispatching of the
+        // framework offers no hook to time the calls to other plugins, so only our own methods are covered.
+        void Measure(const string& method, const uint32_t packageSize, const Sample& sample);
+        void Latency(const string& method, Core::JSON::ArrayType<LatencyData>& latencies) const;
+        void Window(const uint32_t seconds);
+        void ClearLatency();
+        void Expire() const;
+
+        // Microseconds passed since the given time, in ticks.
+        static inline uint32_t Elapsed(const uint64_t start)
+        {
+            return (static_cast<uint32_t>((Core::Time::Now().Ticks() - start) / (Core::Time::TicksPerMillisecond / 1000)));
+        }
 
         inline void Measurement(const PluginHost::PerformanceAdministrator::Statistics::Tuple& statistics, JsonData::PerformanceMonitor::MeasurementData::StatisticsData& statisticsData) const {
 
@@ -78,6 +331,20 @@ namespace Plugin {
 
     private:
         uint8_t _skipURL;
+
+        mutable Core::CriticalSection _adminLock;
+        mutable SeriesMap _series;
+        uint64_t _window;
+        mutable uint64_t _windowStart;
+        uint16_t _maxSeries;
+        uint32_t _dropped;
+
+        uint32_t _maxBufferSize;
+        Core::ProxyPoolType<Buffer> _buffers;
+
+        PluginHost::IShell* _service;
+        Sink _sink;
+        LoadGenerator _loadGenerator;
     };
 
 } // namespace Plugin
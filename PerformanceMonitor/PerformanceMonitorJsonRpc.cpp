@@ -35,6 +35,10 @@ namespace Plugin {
         Register<Core::JSON::DecUInt32,BufferInfo>(_T("receive"), &PerformanceMonitor::endpoint_receive, this);
         Register<BufferInfo,BufferInfo>(_T("exchange"), &PerformanceMonitor::endpoint_exchange, this);
         Property<MeasurementData>(_T("measurement"), &PerformanceMonitor::get_measurement, nullptr, this);
+        Property<Core::JSON::ArrayType<PerformanceMonitor::LatencyData>>(_T("latency"), &PerformanceMonitor::get_latency, nullptr, this);
+        Property<Core::JSON::DecUInt32>(_T("window"), &PerformanceMonitor::get_window, &PerformanceMonitor::set_window, this);
+        Register<LoadGenerator::Settings,void>(_T("benchmark"), &PerformanceMonitor::endpoint_benchmark, this);
+        Property<LoadGenerator::Report>(_T("report"), &PerformanceMonitor::get_report, nullptr, this);
     }
 
     void PerformanceMonitor::UnregisterAll()
@@ -44,6 +48,10 @@ namespace Plugin {
         Unregister(_T("exchange"));
         Unregister(_T("clear"));
         Unregister(_T("measurement"));
+        Unregister(_T("latency"));
+        Unregister(_T("window"));
+        Unregister(_T("benchmark"));
+        Unregister(_T("report"));
     }
 
     // API implementation
@@ -55,6 +63,7 @@ namespace Plugin {
     uint32_t PerformanceMonitor::endpoint_clear()
     {
         PluginHost::PerformanceAdministrator::Instance().Clear();
+        ClearLatency();
         return Core::ERROR_NONE;
     }
 
@@ -63,21 +72,42 @@ namespace Plugin {
     //  - ERROR_NONE: Success
     uint32_t PerformanceMonitor::endpoint_send(const BufferInfo& params, Core::JSON::DecUInt32& response)
     {
-        return Send(params, response);
+        const uint64_t start = Core::Time::Now().Ticks();
+        Sample sample;
+        uint32_t result = Send(params, response, sample);
+
+        sample.Set(TOTAL, Elapsed(start));
+        Measure(_T("send"), static_cast<uint32_t>(params.Data.Value().length()), sample);
+
+        return result;
     }
 
     // Return codes:
     //  - ERROR_NONE: Success
     uint32_t PerformanceMonitor::endpoint_receive(const Core::JSON::DecUInt32& params, BufferInfo& response)
     {
-        return Receive(params, response);
+        const uint64_t start = Core::Time::Now().Ticks();
+        Sample sample;
+        uint32_t result = Receive(params, response, sample);
+
+        sample.Set(TOTAL, Elapsed(start));
+        Measure(_T("receive"), params.Value(), sample);
+
+        return result;
     }
 
     // Return codes:
     //  - ERROR_NONE: Success
     uint32_t PerformanceMonitor::endpoint_exchange(const BufferInfo& params, BufferInfo& response)
     {
-        return Exchange(params, response);
+        const uint64_t start = Core::Time::Now().Ticks();
+        Sample sample;
+        uint32_t result = Exchange(params, response, sample);
+
+        sample.Set(TOTAL, Elapsed(start));
+        Measure(_T("exchange"), static_cast<uint32_t>(params.Data.Value().length()), sample);
+
+        return result;
     }
 
     // Property: measurement - Retrieve the performance measurement against given package size
@@ -89,6 +119,63 @@ namespace Plugin {
         return RetrieveInfo(packageSize, response);
     }
 
+    // Property: latency - Latency percentiles (in microseconds) of the methods of this plugin, per method and
+    //                     package size, the index optionally selects a single method
+    // Return codes:
+    //  - ERROR_NONE: Success
+    uint32_t PerformanceMonitor::get_latency(const string& index, Core::JSON::ArrayType<LatencyData>& response) const
+    {
+        Latency(index, response);
+        return Core::ERROR_NONE;
+    }
+
+    // Property: window - Time in seconds after which the latency histograms start over, 0 means never
+    // Return codes:
+    //  - ERROR_NONE: Success
+    uint32_t PerformanceMonitor::get_window(Core::JSON::DecUInt32& response) const
+    {
+        response = static_cast<uint32_t>(_window / (1000 * Core::Time::TicksPerMillisecond));
+        return Core::ERROR_NONE;
+    }
+
+    uint32_t PerformanceMonitor::set_window(const Core::JSON::DecUInt32& param)
+    {
+        Window(param.Value());
+        return Core::ERROR_NONE;
+    }
+
+    // Method: benchmark - Start a load test, the report follows in the benchmarkcompleted event
+    // Return codes:
+    //  - ERROR_NONE: Success
+    //  - ERROR_INPROGRESS: A load test is already running
+    //  - ERROR_BAD_REQUEST: Invalid parameters
+    //  - ERROR_UNAVAILABLE: The target does not offer the requested interface
+    uint32_t PerformanceMonitor::endpoint_benchmark(const LoadGenerator::Settings& params)
+    {
+        uint32_t result = Core::ERROR_UNAVAILABLE;
+
+        if (_service != nullptr) {
+            result = _loadGenerator.Start(_service, params);
+        }
+
+        return result;
+    }
+
+    // Property: report - Report of the last (or running) load test
+    // Return codes:
+    //  - ERROR_NONE: Success
+    uint32_t PerformanceMonitor::get_report(LoadGenerator::Report& response) const
+    {
+        _loadGenerator.Get(response);
+        return Core::ERROR_NONE;
+    }
+
+    // Event: benchmarkcompleted - Signals the end of a load test
+    void PerformanceMonitor::event_benchmarkcompleted(const LoadGenerator::Report& report)
+    {
+        Notify(_T("benchmarkcompleted"), report);
+    }
+
 } // namespace Plugin
 }
 
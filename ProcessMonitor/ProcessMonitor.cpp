@@ -19,17 +19,48 @@
  
 #include "ProcessMonitor.h"
 
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
 namespace WPEFramework {
 namespace Plugin {
 
 SERVICE_REGISTRATION(ProcessMonitor, 1, 0);
 
+static int PidOpen(const uint32_t processId)
+{
+#ifdef SYS_pidfd_open
+    return (static_cast<int>(::syscall(SYS_pidfd_open, static_cast<pid_t>(processId), 0)));
+#else
+    return (-1);
+#endif
+}
+
+// Through the pidfd the signal can only reach the process it was opened for, never a new process that got the
+// same id once the old one was reaped.
+static void Signal(const int descriptor, const uint32_t processId, const int signal)
+{
+#ifdef SYS_pidfd_send_signal
+    if (descriptor != -1) {
+        ::syscall(SYS_pidfd_send_signal, descriptor, signal, nullptr, 0);
+    } else {
+        ::kill(static_cast<pid_t>(processId), signal);
+    }
+#else
+    ASSERT(descriptor == -1);
+    ::kill(static_cast<pid_t>(processId), signal);
+#endif
+}
+
 const string ProcessMonitor::Initialize(PluginHost::IShell* service)
 {
     Config config;
     config.FromString(service->ConfigLine());
 
-    _notification.Open(service, config.ExitTimeout.Value());
+    _notification.Open(service, config);
 
     return (_T(""));
 }
@@ -44,5 +75,310 @@ string ProcessMonitor::Information() const
     string emptyString;
     return emptyString;
 }
+
+void ProcessMonitor::Notification::Open(PluginHost::IShell* service, const Config& config)
+{
+    ASSERT((service != nullptr) && (_service == nullptr));
+
+    _defaults.Exit = static_cast<uint64_t>(config.ExitTimeout.Value()) * 1000 * 1000; // microseconds
+    _defaults.Kill = static_cast<uint64_t>(config.KillTimeout.Value()) * 1000 * 1000;
+
+    auto index(config.Timeouts.Elements());
+    while (index.Next() == true) {
+        const TimeoutData& entry(index.Current());
+        Timeouts& timeouts(_timeouts[entry.Callsign.Value()]);
+
+        timeouts.Exit = (entry.ExitTimeout.IsSet() == true ? static_cast<uint64_t>(entry.ExitTimeout.Value()) * 1000 * 1000 : _defaults.Exit);
+        timeouts.Kill = (entry.KillTimeout.IsSet() == true ? static_cast<uint64_t>(entry.KillTimeout.Value()) * 1000 * 1000 : _defaults.Kill);
+    }
+
+    _epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    _event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if ((_epoll != -1) && (_event != -1)) {
+        struct epoll_event event;
+
+        event.events = EPOLLIN;
+        event.data.fd = _event;
+        ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _event, &event);
+    }
+
+    _watcher = new Watcher(*this);
+    _watcher->Run();
+
+    _service = service;
+    _service->AddRef();
+
+    _service->Register(static_cast<IPlugin::INotification*>(this));
+    _service->Register(
+            static_cast<RPC::IRemoteConnection::INotification*>(this));
+}
+
+void ProcessMonitor::Notification::Close()
+{
+    ASSERT(_service != nullptr);
+
+    _service->Unregister(static_cast<IPlugin::INotification*>(this));
+    _service->Unregister(
+            static_cast<RPC::IRemoteConnection::INotification*>(this));
+
+    _service->Release();
+    _service = nullptr;
+
+    delete _watcher;
+    _watcher = nullptr;
+
+    _adminLock.Lock();
+
+    _processMap.clear();
+    _descriptors.clear();
+    _wheel.Clear();
+    _timeouts.clear();
+
+    _adminLock.Unlock();
+
+    if (_event != -1) {
+        ::close(_event);
+        _event = -1;
+    }
+    if (_epoll != -1) {
+        ::close(_epoll);
+        _epoll = -1;
+    }
+}
+
+void ProcessMonitor::Notification::Deactivated(const string& callsign, PluginHost::IShell*)
+{
+    bool scheduled = false;
+
+    _adminLock.Lock();
+
+    ProcessMap::iterator index(_processMap.find(callsign));
+
+    if ((index != _processMap.end()) && (index->second->State() == RUNNING)) {
+        const uint64_t now = Core::Time::Now().Ticks();
+
+        index->second->Deactivated(now);
+        Schedule(callsign, *(index->second), DEACTIVATED, now + Timeout(callsign).Exit, now);
+        scheduled = true;
+    }
+
+    _adminLock.Unlock();
+
+    if (scheduled == true) {
+        // The watcher might be sleeping until a later deadline.
+        Wake();
+    }
+}
+
+void ProcessMonitor::Notification::AddProcess(const string& callsign, const uint32_t processId)
+{
+    const int descriptor = PidOpen(processId);
+
+    _adminLock.Lock();
+
+    // A new process for the same callsign replaces the previous one, that one is gone by now.
+    ProcessMap::iterator index(_processMap.find(callsign));
+
+    if (index != _processMap.end()) {
+        _descriptors.erase(index->second->Descriptor());
+        _processMap.erase(index);
+    }
+
+    _processMap.emplace(callsign, std::unique_ptr<ProcessObject>(new ProcessObject(processId, descriptor)));
+
+    if (descriptor != -1) {
+        struct epoll_event event;
+
+        event.events = EPOLLIN;
+        event.data.fd = descriptor;
+
+        if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, descriptor, &event) == 0) {
+            _descriptors[descriptor] = callsign;
+        }
+    }
+
+    _adminLock.Unlock();
+}
+
+const ProcessMonitor::Notification::Timeouts& ProcessMonitor::Notification::Timeout(const string& callsign) const
+{
+    std::unordered_map<string, Timeouts>::const_iterator index(_timeouts.find(callsign));
+
+    return (index != _timeouts.end() ? index->second : _defaults);
+}
+
+void ProcessMonitor::Notification::Schedule(const string& callsign, ProcessObject& process, const state newState, const uint64_t deadline, const uint64_t now)
+{
+    // Without a pidfd nobody tells us the process is gone, so look regularly to measure the time it took.
+    const uint64_t timer = (process.Descriptor() != -1 ? deadline : std::min(deadline, now + Probe));
+
+    process.State(newState, deadline);
+    process.Timer(timer);
+
+    _wheel.Insert(timer, TimerKey(callsign, timer));
+}
+
+void ProcessMonitor::Notification::Expired(const TimerKey& timer, const uint64_t now)
+{
+    ProcessMap::iterator index(_processMap.find(timer.first));
+
+    if ((index != _processMap.end()) && (index->second->Timer() == timer.second)) {
+        ProcessObject& process(*(index->second));
+        bool alive;
+
+        if (process.Descriptor() != -1) {
+            struct pollfd descriptor = { process.Descriptor(), POLLIN, 0 };
+
+            alive = (::poll(&descriptor, 1, 0) == 0);
+        } else {
+            alive = ((::kill(process.ProcessId(), 0) == 0) || (errno == EPERM));
+        }
+
+        if (alive == false) {
+            Exited(index, now);
+        } else if (now < process.Deadline()) {
+            Schedule(timer.first, process, process.State(), process.Deadline(), now);
+        } else {
+            const Timeouts& timeouts(Timeout(timer.first));
+
+            switch (process.State()) {
+            case DEACTIVATED:
+                Signal(process.Descriptor(), process.ProcessId(), SIGTERM);
+                SYSLOG(Logging::Notification,
+                        (_T("ProcessMonitor terminated: [%s]!"),
+                                timer.first.c_str()));
+                Schedule(timer.first, process, TERMINATED, now + timeouts.Kill, now);
+                break;
+            case TERMINATED:
+                Signal(process.Descriptor(), process.ProcessId(), SIGKILL);
+                SYSLOG(Logging::Notification,
+                        (_T("ProcessMonitor killed: [%s]!"),
+                                timer.first.c_str()));
+                // Give the kernel a moment to tear it down before giving up on it.
+                Schedule(timer.first, process, KILLED, now + std::max(timeouts.Kill, static_cast<uint64_t>(Resolution)), now);
+                break;
+            default:
+                SYSLOG(Logging::Notification,
+                        (_T("ProcessMonitor could not kill: [%s]!"),
+                                timer.first.c_str()));
+                _descriptors.erase(process.Descriptor());
+                _processMap.erase(index);
+                break;
+            }
+        }
+    }
+}
+
+void ProcessMonitor::Notification::Exited(ProcessMap::iterator index, const uint64_t now)
+{
+    const ProcessObject& process(*(index->second));
+
+    if (process.State() != RUNNING) {
+        ExitStatistics& statistics(_statistics[index->first]);
+        const uint32_t duration = static_cast<uint32_t>((now - process.Deactivated()) / 1000); // milliseconds
+
+        statistics.Count++;
+        statistics.Total += duration;
+        statistics.Last = duration;
+        statistics.Minimum = std::min(statistics.Minimum, duration);
+        statistics.Maximum = std::max(statistics.Maximum, duration);
+
+        if (process.State() != DEACTIVATED) {
+            statistics.Terminated++;
+        }
+        if (process.State() == KILLED) {
+            statistics.Killed++;
+        }
+    }
+
+    _descriptors.erase(process.Descriptor());
+    _processMap.erase(index);
+}
+
+void ProcessMonitor::Notification::Wake()
+{
+    if (_event != -1) {
+        const uint64_t value = 1;
+
+        if (::write(_event, &value, sizeof(value)) != sizeof(value)) {
+            TRACE_L1("Could not wake the process watcher, error: %d", errno);
+        }
+    }
+}
+
+// Runs on the watcher thread: sleeps until a process exits, a deadline passes or the set of deadlines changes.
+void ProcessMonitor::Notification::Wait()
+{
+    struct epoll_event events[16];
+    int timeout = -1;
+
+    _adminLock.Lock();
+    const uint64_t next = _wheel.Next();
+    _adminLock.Unlock();
+
+    if (next != 0) {
+        const uint64_t now = Core::Time::Now().Ticks();
+
+        timeout = (next > now ? static_cast<int>((next - now + 999) / 1000) : 0);
+    }
+
+    const int count = ::epoll_wait(_epoll, events, sizeof(events) / sizeof(events[0]), timeout);
+
+    if ((count < 0) && (errno != EINTR)) {
+        // Without epoll there are only the deadlines to go by, do not spin.
+        ::usleep(Resolution);
+    }
+
+    _adminLock.Lock();
+
+    const uint64_t now = Core::Time::Now().Ticks();
+
+    for (int index = 0; index < count; index++) {
+        if (events[index].data.fd == _event) {
+            uint64_t value;
+
+            if (::read(_event, &value, sizeof(value)) != sizeof(value)) {
+                TRACE_L1("Could not reset the process watcher, error: %d", errno);
+            }
+        } else {
+            std::unordered_map<int, string>::const_iterator descriptor(_descriptors.find(events[index].data.fd));
+
+            if (descriptor != _descriptors.end()) {
+                ProcessMap::iterator entry(_processMap.find(descriptor->second));
+
+                if ((entry != _processMap.end()) && (entry->second->Descriptor() == events[index].data.fd)) {
+                    Exited(entry, now);
+                }
+            }
+        }
+    }
+
+    _wheel.Expire(now, [this, now](const TimerKey& timer) {
+        Expired(timer, now);
+    });
+
+    _adminLock.Unlock();
+}
+
+void ProcessMonitor::Notification::Statistics(Core::JSON::ArrayType<ExitData>& statistics) const
+{
+    _adminLock.Lock();
+
+    for (const std::pair<const string, ExitStatistics>& entry : _statistics) {
+        ExitData& data(statistics.Add());
+
+        data.Callsign = entry.first;
+        data.Count = entry.second.Count;
+        data.Minimum = entry.second.Minimum;
+        data.Maximum = entry.second.Maximum;
+        data.Average = static_cast<uint32_t>(entry.second.Total / entry.second.Count);
+        data.Last = entry.second.Last;
+        data.Terminated = entry.second.Terminated;
+        data.Killed = entry.second.Killed;
+    }
+
+    _adminLock.Unlock();
+}
 }
 }
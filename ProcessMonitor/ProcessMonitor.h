@@ -21,20 +21,64 @@
 #define __PROCESS_MONITOR_H
 
 #include "Module.h"
+#include "TimerWheel.h"
 
+#include <map>
+#include <memory>
 #include <string>
 #include <syslog.h>
+#include <unistd.h>
 #include <unordered_map>
 
 namespace WPEFramework {
 namespace Plugin {
 
-class ProcessMonitor: public PluginHost::IPlugin
+class ProcessMonitor: public PluginHost::IPlugin, public PluginHost::JSONRPC
 {
 public:
     ProcessMonitor(const ProcessMonitor&) = delete;
     ProcessMonitor& operator=(const ProcessMonitor&) = delete;
 
+    class TimeoutData: public Core::JSON::Container
+    {
+    public:
+        TimeoutData()
+            : Core::JSON::Container(), Callsign(), ExitTimeout(), KillTimeout()
+        {
+            Init();
+        }
+        TimeoutData(const TimeoutData& copy)
+            : Core::JSON::Container(), Callsign(copy.Callsign), ExitTimeout(copy.ExitTimeout), KillTimeout(copy.KillTimeout)
+        {
+            Init();
+        }
+        ~TimeoutData() override
+        {
+        }
+
+        TimeoutData& operator=(const TimeoutData& rhs)
+        {
+            Callsign = rhs.Callsign;
+            ExitTimeout = rhs.ExitTimeout;
+            KillTimeout = rhs.KillTimeout;
+
+            return (*this);
+        }
+
+    private:
+        void Init()
+        {
+            Add(_T("callsign"), &Callsign);
+            Add(_T("exittimeout"), &ExitTimeout);
+            Add(_T("killtimeout"), &KillTimeout);
+        }
+
+    public:
+        Core::JSON::String Callsign;
+        Core::JSON::DecUInt32 ExitTimeout;
+        Core::JSON::DecUInt32 KillTimeout;
+    };
+
     class Config: public Core::JSON::Container
     {
     public:
@@ -43,17 +87,80 @@ public:
 
     public:
         Config()
-            : Core::JSON::Container(), ExitTimeout()
+            : Core::JSON::Container(), ExitTimeout(), KillTimeout(2), Timeouts()
         {
             Add(_T("exittimeout"), &ExitTimeout);
+            Add(_T("killtimeout"), &KillTimeout);
+            Add(_T("timeouts"), &Timeouts);
         }
         ~Config() override
         {
         }
     public:
-        Core::JSON::DecUInt32 ExitTimeout;
+        Core::JSON::DecUInt32 ExitTimeout; // Seconds after deactivation before the process is sent a SIGTERM
+        Core::JSON::DecUInt32 KillTimeout; // Seconds after the SIGTERM before it is sent a SIGKILL
+        Core::JSON::ArrayType<TimeoutData> Timeouts; // Per callsign
+    };
+
+    // How long processes took to exit after their plugin was deactivated, in milliseconds.
+    class ExitData: public Core::JSON::Container
+    {
+    public:
+        ExitData()
+            : Core::JSON::Container()
+        {
+            Init();
+        }
+        ExitData(const ExitData& copy)
+            : Core::JSON::Container(), Callsign(copy.Callsign), Count(copy.Count), Minimum(copy.Minimum), Maximum(copy.Maximum), Average(copy.Average), Last(copy.Last), Terminated(copy.Terminated), Killed(copy.Killed)
+        {
+            Init();
+        }
+        ~ExitData() override
+        {
+        }
+
+        ExitData& operator=(const ExitData& rhs)
+        {
+            Callsign = rhs.Callsign;
+            Count = rhs.Count;
+            Minimum = rhs.Minimum;
+            Maximum = rhs.Maximum;
+            Average = rhs.Average;
+            Last = rhs.Last;
+            Terminated = rhs.Terminated;
+            Killed = rhs.Killed;
+
+            return (*this);
+        }
+
+    private:
+        void Init()
+        {
+            Add(_T("callsign"), &Callsign);
+            Add(_T("count"), &Count);
+            Add(_T("minimum"), &Minimum);
+            Add(_T("maximum"), &Maximum);
+            Add(_T("average"), &Average);
+            Add(_T("last"), &Last);
+            Add(_T("terminated"), &Terminated);
+            Add(_T("killed"), &Killed);
+        }
+
+    public:
+        Core::JSON::String Callsign;
+        Core::JSON::DecUInt32 Count;
+        Core::JSON::DecUInt32 Minimum;
+        Core::JSON::DecUInt32 Maximum;
+        Core::JSON::DecUInt32 Average;
+        Core::JSON::DecUInt32 Last;
+        Core::JSON::DecUInt32 Terminated; // Exits that needed a SIGTERM
+        Core::JSON::DecUInt32 Killed; // Exits that needed a SIGKILL
     };
 
+    // Tracks the processes of out-of-process plugins. Every process is watched through a pidfd in an epoll set, so
+    // its exit is known the moment it happens. Deadlines (SIGTERM after exittimeout, SIGKILL after killtimeout)
+    // are kept in a timer wheel, so neither exits nor deadlines need a scan over all processes.
     class Notification: public PluginHost::IPlugin::INotification,
             public RPC::IRemoteConnection::INotification
     {
@@ -62,52 +169,168 @@ public:
         Notification(const Notification&) = delete;
         Notification& operator=(const Notification&) = delete;
 
-        using Job = Core::WorkerPool::JobType<Notification&>;
+    private:
+        enum state {
+            RUNNING,
+            DEACTIVATED,
+            TERMINATED,
+            KILLED
+        };
 
         class ProcessObject
         {
         public:
             ProcessObject() = delete;
-            ProcessObject(const ProcessObject&) = default;
-            ProcessObject& operator=(const ProcessObject&) = default;
+            ProcessObject(const ProcessObject&) = delete;
+            ProcessObject& operator=(const ProcessObject&) = delete;
 
         public:
             ProcessObject(
-                const uint32_t processId)
+                const uint32_t processId, const int descriptor)
                 : _processId(processId)
-                , _exitTime(0)
+                , _descriptor(descriptor)
+                , _state(RUNNING)
+                , _deactivated(0)
+                , _deadline(0)
+                , _timer(0)
             {
                 ASSERT(_processId != 0);
             }
             ~ProcessObject()
             {
+                if (_descriptor != -1) {
+                    ::close(_descriptor);
+                }
             }
-            uint32_t ProcessId()
+            uint32_t ProcessId() const
             {
                 return _processId;
             }
-            void SetExitTime(const uint64_t exitTime)
+            // The pidfd of the process, -1 if the kernel does not support these.
+            int Descriptor() const
+            {
+                return _descriptor;
+            }
+            state State() const
             {
-                _exitTime = exitTime;
+                return _state;
             }
-            uint64_t ExitTime()
+            void State(const state newState, const uint64_t deadline)
             {
-                return _exitTime;
+                _state = newState;
+                _deadline = deadline;
+            }
+            uint64_t Deactivated() const
+            {
+                return _deactivated;
+            }
+            void Deactivated(const uint64_t time)
+            {
+                _deactivated = time;
+            }
+            uint64_t Deadline() const
+            {
+                return _deadline;
+            }
+            uint64_t Timer() const
+            {
+                return _timer;
+            }
+            void Timer(const uint64_t time)
+            {
+                _timer = time;
             }
 
         private:
             const uint32_t _processId;
-            uint64_t _exitTime;
+            const int _descriptor;
+            state _state;
+            uint64_t _deactivated;
+            uint64_t _deadline;
+            uint64_t _timer;
+        };
+
+        struct ExitStatistics {
+            ExitStatistics()
+                : Count(0)
+                , Minimum(~0)
+                , Maximum(0)
+                , Total(0)
+                , Last(0)
+                , Terminated(0)
+                , Killed(0)
+            {
+            }
+
+            uint32_t Count;
+            uint32_t Minimum;
+            uint32_t Maximum;
+            uint64_t Total;
+            uint32_t Last;
+            uint32_t Terminated;
+            uint32_t Killed;
         };
 
+        struct Timeouts {
+            uint64_t Exit; // Microseconds
+            uint64_t Kill;
+        };
+
+        class Watcher : public Core::Thread {
+        public:
+            Watcher() = delete;
+            Watcher(const Watcher&) = delete;
+            Watcher& operator=(const Watcher&) = delete;
+
+            Watcher(Notification& parent)
+                : Core::Thread(Core::Thread::DefaultStackSize(), _T("ProcessMonitor"))
+                , _parent(parent)
+            {
+            }
+            ~Watcher() override
+            {
+                Stop();
+                _parent.Wake();
+                Wait(Core::Thread::STOPPED | Core::Thread::BLOCKED, Core::infinite);
+            }
+
+        private:
+            uint32_t Worker() override
+            {
+                if (IsRunning() == true) {
+                    _parent.Wait();
+                }
+
+                return (0);
+            }
+
+        private:
+            Notification& _parent;
+        };
+
+        typedef std::unordered_map<string, std::unique_ptr<ProcessObject>> ProcessMap;
+        // A timer is only valid if it is the last one set for the process.
+        typedef std::pair<string, uint64_t> TimerKey;
+
+        // Granularity of the deadlines, in microseconds.
+        static constexpr uint32_t Resolution = 100 * 1000;
+        // Without pidfds the exit can only be found by looking, this often, in microseconds.
+        static constexpr uint32_t Probe = 100 * 1000;
+
     public:
         Notification(ProcessMonitor* parent)
             : _adminLock()
             , _processMap()
-            , _job(*this)
+            , _statistics()
+            , _timeouts()
+            , _wheel(Resolution, 64)
+            , _epoll(-1)
+            , _event(-1)
+            , _watcher(nullptr)
             , _service(nullptr)
             , _parent(*parent)
-            ,_exittimeout(10000000)
+            , _descriptors()
+            , _defaults()
         {
             ASSERT(parent != nullptr);
         }
@@ -117,118 +340,17 @@ public:
         }
 
     public:
-        inline void Open(PluginHost::IShell* service, const uint32_t exittimeout)
-        {
-            ASSERT((service != nullptr) && (_service == nullptr));
-            
-            _exittimeout = exittimeout * 1000 * 1000; // microseconds
-
-            _service = service;
-            _service->AddRef();
-
-            _service->Register(static_cast<IPlugin::INotification*>(this));
-            _service->Register(
-                    static_cast<RPC::IRemoteConnection::INotification*>(this));
-        }
-        inline void Close()
-        {
-            ASSERT(_service != nullptr);
-
-            _service->Unregister(static_cast<IPlugin::INotification*>(this));
-            _service->Unregister(
-                    static_cast<RPC::IRemoteConnection::INotification*>(this));
-
-            _service->Release();
-            _service = nullptr;
-
-            _job.Revoke();
-
-            _processMap.clear();
-        }
+        void Open(PluginHost::IShell* service, const Config& config);
+        void Close();
 
         void Activated(const string&, PluginHost::IShell*) override
         {
         }
-
-        void Deactivated(const string& callsign, PluginHost::IShell*) override
-        {
-            uint64_t exitTime = 0;
-
-            _adminLock.Lock();
-
-            std::unordered_map<string, ProcessObject>::iterator itr(
-                    _processMap.find(callsign));
-            if (itr != _processMap.end()) {
-                exitTime = Core::Time::Now().Ticks() + _exittimeout;
-                itr->second.SetExitTime(exitTime);
-            }
-
-            if (exitTime != 0) {
-                ScheduleJob();
-            }
-
-            _adminLock.Unlock();
-        }
-
+        void Deactivated(const string& callsign, PluginHost::IShell*) override;
         void Unavailable(const string&, PluginHost::IShell*) override
         {
         }
 
-        void AddProcess(const string callsign, const uint32_t processId)
-        {
-            _adminLock.Lock();
-
-            _processMap.emplace(callsign, ProcessObject(processId));
-
-            _adminLock.Unlock();
-        }
-        void Dispatch()
-        {
-            uint64_t currTime(Core::Time::Now().Ticks());
-
-            _adminLock.Lock();
-
-            auto itr = _processMap.begin();
-            while (itr != _processMap.end()) {
-
-                uint64_t exitTime = itr->second.ExitTime();
-                if ((exitTime != 0) && (exitTime <= currTime)) {
-                    Core::Process proc(itr->second.ProcessId());
-                    if (proc.IsActive()) {
-                        proc.Kill(true);
-                        SYSLOG(Logging::Notification,
-                                (_T("ProcessMonitor killed: [%s]!"),
-                                        itr->first.c_str()));
-                    }
-                    itr = _processMap.erase(itr);
-                }
-                else {
-                    itr++;
-                }
-            }
-
-            ScheduleJob();
-
-            _adminLock.Unlock();
-        }
-        void ScheduleJob()
-        {
-            uint64_t scheduleTime = 0;
-
-            for (auto itr : _processMap) {
-                uint64_t exitTime = itr.second.ExitTime();
-                if (exitTime != 0) {
-                    if ((scheduleTime == 0) || (scheduleTime > exitTime)) {
-                        scheduleTime = exitTime;
-                    }
-                }
-            }
-
-            if (scheduleTime != 0) {
-                _job.Revoke();
-                _job.Schedule(scheduleTime);
-            }
-        }
         void Activated(RPC::IRemoteConnection* connection) override
         {
             RPC::IMonitorableProcess* proc =
@@ -242,32 +364,52 @@ public:
         {
         }
 
+        void Statistics(Core::JSON::ArrayType<ExitData>& statistics) const;
+
         BEGIN_INTERFACE_MAP(Notification)
         INTERFACE_ENTRY(PluginHost::IPlugin::INotification)
         INTERFACE_ENTRY(RPC::IRemoteConnection::INotification)
         END_INTERFACE_MAP
 
     private:
-        Core::CriticalSection _adminLock;
-        std::unordered_map<string, ProcessObject> _processMap;
-        Job  _job;
+        void AddProcess(const string& callsign, const uint32_t processId);
+        const Timeouts& Timeout(const string& callsign) const;
+        void Schedule(const string& callsign, ProcessObject& process, const state newState, const uint64_t deadline, const uint64_t now);
+        void Expired(const TimerKey& timer, const uint64_t now);
+        void Exited(ProcessMap::iterator index, const uint64_t now);
+        void Wake();
+        void Wait();
+
+    private:
+        mutable Core::CriticalSection _adminLock;
+        ProcessMap _processMap;
+        std::map<string, ExitStatistics> _statistics;
+        std::unordered_map<string, Timeouts> _timeouts;
+        TimerWheel<TimerKey> _wheel;
+        int _epoll;
+        int _event;
+        Watcher* _watcher;
         PluginHost::IShell* _service;
         ProcessMonitor& _parent;
-        uint32_t _exittimeout;
+        std::unordered_map<int, string> _descriptors;
+        Timeouts _defaults;
     };
 
 public:
     ProcessMonitor()
         : _notification(this)
     {
+        RegisterAll();
     }
     ~ProcessMonitor() override
     {
+        UnregisterAll();
         _notification.Release();
     }
 
     BEGIN_INTERFACE_MAP(ProcessMonitor)
     INTERFACE_ENTRY(PluginHost::IPlugin)
+    INTERFACE_ENTRY(PluginHost::IDispatcher)
     END_INTERFACE_MAP
 
 public:
@@ -276,6 +418,11 @@ public:
     void Deinitialize(PluginHost::IShell* service) override;
     string Information() const override;
 
+private:
+    void RegisterAll();
+    void UnregisterAll();
+    uint32_t get_statistics(Core::JSON::ArrayType<ExitData>& response) const;
+
 private:
     Core::Sink<Notification> _notification;
 };
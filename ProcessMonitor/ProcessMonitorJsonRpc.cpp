@@ -0,0 +1,51 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProcessMonitor.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Registration
+//
+
+void ProcessMonitor::RegisterAll()
+{
+    Property<Core::JSON::ArrayType<ExitData>>(_T("statistics"), &ProcessMonitor::get_statistics, nullptr, this);
+}
+
+void ProcessMonitor::UnregisterAll()
+{
+    Unregister(_T("statistics"));
+}
+
+// API implementation
+//
+
+// Property: statistics - Time it took processes to exit after their plugin was deactivated, per callsign
+// Return codes:
+//  - ERROR_NONE: Success
+uint32_t ProcessMonitor::get_statistics(Core::JSON::ArrayType<ExitData>& response) const
+{
+    _notification.Statistics(response);
+
+    return Core::ERROR_NONE;
+}
+}
+}
@@ -0,0 +1,189 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Hashed timing wheel: a timer goes into the slot of its tick (time / resolution) modulo the number of slots.
+// Inserting is constant time, expiring only looks at the slots of the ticks that passed. Timers further away
+// than one turn of the wheel share a slot with nearer ones and are kept there until their turn comes.
+// Timers can not be removed; the owner ignores the keys it no longer cares about when they expire.
+// Times are in Core::Time ticks (microseconds). Not thread safe, the owner locks.
+template <typename KEY>
+class TimerWheel {
+private:
+    struct Entry {
+        Entry(const uint64_t time, const KEY& key)
+            : Time(time)
+            , Key(key)
+        {
+        }
+
+        uint64_t Time;
+        KEY Key;
+    };
+
+    typedef std::list<Entry> Slot;
+
+public:
+    TimerWheel() = delete;
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    TimerWheel(const uint32_t resolution, const uint16_t slots)
+        : _slots(slots)
+        , _resolution(resolution)
+        , _current(0)
+        , _floor(0)
+        , _count(0)
+    {
+        ASSERT((resolution != 0) && (slots != 0));
+    }
+    ~TimerWheel()
+    {
+    }
+
+public:
+    inline bool IsEmpty() const
+    {
+        return (_count == 0);
+    }
+    // Time at which Expire has to be called next, the tick of the earliest timer, 0 if there is nothing to wait for.
+    inline uint64_t Next() const
+    {
+        return (_count == 0 ? 0 : (_current * _resolution));
+    }
+    void Insert(const uint64_t time, const KEY& key)
+    {
+        const uint64_t tick = std::max(Tick(time), _floor);
+
+        if ((_count == 0) || (tick < _current)) {
+            _current = tick;
+        }
+
+        _slots[tick % _slots.size()].emplace_back(time, key);
+        _count++;
+    }
+    void Clear()
+    {
+        for (Slot& slot : _slots) {
+            slot.clear();
+        }
+        _count = 0;
+    }
+    // Calls action(key) for every timer that is due at the given time. The action may insert new timers.
+    template <typename ACTION>
+    void Expire(const uint64_t now, ACTION&& action)
+    {
+        const uint64_t tick = now / _resolution;
+        uint64_t last = tick;
+
+        // After a long sleep every slot is visited once, no need to go round more often.
+        if ((tick >= _current) && ((tick - _current) >= _slots.size())) {
+            last = _current + _slots.size() - 1;
+        }
+
+        while ((_current <= last) && (_count != 0)) {
+            Slot due;
+
+            due.splice(due.end(), _slots[_current % _slots.size()]);
+
+            typename Slot::iterator index(due.begin());
+
+            while (index != due.end()) {
+                if (index->Time <= now) {
+                    index++;
+                } else {
+                    // Not in this turn of the wheel.
+                    typename Slot::iterator next(std::next(index));
+                    Slot& slot(_slots[_current % _slots.size()]);
+                    slot.splice(slot.end(), due, index);
+                    index = next;
+                }
+            }
+
+            _count -= static_cast<uint32_t>(due.size());
+
+            for (const Entry& entry : due) {
+                action(entry.Key);
+            }
+
+            _current++;
+        }
+
+        if (_current <= tick) {
+            _current = tick + 1;
+        }
+        _floor = _current;
+
+        Advance();
+    }
+
+private:
+    inline uint64_t Tick(const uint64_t time) const
+    {
+        return ((time + _resolution - 1) / _resolution);
+    }
+    // Moves on to the tick of the earliest timer, so the owner does not wake up for every tick in between. The
+    // slots of one turn are searched first, only if all timers are further away all of them are looked at.
+    void Advance()
+    {
+        if (_count != 0) {
+            const uint64_t end = _current + _slots.size();
+            uint64_t earliest = ~static_cast<uint64_t>(0);
+
+            for (uint64_t tick = _current; (tick < end) && (earliest == ~static_cast<uint64_t>(0)); tick++) {
+                for (const Entry& entry : _slots[tick % _slots.size()]) {
+                    if (Tick(entry.Time) <= tick) {
+                        earliest = tick;
+                        break;
+                    }
+                }
+            }
+
+            if (earliest == ~static_cast<uint64_t>(0)) {
+                for (const Slot& slot : _slots) {
+                    for (const Entry& entry : slot) {
+                        earliest = std::min(earliest, std::max(Tick(entry.Time), _current));
+                    }
+                }
+            }
+
+            _current = earliest;
+        }
+    }
+
+private:
+    std::vector<Slot> _slots;
+    const uint64_t _resolution;
+    uint64_t _current; // Tick of the earliest timer that has not expired yet
+    uint64_t _floor; // Ticks before this one have been expired already
+    uint32_t _count;
+};
+
+} // namespace Plugin
+} // namespace WPEFramework
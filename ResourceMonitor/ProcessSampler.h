@@ -0,0 +1,603 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Samples the CPU usage of all processes whose name starts with one of the given names. The procfs files of
+    // a process are opened once and re-read with pread into a fixed buffer, /proc/stat is read once per sample
+    // for all processes together. New processes are picked up from the kernel process events (netlink proc
+    // connector), which requires CAP_NET_ADMIN. Without those events /proc is rescanned every "rescan" samples.
+    // Processes that are gone are dropped as soon as their stat file can no longer be read.
+    // Optionally the threads of these processes are sampled as well, tracked in the same way, so the CPU usage can
+    // be attributed to the plugins (out of process: their host process, in process: their threads) that cause it.
+    class ProcessSampler {
+    private:
+        static constexpr uint16_t BufferSize = 2048;
+
+        // A procfs file that stays open, so a sample costs one pread and no open/close.
+        class ProcFile {
+        public:
+            ProcFile(const ProcFile&) = delete;
+            ProcFile& operator=(const ProcFile&) = delete;
+
+            ProcFile()
+                : _fd(-1)
+            {
+            }
+            ~ProcFile()
+            {
+                Close();
+            }
+
+        public:
+            inline bool IsOpen() const
+            {
+                return (_fd != -1);
+            }
+            bool Open(const char path[])
+            {
+                Close();
+                _fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+                return (_fd != -1);
+            }
+            void Close()
+            {
+                if (_fd != -1) {
+                    ::close(_fd);
+                    _fd = -1;
+                }
+            }
+            // Returns the number of bytes read, the buffer is always terminated. Returns 0 once the process
+            // this file belongs to is gone, even if its pid has been reused since.
+            uint16_t Read(char buffer[], const uint16_t size) const
+            {
+                ssize_t length = (_fd != -1 ? ::pread(_fd, buffer, size - 1, 0) : -1);
+
+                length = (length < 0 ? 0 : length);
+                buffer[length] = '\0';
+
+                return (static_cast<uint16_t>(length));
+            }
+
+        private:
+            int _fd;
+        };
+
+        class Thread {
+        public:
+            Thread(const Thread&) = delete;
+            Thread& operator=(const Thread&) = delete;
+
+            Thread(const string& name)
+                : Name(name)
+                , Stat()
+                , User(0)
+                , System(0)
+                , Sampled(false)
+            {
+            }
+            ~Thread()
+            {
+            }
+
+        public:
+            string Name; // Threads usually name themselves after they are started
+            ProcFile Stat;
+            uint64_t User;
+            uint64_t System;
+            bool Sampled;
+        };
+
+        typedef std::map<Core::process_t, Thread> ThreadMap;
+
+        class Process {
+        public:
+            Process(const Process&) = delete;
+            Process& operator=(const Process&) = delete;
+
+            Process(const string& name)
+                : Name(name)
+                , Callsign()
+                , Stat()
+                , User(0)
+                , System(0)
+                , Total(0)
+                , Threads()
+            {
+            }
+            ~Process()
+            {
+            }
+
+        public:
+            const string Name;
+            string Callsign; // Of the plugin hosted, if this is a plugin host process
+            ProcFile Stat;
+            uint64_t User;
+            uint64_t System;
+            uint64_t Total; // Value of /proc/stat at the previous sample
+            ThreadMap Threads;
+        };
+
+        // For samples without thread details.
+        struct NoThreads {
+            void operator()(const Core::process_t, const string&, const Core::process_t, const string&, const uint64_t, const uint64_t) const
+            {
+            }
+        };
+
+        typedef std::map<Core::process_t, Process> ProcessMap;
+
+    public:
+        ProcessSampler() = delete;
+        ProcessSampler(const ProcessSampler&) = delete;
+        ProcessSampler& operator=(const ProcessSampler&) = delete;
+
+        ProcessSampler(const std::list<string>& names, const uint16_t rescan, const bool threads)
+            : _names(names)
+            , _processes()
+            , _stat()
+            , _netlink(-1)
+            , _rescan(std::max(rescan, static_cast<uint16_t>(1)))
+            , _countdown(0)
+            , _threads(threads)
+            , _total(0)
+            , _elapsed(0)
+        {
+            if (_stat.Open("/proc/stat") == false) {
+                TRACE_L1("Could not open /proc/stat.");
+            }
+            if (Listen() == false) {
+                TRACE_L1("No process events available, rescanning /proc every %d samples.", _rescan);
+            }
+
+            Rescan();
+        }
+        ~ProcessSampler()
+        {
+            if (_netlink != -1) {
+                ::close(_netlink);
+            }
+        }
+
+    public:
+        // Clock ticks of all CPUs together between the previous two samples.
+        inline uint64_t Elapsed() const
+        {
+            return (_elapsed);
+        }
+
+        // Samples all matching processes and calls action(id, name, user, system) for every process that is still
+        // running. User and system time are in percent of all CPUs together (not of a single core, as top shows
+        // by default) since the previous sample of that process, and are 0 for its first sample.
+        template <typename ACTION>
+        void Sample(ACTION&& action)
+        {
+            Sample(action, NoThreads());
+        }
+        // As above, if threads are sampled threadAction(id, callsign, thread id, thread name, user, system) is called
+        // for every thread of the process as well, with the clock ticks spent since the previous sample.
+        template <typename ACTION, typename THREADACTION>
+        void Sample(ACTION&& action, THREADACTION&& threadAction)
+        {
+            char buffer[BufferSize];
+
+            if (_netlink != -1) {
+                Events();
+            } else if (--_countdown == 0) {
+                Rescan();
+            }
+
+            uint64_t total = 0;
+
+            if (_stat.Read(buffer, sizeof(buffer)) != 0) {
+                // cpu user nice system idle iowait irq softirq steal guest
+                const char* text = Skip(buffer, 1);
+
+                for (uint8_t index = 0; index < 9; index++) {
+                    uint64_t value;
+                    text = Number(text, value);
+                    total += value;
+                }
+            }
+
+            _elapsed = ((_total != 0) && (total > _total) ? total - _total : 0);
+            _total = total;
+
+            ProcessMap::iterator index(_processes.begin());
+
+            while (index != _processes.end()) {
+                uint64_t user, system;
+
+                if (Times(index->second.Stat, buffer, sizeof(buffer), user, system) == false) {
+                    index = _processes.erase(index);
+                } else {
+                    Process& process(index->second);
+                    double userTime = 0.0;
+                    double systemTime = 0.0;
+
+                    if ((process.Total != 0) && (total > process.Total)) {
+                        userTime = (100.0 * (user - process.User)) / (total - process.Total);
+                        systemTime = (100.0 * (system - process.System)) / (total - process.Total);
+                    }
+
+                    process.User = user;
+                    process.System = system;
+                    process.Total = total;
+
+                    action(index->first, process.Name, userTime, systemTime);
+
+                    ThreadMap::iterator loop(process.Threads.begin());
+
+                    while (loop != process.Threads.end()) {
+                        Thread& thread(loop->second);
+
+                        if (Times(thread.Stat, buffer, sizeof(buffer), user, system) == false) {
+                            loop = process.Threads.erase(loop);
+                        } else {
+                            if (thread.Sampled == true) {
+                                threadAction(index->first, process.Callsign, loop->first, thread.Name, user - thread.User, system - thread.System);
+                            }
+
+                            thread.User = user;
+                            thread.System = system;
+                            thread.Sampled = true;
+                            loop++;
+                        }
+                    }
+
+                    index++;
+                }
+            }
+        }
+
+    private:
+        static const char* Skip(const char* text, uint8_t fields)
+        {
+            while ((fields != 0) && (*text != '\0')) {
+                while (*text == ' ') {
+                    text++;
+                }
+                while ((*text != ' ') && (*text != '\0')) {
+                    text++;
+                }
+                fields--;
+            }
+
+            return (text);
+        }
+        static const char* Number(const char* text, uint64_t& value)
+        {
+            value = 0;
+
+            while (*text == ' ') {
+                text++;
+            }
+            while ((*text >= '0') && (*text <= '9')) {
+                value = (value * 10) + (*text - '0');
+                text++;
+            }
+
+            return (text);
+        }
+        static bool Times(const ProcFile& file, char buffer[], const uint16_t size, uint64_t& user, uint64_t& system)
+        {
+            bool result = false;
+
+            if (file.Read(buffer, size) != 0) {
+                // The name (field 2) is between parentheses and may contain anything, including spaces and
+                // parentheses, so the fields are counted from the last closing parenthesis. The next field is
+                // the state (3), utime and stime are fields 14 and 15.
+                const char* text = ::strrchr(buffer, ')');
+
+                if (text != nullptr) {
+                    text = Number(Skip(text + 1, 11), user);
+                    Number(text, system);
+                    result = true;
+                }
+            }
+
+            return (result);
+        }
+
+        bool Matches(const char name[]) const
+        {
+            std::list<string>::const_iterator index(_names.begin());
+
+            while ((index != _names.end()) && (::strncmp(name, index->c_str(), index->length()) != 0)) {
+                index++;
+            }
+
+            return (index != _names.end());
+        }
+        void Discover(const Core::process_t id)
+        {
+            char path[32];
+            char name[32];
+
+            if (_processes.find(id) == _processes.end()) {
+                ::snprintf(path, sizeof(path), "/proc/%u/comm", id);
+
+                if (Name(path, name, sizeof(name)) == true) {
+                    if (Matches(name) == true) {
+                        ProcessMap::iterator index = _processes.emplace(std::piecewise_construct,
+                            std::forward_as_tuple(id),
+                            std::forward_as_tuple(string(name))).first;
+
+                        ::snprintf(path, sizeof(path), "/proc/%u/stat", id);
+
+                        if (index->second.Stat.Open(path) == false) {
+                            _processes.erase(index);
+                        } else if (_threads == true) {
+                            index->second.Callsign = Callsign(id);
+                            Tasks(id, index->second);
+                        }
+                    }
+                }
+            }
+        }
+        // Plugins running out of process are hosted by a process started with "-C <callsign>".
+        static string Callsign(const Core::process_t id)
+        {
+            char path[32];
+            char buffer[BufferSize];
+            ProcFile cmdline;
+            string result;
+
+            ::snprintf(path, sizeof(path), "/proc/%u/cmdline", id);
+
+            if (cmdline.Open(path) == true) {
+                const uint16_t length = cmdline.Read(buffer, sizeof(buffer));
+                const char* argument = buffer;
+
+                // The arguments are separated by a '\0'.
+                while ((argument < (buffer + length)) && (result.empty() == true)) {
+                    const char* next = argument + ::strlen(argument) + 1;
+
+                    if ((::strcmp(argument, "-C") == 0) && (next < (buffer + length))) {
+                        result = next;
+                    }
+                    argument = next;
+                }
+            }
+
+            return (result);
+        }
+        static bool Name(const char path[], char name[], const uint16_t size)
+        {
+            ProcFile comm;
+            bool result = ((comm.Open(path) == true) && (comm.Read(name, size) != 0));
+
+            if (result == true) {
+                char* end = ::strchr(name, '\n');
+
+                if (end != nullptr) {
+                    *end = '\0';
+                }
+            }
+
+            return (result);
+        }
+        void Task(const Core::process_t id, Process& process, const Core::process_t task)
+        {
+            char path[48];
+            char name[32];
+
+            if (process.Threads.find(task) == process.Threads.end()) {
+                ::snprintf(path, sizeof(path), "/proc/%u/task/%u/comm", id, task);
+
+                if (Name(path, name, sizeof(name)) == true) {
+                    ThreadMap::iterator index = process.Threads.emplace(std::piecewise_construct,
+                        std::forward_as_tuple(task),
+                        std::forward_as_tuple(string(name))).first;
+
+                    ::snprintf(path, sizeof(path), "/proc/%u/task/%u/stat", id, task);
+
+                    if (index->second.Stat.Open(path) == false) {
+                        process.Threads.erase(index);
+                    }
+                }
+            }
+        }
+        void Tasks(const Core::process_t id, Process& process)
+        {
+            char path[32];
+
+            ::snprintf(path, sizeof(path), "/proc/%u/task", id);
+
+            DIR* directory = ::opendir(path);
+
+            if (directory != nullptr) {
+                struct dirent* entry;
+
+                while ((entry = ::readdir(directory)) != nullptr) {
+                    if ((entry->d_name[0] >= '0') && (entry->d_name[0] <= '9')) {
+                        Task(id, process, static_cast<Core::process_t>(::strtoul(entry->d_name, nullptr, 10)));
+                    }
+                }
+
+                ::closedir(directory);
+            }
+        }
+        void Rename(const Core::process_t id, const Core::process_t task)
+        {
+            ProcessMap::iterator index(_processes.find(id));
+
+            if (index != _processes.end()) {
+                ThreadMap::iterator loop(index->second.Threads.find(task));
+
+                if (loop != index->second.Threads.end()) {
+                    char path[48];
+                    char name[32];
+
+                    ::snprintf(path, sizeof(path), "/proc/%u/task/%u/comm", id, task);
+
+                    if (Name(path, name, sizeof(name)) == true) {
+                        loop->second.Name = name;
+                    }
+                }
+            }
+        }
+        void Rescan()
+        {
+            DIR* directory = ::opendir("/proc");
+
+            if (directory != nullptr) {
+                struct dirent* entry;
+
+                while ((entry = ::readdir(directory)) != nullptr) {
+                    if ((entry->d_name[0] >= '0') && (entry->d_name[0] <= '9')) {
+                        Discover(static_cast<Core::process_t>(::strtoul(entry->d_name, nullptr, 10)));
+                    }
+                }
+
+                ::closedir(directory);
+            }
+
+            if (_threads == true) {
+                for (std::pair<const Core::process_t, Process>& entry : _processes) {
+                    Tasks(entry.first, entry.second);
+                }
+            }
+
+            _countdown = _rescan;
+        }
+
+        bool Listen()
+        {
+            _netlink = ::socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+
+            if (_netlink != -1) {
+                struct sockaddr_nl address;
+                char request[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+
+                ::memset(&address, 0, sizeof(address));
+                address.nl_family = AF_NETLINK;
+                address.nl_groups = CN_IDX_PROC;
+
+                ::memset(request, 0, sizeof(request));
+                struct nlmsghdr* header = reinterpret_cast<struct nlmsghdr*>(request);
+                header->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+                header->nlmsg_type = NLMSG_DONE;
+                header->nlmsg_pid = ::getpid();
+
+                struct cn_msg* message = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(header));
+                message->id.idx = CN_IDX_PROC;
+                message->id.val = CN_VAL_PROC;
+                message->len = sizeof(enum proc_cn_mcast_op);
+                *reinterpret_cast<enum proc_cn_mcast_op*>(message->data) = PROC_CN_MCAST_LISTEN;
+
+                if ((::bind(_netlink, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) || (::send(_netlink, request, header->nlmsg_len, 0) < 0)) {
+                    ::close(_netlink);
+                    _netlink = -1;
+                }
+            }
+
+            return (_netlink != -1);
+        }
+        // Drains the process events queued since the previous sample, without blocking.
+        void Events()
+        {
+            char buffer[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+            ssize_t length;
+
+            while ((length = ::recv(_netlink, buffer, sizeof(buffer), 0)) > 0) {
+                struct nlmsghdr* header = reinterpret_cast<struct nlmsghdr*>(buffer);
+
+                for (; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+                    const struct cn_msg* message = reinterpret_cast<const struct cn_msg*>(NLMSG_DATA(header));
+
+                    if ((message->id.idx == CN_IDX_PROC) && (message->id.val == CN_VAL_PROC)) {
+                        const struct proc_event* event = reinterpret_cast<const struct proc_event*>(message->data);
+
+                        // Threads report events as well, these only matter if threads are sampled.
+                        switch (event->what) {
+                        case proc_event::PROC_EVENT_FORK:
+                            if (event->event_data.fork.child_pid == event->event_data.fork.child_tgid) {
+                                Discover(event->event_data.fork.child_pid);
+                            } else if (_threads == true) {
+                                ProcessMap::iterator index(_processes.find(event->event_data.fork.child_tgid));
+
+                                if (index != _processes.end()) {
+                                    Task(index->first, index->second, event->event_data.fork.child_pid);
+                                }
+                            }
+                            break;
+                        case proc_event::PROC_EVENT_COMM:
+                            if (_threads == true) {
+                                Rename(event->event_data.comm.process_tgid, event->event_data.comm.process_pid);
+                            }
+                            break;
+                        case proc_event::PROC_EVENT_EXEC:
+                            // The name changes on exec, so it might match now, or no longer.
+                            _processes.erase(event->event_data.exec.process_pid);
+                            Discover(event->event_data.exec.process_pid);
+                            break;
+                        case proc_event::PROC_EVENT_EXIT:
+                            if (event->event_data.exit.process_pid == event->event_data.exit.process_tgid) {
+                                _processes.erase(event->event_data.exit.process_pid);
+                            } else if (_threads == true) {
+                                ProcessMap::iterator index(_processes.find(event->event_data.exit.process_tgid));
+
+                                if (index != _processes.end()) {
+                                    index->second.Threads.erase(event->event_data.exit.process_pid);
+                                }
+                            }
+                            break;
+                        default:
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if ((length < 0) && (errno == ENOBUFS)) {
+                // The kernel dropped events, the only way to be sure nothing is missed is a full scan.
+                Rescan();
+            }
+        }
+
+    private:
+        const std::list<string> _names;
+        ProcessMap _processes;
+        ProcFile _stat;
+        int _netlink;
+        uint16_t _rescan;
+        uint16_t _countdown;
+        const bool _threads;
+        uint64_t _total;
+        uint64_t _elapsed;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
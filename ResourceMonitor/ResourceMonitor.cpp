@@ -26,6 +26,9 @@ namespace WPEFramework
 
         SERVICE_REGISTRATION(ResourceMonitor, 1, 0);
 
+        static Core::ProxyPoolType<Web::JSONBodyType<ResourceMonitor::SamplesData>> jsonBodyFactory(1);
+        static Core::ProxyPoolType<Web::JSONBodyType<ResourceMonitor::TopData>> jsonTopFactory(1);
+
         const string ResourceMonitor::Initialize(PluginHost::IShell *service)
         {
             string message;
@@ -38,6 +41,10 @@ namespace WPEFramework
 
             _skipURL = static_cast<uint32_t>(_service->WebPrefix().length());
 
+            Config config;
+            config.FromString(_service->ConfigLine());
+            _storePath = config.Store.Value();
+
             _monitor = _service->Root<Exchange::IResourceMonitor>(_connectionId, 2000, _T("ResourceMonitorImplementation"));
 
             if (_monitor == nullptr)
@@ -83,6 +90,107 @@ namespace WPEFramework
             return "";
         }
 
+        // GET .../ResourceMonitor/samples?level=0&pid=0&name=WPE&from=0&to=4294967295
+        // The store is mapped read-only in this process, so queries do not load the monitor itself.
+        void ResourceMonitor::Samples(const Web::Request &request, Web::Response &response) const
+        {
+            uint8_t level = 0;
+            uint32_t pid = 0;
+            uint32_t from = 0;
+            uint32_t to = ~0;
+            string name;
+
+            if (request.Query.IsSet() == true)
+            {
+                Core::URL::KeyValue options(request.Query.Value());
+
+                level = options.Number<uint8_t>(_T("level"), 0);
+                pid = options.Number<uint32_t>(_T("pid"), 0);
+                from = options.Number<uint32_t>(_T("from"), 0);
+                to = options.Number<uint32_t>(_T("to"), static_cast<uint32_t>(~0));
+
+                if (options.Exists(_T("name"), true) == true)
+                {
+                    name = options[_T("name")].Text();
+                }
+            }
+
+            SampleStore store;
+
+            if (level >= SampleStore::Levels)
+            {
+                response.ErrorCode = Web::STATUS_BAD_REQUEST;
+                response.Message = _T("Unknown level.");
+            }
+            else if (store.Open(_storePath) != Core::ERROR_NONE)
+            {
+                response.ErrorCode = Web::STATUS_NOT_FOUND;
+                response.Message = _T("No samples stored yet.");
+            }
+            else
+            {
+                Core::ProxyType<Web::JSONBodyType<SamplesData>> body(jsonBodyFactory.Element());
+
+                body->Factor = static_cast<uint16_t>(store.Factor());
+                body->Samples.Clear();
+
+                store.Query(level, pid, name, from, to, [&body](const SampleStore::Rollup &record) {
+                    SampleData &sample(body->Samples.Add());
+
+                    sample.Time = record.Time;
+                    sample.Pid = record.Id;
+                    sample.Name = string(record.Name, ::strnlen(record.Name, SampleStore::NameLength));
+                    sample.Count = record.Count;
+                    sample.Minimum.Set(record.Minimum);
+                    sample.Average.Set(record.Average);
+                    sample.Maximum.Set(record.Maximum);
+                });
+
+                response.ErrorCode = Web::STATUS_OK;
+                response.ContentType = Web::MIMETypes::MIME_JSON;
+                response.Message = _T("OK");
+                response.Body(Core::ProxyType<Web::IBody>(body));
+            }
+        }
+
         /* static */ Core::ProxyPoolType<Web::TextBody> ResourceMonitor::webBodyFactory(4);
+
+        // GET .../ResourceMonitor/top
+        // The owners (plugins, or threads that could not be attributed) that used most CPU over the last window.
+        void ResourceMonitor::Top(Web::Response &response) const
+        {
+            SampleStore store;
+            std::vector<SampleStore::Usage> ranking;
+            uint32_t window = 0;
+
+            if ((store.Open(_storePath) == Core::ERROR_NONE) && ((window = store.Ranking(ranking)) != 0))
+            {
+                Core::ProxyType<Web::JSONBodyType<TopData>> body(jsonTopFactory.Element());
+
+                body->Window = window;
+                body->Top.Clear();
+
+                for (const SampleStore::Usage &usage : ranking)
+                {
+                    UsageData &entry(body->Top.Add());
+
+                    entry.Owner = string(usage.Owner, ::strnlen(usage.Owner, SampleStore::NameLength));
+                    entry.Pid = usage.Id;
+                    entry.Threads = usage.Threads;
+                    entry.User = usage.User;
+                    entry.System = usage.System;
+                }
+
+                response.ErrorCode = Web::STATUS_OK;
+                response.ContentType = Web::MIMETypes::MIME_JSON;
+                response.Message = _T("OK");
+                response.Body(Core::ProxyType<Web::IBody>(body));
+            }
+            else
+            {
+                response.ErrorCode = Web::STATUS_NOT_FOUND;
+                response.Message = _T("No ranking available, thread sampling might be disabled.");
+            }
+        }
     } // namespace Plugin
 } // namespace WPEFramework
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "Module.h"
+#include "SampleStore.h"
 #include <interfaces/IMemory.h>
 #include <interfaces/IResourceMonitor.h>
 
@@ -32,9 +33,231 @@ namespace WPEFramework
             ResourceMonitor(const ResourceMonitor &) = delete;
             ResourceMonitor &operator=(const ResourceMonitor &) = delete;
 
+            class Config : public Core::JSON::Container
+            {
+            private:
+                Config(const Config &) = delete;
+                Config &operator=(const Config &) = delete;
+
+            public:
+                Config()
+                    : Core::JSON::Container(), Store(_T("/tmp/resource.store"))
+                {
+                    Add(_T("store"), &Store);
+                }
+                ~Config() override
+                {
+                }
+
+            public:
+                Core::JSON::String Store;
+            };
+
+        public:
+            class MetricsData : public Core::JSON::Container
+            {
+            public:
+                MetricsData()
+                    : Core::JSON::Container()
+                {
+                    Init();
+                }
+                MetricsData(const MetricsData &copy)
+                    : Core::JSON::Container(), USS(copy.USS), PSS(copy.PSS), RSS(copy.RSS), VSS(copy.VSS), User(copy.User), System(copy.System)
+                {
+                    Init();
+                }
+                ~MetricsData() override
+                {
+                }
+
+                MetricsData &operator=(const MetricsData &rhs)
+                {
+                    USS = rhs.USS;
+                    PSS = rhs.PSS;
+                    RSS = rhs.RSS;
+                    VSS = rhs.VSS;
+                    User = rhs.User;
+                    System = rhs.System;
+
+                    return (*this);
+                }
+
+                void Set(const SampleStore::Metrics &metrics)
+                {
+                    USS = metrics.USS;
+                    PSS = metrics.PSS;
+                    RSS = metrics.RSS;
+                    VSS = metrics.VSS;
+                    User = metrics.User;
+                    System = metrics.System;
+                }
+
+            private:
+                void Init()
+                {
+                    Add(_T("uss"), &USS);
+                    Add(_T("pss"), &PSS);
+                    Add(_T("rss"), &RSS);
+                    Add(_T("vss"), &VSS);
+                    Add(_T("user"), &User);
+                    Add(_T("system"), &System);
+                }
+
+            public:
+                Core::JSON::DecUInt32 USS; // KiB
+                Core::JSON::DecUInt32 PSS;
+                Core::JSON::DecUInt32 RSS;
+                Core::JSON::DecUInt32 VSS;
+                Core::JSON::DecUInt16 User; // Hundredths of a percent of all CPUs
+                Core::JSON::DecUInt16 System;
+            };
+
+            class SampleData : public Core::JSON::Container
+            {
+            public:
+                SampleData()
+                    : Core::JSON::Container()
+                {
+                    Init();
+                }
+                SampleData(const SampleData &copy)
+                    : Core::JSON::Container(), Time(copy.Time), Pid(copy.Pid), Name(copy.Name), Count(copy.Count), Minimum(copy.Minimum), Average(copy.Average), Maximum(copy.Maximum)
+                {
+                    Init();
+                }
+                ~SampleData() override
+                {
+                }
+
+                SampleData &operator=(const SampleData &rhs)
+                {
+                    Time = rhs.Time;
+                    Pid = rhs.Pid;
+                    Name = rhs.Name;
+                    Count = rhs.Count;
+                    Minimum = rhs.Minimum;
+                    Average = rhs.Average;
+                    Maximum = rhs.Maximum;
+
+                    return (*this);
+                }
+
+            private:
+                void Init()
+                {
+                    Add(_T("time"), &Time);
+                    Add(_T("pid"), &Pid);
+                    Add(_T("name"), &Name);
+                    Add(_T("count"), &Count);
+                    Add(_T("minimum"), &Minimum);
+                    Add(_T("average"), &Average);
+                    Add(_T("maximum"), &Maximum);
+                }
+
+            public:
+                Core::JSON::DecUInt32 Time; // Seconds since the epoch
+                Core::JSON::DecUInt32 Pid;
+                Core::JSON::String Name;
+                Core::JSON::DecUInt32 Count; // Samples covered
+                MetricsData Minimum;
+                MetricsData Average;
+                MetricsData Maximum;
+            };
+
+            class SamplesData : public Core::JSON::Container
+            {
+            private:
+                SamplesData(const SamplesData &) = delete;
+                SamplesData &operator=(const SamplesData &) = delete;
+
+            public:
+                SamplesData()
+                    : Core::JSON::Container()
+                {
+                    Add(_T("factor"), &Factor);
+                    Add(_T("samples"), &Samples);
+                }
+                ~SamplesData() override
+                {
+                }
+
+            public:
+                Core::JSON::DecUInt16 Factor; // Records of one level in a record of the next
+                Core::JSON::ArrayType<SampleData> Samples;
+            };
+
+            class UsageData : public Core::JSON::Container
+            {
+            public:
+                UsageData()
+                    : Core::JSON::Container()
+                {
+                    Init();
+                }
+                UsageData(const UsageData &copy)
+                    : Core::JSON::Container(), Owner(copy.Owner), Pid(copy.Pid), Threads(copy.Threads), User(copy.User), System(copy.System)
+                {
+                    Init();
+                }
+                ~UsageData() override
+                {
+                }
+
+                UsageData &operator=(const UsageData &rhs)
+                {
+                    Owner = rhs.Owner;
+                    Pid = rhs.Pid;
+                    Threads = rhs.Threads;
+                    User = rhs.User;
+                    System = rhs.System;
+
+                    return (*this);
+                }
+
+            private:
+                void Init()
+                {
+                    Add(_T("owner"), &Owner);
+                    Add(_T("pid"), &Pid);
+                    Add(_T("threads"), &Threads);
+                    Add(_T("user"), &User);
+                    Add(_T("system"), &System);
+                }
+
+            public:
+                Core::JSON::String Owner; // Plugin, or the thread if it could not be attributed
+                Core::JSON::DecUInt32 Pid;
+                Core::JSON::DecUInt16 Threads;
+                Core::JSON::DecUInt16 User; // Hundredths of a percent of all CPUs
+                Core::JSON::DecUInt16 System;
+            };
+
+            class TopData : public Core::JSON::Container
+            {
+            private:
+                TopData(const TopData &) = delete;
+                TopData &operator=(const TopData &) = delete;
+
+            public:
+                TopData()
+                    : Core::JSON::Container()
+                {
+                    Add(_T("window"), &Window);
+                    Add(_T("top"), &Top);
+                }
+                ~TopData() override
+                {
+                }
+
+            public:
+                Core::JSON::DecUInt32 Window; // Seconds
+                Core::JSON::ArrayType<UsageData> Top;
+            };
+
         public:
             ResourceMonitor()
-                : _service(nullptr), _monitor(nullptr), _connectionId(0)
+                : _service(nullptr), _monitor(nullptr), _connectionId(0), _storePath()
             {
             }
 
@@ -62,7 +285,17 @@ namespace WPEFramework
                     if (index.IsValid() == true && index.Next() == true)
                     {
                         const string requestStr = index.Current().Text();
-                        if (requestStr == "history")
+                        if (requestStr == "samples")
+                        {
+                            // Asked for a range of the stored samples
+                            Samples(request, *result);
+                        }
+                        else if (requestStr == "top")
+                        {
+                            // Asked for the owners using most CPU
+                            Top(*result);
+                        }
+                        else if (requestStr == "history")
                         {
                             // Asked for history csv
                             result->ErrorCode = Web::STATUS_OK;
@@ -89,12 +322,17 @@ namespace WPEFramework
             void Deinitialize(PluginHost::IShell *service) override;
             string Information() const override;
 
+        private:
+            void Samples(const Web::Request &request, Web::Response &response) const;
+            void Top(Web::Response &response) const;
+
         private:
             PluginHost::IShell *_service;
             Exchange::IResourceMonitor *_monitor;
             uint32_t _connectionId;
             static Core::ProxyPoolType<Web::TextBody> webBodyFactory;
             uint32_t _skipURL;
+            string _storePath;
         };
     } // namespace Plugin
 } // namespace WPEFramework
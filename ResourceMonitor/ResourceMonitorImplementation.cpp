@@ -17,11 +17,14 @@
  * limitations under the License.
  */
 #include "Module.h"
+#include "ProcessSampler.h"
+#include "SampleStore.h"
+#include <algorithm>
 #include <bitset>
 #include <core/ProcessInfo.h>
-#include <fstream>
 #include <interfaces/IMemory.h>
 #include <interfaces/IResourceMonitor.h>
+#include <list>
 #include <numeric>
 #include <sstream>
 #include <unistd.h>
@@ -31,65 +34,43 @@ namespace WPEFramework {
 namespace Plugin {
     class ResourceMonitorImplementation : public Exchange::IResourceMonitor {
     private:
-        class CSVFile {
+        // Threads whose name starts with Thread are accounted to Owner.
+        class OwnerData : public Core::JSON::Container {
         public:
-            CSVFile(string filepath, string seperator)
-                : _file(filepath)
-                , _seperator()
+            OwnerData()
+                : Core::JSON::Container()
             {
-                _file.Create();
-                if (!_file.IsOpen()) {
-                    TRACE(Trace::Error, (_T("Could not open file <%s>. Full resource monitoring unavailable."), filepath));
-                } else {
-                    if (seperator.empty() || seperator.size() > 1) {
-                        TRACE(Trace::Error, (_T("Invalid seperator, falling back to ';'.")));
-                        _seperator = ';';
-                    } else {
-                        _seperator = seperator[0];
-                    }
-                }
-                _stringstream.precision(2);
+                Init();
             }
-
-            ~CSVFile()
+            OwnerData(const OwnerData& copy)
+                : Core::JSON::Container()
+                , Thread(copy.Thread)
+                , Owner(copy.Owner)
             {
-                if (_file.IsOpen()) {
-                    _file.Close();
-                }
+                Init();
             }
-
-            void Store()
+            ~OwnerData() override
             {
-                if (_file.IsOpen()) {
-                    std::string output = _stringstream.str();
-                    _file.Write(reinterpret_cast<const uint8_t*>(output.c_str()), output.length());
-                }
-                _stringstream.str("");
             }
 
-            template <typename FIRST, typename... Args>
-            void Append(const FIRST& first, Args... rest)
+            OwnerData& operator=(const OwnerData& rhs)
             {
-                _stringstream << first;
-                Append(true, rest...);
-            }
+                Thread = rhs.Thread;
+                Owner = rhs.Owner;
 
-        private:
-            template <typename FIRST, typename... Args>
-            void Append(bool dummy, const FIRST& first, Args... rest)
-            {
-                _stringstream << _seperator << first;
-                Append(dummy, rest...);
+                return (*this);
             }
 
-            void Append(bool)
+        private:
+            void Init()
             {
-                _stringstream << std::endl;
+                Add(_T("thread"), &Thread);
+                Add(_T("owner"), &Owner);
             }
 
-            Core::File _file;
-            std::stringstream _stringstream;
-            char _seperator;
+        public:
+            Core::JSON::String Thread;
+            Core::JSON::String Owner;
         };
 
         class Config : public Core::JSON::Container {
@@ -98,21 +79,52 @@ namespace Plugin {
 
             Config()
                 : Core::JSON::Container()
-                , Path(_T("/tmp/resource.csv"))
+                , Path()
                 , Seperator(_T(";"))
+                , Rows(10)
                 , Interval(5)
+                , Rescan(6)
+                , Store(_T("/tmp/resource.store"))
+                , Samples(4096)
+                , Rollups(4096)
+                , Factor(12)
+                , Threads(false)
+                , Top(10)
+                , Window(12)
+                , Owners()
             {
                 Add(_T("csv_filepath"), &Path);
                 Add(_T("csv_sep"), &Seperator);
+                Add(_T("csv_rows"), &Rows);
                 Add(_T("interval"), &Interval);
                 Add(_T("names"), &FilterNames);
+                Add(_T("rescan"), &Rescan);
+                Add(_T("store"), &Store);
+                Add(_T("samples"), &Samples);
+                Add(_T("rollups"), &Rollups);
+                Add(_T("factor"), &Factor);
+                Add(_T("threads"), &Threads);
+                Add(_T("top"), &Top);
+                Add(_T("window"), &Window);
+                Add(_T("owners"), &Owners);
             }
 
             Config(const Config& copy)
                 : Core::JSON::Container()
                 , Path(copy.Path)
+                , Seperator(copy.Seperator)
+                , Rows(copy.Rows)
                 , Interval(copy.Interval)
                 , FilterNames(copy.FilterNames)
+                , Rescan(copy.Rescan)
+                , Store(copy.Store)
+                , Samples(copy.Samples)
+                , Rollups(copy.Rollups)
+                , Factor(copy.Factor)
+                , Threads(copy.Threads)
+                , Top(copy.Top)
+                , Window(copy.Window)
+                , Owners(copy.Owners)
             {
             }
 
@@ -121,10 +133,162 @@ namespace Plugin {
             }
 
         public:
-            Core::JSON::String Path;
+            Core::JSON::String Path; // No longer used, the samples are kept in the store
             Core::JSON::String Seperator;
+            Core::JSON::DecUInt32 Rows; // Most recent samples in the CSV history, 0 for all of the store
             Core::JSON::DecUInt32 Interval;
             Core::JSON::ArrayType<Core::JSON::String> FilterNames;
+            Core::JSON::DecUInt16 Rescan; // Intervals between scans of /proc, if process events are not available
+            Core::JSON::String Store;
+            Core::JSON::DecUInt32 Samples; // Records kept at full detail, for all processes together
+            Core::JSON::DecUInt32 Rollups; // Records kept per rollup level
+            Core::JSON::DecUInt16 Factor; // Records of one level combined into a rollup of the next
+            Core::JSON::Boolean Threads; // Sample the threads and rank their owners, costs a /proc read per thread per interval
+            Core::JSON::DecUInt8 Top; // Owners in the ranking
+            Core::JSON::DecUInt16 Window; // Intervals the ranking covers
+            Core::JSON::ArrayType<OwnerData> Owners;
+        };
+
+        // CPU usage per owner (a plugin, or a thread that could not be attributed) over a sliding window of
+        // intervals. Every owner keeps the clock ticks it used per interval, so moving the window is subtracting
+        // the interval that drops out.
+        class Ranking {
+        private:
+            class Owner {
+            public:
+                Owner() = delete;
+                Owner(const Owner&) = delete;
+                Owner& operator=(const Owner&) = delete;
+
+                Owner(const uint16_t window)
+                    : User(window, 0)
+                    , System(window, 0)
+                    , UserSum(0)
+                    , SystemSum(0)
+                    , Threads(0)
+                {
+                }
+                ~Owner()
+                {
+                }
+
+            public:
+                std::vector<uint64_t> User;
+                std::vector<uint64_t> System;
+                uint64_t UserSum;
+                uint64_t SystemSum;
+                uint16_t Threads;
+            };
+
+            // Owners are counted per process, different processes may have threads of the same name.
+            typedef std::map<std::pair<Core::process_t, string>, Owner> OwnerMap;
+
+        public:
+            Ranking() = delete;
+            Ranking(const Ranking&) = delete;
+            Ranking& operator=(const Ranking&) = delete;
+
+            Ranking(const uint16_t window, const uint8_t top)
+                : _owners()
+                , _elapsed(std::max(window, static_cast<uint16_t>(1)), 0)
+                , _elapsedSum(0)
+                , _slot(0)
+                , _top(top)
+            {
+            }
+            ~Ranking()
+            {
+            }
+
+        public:
+            // Starts a new interval, the oldest one leaves the window.
+            void Begin()
+            {
+                _slot = (_slot + 1) % _elapsed.size();
+                _elapsedSum -= _elapsed[_slot];
+                _elapsed[_slot] = 0;
+
+                OwnerMap::iterator index(_owners.begin());
+
+                while (index != _owners.end()) {
+                    Owner& owner(index->second);
+
+                    owner.UserSum -= owner.User[_slot];
+                    owner.SystemSum -= owner.System[_slot];
+                    owner.User[_slot] = 0;
+                    owner.System[_slot] = 0;
+                    owner.Threads = 0;
+
+                    if ((owner.UserSum == 0) && (owner.SystemSum == 0)) {
+                        index = _owners.erase(index);
+                    } else {
+                        index++;
+                    }
+                }
+            }
+            void Add(const Core::process_t id, const string& name, const uint64_t user, const uint64_t system)
+            {
+                OwnerMap::iterator index(_owners.find(std::make_pair(id, name)));
+
+                if (index == _owners.end()) {
+                    index = _owners.emplace(std::piecewise_construct,
+                        std::forward_as_tuple(id, name),
+                        std::forward_as_tuple(static_cast<uint16_t>(_elapsed.size()))).first;
+                }
+
+                Owner& owner(index->second);
+
+                owner.User[_slot] += user;
+                owner.System[_slot] += system;
+                owner.UserSum += user;
+                owner.SystemSum += system;
+                owner.Threads++;
+            }
+            // Closes the interval and returns the owners that used most, highest first.
+            void End(const uint64_t elapsed, std::vector<SampleStore::Usage>& ranking)
+            {
+                typedef std::pair<uint64_t, const OwnerMap::value_type*> Entry;
+
+                std::vector<Entry> entries;
+
+                _elapsed[_slot] = elapsed;
+                _elapsedSum += elapsed;
+
+                entries.reserve(_owners.size());
+
+                for (const OwnerMap::value_type& owner : _owners) {
+                    entries.emplace_back(owner.second.UserSum + owner.second.SystemSum, &owner);
+                }
+
+                const size_t count = std::min(entries.size(), static_cast<size_t>(_top));
+
+                std::partial_sort(entries.begin(), entries.begin() + count, entries.end(), [](const Entry& lhs, const Entry& rhs) {
+                    return (lhs.first > rhs.first);
+                });
+
+                ranking.clear();
+
+                for (size_t index = 0; (index < count) && (_elapsedSum != 0); index++) {
+                    const OwnerMap::value_type& owner(*(entries[index].second));
+                    SampleStore::Usage usage;
+
+                    ::memset(&usage, 0, sizeof(usage));
+                    ::strncpy(usage.Owner, owner.first.second.c_str(), sizeof(usage.Owner) - 1);
+                    usage.Id = owner.first.first;
+                    usage.Threads = owner.second.Threads;
+                    usage.User = static_cast<uint16_t>((owner.second.UserSum * 10000) / _elapsedSum);
+                    usage.System = static_cast<uint16_t>((owner.second.SystemSum * 10000) / _elapsedSum);
+
+                    ranking.push_back(usage);
+                }
+            }
+
+        private:
+            OwnerMap _owners;
+            std::vector<uint64_t> _elapsed;
+            uint64_t _elapsedSum;
+            uint32_t _slot;
+            const uint8_t _top;
         };
 
         class StatCollecter {
@@ -151,22 +315,26 @@ namespace Plugin {
 
         public:
             explicit StatCollecter(const Config& config)
-                : _userCpuTime(0)
-                , _systemCpuTime(0)
-                , _logfile(config.Path.Value(), config.Seperator.Value())
+                : _store()
                 , _interval(config.Interval.Value())
+                , _sampler(FilterNames(config), config.Rescan.Value(), config.Threads.Value())
+                , _threads(config.Threads.Value())
+                , _ranking(config.Window.Value(), config.Top.Value())
+                , _window(std::max(config.Window.Value(), static_cast<uint16_t>(1)))
+                , _owners()
+                , _usage()
                 , _worker(Core::ProxyType<Worker>::Create(this))
 
             {
-                _logfile.Append("Time[s]", "Name", "USS[KiB]", "PSS[KiB]", "RSS[KiB]", "VSS[KiB]", "UserTotalCPU[%]", "SystemTotalCPU[%]");
+                const uint32_t capacity[SampleStore::Levels] = { config.Samples.Value(), config.Rollups.Value(), config.Rollups.Value() };
 
-                if (config.FilterNames.Elements().Count() == 0) {
-                    _filterNames.push_back("WPE");
-                } else {
-                    auto filterIterator(config.FilterNames.Elements());
-                    while (filterIterator.Next()) {
-                        _filterNames.push_back(filterIterator.Current().Value());
-                    }
+                if (_store.Create(config.Store.Value(), capacity, std::max(config.Factor.Value(), static_cast<uint16_t>(2)), (_threads == true ? config.Top.Value() : 0)) != Core::ERROR_NONE) {
+                    TRACE(Trace::Error, (_T("Could not open store <%s>. Full resource monitoring unavailable."), config.Store.Value().c_str()));
+                }
+
+                auto ownerIterator(config.Owners.Elements());
+                while (ownerIterator.Next()) {
+                    _owners.emplace_back(ownerIterator.Current().Thread.Value(), ownerIterator.Current().Owner.Value());
                 }
 
                 Core::IWorkerPool::Instance().Schedule(Core::Time::Now(), Core::ProxyType<Core::IDispatch>(_worker));
@@ -178,114 +346,91 @@ namespace Plugin {
             }
 
         private:
-            void GetTotalTime(Core::process_t pid)
+            static std::list<string> FilterNames(const Config& config)
             {
-                std::ifstream stat("/proc/stat");
-                if (!stat.is_open()) {
-                    TRACE(Trace::Error, (_T("Could not open /proc/stat.")));
+                std::list<string> filterNames;
 
-                    return;
+                if (config.FilterNames.Elements().Count() == 0) {
+                    filterNames.push_back("WPE");
+                } else {
+                    auto filterIterator(config.FilterNames.Elements());
+                    while (filterIterator.Next()) {
+                        filterNames.push_back(filterIterator.Current().Value());
+                    }
                 }
-                std::string line;
-                std::istringstream iss;
 
-                std::getline(stat, line);
-                iss.str(line);
-
-                std::string dummy;
-                uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0, guest = 0;
-
-                iss >> dummy >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal >> guest;
-                _processTimeInfo[pid].totalTime = user + nice + system + idle + iowait + irq + softirq + steal + guest;
+                return (filterNames);
             }
 
-            void GetProcessTimes(Core::process_t pid)
+            // The plugin a thread belongs to: configured by thread name, else the plugin hosted by the process,
+            // else nothing better than the name of the thread itself.
+            const string& Owner(const string& callsign, const string& thread) const
             {
-                std::ostringstream pathToSmaps;
-                pathToSmaps << "/proc/" << pid << "/stat";
-
-                std::ifstream stat(pathToSmaps.str());
-                if (!stat.is_open()) {
-                    TRACE(Trace::Error, (_T("Could not open %s"), pathToSmaps.str()));
-                    return;
-                }
-
-                std::string uTimeString, sTimeString;
+                std::list<std::pair<string, string>>::const_iterator index(_owners.begin());
 
-                //ignoring 13 words spearated by space
-                for (uint32_t i = 0; i < 13; ++i) {
-                    stat.ignore(std::numeric_limits<std::streamsize>::max(), ' ');
+                while ((index != _owners.end()) && (thread.compare(0, index->first.length(), index->first) != 0)) {
+                    index++;
                 }
 
-                stat >> _processTimeInfo[pid].uTime >> _processTimeInfo[pid].sTime;
-            }
-
-            void CalculateCpuUsage(Core::process_t pid)
-            {
-                GetTotalTime(pid);
-                GetProcessTimes(pid);
-
-                _userCpuTime = 100.0 * (_processTimeInfo[pid].uTime - _processTimeInfo[pid].prevUTime) / (_processTimeInfo[pid].totalTime - _processTimeInfo[pid].prevTotalTime);
-
-                _systemCpuTime = 100.0 * (_processTimeInfo[pid].sTime - _processTimeInfo[pid].prevSTime) / (_processTimeInfo[pid].totalTime - _processTimeInfo[pid].prevTotalTime);
-
-                _processTimeInfo[pid].prevTotalTime = _processTimeInfo[pid].totalTime;
-                _processTimeInfo[pid].prevSTime = _processTimeInfo[pid].sTime;
-                _processTimeInfo[pid].prevUTime = _processTimeInfo[pid].uTime;
+                return (index != _owners.end() ? index->second : (callsign.empty() == false ? callsign : thread));
             }
 
             void Dispatch()
             {
+                if (_store.IsOpen() == true) {
+                    const uint32_t timestamp = static_cast<uint32_t>(Core::Time::Now().Ticks() / 1000 / 1000);
+
+                    if (_threads == false) {
+                        _sampler.Sample([this, timestamp](const Core::process_t id, const string& name, const double userCpuTime, const double systemCpuTime) {
+                            LogProcess(timestamp, id, name, userCpuTime, systemCpuTime);
+                        });
+                    } else {
+                        _ranking.Begin();
 
-                for (const auto& filterName : _filterNames) {
-                    std::list<Core::ProcessInfo> processes;
-                    Core::ProcessInfo::FindByName(filterName, false, processes);
+                        _sampler.Sample([this, timestamp](const Core::process_t id, const string& name, const double userCpuTime, const double systemCpuTime) {
+                            LogProcess(timestamp, id, name, userCpuTime, systemCpuTime);
+                        },
+                            [this](const Core::process_t id, const string& callsign, const Core::process_t, const string& name, const uint64_t user, const uint64_t system) {
+                                _ranking.Add(id, Owner(callsign, name), user, system);
+                            });
 
-                    for (const Core::ProcessInfo& process : processes) {
-                        CalculateCpuUsage(process.Id());
-                        LogProcess(process);
+                        _ranking.End(_sampler.Elapsed(), _usage);
+                        _store.Rank(_usage, _window * _interval);
                     }
+
+                    _store.Completed();
                 }
             }
 
-            void LogProcess(const Core::ProcessInfo& process)
+            void LogProcess(const uint32_t timestamp, const Core::process_t id, const string& name, const double userCpuTime, const double systemCpuTime)
             {
-                auto timestamp = static_cast<uint32_t>(Core::Time::Now().Ticks() / 1000 / 1000);
-                string name = process.Name() + " (" + std::to_string(process.Id()) + ")";
+                SampleStore::Sample sample;
+                Core::ProcessInfo process(id);
                 process.MemoryStats();
 
-                _logfile.Append(timestamp, name, process.USS(), process.PSS(), process.RSS(), process.VSS(), _userCpuTime, _systemCpuTime);
-                _logfile.Store();
+                ::memset(&sample, 0, sizeof(sample));
+                ::strncpy(sample.Name, name.c_str(), sizeof(sample.Name) - 1);
+                sample.Time = timestamp;
+                sample.Id = id;
+                sample.Value.USS = static_cast<uint32_t>(process.USS());
+                sample.Value.PSS = static_cast<uint32_t>(process.PSS());
+                sample.Value.RSS = static_cast<uint32_t>(process.RSS());
+                sample.Value.VSS = static_cast<uint32_t>(process.VSS());
+                sample.Value.User = static_cast<uint16_t>(userCpuTime * 100);
+                sample.Value.System = static_cast<uint16_t>(systemCpuTime * 100);
+
+                _store.Add(sample);
             }
 
         private:
-            struct Time {
-                Time()
-                    : totalTime(0)
-                    , sTime(0)
-                    , uTime(0)
-                    , prevTotalTime(0)
-                    , prevUTime(0)
-                    , prevSTime(0)
-                {
-                }
-                uint64_t totalTime;
-                uint64_t sTime;
-                uint64_t uTime;
-                uint64_t prevTotalTime;
-                uint64_t prevUTime;
-                uint64_t prevSTime;
-            };
-
-            //NOTE: these two indicate usage of the whole CPU, not the single core (as 'top' shows by default)
-            double _userCpuTime;
-            double _systemCpuTime;
-
-            std::map<Core::process_t, Time> _processTimeInfo;
-
-            CSVFile _logfile;
+            SampleStore _store;
             uint32_t _interval;
-            std::list<std::string> _filterNames;
+            ProcessSampler _sampler;
+            const bool _threads;
+            Ranking _ranking;
+            uint16_t _window;
+            std::list<std::pair<string, string>> _owners;
+            std::vector<SampleStore::Usage> _usage;
 
             Core::CriticalSection _guard;
             Core::ProxyType<Worker> _worker;
@@ -298,7 +443,9 @@ namespace Plugin {
     public:
         ResourceMonitorImplementation()
             : _processThread(nullptr)
-            , _csvFilePath()
+            , _storePath()
+            , _seperator(';')
+            , _rows(0)
         {
         }
 
@@ -316,6 +463,16 @@ namespace Plugin {
             if (config.Interval.Value() <= 0) {
                 TRACE(Trace::Error, (_T("Interval must be greater than 0!")));
             } else {
+                if ((config.Seperator.Value().empty() == true) || (config.Seperator.Value().size() > 1)) {
+                    TRACE(Trace::Error, (_T("Invalid seperator, falling back to ';'.")));
+                } else {
+                    _seperator = config.Seperator.Value()[0];
+                }
+                if (config.Path.IsSet() == true) {
+                    TRACE(Trace::Warning, (_T("csv_filepath is no longer used, the samples are kept in <%s>."), config.Store.Value().c_str()));
+                }
+                _storePath = config.Store.Value();
+                _rows = config.Rows.Value();
                 _processThread.reset(new StatCollecter(config));
                 result = Core::ERROR_NONE;
             }
@@ -323,27 +480,37 @@ namespace Plugin {
             return (result);
         }
 
+        // Converts the most recent samples at full detail into CSV.
         string CompileMemoryCsv() override
         {
-            const uint8_t lastMeasurementsHistory = 10;
-
-            std::ifstream csvFile(_csvFilePath, std::fstream::binary);
+            SampleStore store;
             std::ostringstream result;
-            std::string line;
-            std::vector<std::string> allLines;
 
-            while (std::getline(csvFile, line)) {
-                allLines.push_back(line);
-            }
-            if (allLines.size() > lastMeasurementsHistory) {
+            if (store.Open(_storePath) != Core::ERROR_NONE) {
+                result << "Not enough measurements yet!" << std::endl;
+            } else {
+                std::list<string> lines;
+                char line[128];
+
+                store.Query(0, 0, string(), 0, ~0, [&](const SampleStore::Rollup& sample) {
+                    ::snprintf(line, sizeof(line), "%u%c%.*s (%u)%c%u%c%u%c%u%c%u%c%u.%02u%c%u.%02u\n",
+                        sample.Time, _seperator,
+                        static_cast<int>(SampleStore::NameLength), sample.Name, sample.Id, _seperator,
+                        sample.Average.USS, _seperator, sample.Average.PSS, _seperator, sample.Average.RSS, _seperator, sample.Average.VSS, _seperator,
+                        sample.Average.User / 100, sample.Average.User % 100, _seperator,
+                        sample.Average.System / 100, sample.Average.System % 100);
+                    lines.emplace_back(line);
+
+                    if ((_rows != 0) && (lines.size() > _rows)) {
+                        lines.pop_front();
+                    }
+                });
 
-                result << allLines.front() << "\n"; //write header
+                result << "Time[s]" << _seperator << "Name" << _seperator << "USS[KiB]" << _seperator << "PSS[KiB]" << _seperator << "RSS[KiB]" << _seperator << "VSS[KiB]" << _seperator << "UserTotalCPU[%]" << _seperator << "SystemTotalCPU[%]" << "\n";
 
-                for (auto currentLine = allLines.end() - lastMeasurementsHistory; currentLine != allLines.end(); ++currentLine) {
-                    result << *currentLine << "\n";
+                for (const string& entry : lines) {
+                    result << entry;
                 }
-            } else {
-                result << "Not enough measurements yet!" << std::endl;
             }
 
             result.flush();
@@ -356,7 +523,9 @@ namespace Plugin {
 
     private:
         std::unique_ptr<StatCollecter> _processThread;
-        string _csvFilePath;
+        string _storePath;
+        char _seperator;
+        uint32_t _rows;
     };
 
     SERVICE_REGISTRATION(ResourceMonitorImplementation, 1, 0);
@@ -0,0 +1,504 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Time series of resource samples in a memory mapped file of fixed size. The file holds one ring buffer per
+    // level: level 0 keeps every sample, every next level keeps rollups (minimum, average and maximum) of
+    // "factor" records of the level below, per process. So the most recent history is available in full detail
+    // and older history in ever coarser steps, while disk usage and the cost of adding a sample stay constant.
+    //
+    // One process (the monitor) writes, any number of processes can map the same file read-only and query it.
+    // A record is written before the head of its ring is advanced, readers check the head again after copying
+    // and drop whatever might have been overwritten in the meantime, so no locking is needed between them.
+    //
+    // Next to the series the file holds the latest CPU ranking, which is replaced as a whole every interval. It is
+    // guarded by a sequence count: odd while it is written, readers retry until they copied it in one go.
+    class SampleStore {
+    public:
+        static constexpr uint8_t Levels = 3;
+        static constexpr uint8_t NameLength = 16;
+
+        struct Metrics {
+            uint32_t USS; // KiB
+            uint32_t PSS;
+            uint32_t RSS;
+            uint32_t VSS;
+            uint16_t User; // Hundredths of a percent of all CPUs
+            uint16_t System;
+        };
+
+        struct Sample {
+            uint32_t Time; // Seconds since the epoch
+            uint32_t Id;
+            char Name[NameLength];
+            Metrics Value;
+        };
+
+        struct Rollup {
+            uint32_t Time; // Of the first sample
+            uint32_t Id;
+            char Name[NameLength];
+            uint32_t Count; // Samples covered
+            Metrics Minimum;
+            Metrics Average;
+            Metrics Maximum;
+        };
+
+        struct Usage {
+            char Owner[NameLength]; // Plugin or thread
+            uint32_t Id; // Of the process
+            uint16_t Threads;
+            uint16_t User; // Hundredths of a percent of all CPUs, over the window
+            uint16_t System;
+        };
+
+    private:
+        static constexpr uint32_t Magic = 0x53534D52; // RMSS
+
+        struct Header {
+            uint32_t Magic;
+            uint32_t Factor;
+            uint32_t Capacity[Levels];
+            uint32_t Top; // Capacity of the ranking
+            uint32_t Sequence;
+            uint32_t Entries;
+            uint32_t Window; // Seconds covered by the ranking
+            uint64_t Head[Levels]; // Records ever written to the level
+        };
+
+        // A rollup in the making, one per process and level above 0.
+        class Accumulator {
+        public:
+            Accumulator()
+                : Count(0)
+            {
+            }
+
+        public:
+            void Add(const Rollup& record)
+            {
+                if (Count == 0) {
+                    Result = record;
+                    Sum[0] = static_cast<uint64_t>(record.Average.USS) * record.Count;
+                    Sum[1] = static_cast<uint64_t>(record.Average.PSS) * record.Count;
+                    Sum[2] = static_cast<uint64_t>(record.Average.RSS) * record.Count;
+                    Sum[3] = static_cast<uint64_t>(record.Average.VSS) * record.Count;
+                    Sum[4] = static_cast<uint64_t>(record.Average.User) * record.Count;
+                    Sum[5] = static_cast<uint64_t>(record.Average.System) * record.Count;
+                } else {
+                    Result.Count += record.Count;
+                    Sum[0] += static_cast<uint64_t>(record.Average.USS) * record.Count;
+                    Sum[1] += static_cast<uint64_t>(record.Average.PSS) * record.Count;
+                    Sum[2] += static_cast<uint64_t>(record.Average.RSS) * record.Count;
+                    Sum[3] += static_cast<uint64_t>(record.Average.VSS) * record.Count;
+                    Sum[4] += static_cast<uint64_t>(record.Average.User) * record.Count;
+                    Sum[5] += static_cast<uint64_t>(record.Average.System) * record.Count;
+                    Minimum(Result.Minimum, record.Minimum);
+                    Maximum(Result.Maximum, record.Maximum);
+                }
+                Count++;
+            }
+            const Rollup& Get()
+            {
+                Result.Average.USS = static_cast<uint32_t>(Sum[0] / Result.Count);
+                Result.Average.PSS = static_cast<uint32_t>(Sum[1] / Result.Count);
+                Result.Average.RSS = static_cast<uint32_t>(Sum[2] / Result.Count);
+                Result.Average.VSS = static_cast<uint32_t>(Sum[3] / Result.Count);
+                Result.Average.User = static_cast<uint16_t>(Sum[4] / Result.Count);
+                Result.Average.System = static_cast<uint16_t>(Sum[5] / Result.Count);
+                Count = 0;
+
+                return (Result);
+            }
+
+        private:
+            static void Minimum(Metrics& result, const Metrics& value)
+            {
+                result.USS = std::min(result.USS, value.USS);
+                result.PSS = std::min(result.PSS, value.PSS);
+                result.RSS = std::min(result.RSS, value.RSS);
+                result.VSS = std::min(result.VSS, value.VSS);
+                result.User = std::min(result.User, value.User);
+                result.System = std::min(result.System, value.System);
+            }
+            static void Maximum(Metrics& result, const Metrics& value)
+            {
+                result.USS = std::max(result.USS, value.USS);
+                result.PSS = std::max(result.PSS, value.PSS);
+                result.RSS = std::max(result.RSS, value.RSS);
+                result.VSS = std::max(result.VSS, value.VSS);
+                result.User = std::max(result.User, value.User);
+                result.System = std::max(result.System, value.System);
+            }
+
+        public:
+            uint32_t Count; // Records added
+            Rollup Result;
+            uint64_t Sum[6];
+        };
+
+        struct Pending {
+            Pending()
+                : Updated(true)
+            {
+            }
+
+            bool Updated;
+            Accumulator Level[Levels - 1];
+        };
+
+        typedef std::map<uint32_t, Pending> PendingMap;
+
+    public:
+        SampleStore(const SampleStore&) = delete;
+        SampleStore& operator=(const SampleStore&) = delete;
+
+        SampleStore()
+            : _header(nullptr)
+            , _size(0)
+            , _writable(false)
+            , _pending()
+        {
+        }
+        ~SampleStore()
+        {
+            Close();
+        }
+
+    public:
+        inline bool IsOpen() const
+        {
+            return (_header != nullptr);
+        }
+        inline uint32_t Factor() const
+        {
+            return (_header != nullptr ? _header->Factor : 0);
+        }
+
+        // Opens the store for writing. An existing file with the same layout is continued, otherwise it is
+        // (re)created empty.
+        uint32_t Create(const string& fileName, const uint32_t capacity[Levels], const uint32_t factor, const uint8_t top)
+        {
+            uint32_t result = Core::ERROR_OPENING_FAILED;
+
+            Close();
+
+            int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+            if (fd != -1) {
+                const size_t size = Size(capacity, top);
+                struct stat info;
+                bool reuse = ((::fstat(fd, &info) == 0) && (static_cast<size_t>(info.st_size) == size));
+
+                if ((reuse == true) || (::ftruncate(fd, size) == 0)) {
+                    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+                    if (memory != MAP_FAILED) {
+                        _header = static_cast<Header*>(memory);
+                        _size = size;
+                        _writable = true;
+
+                        if ((reuse == false) || (_header->Magic != Magic) || (_header->Factor != factor) || (_header->Top != top) || (::memcmp(_header->Capacity, capacity, sizeof(_header->Capacity)) != 0)) {
+                            ::memset(_header, 0, sizeof(Header));
+                            _header->Factor = factor;
+                            _header->Top = top;
+                            ::memcpy(_header->Capacity, capacity, sizeof(_header->Capacity));
+                            _header->Magic = Magic;
+                        } else {
+                            _header->Sequence &= ~1;
+                        }
+
+                        result = Core::ERROR_NONE;
+                    }
+                }
+
+                ::close(fd);
+            }
+
+            return (result);
+        }
+        // Opens the store read-only, for queries.
+        uint32_t Open(const string& fileName)
+        {
+            uint32_t result = Core::ERROR_OPENING_FAILED;
+
+            Close();
+
+            int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (fd != -1) {
+                struct stat info;
+
+                if ((::fstat(fd, &info) == 0) && (static_cast<size_t>(info.st_size) >= sizeof(Header))) {
+                    void* memory = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+                    if (memory != MAP_FAILED) {
+                        const Header* header = static_cast<const Header*>(memory);
+
+                        if ((header->Magic == Magic) && (Size(header->Capacity, header->Top) == static_cast<size_t>(info.st_size))) {
+                            _header = const_cast<Header*>(header);
+                            _size = info.st_size;
+                            result = Core::ERROR_NONE;
+                        } else {
+                            ::munmap(memory, info.st_size);
+                        }
+                    }
+                }
+
+                ::close(fd);
+            }
+
+            return (result);
+        }
+        void Close()
+        {
+            if (_header != nullptr) {
+                ::munmap(_header, _size);
+                _header = nullptr;
+                _size = 0;
+                _writable = false;
+            }
+            _pending.clear();
+        }
+
+        void Add(const Sample& sample)
+        {
+            ASSERT(_writable == true);
+
+            Rollup record;
+
+            ::memcpy(record.Name, sample.Name, sizeof(record.Name));
+            record.Time = sample.Time;
+            record.Id = sample.Id;
+            record.Count = 1;
+            record.Minimum = sample.Value;
+            record.Average = sample.Value;
+            record.Maximum = sample.Value;
+
+            Append(Slot<Sample>(0), 0, sample);
+
+            Pending& pending(_pending[sample.Id]);
+            pending.Updated = true;
+
+            uint8_t level = 1;
+            pending.Level[0].Add(record);
+
+            while ((level < Levels) && (pending.Level[level - 1].Count >= _header->Factor)) {
+                const Rollup& rollup(pending.Level[level - 1].Get());
+
+                Append(Slot<Rollup>(level), level, rollup);
+
+                if (level < (Levels - 1)) {
+                    pending.Level[level].Add(rollup);
+                }
+                level++;
+            }
+        }
+        // To be called after each round of samples. Processes that were not sampled in this round are gone, their
+        // incomplete rollups are written as they are.
+        void Completed()
+        {
+            PendingMap::iterator index(_pending.begin());
+
+            while (index != _pending.end()) {
+                if (index->second.Updated == true) {
+                    index->second.Updated = false;
+                    index++;
+                } else {
+                    for (uint8_t level = 1; level < Levels; level++) {
+                        Accumulator& accumulator(index->second.Level[level - 1]);
+
+                        if (accumulator.Count != 0) {
+                            const Rollup& rollup(accumulator.Get());
+
+                            Append(Slot<Rollup>(level), level, rollup);
+
+                            if (level < (Levels - 1)) {
+                                index->second.Level[level].Add(rollup);
+                            }
+                        }
+                    }
+                    index = _pending.erase(index);
+                }
+            }
+        }
+
+        // Calls action(const Rollup&) for every record of the given level with a time in [from, to], oldest first.
+        // An id of 0 matches any process, an empty name any name, otherwise the name must start with it. Level 0
+        // samples are reported as rollups of a single sample.
+        template <typename ACTION>
+        void Query(const uint8_t level, const uint32_t id, const string& name, const uint32_t from, const uint32_t to, ACTION&& action) const
+        {
+            ASSERT(_header != nullptr);
+
+            if (level < Levels) {
+                const uint32_t capacity = _header->Capacity[level];
+                const uint64_t head = __atomic_load_n(&(_header->Head[level]), __ATOMIC_ACQUIRE);
+                std::list<std::pair<uint64_t, Rollup>> records;
+
+                for (uint64_t index = (head > capacity ? head - capacity : 0); index < head; index++) {
+                    Rollup record;
+
+                    if (level == 0) {
+                        const Sample& sample(Slot<Sample>(0)[index % capacity]);
+
+                        ::memcpy(record.Name, sample.Name, sizeof(record.Name));
+                        record.Time = sample.Time;
+                        record.Id = sample.Id;
+                        record.Count = 1;
+                        record.Minimum = sample.Value;
+                        record.Average = sample.Value;
+                        record.Maximum = sample.Value;
+                    } else {
+                        record = Slot<Rollup>(level)[index % capacity];
+                    }
+
+                    if ((record.Time >= from) && (record.Time <= to) && ((id == 0) || (record.Id == id)) && ((name.empty() == true) || (::strncmp(record.Name, name.c_str(), std::min(name.length(), static_cast<size_t>(NameLength))) == 0))) {
+                        records.emplace_back(index, record);
+                    }
+                }
+
+                // The writer might have lapped us while copying, the slot it is writing now is suspect as well.
+                const uint64_t now = __atomic_load_n(&(_header->Head[level]), __ATOMIC_ACQUIRE);
+                const uint64_t valid = (now >= capacity ? now - capacity + 1 : 0);
+
+                for (const std::pair<uint64_t, Rollup>& entry : records) {
+                    if (entry.first >= valid) {
+                        action(entry.second);
+                    }
+                }
+            }
+        }
+
+        // Replaces the ranking, entries beyond the capacity of the store are dropped.
+        void Rank(const std::vector<Usage>& entries, const uint32_t window)
+        {
+            ASSERT(_writable == true);
+
+            Usage* table = Table();
+            const uint32_t count = std::min(static_cast<uint32_t>(entries.size()), _header->Top);
+
+            __atomic_store_n(&(_header->Sequence), _header->Sequence + 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+
+            for (uint32_t index = 0; index < count; index++) {
+                table[index] = entries[index];
+            }
+            _header->Entries = count;
+            _header->Window = window;
+
+            __atomic_store_n(&(_header->Sequence), _header->Sequence + 1, __ATOMIC_RELEASE);
+        }
+        // Copies the latest ranking, highest usage first. Returns the seconds it covers, 0 if there is none (yet).
+        uint32_t Ranking(std::vector<Usage>& entries) const
+        {
+            ASSERT(_header != nullptr);
+
+            const Usage* table = Table();
+            uint32_t window = 0;
+            uint32_t before;
+            uint32_t after;
+            uint8_t attempts = 10;
+
+            do {
+                before = __atomic_load_n(&(_header->Sequence), __ATOMIC_ACQUIRE);
+
+                const uint32_t count = std::min(_header->Entries, _header->Top);
+
+                entries.assign(table, table + count);
+                window = _header->Window;
+
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                after = __atomic_load_n(&(_header->Sequence), __ATOMIC_RELAXED);
+
+            } while ((((before & 1) != 0) || (before != after)) && (--attempts != 0));
+
+            if (attempts == 0) {
+                entries.clear();
+                window = 0;
+            }
+
+            return (window);
+        }
+
+    private:
+        static size_t Size(const uint32_t capacity[Levels], const uint32_t top)
+        {
+            size_t result = sizeof(Header) + (capacity[0] * sizeof(Sample));
+
+            for (uint8_t level = 1; level < Levels; level++) {
+                result += (capacity[level] * sizeof(Rollup));
+            }
+
+            return (result + (top * sizeof(Usage)));
+        }
+        Usage* Table() const
+        {
+            uint8_t* base = reinterpret_cast<uint8_t*>(Slot<Rollup>(Levels - 1));
+
+            return (reinterpret_cast<Usage*>(base + (_header->Capacity[Levels - 1] * sizeof(Rollup))));
+        }
+        template <typename RECORD>
+        RECORD* Slot(const uint8_t level) const
+        {
+            uint8_t* base = reinterpret_cast<uint8_t*>(_header) + sizeof(Header);
+
+            if (level > 0) {
+                base += _header->Capacity[0] * sizeof(Sample);
+
+                for (uint8_t index = 1; index < level; index++) {
+                    base += _header->Capacity[index] * sizeof(Rollup);
+                }
+            }
+
+            return (reinterpret_cast<RECORD*>(base));
+        }
+        template <typename RECORD>
+        void Append(RECORD ring[], const uint8_t level, const RECORD& record)
+        {
+            const uint32_t capacity = _header->Capacity[level];
+
+            if (capacity != 0) {
+                const uint64_t head = _header->Head[level];
+
+                ring[head % capacity] = record;
+                __atomic_store_n(&(_header->Head[level]), head + 1, __ATOMIC_RELEASE);
+            }
+        }
+
+    private:
+        Header* _header;
+        size_t _size;
+        bool _writable;
+        PendingMap _pending;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,118 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../Module.h"
+
+#include <interfaces/ICapture.h>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Capture device without any graphics hardware: hands out a test pattern from memory, so capturing and encoding
+    // can be exercised and measured anywhere. The pattern is a set of colour bars over a gradient, with a square that
+    // moves on every capture, so no two captures are the same.
+    class Software : public Exchange::ICapture {
+    private:
+        Software(const Software&) = delete;
+        Software& operator=(const Software&) = delete;
+
+        static constexpr uint32_t Width = 1920;
+        static constexpr uint32_t Height = 1080;
+        static constexpr uint32_t Square = 64;
+
+    public:
+        Software()
+            : _lock()
+            , _pattern(Width * Height * 4)
+            , _frame(Width * Height * 4)
+            , _count(0)
+        {
+            static const uint8_t bars[][3] = {
+                { 192, 192, 192 }, { 192, 192, 0 }, { 0, 192, 192 }, { 0, 192, 0 },
+                { 192, 0, 192 }, { 192, 0, 0 }, { 0, 0, 192 }, { 16, 16, 16 }
+            };
+
+            for (uint32_t y = 0; y < Height; y++) {
+                for (uint32_t x = 0; x < Width; x++) {
+                    uint8_t* pixel = &_pattern[((y * Width) + x) * 4];
+
+                    if (y < ((Height * 2) / 3)) {
+                        const uint8_t* bar = bars[(x * 8) / Width];
+                        pixel[0] = bar[2]; // Blue
+                        pixel[1] = bar[1]; // Green
+                        pixel[2] = bar[0]; // Red
+                    } else {
+                        pixel[0] = static_cast<uint8_t>((x * 255) / Width);
+                        pixel[1] = static_cast<uint8_t>((y * 255) / Height);
+                        pixel[2] = static_cast<uint8_t>(((Width - x) * 255) / Width);
+                    }
+                    pixel[3] = 0xFF; // Alpha
+                }
+            }
+        }
+
+        virtual ~Software()
+        {
+        }
+
+        BEGIN_INTERFACE_MAP(Software)
+        INTERFACE_ENTRY(Exchange::ICapture)
+        END_INTERFACE_MAP
+
+        virtual const TCHAR* Name() const
+        {
+            return (_T("Software"));
+        }
+
+        virtual bool Capture(ICapture::IStore& storer)
+        {
+            _lock.Lock();
+
+            const uint32_t left = ((_count * 8) % (Width - Square));
+            const uint32_t top = ((_count * 4) % (Height - Square));
+
+            ::memcpy(_frame.data(), _pattern.data(), _frame.size());
+
+            for (uint32_t y = top; y < (top + Square); y++) {
+                ::memset(&_frame[((y * Width) + left) * 4], 0xFF, Square * 4);
+            }
+
+            _count++;
+
+            bool result = storer.R8_G8_B8_A8(static_cast<const unsigned char*>(_frame.data()), Width, Height);
+
+            _lock.Unlock();
+
+            return result;
+        }
+
+    private:
+        Core::CriticalSection _lock;
+        std::vector<uint8_t> _pattern;
+        std::vector<uint8_t> _frame;
+        uint32_t _count;
+    };
+}
+
+/* static */ Exchange::ICapture* Exchange::ICapture::Instance()
+{
+    return (Core::Service<Plugin::Software>::Create<Exchange::ICapture>());
+}
+}
@@ -0,0 +1,287 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <png.h>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Encoders for the captured frames. Captures come in as B8G8R8A8 bytes (ARGB8888 on a little endian
+    // machine), all formats store R8G8B8 and drop the alpha channel. The output is appended to a string, so it can
+    // be handed to the web server as it is.
+    class ImageEncoder {
+    public:
+        enum format {
+            PNG,
+            QOI,
+            PPM // binary portable pixmap (P6), the pixels without compression
+        };
+
+        enum filter {
+            NONE,
+            SUB,
+            UP,
+            AVERAGE,
+            PAETH,
+            ALL // libpng picks one per row, smallest files but slowest
+        };
+
+    public:
+        ImageEncoder(const ImageEncoder&) = delete;
+        ImageEncoder& operator=(const ImageEncoder&) = delete;
+
+        ImageEncoder(const format type, const uint8_t level, const filter filters)
+            : _format(type)
+            , _level(level > 9 ? 9 : level)
+            , _filter(filters)
+        {
+        }
+        ~ImageEncoder() = default;
+
+    public:
+        format Format() const
+        {
+            return (_format);
+        }
+        bool Encode(string& output, const uint8_t buffer[], const uint32_t width, const uint32_t height) const
+        {
+            bool result = false;
+
+            switch (_format) {
+            case QOI:
+                result = EncodeQOI(output, buffer, width, height);
+                break;
+            case PPM:
+                result = EncodePPM(output, buffer, width, height);
+                break;
+            default:
+                result = EncodePNG(output, buffer, width, height);
+                break;
+            }
+
+            return (result);
+        }
+
+    public:
+        static void Swizzle(const uint8_t source[], uint8_t destination[], const uint32_t pixels)
+        {
+            uint32_t index = 0;
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+            // The plugin is built for the baseline instruction set, the byte shuffle is used if the processor has it.
+            static const bool ssse3 = HasSSSE3();
+
+            if (ssse3 == true) {
+                index = SwizzleSSSE3(source, destination, pixels);
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            // Sixteen pixels per step, de-interleaved on load and interleaved again on store.
+            for (; (index + 16) <= pixels; index += 16) {
+                const uint8x16x4_t in = vld4q_u8(&source[index * 4]);
+                uint8x16x3_t out;
+                out.val[0] = in.val[2];
+                out.val[1] = in.val[1];
+                out.val[2] = in.val[0];
+                vst3q_u8(&destination[index * 3], out);
+            }
+#endif
+
+            for (; index < pixels; index++) {
+                destination[(index * 3) + 0] = source[(index * 4) + 2]; // Red
+                destination[(index * 3) + 1] = source[(index * 4) + 1]; // Green
+                destination[(index * 3) + 2] = source[(index * 4) + 0]; // Blue
+            }
+        }
+
+    private:
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+        static bool HasSSSE3()
+        {
+            __builtin_cpu_init();
+            return (__builtin_cpu_supports("ssse3") != 0);
+        }
+        // Returns the number of pixels done, the remainder is left to the caller.
+        __attribute__((target("ssse3"))) static uint32_t SwizzleSSSE3(const uint8_t source[], uint8_t destination[], const uint32_t pixels)
+        {
+            const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+            uint32_t index = 0;
+
+            // Four pixels per step, the store is 16 bytes wide for 12 useful ones, so stay clear of the row end.
+            for (; (index + 6) <= pixels; index += 4) {
+                const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&source[index * 4]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&destination[index * 3]), _mm_shuffle_epi8(in, order));
+            }
+
+            return (index);
+        }
+#endif
+        bool EncodePNG(string& output, const uint8_t buffer[], const uint32_t width, const uint32_t height) const
+        {
+            static const int filters[] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS };
+
+            // One row at a time is converted and compressed, it stays in the cache on its way through.
+            std::vector<png_byte> row(width * 3);
+            bool result = false;
+
+            png_structp pngPointer = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+            png_infop infoPointer = (pngPointer != nullptr ? png_create_info_struct(pngPointer) : nullptr);
+
+            if ((infoPointer != nullptr) && (setjmp(png_jmpbuf(pngPointer)) == 0)) {
+
+                png_set_write_fn(pngPointer, &output, Write, Flush);
+                png_set_compression_level(pngPointer, _level);
+                png_set_filter(pngPointer, PNG_FILTER_TYPE_BASE, filters[_filter]);
+
+                png_set_IHDR(pngPointer,
+                    infoPointer,
+                    width,
+                    height,
+                    8,
+                    PNG_COLOR_TYPE_RGB,
+                    PNG_INTERLACE_NONE,
+                    PNG_COMPRESSION_TYPE_DEFAULT,
+                    PNG_FILTER_TYPE_DEFAULT);
+
+                png_write_info(pngPointer, infoPointer);
+
+                for (uint32_t line = 0; line < height; line++) {
+                    Swizzle(&buffer[line * width * 4], row.data(), width);
+                    png_write_row(pngPointer, row.data());
+                }
+
+                png_write_end(pngPointer, nullptr);
+
+                result = true;
+            }
+
+            png_destroy_write_struct(&pngPointer, &infoPointer);
+
+            return (result);
+        }
+        // The "Quite OK Image" format, see https://qoiformat.org/qoi-specification.pdf. Typically a bit larger
+        // than PNG for screen content, but many times faster to encode.
+        bool EncodeQOI(string& output, const uint8_t buffer[], const uint32_t width, const uint32_t height) const
+        {
+            const uint32_t pixels = width * height;
+            uint32_t index[64] = {};
+            uint32_t previous = 0xFF000000;
+            uint8_t run = 0;
+            uint8_t header[14] = { 'q', 'o', 'i', 'f',
+                static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16), static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+                static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16), static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+                3, 0 };
+
+            output.reserve(output.length() + sizeof(header) + (pixels * 2));
+            output.append(reinterpret_cast<const char*>(header), sizeof(header));
+
+            for (uint32_t position = 0; position < pixels; position++) {
+                const uint8_t red = buffer[(position * 4) + 2];
+                const uint8_t green = buffer[(position * 4) + 1];
+                const uint8_t blue = buffer[(position * 4) + 0];
+                const uint32_t pixel = (red | (green << 8) | (blue << 16) | 0xFF000000);
+
+                if (pixel == previous) {
+                    run++;
+                    if ((run == 62) || (position == (pixels - 1))) {
+                        output += static_cast<char>(0xC0 | (run - 1));
+                        run = 0;
+                    }
+                } else {
+                    if (run > 0) {
+                        output += static_cast<char>(0xC0 | (run - 1));
+                        run = 0;
+                    }
+
+                    const uint8_t slot = (((red * 3) + (green * 5) + (blue * 7) + (255 * 11)) % 64);
+
+                    if (index[slot] == pixel) {
+                        output += static_cast<char>(slot);
+                    } else {
+                        index[slot] = pixel;
+
+                        const int8_t dr = static_cast<int8_t>(red - (previous & 0xFF));
+                        const int8_t dg = static_cast<int8_t>(green - ((previous >> 8) & 0xFF));
+                        const int8_t db = static_cast<int8_t>(blue - ((previous >> 16) & 0xFF));
+                        const int8_t drdg = (dr - dg);
+                        const int8_t dbdg = (db - dg);
+
+                        if ((dr >= -2) && (dr <= 1) && (dg >= -2) && (dg <= 1) && (db >= -2) && (db <= 1)) {
+                            output += static_cast<char>(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                        } else if ((dg >= -32) && (dg <= 31) && (drdg >= -8) && (drdg <= 7) && (dbdg >= -8) && (dbdg <= 7)) {
+                            output += static_cast<char>(0x80 | (dg + 32));
+                            output += static_cast<char>(((drdg + 8) << 4) | (dbdg + 8));
+                        } else {
+                            output += static_cast<char>(0xFE);
+                            output += static_cast<char>(red);
+                            output += static_cast<char>(green);
+                            output += static_cast<char>(blue);
+                        }
+                    }
+                }
+
+                previous = pixel;
+            }
+
+            output.append(7, '\0');
+            output += '\x01';
+
+            return (true);
+        }
+        bool EncodePPM(string& output, const uint8_t buffer[], const uint32_t width, const uint32_t height) const
+        {
+            const string header(_T("P6\n") + Core::NumberType<uint32_t>(width).Text() + ' ' + Core::NumberType<uint32_t>(height).Text() + _T("\n255\n"));
+            const uint32_t start = static_cast<uint32_t>(output.length() + header.length());
+
+            output += header;
+            output.resize(start + (width * height * 3));
+
+            for (uint32_t line = 0; line < height; line++) {
+                Swizzle(&buffer[line * width * 4], reinterpret_cast<uint8_t*>(&output[start + (line * width * 3)]), width);
+            }
+
+            return (true);
+        }
+
+        static void Write(png_structp pngPointer, png_bytep data, png_size_t length)
+        {
+            static_cast<string*>(png_get_io_ptr(pngPointer))->append(reinterpret_cast<const char*>(data), length);
+        }
+        static void Flush(png_structp)
+        {
+        }
+
+    private:
+        const format _format;
+        const uint8_t _level;
+        const filter _filter;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -19,183 +19,133 @@
  
 #include "Snapshot.h"
 
-#include <png.h>
-
 namespace WPEFramework {
+
+ENUM_CONVERSION_BEGIN(Plugin::ImageEncoder::format)
+    { Plugin::ImageEncoder::PNG, _TXT("png") },
+    { Plugin::ImageEncoder::QOI, _TXT("qoi") },
+    { Plugin::ImageEncoder::PPM, _TXT("ppm") },
+ENUM_CONVERSION_END(Plugin::ImageEncoder::format);
+
+ENUM_CONVERSION_BEGIN(Plugin::ImageEncoder::filter)
+    { Plugin::ImageEncoder::NONE, _TXT("none") },
+    { Plugin::ImageEncoder::SUB, _TXT("sub") },
+    { Plugin::ImageEncoder::UP, _TXT("up") },
+    { Plugin::ImageEncoder::AVERAGE, _TXT("average") },
+    { Plugin::ImageEncoder::PAETH, _TXT("paeth") },
+    { Plugin::ImageEncoder::ALL, _TXT("all") },
+ENUM_CONVERSION_END(Plugin::ImageEncoder::filter);
+
 namespace Plugin {
 
     SERVICE_REGISTRATION(Snapshot, 1, 0);
 
-    class StoreImpl : public Exchange::ICapture::IStore {
-    private:
-        StoreImpl() = delete;
-        StoreImpl(const StoreImpl&) = delete;
-        StoreImpl& operator=(const StoreImpl&) = delete;
+    // Longest a request waits for the capture of another request to finish.
+    static constexpr uint32_t CaptureTimeout = 10000; // ms
 
+    // Sends a shared capture as it is, all responses read from the same image.
+    class ImageBody : public Web::IBody {
     public:
-        StoreImpl(Core::BinairySemaphore& inProgress, const string& path)
-            : _file(FileBodyExtended::Instance(inProgress, path))
+        ImageBody(const ImageBody&) = delete;
+        ImageBody& operator=(const ImageBody&) = delete;
+
+        ImageBody()
+            : _image()
+            , _offset(0)
         {
         }
-
-        virtual ~StoreImpl()
+        ~ImageBody() override
         {
         }
 
-        virtual bool R8_G8_B8_A8(const unsigned char* buffer, const unsigned int width, const unsigned int height)
+    public:
+        void Link(const Core::ProxyType<Snapshot::Image>& image)
         {
+            _image = image;
+            _offset = 0;
+        }
 
-            png_structp pngPointer = nullptr;
-            bool result = false;
-
-            pngPointer = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-            if (pngPointer == nullptr) {
-
-                return result;
-            }
-
-            png_infop infoPointer = nullptr;
-            infoPointer = png_create_info_struct(pngPointer);
-            if (infoPointer == nullptr) {
-
-                png_destroy_write_struct(&pngPointer, &infoPointer);
-                return result;
-            }
-
-            // Set up error handling.
-            if (setjmp(png_jmpbuf(pngPointer))) {
-
-                png_destroy_write_struct(&pngPointer, &infoPointer);
-                return result;
-            }
-
-            // Set image attributes.
-            int depth = 8;
-            png_set_IHDR(pngPointer,
-                infoPointer,
-                width,
-                height,
-                depth,
-                PNG_COLOR_TYPE_RGB,
-                PNG_INTERLACE_NONE,
-                PNG_COMPRESSION_TYPE_DEFAULT,
-                PNG_FILTER_TYPE_DEFAULT);
-
-            // Initialize rows of PNG.
-            png_byte** rowLines = static_cast<png_byte**>(png_malloc(pngPointer, height * sizeof(png_byte*)));
-            const int pixelSize = 4; // RGBA
-            for (unsigned int i = 0; i < height; ++i) {
-
-                png_byte* rowLine = static_cast<png_byte*>(png_malloc(pngPointer, sizeof(png_byte) * width * pixelSize));
-                const uint8_t* rowSource = buffer + (sizeof(png_byte) * i * width * pixelSize);
-                rowLines[i] = rowLine;
-                for (unsigned int j = 0; j < width * pixelSize; j += pixelSize) {
-                    *rowLine++ = rowSource[j + 2]; // Red
-                    *rowLine++ = rowSource[j + 1]; // Green
-                    *rowLine++ = rowSource[j + 0]; // Blue
-                    // ignore alpha
-                }
-            }
-
-            // Duplicate file descriptor and create File stream based on it.
-            FILE* filePointer = static_cast<FILE*>(*_file);
-            if (nullptr != filePointer) {
-                // Write the image data to "file".
-                png_init_io(pngPointer, filePointer);
-                png_set_rows(pngPointer, infoPointer, rowLines);
-                png_write_png(pngPointer, infoPointer, PNG_TRANSFORM_IDENTITY, nullptr);
-                // All went well.
-                result = true;
-            }
+    protected:
+        uint32_t Serialize() const override
+        {
+            _offset = 0;
+            return (_image.IsValid() == true ? static_cast<uint32_t>(_image->Data.length()) : 0);
+        }
+        uint16_t Serialize(uint8_t stream[], const uint16_t maxLength) const override
+        {
+            uint16_t loaded = 0;
 
-            // Close stream to flush and release allocated buffers
-            fclose(filePointer);
+            if (_image.IsValid() == true) {
+                loaded = static_cast<uint16_t>(std::min(static_cast<uint32_t>(_image->Data.length() - _offset), static_cast<uint32_t>(maxLength)));
 
-            for (unsigned int i = 0; i < height; i++) {
-                png_free(pngPointer, rowLines[i]);
+                ::memcpy(stream, &(_image->Data[_offset]), loaded);
+                _offset += loaded;
             }
 
-            png_free(pngPointer, rowLines);
-            png_destroy_write_struct(&pngPointer, &infoPointer);
-
-            return result;
+            return (loaded);
         }
-
-        operator Core::ProxyType<Web::IBody>()
+        uint32_t Deserialize() override
         {
-
-            return Core::ProxyType<Web::IBody>(*_file);
+            return (0);
         }
-
-        bool IsValid()
+        uint16_t Deserialize(const uint8_t[], const uint16_t) override
         {
-            return (_file.IsValid());
+            return (0);
+        }
+        void End() const override
+        {
+            // Sent, the image can go, even while this body waits in the pool.
+            _image = Core::ProxyType<Snapshot::Image>();
         }
 
-        class FileBodyExtended : public Web::FileBody {
-        private:
-            FileBodyExtended() = delete;
-            FileBodyExtended(const FileBodyExtended&) = delete;
-            FileBodyExtended& operator=(const FileBodyExtended&) = delete;
-
-        protected:
-            FileBodyExtended(Core::BinairySemaphore* semLock, const string& path)
-                : Web::FileBody(path)
-                , _semLock(*semLock)
-            {
-                // Already exist, due to unexpected termination!
-                if (true == Core::File::Exists()) {
-                    // Close and remove file
-                    Core::File::Destroy();
-                }
-
-                Core::File::Create();
-            }
+    private:
+        mutable Core::ProxyType<Snapshot::Image> _image;
+        mutable uint32_t _offset;
+    };
 
-        public:
-            virtual ~FileBodyExtended()
-            {
-                Core::File::Destroy();
+    static Core::ProxyPoolType<ImageBody> imageFactory(2);
 
-                // Signal, It is ready for new capture
-                _semLock.Unlock();
-            }
+    class StoreImpl : public Exchange::ICapture::IStore {
+    private:
+        StoreImpl() = delete;
+        StoreImpl(const StoreImpl&) = delete;
+        StoreImpl& operator=(const StoreImpl&) = delete;
 
-        public:
-            static Core::ProxyType<FileBodyExtended> Instance(Core::BinairySemaphore& semLock, const string& fileName)
-            {
-                Core::ProxyType<FileBodyExtended> result;
+    public:
+        StoreImpl(const ImageEncoder& encoder, string& output)
+            : _encoder(encoder)
+            , _output(output)
+        {
+        }
 
-                if (semLock.Lock(0) == Core::ERROR_NONE) {
-                    // We got the lock, forward it to the filebody
-                    result = Core::ProxyType<FileBodyExtended>::Create(&semLock, fileName);
-                }
+        virtual ~StoreImpl()
+        {
+        }
 
-                return (result);
-            }
+        virtual bool R8_G8_B8_A8(const unsigned char* buffer, const unsigned int width, const unsigned int height)
+        {
+            _output.clear();
 
-        private:
-            Core::BinairySemaphore& _semLock;
-        };
+            return (_encoder.Encode(_output, buffer, width, height));
+        }
 
     private:
-        Core::ProxyType<FileBodyExtended> _file;
+        const ImageEncoder& _encoder;
+        string& _output;
     };
 
     /* virtual */ const string Snapshot::Initialize(PluginHost::IShell* service)
     {
         string result;
+        Config config;
+        config.FromString(service->ConfigLine());
 
-        // Capture PNG file name
-        ASSERT(service->PersistentPath() != _T(""));
         ASSERT(_device == nullptr);
+        ASSERT(_encoder == nullptr);
 
-        Core::Directory directory(service->PersistentPath().c_str());
-        if (directory.CreatePath()) {
-            _fileName = service->PersistentPath() + string("Capture.png");
-        } else {
-            _fileName = string("/tmp/Capture.png");
-        }
+        _encoder = new ImageEncoder(config.Format.Value(), static_cast<uint8_t>(config.Compression.Value()), config.Filter.Value());
+        _window = static_cast<uint64_t>(config.Window.Value()) * Core::Time::TicksPerMillisecond;
+        _waiters = config.Waiters.Value();
 
         // Setup skip URL for right offset.
         _skipURL = service->WebPrefix().length();
@@ -220,6 +170,11 @@ namespace Plugin {
             _device->Release();
             _device = nullptr;
         }
+
+        delete _encoder;
+        _encoder = nullptr;
+
+        _image = Core::ProxyType<Image>();
     }
 
     /* virtual */ string Snapshot::Information() const
@@ -258,24 +213,24 @@ namespace Plugin {
                 response->ErrorCode = Web::STATUS_OK;
             } else if ((index.Current() == "Capture")) {
 
-                StoreImpl file(_inProgress, _fileName);
-
-                // _inProgress event is signalled, capture screen
-                if (file.IsValid() == true) {
-
-                    if (_device->Capture(file)) {
-
-                        // Attach to response.
-                        response->ContentType = Web::MIMETypes::MIME_IMAGE_PNG;
-                        response->Body(static_cast<Core::ProxyType<Web::IBody>>(file));
-                        response->Message = string(_device->Name());
-                        response->ErrorCode = Web::STATUS_ACCEPTED;
-                    } else {
-                        response->Message = _T("Could not create a capture on ") + string(_device->Name());
-                        response->ErrorCode = Web::STATUS_PRECONDITION_FAILED;
-                    }
+                Core::ProxyType<Image> image;
+                const uint32_t result = Capture(image);
+
+                if (result == Core::ERROR_NONE) {
+                    // Every response needs a body of its own, the image itself is shared.
+                    Core::ProxyType<ImageBody> body(imageFactory.Element());
+                    body->Link(image);
+
+                    // Attach to response.
+                    response->ContentType = (_encoder->Format() == ImageEncoder::PNG ? Web::MIMETypes::MIME_IMAGE_PNG : Web::MIMETypes::MIME_BINARY);
+                    response->Body(Core::ProxyType<Web::IBody>(body));
+                    response->Message = string(_device->Name());
+                    response->ErrorCode = Web::STATUS_ACCEPTED;
+                } else if (result == Core::ERROR_UNAVAILABLE) {
+                    response->Message = _T("Too many requests are waiting for a capture on ") + string(_device->Name());
+                    response->ErrorCode = Web::STATUS_SERVICE_UNAVAILABLE;
                 } else {
-                    response->Message = _T("Plugin is already in progress");
+                    response->Message = _T("Could not create a capture on ") + string(_device->Name());
                     response->ErrorCode = Web::STATUS_PRECONDITION_FAILED;
                 }
             }
@@ -283,5 +238,77 @@ namespace Plugin {
 
         return (response);
     }
+
+    // Requests that come in while a capture is running get the result of that capture, rather than failing or
+    // starting another one. A finished capture is also handed out for the configured window after it started.
+    // Every waiting request blocks a worker thread, so only the configured number of them may wait, the others
+    // are turned away.
+    uint32_t Snapshot::Capture(Core::ProxyType<Image>& result)
+    {
+        uint32_t status = Core::ERROR_GENERAL;
+
+        _adminLock.Lock();
+
+        uint64_t now = Core::Time::Now().Ticks();
+
+        if ((_capturing == false) && (_image.IsValid() == true) && ((now - _image->Time) <= _window)) {
+            result = _image;
+        } else if ((_capturing == true) && (_waiting >= _waiters)) {
+            TRACE(Trace::Information, (_T("Capture request refused, %d requests are waiting already"), _waiting));
+            status = Core::ERROR_UNAVAILABLE;
+        } else if (_capturing == true) {
+            const uint32_t generation = _generation;
+            const uint64_t deadline = now + (CaptureTimeout * Core::Time::TicksPerMillisecond);
+
+            _waiting++;
+
+            while ((generation == _generation) && (now < deadline)) {
+                _adminLock.Unlock();
+                _captured.Lock(static_cast<uint32_t>((deadline - now) / Core::Time::TicksPerMillisecond) + 1);
+                _adminLock.Lock();
+                now = Core::Time::Now().Ticks();
+            }
+
+            _waiting--;
+
+            if (generation != _generation) {
+                // Invalid if that capture failed.
+                result = _image;
+            }
+        } else {
+            _capturing = true;
+            _captured.ResetEvent();
+
+            _adminLock.Unlock();
+
+            Core::ProxyType<Image> image(Core::ProxyType<Image>::Create());
+            image->Time = now;
+
+            StoreImpl store(*_encoder, image->Data);
+            const bool captured = _device->Capture(store);
+
+            _adminLock.Lock();
+
+            if (captured == true) {
+                _image = image;
+            } else {
+                _image = Core::ProxyType<Image>();
+            }
+
+            _capturing = false;
+            _generation++;
+            _captured.SetEvent();
+
+            result = _image;
+        }
+
+        if (result.IsValid() == true) {
+            status = Core::ERROR_NONE;
+        }
+
+        _adminLock.Unlock();
+
+        return (status);
+    }
 }
 }
@@ -21,6 +21,7 @@
 #define __SNAPSHOT_H
 
 #include "Module.h"
+#include "ImageEncoder.h"
 #include <interfaces/ICapture.h>
 
 namespace WPEFramework {
@@ -31,12 +32,72 @@ namespace Plugin {
         Snapshot(const Snapshot&) = delete;
         Snapshot& operator=(const Snapshot&) = delete;
 
+        class Config : public Core::JSON::Container {
+        private:
+            Config(const Config&) = delete;
+            Config& operator=(const Config&) = delete;
+
+        public:
+            Config()
+                : Core::JSON::Container()
+                , Format(ImageEncoder::PNG)
+                , Compression(1)
+                , Filter(ImageEncoder::SUB)
+                , Window(0)
+                , Waiters(2)
+            {
+                Add(_T("format"), &Format);
+                Add(_T("compression"), &Compression);
+                Add(_T("filter"), &Filter);
+                Add(_T("window"), &Window);
+                Add(_T("waiters"), &Waiters);
+            }
+            ~Config()
+            {
+            }
+
+        public:
+            Core::JSON::EnumType<ImageEncoder::format> Format;
+            Core::JSON::DecUInt8 Compression; // zlib level, 0 (none) to 9 (smallest)
+            Core::JSON::EnumType<ImageEncoder::filter> Filter; // PNG row filter
+            Core::JSON::DecUInt32 Window; // Milliseconds a finished capture is handed out to new requests
+            Core::JSON::DecUInt8 Waiters; // Requests that may wait for a running capture, each holds a thread
+        };
+
+    public:
+        // An encoded capture, shared by all requests that were waiting for it.
+        class Image {
+        public:
+            Image(const Image&) = delete;
+            Image& operator=(const Image&) = delete;
+
+            Image()
+                : Data()
+                , Time(0)
+            {
+            }
+            ~Image()
+            {
+            }
+
+        public:
+            string Data;
+            uint64_t Time; // Start of the capture, in ticks
+        };
+
     public:
         Snapshot()
             : _skipURL(0)
             , _device(nullptr)
-            , _fileName()
-            , _inProgress(false)
+            , _encoder(nullptr)
+            , _adminLock()
+            , _captured(false, false)
+            , _image()
+            , _capturing(false)
+            , _generation(0)
+            , _window(0)
+            , _waiting(0)
+            , _waiters(0)
         {
         }
 
@@ -62,11 +123,21 @@ namespace Plugin {
         virtual void Inbound(Web::Request& request);
         virtual Core::ProxyType<Web::Response> Process(const Web::Request& request);
 
+    private:
+        uint32_t Capture(Core::ProxyType<Image>& image);
+
     private:
         uint8_t _skipURL;
         Exchange::ICapture* _device;
-        string _fileName;
-        Core::BinairySemaphore _inProgress;
+        ImageEncoder* _encoder;
+        Core::CriticalSection _adminLock;
+        Core::Event _captured;
+        Core::ProxyType<Image> _image;
+        bool _capturing;
+        uint32_t _generation;
+        uint64_t _window; // ticks
+        uint8_t _waiting;
+        uint8_t _waiters;
     };
 
 } // Namespace Plugin.
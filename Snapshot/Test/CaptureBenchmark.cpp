@@ -0,0 +1,168 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the capture path of the plugin on the software device, a 1920x1080 test pattern from memory:
+//  - capturing alone, the frame is handed to a store that does nothing with it;
+//  - capturing and encoding, for every format and for the PNG compression levels and row filters that matter.
+// For each it reports the frames per second, the time per frame, the input handled per second and the average
+// size of an image, so the cost of a setting can be weighed against what it saves on the wire.
+//
+// Usage: SnapshotCaptureBenchmark [frames]
+
+#include "../Module.h"
+#include "../ImageEncoder.h"
+
+#include <interfaces/ICapture.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    class Store : public Exchange::ICapture::IStore {
+    public:
+        Store() = delete;
+        Store(const Store&) = delete;
+        Store& operator=(const Store&) = delete;
+
+        // Without an encoder the frame is only looked at, which leaves the cost of the capture itself.
+        Store(const ImageEncoder* encoder)
+            : _encoder(encoder)
+            , _output()
+            , _pixels(0)
+            , _bytes(0)
+        {
+        }
+        virtual ~Store()
+        {
+        }
+
+    public:
+        virtual bool R8_G8_B8_A8(const unsigned char* buffer, const unsigned int width, const unsigned int height)
+        {
+            bool result = true;
+
+            _output.clear();
+
+            if (_encoder != nullptr) {
+                result = _encoder->Encode(_output, buffer, width, height);
+            }
+
+            _pixels += (static_cast<uint64_t>(width) * height);
+            _bytes += _output.length();
+
+            return (result);
+        }
+
+        inline uint64_t Pixels() const
+        {
+            return (_pixels);
+        }
+        inline uint64_t Bytes() const
+        {
+            return (_bytes);
+        }
+
+    private:
+        const ImageEncoder* _encoder;
+        string _output;
+        uint64_t _pixels;
+        uint64_t _bytes;
+    };
+
+    struct Setting {
+        const TCHAR* Name;
+        ImageEncoder::format Format;
+        uint8_t Level;
+        ImageEncoder::filter Filter;
+    };
+
+    static void Measure(Exchange::ICapture& device, const TCHAR name[], const ImageEncoder* encoder, const uint32_t frames)
+    {
+        Store warmup(encoder);
+        Store store(encoder);
+        uint32_t captured = 0;
+
+        // One capture up front, the first one pays for the page faults of the buffers.
+        device.Capture(warmup);
+
+        const uint64_t start = Core::Time::Now().Ticks();
+
+        while ((captured < frames) && (device.Capture(store) == true)) {
+            captured++;
+        }
+
+        const double seconds = std::max(static_cast<double>(Core::Time::Now().Ticks() - start), 1.0) / (1000.0 * Core::Time::TicksPerMillisecond);
+
+        if (captured == 0) {
+            printf(_T("%-18s failed\n"), name);
+        } else {
+            printf(_T("%-18s %10.1f %10.2f %10.1f %12.1f\n"),
+                name,
+                captured / seconds,
+                (seconds * 1000.0) / captured,
+                (static_cast<double>(store.Pixels()) * 4) / (seconds * 1024 * 1024),
+                static_cast<double>(store.Bytes()) / (static_cast<double>(captured) * 1024));
+        }
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t frames = (argc > 1 ? ::atoi(argv[1]) : 20);
+
+    static const Plugin::Setting Settings[] = {
+        { _T("ppm"), Plugin::ImageEncoder::PPM, 0, Plugin::ImageEncoder::NONE },
+        { _T("qoi"), Plugin::ImageEncoder::QOI, 0, Plugin::ImageEncoder::NONE },
+        { _T("png 0 none"), Plugin::ImageEncoder::PNG, 0, Plugin::ImageEncoder::NONE },
+        { _T("png 1 none"), Plugin::ImageEncoder::PNG, 1, Plugin::ImageEncoder::NONE },
+        { _T("png 1 sub"), Plugin::ImageEncoder::PNG, 1, Plugin::ImageEncoder::SUB },
+        { _T("png 1 up"), Plugin::ImageEncoder::PNG, 1, Plugin::ImageEncoder::UP },
+        { _T("png 1 average"), Plugin::ImageEncoder::PNG, 1, Plugin::ImageEncoder::AVERAGE },
+        { _T("png 1 paeth"), Plugin::ImageEncoder::PNG, 1, Plugin::ImageEncoder::PAETH },
+        { _T("png 1 all"), Plugin::ImageEncoder::PNG, 1, Plugin::ImageEncoder::ALL },
+        { _T("png 6 sub"), Plugin::ImageEncoder::PNG, 6, Plugin::ImageEncoder::SUB },
+        { _T("png 9 sub"), Plugin::ImageEncoder::PNG, 9, Plugin::ImageEncoder::SUB }
+    };
+
+    Exchange::ICapture* device = Exchange::ICapture::Instance();
+
+    if (device == nullptr) {
+        printf(_T("No capture device\n"));
+        return (1);
+    }
+
+    printf(_T("%u captures per setting on the %s device\n"), frames, device->Name());
+    printf(_T("%-18s %10s %10s %10s %12s\n"), _T("setting"), _T("fps"), _T("ms"), _T("MB/s in"), _T("KB/image"));
+
+    Plugin::Measure(*device, _T("capture only"), nullptr, frames);
+
+    for (const Plugin::Setting& setting : Settings) {
+        const Plugin::ImageEncoder encoder(setting.Format, setting.Level, setting.Filter);
+
+        Plugin::Measure(*device, setting.Name, &encoder, frames);
+    }
+
+    device->Release();
+
+    Core::Singleton::Dispose();
+
+    return (0);
+}
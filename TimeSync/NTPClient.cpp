@@ -18,6 +18,7 @@
  */
 
 #include "NTPClient.h"
+#include <limits>
 #include <stdio.h>
 
 namespace WPEFramework {
@@ -25,6 +26,9 @@ namespace Plugin {
 
     constexpr uint32_t WaitForResponse = 2000;
 
+    // Our own precision, Core::Time has microseconds.
+    constexpr double LocalPrecision = 1e-6;
+
 #ifdef __WINDOWS__
 #pragma warning(disable : 4355)
 #endif
@@ -34,9 +38,13 @@ namespace Plugin {
         , _packet()
         , _syncedTimestamp()
         , _state(INITIAL)
-        , _fired(true)
         , _WaitForNetwork(2000) // Wait for 2 Seconds for a new attempt
         , _retryAttempts(5)
+        , _currentAttempt(0)
+        , _peers()
+        , _source()
+        , _offset(0)
+        , _round(0)
         , _activity(Core::ProxyType<Activity>::Create(this))
         , _clients()
     {
@@ -65,7 +73,7 @@ namespace Plugin {
     {
         _retryAttempts = retries;
         _WaitForNetwork = (delay * 1000); /* in ms */
-        _servers.clear();
+        _peers.clear();
 
         while (sources.Next() == true) {
             Core::URL url(sources.Current().Value());
@@ -82,11 +90,9 @@ namespace Plugin {
                     hostname += ':' + Core::NumberType<uint16_t>(Core::URL::Port(url.Type())).Text();
                 }
 
-                _servers.push_back(hostname);
+                _peers.emplace_back(hostname);
             }
         }
-
-        _serverIndex = ServerIterator(_servers);
     }
 
     /* virtual */ uint32_t NTPClient::Synchronize()
@@ -97,7 +103,9 @@ namespace Plugin {
 
         _adminLock.Lock();
 
-        if ((_state == INITIAL) || (_state == SUCCESS) || ((_state == FAILED) && (_serverIndex.IsValid() == false))) {
+        if (_peers.empty() == true) {
+            TRACE(Trace::Error, (_T("No NTP servers configured")));
+        } else if ((_state == INITIAL) || (_state == SUCCESS) || (_state == FAILED)) {
             result = Core::ERROR_NONE;
             _state = SENDREQUEST;
             Core::IWorkerPool::Instance().Submit(_activity);
@@ -136,7 +144,7 @@ namespace Plugin {
 
     /* virtual */ string NTPClient::Source() const
     {
-        return (_serverIndex.IsValid() == true ? string(_T("NTP://")) + (*_serverIndex) + '/' : _T("NTP:///"));
+        return (string(_T("NTP://")) + _source + '/');
     }
 
     /* virtual */ void NTPClient::Register(Exchange::ITimeSync::INotification* notification)
@@ -174,17 +182,26 @@ namespace Plugin {
 
         _adminLock.Lock();
 
-        if (_fired == false) {
+        // One request per call, the socket keeps asking until all queued servers got theirs.
+        std::vector<Peer>::iterator index(_peers.begin());
+
+        while ((index != _peers.end()) && (index->IsQueued() == false)) {
+            index++;
+        }
 
-            _fired = true;
+        if (index != _peers.end()) {
+            const NTPPacket::Timestamp now(Core::Time::Now());
 
             DataFrame newFrame(dataFrame, maxSendSize);
             DataFrame::Writer writer(newFrame, 0);
-            _packet.TransmitTimestamp(NTPPacket::Timestamp(Core::Time::Now()));
+            _packet.TransmitTimestamp(now);
             _packet.Serialize(writer);
 
+            RemoteNode(index->Remote());
+            index->Sent(now.TimeSeconds());
+
             result = newFrame.Size();
-            TRACE(Trace::Information, (_T("Timesync: Send data: %d bytes"), result));
+            TRACE(Trace::Information, (_T("Timesync: Send data to [%s]: %d bytes"), index->Name().c_str(), result));
         }
 
         _adminLock.Unlock();
@@ -192,20 +209,23 @@ namespace Plugin {
         return result;
     }
 
-    inline static uint64_t SecondsToTicks(double seconds)
-    {
-        return static_cast<uint64_t>(seconds * NTPClient::MicroSeconds);
-    }
-
     /* virtual */ uint16_t NTPClient::ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize)
     {
-        double received = static_cast<double>(Core::Time::Now().Ticks() / MicroSeconds);
+        const uint64_t receivedTicks = Core::Time::Now().Ticks();
+        const double received = static_cast<double>(receivedTicks) / MicroSeconds;
 
         TRACE(Trace::Information, (_T("Timesync: Received data: %d bytes"), receivedSize));
 
         _adminLock.Lock();
 
-        if (receivedSize == NTPPacket::PacketSize) {
+        const Core::NodeId& origin(ReceivedNode());
+        std::vector<Peer>::iterator peer(_peers.begin());
+
+        while ((peer != _peers.end()) && (peer->Remote() != origin)) {
+            peer++;
+        }
+
+        if ((receivedSize == NTPPacket::PacketSize) && (peer != _peers.end())) {
 
             DataFrame frame(dataFrame, receivedSize, receivedSize);
             NTPPacket packet;
@@ -215,49 +235,43 @@ namespace Plugin {
 // packet.DisplayPacket();
 #endif
 
-            double receivedServerTS = packet.ReceiveTimestamp().TimeSeconds();
-            double sentServerTS = packet.TransmitTimestamp().TimeSeconds();
-            double sentTS = packet.OriginalTimestamp().TimeSeconds();
-
-            double diffRequest = receivedServerTS - sentTS;
-            double diffResponse = sentServerTS - received;
-            double offset = (diffRequest + diffResponse) / 2;
+            // A server that is not synchronized itself, or a kiss-o'-death (stratum 0), does not count.
+            if ((packet.NTPMode() != 4) || (packet.LeapIndicator() == 3) || (packet.Stratum() == 0) || (packet.Stratum() > 15)) {
+                TRACE(Trace::Warning, (_T("NTP Server [%s] is not usable: mode %d, leap %d, stratum %d"), peer->Name().c_str(), packet.NTPMode(), packet.LeapIndicator(), packet.Stratum()));
+            } else if (peer->IsAnswer(packet.OriginalTimestamp().TimeSeconds()) == false) {
+                TRACE(Trace::Warning, (_T("NTP Server [%s] answered a request that is not outstanding"), peer->Name().c_str()));
+            } else {
+                const double Fraction_16_16 = 65536.0;
 
-#ifdef __DEBUG__
-            double elapsedServer = sentServerTS - receivedServerTS;
-            double elapsedTotal = received - sentTS;
-            double roundTrip = elapsedTotal - elapsedServer;
-#endif
+                double receivedServerTS = packet.ReceiveTimestamp().TimeSeconds();
+                double sentServerTS = packet.TransmitTimestamp().TimeSeconds();
+                double sentTS = packet.OriginalTimestamp().TimeSeconds();
 
-            TRACE(Trace::Information, (_T("Request time diff  = %lf"), diffRequest));
-            TRACE(Trace::Information, (_T("Response time diff = %lf"), diffResponse));
-            TRACE(Trace::Information, (_T("Offset time        = %lf"), offset));
+                double diffRequest = receivedServerTS - sentTS;
+                double diffResponse = sentServerTS - received;
 
-#ifdef __DEBUG__
-            TRACE(Trace::Information, (_T("Server elapsed time = %lf"), elapsedServer));
-            TRACE(Trace::Information, (_T("Total elapsed time  = %lf"), elapsedTotal));
-            TRACE(Trace::Information, (_T("Round trip time     = %lf"), roundTrip));
-#endif
-            TRACE(Trace::Information, (_T("TimeSync: Request time diff   = %lf s"), diffRequest));
-            TRACE(Trace::Information, (_T("TimeSync: Response time diff  = %lf s"), diffResponse));
-            TRACE(Trace::Information, (_T("TimeSync: Offset time         = %lf s"), offset));
+                Peer::Sample sample;
+                sample.Offset = (diffRequest + diffResponse) / 2;
+                sample.Delay = std::max((received - sentTS) - (sentServerTS - receivedServerTS), LocalPrecision);
+                sample.Dispersion = std::ldexp(1.0, static_cast<int8_t>(packet.Precision())) + LocalPrecision;
+                sample.Time = receivedTicks;
 
-            uint64_t receivedTicks = SecondsToTicks(received);
-            TRACE(Trace::Information, (_T("TimeSync: Current time: %s"), Core::Time(receivedTicks).ToRFC1123(false).c_str()));
-            _syncedTimestamp = Core::Time(receivedTicks + SecondsToTicks(offset));
-            TRACE(Trace::Information, (_T("TimeSync: New time:     %s"), _syncedTimestamp.ToRFC1123(false).c_str()));
+                TRACE(Trace::Information, (_T("TimeSync: [%s] offset %lf s, delay %lf s, stratum %d"), peer->Name().c_str(), sample.Offset, sample.Delay, packet.Stratum()));
 
-            _state = SUCCESS;
+                peer->Add(sample, packet.RootDelay() / Fraction_16_16, packet.RootDispersion() / Fraction_16_16);
 
-            // We don't need the socket anymore, so close it
-            TRACE(Trace::Information, (_T("TimeSync: %s"), "Closing socket, no longer needed"));
-            Close(0);
+                std::vector<Peer>::const_iterator index(_peers.begin());
 
-            // Lets remove the watchdog subject, we do not want to wait anymore, we got an answer.
-            Core::IWorkerPool::Instance().Revoke(_activity);
+                while ((index != _peers.end()) && (index->IsQueued() == false) && (index->IsOutstanding() == false)) {
+                    index++;
+                }
 
-            // Schedule it again to broadcast the successfull update of the time.
-            Core::IWorkerPool::Instance().Submit(_activity);
+                if (index == _peers.end()) {
+                    // Everybody answered, no need to wait for the timeout to start the next round.
+                    Core::IWorkerPool::Instance().Revoke(_activity);
+                    Core::IWorkerPool::Instance().Submit(_activity);
+                }
+            }
         }
 
         _adminLock.Unlock();
@@ -277,61 +291,161 @@ namespace Plugin {
 
     bool NTPClient::FireRequest()
     {
-
         bool activated = false;
 
-        // Make sure socket is closed otherwise an assert will fire.
-        if (!IsClosed()) {
-            TRACE(Trace::Information, (_T("Lingering socket, closing")));
-            Close(1000);
-        }
+        if (_round == 0) {
+            // Start of a synchronization, resolve the servers again, the network may have changed.
+            if (!IsClosed()) {
+                TRACE(Trace::Information, (_T("Lingering socket, closing")));
+                Close(1000);
+            }
 
-        if (true == IsClosed() && (_serverIndex.Count() > 0)) {
+            for (Peer& peer : _peers) {
+                peer.Reset();
 
-            uint32_t lastonetried = _serverIndex.Index();
+                if (peer.Remote().IsValid() == false) {
+                    TRACE(Trace::Warning, (_T("Could not resolve NTP Server [%s]"), peer.Name().c_str()));
+                } else if (IsClosed() == true) {
+                    // All servers are asked through the same socket.
+                    LocalNode(peer.Remote().AnyInterface());
 
-            do {
+                    // UDP should open by definition directly...
+                    uint32_t status = Open(100);
 
-                // next server
-                if( _serverIndex.Index() >= _serverIndex.Count() ) {
-                    _serverIndex.Reset(0);
+                    if ((status != Core::ERROR_NONE) && (status != Core::ERROR_INPROGRESS)) {
+                        TRACE(Trace::Warning, (_T("Could not open connection to NTP Server [%s]"), peer.Name().c_str()));
+                    }
                 }
-                _serverIndex.Next();
-                ASSERT(_serverIndex.IsValid());
+            }
+        }
+
+        if (IsClosed() == false) {
+            for (Peer& peer : _peers) {
+                if (peer.Remote().IsValid() == true) {
+                    TRACE(Trace::Information, (_T("Trying NTP Server: [%s]"), peer.Name().c_str()));
+                    peer.Queue();
+                    activated = true;
+                }
+            }
+
+            if (activated == true) {
+                Trigger();
+            }
+        }
 
-                TRACE(Trace::Information, (_T("Trying NTP Server: [%s]"), (*_serverIndex).c_str()));
+        return (activated);
+    }
+
+    // Intersection algorithm (RFC 5905 section 11.2.1): find the smallest interval that holds the offsets of the
+    // majority of the servers, each give or take its root distance. Servers outside it are falsetickers, the others
+    // are combined, weighted by the inverse of their root distance.
+    bool NTPClient::Select()
+    {
+        struct Candidate {
+            double Offset;
+            double Distance;
+            const Peer* Source;
+        };
+
+        const uint64_t now = Core::Time::Now().Ticks();
+        std::vector<Candidate> candidates;
+        std::vector<std::pair<double, int8_t>> edges;
+
+        for (const Peer& peer : _peers) {
+            Candidate candidate;
+
+            if (peer.Filter(now, candidate.Offset, candidate.Distance) == true) {
+                candidate.Source = &peer;
+                candidates.push_back(candidate);
+                edges.emplace_back(candidate.Offset - candidate.Distance, -1);
+                edges.emplace_back(candidate.Offset, 0);
+                edges.emplace_back(candidate.Offset + candidate.Distance, +1);
+            }
+        }
 
-                // Set the socket to send to the remote
-                Core::NodeId remote((*_serverIndex).c_str(), Core::NodeId::TYPE_IPV4);
+        if (candidates.empty() == false) {
+            const uint32_t count = static_cast<uint32_t>(candidates.size());
+            double low = 0;
+            double high = 0;
+            bool found = false;
 
-                if (remote.IsValid() == true) {
-                    // Set the remote endpoint for the socket to the selected NTP server
-                    RemoteNode(remote);
-                    LocalNode(remote.AnyInterface());
+            std::sort(edges.begin(), edges.end());
 
-                    // UDP should open by definition directly...
-                    uint32_t status = Open(100);
+            for (uint32_t allow = 0; ((2 * allow) < count) && (found == false); allow++) {
+                uint32_t outside = 0;
+                int32_t chime = 0;
 
-                    if ((status == Core::ERROR_NONE) || (status == Core::ERROR_INPROGRESS)) {
+                low = std::numeric_limits<double>::max();
+                high = std::numeric_limits<double>::lowest();
 
-                        activated = true;
-                        _fired = false;
-                        Trigger();
+                for (uint32_t index = 0; index < edges.size(); index++) {
+                    chime -= edges[index].second;
+                    if (chime >= static_cast<int32_t>(count - allow)) {
+                        low = edges[index].first;
+                        break;
                     }
-                    else {
-                        TRACE(Trace::Warning, (_T("Could not open connection to NTP Server [%s]"), (*_serverIndex).c_str()));
+                    if (edges[index].second == 0) {
+                        outside++;
                     }
                 }
-                else {
-                    TRACE(Trace::Warning, (_T("Could not resolve NTP Server [%s]"), (*_serverIndex).c_str()));
+
+                chime = 0;
+
+                for (uint32_t index = static_cast<uint32_t>(edges.size()); index-- != 0;) {
+                    chime += edges[index].second;
+                    if (chime >= static_cast<int32_t>(count - allow)) {
+                        high = edges[index].first;
+                        break;
+                    }
+                    if (edges[index].second == 0) {
+                        outside++;
+                    }
                 }
+
+                found = ((outside <= allow) && (low < high));
             }
-            while ((activated == false) && ( ((lastonetried != 0) && (lastonetried != _serverIndex.Index())) ||
-                                             ((lastonetried == 0) && (_serverIndex.Index() != _serverIndex.Count())) 
-                                           ) );
+
+            const Candidate* system = nullptr;
+
+            if (found == false) {
+                // No majority agrees, rather than having no time at all, trust the best one.
+                TRACE(Trace::Warning, (_T("NTP Servers do not agree on the time, using the closest one")));
+
+                for (const Candidate& candidate : candidates) {
+                    if ((system == nullptr) || (candidate.Distance < system->Distance)) {
+                        system = &candidate;
+                    }
+                }
+
+                _offset = system->Offset;
+            } else {
+                double weights = 0;
+                double offset = 0;
+
+                for (const Candidate& candidate : candidates) {
+                    if ((candidate.Offset >= low) && (candidate.Offset <= high)) {
+                        offset += candidate.Offset / candidate.Distance;
+                        weights += 1.0 / candidate.Distance;
+
+                        if ((system == nullptr) || (candidate.Distance < system->Distance)) {
+                            system = &candidate;
+                        }
+                    }
+                }
+
+                _offset = offset / weights;
+            }
+
+            ASSERT(system != nullptr);
+
+            _source = system->Source->Name();
+            _syncedTimestamp = Core::Time(now + static_cast<int64_t>(_offset * MicroSeconds));
+
+            TRACE(Trace::Information, (_T("TimeSync: Offset time         = %lf s, source [%s]"), _offset, _source.c_str()));
+            TRACE(Trace::Information, (_T("TimeSync: New time:     %s"), _syncedTimestamp.ToRFC1123(false).c_str()));
         }
 
-        return (activated);
+        return (candidates.empty() == false);
     }
 
     void NTPClient::Update()
@@ -359,31 +473,49 @@ namespace Plugin {
         _adminLock.Lock();
 
         if (_state == SENDREQUEST) {
-            // This case means that nothing has started yet, let reset the list of servers and start at the beginning...
-            _serverIndex.Reset(0);
+            // This case means that nothing has started yet, start with the first round...
             _state = INPROGRESS;
             _currentAttempt = _retryAttempts;
+            _round = 0;
+            _offset = 0;
         }
 
         if (_state == INPROGRESS) {
-            // If we end up here in this state, it means that the package was send but no response was received,
-            // or a response was received but is was not properly formatted...
-            // Lets move to the next server in the list, see if that one responds correctly, if we tried all servers let's
-            // start at the first one again, this time it might work
-            if (FireRequest() == true) {
-              result = WaitForResponse;
-            } 
-            else if (_currentAttempt-- != 0) {
-
-                // Looks like there is no network connectivity, Just sleep and retry later
+            // If we end up here in this state, all servers answered the last round, or the ones that did not
+            // are not going to. Ask all of them again, a few times, as the clock filter needs more than one sample
+            // to see which answer suffered the least from network delays.
+            if (_round < Burst) {
+                if (FireRequest() == true) {
+                    _round++;
+                    result = WaitForResponse;
+                } else if (_currentAttempt-- != 0) {
+
+                    // Looks like there is no network connectivity, Just sleep and retry later
+                    _round = 0;
+                    result = _WaitForNetwork;
+
+                } else {
+
+                    // Looks like there is no server we can reach.
+                    _state = FAILED;
+                }
+            } else if (Select() == true) {
+                _state = SUCCESS;
+            } else if (_currentAttempt-- != 0) {
+
+                // None of the servers answered, maybe the network is not up yet, start all over later.
+                _round = 0;
                 result = _WaitForNetwork;
 
             } else {
-
-                // Looks like there is no valid server anymore that we could use. There where servers
-                // that did resolve correctly, so it is not a network connectivity problem.
                 _state = FAILED;
             }
+
+            if ((_state != INPROGRESS) && (IsClosed() == false)) {
+                // We don't need the socket anymore, so close it
+                TRACE(Trace::Information, (_T("TimeSync: %s"), "Closing socket, no longer needed"));
+                Close(0);
+            }
         }
 
         if ((_state == FAILED) || (_state == SUCCESS)) {
@@ -23,6 +23,9 @@
 #include "Module.h"
 #include <interfaces/ITimeSync.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace WPEFramework {
 namespace Plugin {
 
@@ -35,16 +38,17 @@ namespace Plugin {
         using SourceIterator = Core::JSON::ArrayType<Core::JSON::String>::Iterator;
 
     private:
-        using ServerList = std::vector<string>;
-        using ServerIterator = Core::IteratorType<const ServerList, const string&, ServerList::const_iterator>;
         using DataFrame = Core::FrameType<0>;
 
+        // Requests sent to every server for one synchronization, each round waits for all answers or a timeout.
+        static constexpr uint8_t Burst = 4;
+
         // This enum tracks the state for actions begin performed. As the Worker() method is re-entered,
         // we need to keep track of state.
         enum state {
             INITIAL, // Initial state
-            SENDREQUEST, // Let send out an NTP request to a legitimate server.
-            INPROGRESS, // A request has been sent to a NTP server, waiting for a response
+            SENDREQUEST, // Let send out NTP requests to all legitimate servers.
+            INPROGRESS, // Requests have been sent to the NTP servers, collecting responses
             SUCCESS, // Action succeeded, we received a valid response from an NTP server
             FAILED // Action failed, we did not receive any valid response from any of the NTP servers
         };
@@ -328,6 +332,149 @@ namespace Plugin {
                 // bit (NTP time)
         };
 
+        // A configured server and the last samples taken from it. The clock filter (RFC 5905 section 10) picks the
+        // sample with the lowest round trip delay, as it has the smallest error, and reports the root distance:
+        // the maximum error of the offset that is used to select the servers that agree with each other.
+        class Peer {
+        public:
+            static constexpr uint8_t Stages = 8;
+            static constexpr double Phi = 15e-6; // Frequency tolerance of the local clock (15 ppm)
+
+            struct Sample {
+                double Offset; // Seconds the server is ahead of us
+                double Delay; // Round trip, in seconds
+                double Dispersion; // Seconds
+                uint64_t Time; // Ticks at which it was taken
+            };
+
+        public:
+            Peer() = delete;
+            Peer& operator=(const Peer&) = delete;
+
+            Peer(const string& name)
+                : _name(name)
+                , _remote()
+                , _sent(0)
+                , _queued(false)
+                , _outstanding(false)
+                , _rootDelay(0)
+                , _rootDispersion(0)
+                , _samples()
+                , _count(0)
+                , _next(0)
+            {
+            }
+            Peer(const Peer& copy)
+                : _name(copy._name)
+                , _remote(copy._remote)
+                , _sent(copy._sent)
+                , _queued(copy._queued)
+                , _outstanding(copy._outstanding)
+                , _rootDelay(copy._rootDelay)
+                , _rootDispersion(copy._rootDispersion)
+                , _count(copy._count)
+                , _next(copy._next)
+            {
+                ::memcpy(_samples, copy._samples, sizeof(_samples));
+            }
+            ~Peer()
+            {
+            }
+
+        public:
+            inline const string& Name() const
+            {
+                return (_name);
+            }
+            inline const Core::NodeId& Remote() const
+            {
+                return (_remote);
+            }
+            inline bool IsQueued() const
+            {
+                return (_queued);
+            }
+            inline bool IsOutstanding() const
+            {
+                return (_outstanding);
+            }
+            void Reset()
+            {
+                _remote = Core::NodeId(_name.c_str(), Core::NodeId::TYPE_IPV4);
+                _queued = false;
+                _outstanding = false;
+                _count = 0;
+                _next = 0;
+            }
+            void Queue()
+            {
+                _queued = true;
+                _outstanding = false;
+            }
+            void Sent(const double timestamp)
+            {
+                _sent = timestamp;
+                _queued = false;
+                _outstanding = true;
+            }
+            // Only accept the answer to the request that is outstanding, anything else is old or forged.
+            inline bool IsAnswer(const double originate) const
+            {
+                return ((_outstanding == true) && (std::fabs(originate - _sent) < 1e-6));
+            }
+            void Add(const Sample& sample, const double rootDelay, const double rootDispersion)
+            {
+                _samples[_next] = sample;
+                _next = (_next + 1) % Stages;
+                if (_count < Stages) {
+                    _count++;
+                }
+                _rootDelay = rootDelay;
+                _rootDispersion = rootDispersion;
+                _outstanding = false;
+            }
+            bool Filter(const uint64_t now, double& offset, double& distance) const
+            {
+                if (_count != 0) {
+                    uint8_t best = 0;
+
+                    for (uint8_t index = 1; index < _count; index++) {
+                        if (_samples[index].Delay < _samples[best].Delay) {
+                            best = index;
+                        }
+                    }
+
+                    double jitter = 0;
+
+                    for (uint8_t index = 0; index < _count; index++) {
+                        const double difference = _samples[index].Offset - _samples[best].Offset;
+                        jitter += difference * difference;
+                    }
+
+                    jitter = (_count > 1 ? std::sqrt(jitter / (_count - 1)) : 0);
+
+                    const double age = static_cast<double>(now - _samples[best].Time) / MicroSeconds;
+
+                    offset = _samples[best].Offset;
+                    distance = ((_rootDelay + _samples[best].Delay) / 2) + _rootDispersion + _samples[best].Dispersion + (Phi * age) + jitter;
+                }
+
+                return (_count != 0);
+            }
+
+        private:
+            const string _name;
+            Core::NodeId _remote;
+            double _sent; // Transmit timestamp of the outstanding request
+            bool _queued;
+            bool _outstanding;
+            double _rootDelay;
+            double _rootDispersion;
+            Sample _samples[Stages];
+            uint8_t _count;
+            uint8_t _next;
+        };
+
         class Activity : public Core::IDispatchType<void> {
         private:
             Activity() = delete;
@@ -372,6 +519,12 @@ namespace Plugin {
         virtual string Source() const override;
         virtual uint64_t SyncTime() const override;
 
+        // Seconds the clock was off at the last synchronization, positive if it was behind.
+        inline double Offset() const
+        {
+            return (_offset);
+        }
+
         // ITime methods
         virtual uint64_t TimeSync() const override
         {
@@ -394,18 +547,20 @@ namespace Plugin {
         void Update();
         void Dispatch();
         bool FireRequest();
+        bool Select();
 
     private:
         Core::CriticalSection _adminLock;
         NTPPacket _packet;
         Core::Time _syncedTimestamp;
         state _state;
-        bool _fired;
         uint32_t _WaitForNetwork;
         uint32_t _retryAttempts;
         uint32_t _currentAttempt;
-        ServerList _servers;
-        ServerIterator _serverIndex;
+        std::vector<Peer> _peers;
+        string _source;
+        double _offset;
+        uint8_t _round;
         Core::ProxyType<Core::IDispatchType<void>> _activity;
         std::list<Exchange::ITimeSync::INotification*> _clients;
     };
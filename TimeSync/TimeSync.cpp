@@ -20,6 +20,10 @@
 #include "TimeSync.h"
 #include "NTPClient.h"
 
+#ifdef __LINUX__
+#include <sys/timex.h>
+#endif
+
 namespace WPEFramework {
 namespace Plugin {
 
@@ -31,6 +35,26 @@ namespace Plugin {
 
     static const uint16_t NTPPort = 123;
 
+    // Offsets below this are slewed, larger ones stepped, like ntpd does (seconds).
+    static constexpr double StepThreshold = 0.128;
+
+    // Let the kernel gradually speed up or slow down the clock until the offset is gone, so time never jumps,
+    // nor runs backwards. It slews at most 500 ppm, so the threshold takes about 4 minutes.
+    static bool Slew(const double offset)
+    {
+#ifdef __LINUX__
+        struct timex adjustment;
+
+        ::memset(&adjustment, 0, sizeof(adjustment));
+        adjustment.modes = ADJ_OFFSET_SINGLESHOT;
+        adjustment.offset = static_cast<long>(offset * NTPClient::MicroSeconds);
+
+        return (::adjtimex(&adjustment) != -1);
+#else
+        return (false);
+#endif
+    }
+
 #ifdef __WINDOWS__
 #pragma warning(disable : 4355)
 #endif
@@ -174,10 +198,15 @@ namespace Plugin {
     void TimeSync::SyncedTime(const uint64_t time)
     {
         Core::Time newTime(time);
+        const double offset = static_cast<NTPClient*>(_client)->Offset();
 
-        TRACE(Trace::Information, (_T("Syncing time to %s."), newTime.ToRFC1123(false).c_str()));
+        if ((std::fabs(offset) < StepThreshold) && (Slew(offset) == true)) {
+            TRACE(Trace::Information, (_T("Slewing time by %lf s."), offset));
+        } else {
+            TRACE(Trace::Information, (_T("Syncing time to %s."), newTime.ToRFC1123(false).c_str()));
 
-        Core::SystemInfo::Instance().SetTime(newTime);
+            Core::SystemInfo::Instance().SetTime(newTime);
+        }
 
         if (_periodicity != 0) {
             Core::Time newSyncTime(Core::Time::Now());
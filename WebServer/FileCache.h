@@ -0,0 +1,322 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#include <atomic>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Keeps the contents of small static files in memory, so repeated requests for the same file do not hit the
+    // disk. The cache is bounded in bytes and evicts the least recently used files first. An entry is dropped as
+    // soon as the size or modification time of the file on disk changes.
+    // If a precompressed sibling (<file>.gz) exists next to the file, it is loaded as well and can be served to
+    // clients accepting gzip. The entry is also dropped if that sibling appears, changes or is removed.
+    // All access happens on the SocketPortMonitor thread, so no locking is required. Only the statistics are read
+    // from other threads.
+    class FileCache {
+    public:
+        class Entry {
+        public:
+            Entry() = delete;
+            Entry(const Entry&) = delete;
+            Entry& operator=(const Entry&) = delete;
+
+            Entry(const Web::MIMETypes type, const Web::EncodingTypes encoding, const Core::Time& modified, const uint32_t size)
+                : Content()
+                , Compressed()
+                , Type(type)
+                , Encoding(encoding)
+                , Modified(modified)
+                , Size(size)
+                , ETag()
+                , SiblingModified()
+                , SiblingSize(0)
+            {
+                char tag[32];
+
+                ::snprintf(tag, sizeof(tag), "\"%x-%llx\"", size, static_cast<unsigned long long>(modified.Ticks()));
+
+                ETag = tag;
+            }
+            ~Entry()
+            {
+            }
+
+        public:
+            inline uint32_t Footprint() const
+            {
+                return (static_cast<uint32_t>(Content.length() + Compressed.length()));
+            }
+
+        public:
+            string Content;
+            string Compressed;
+            Web::MIMETypes Type;
+            Web::EncodingTypes Encoding;
+            Core::Time Modified;
+            uint32_t Size;
+            string ETag;
+            Core::Time SiblingModified; // Of the .gz sibling when the entry was loaded, if there was one
+            uint64_t SiblingSize;
+        };
+
+        // Serves a cached file. The body keeps a reference to the entry until it is reused, so an eviction while
+        // the response is still being sent is harmless.
+        class Body : public Web::IBody {
+        public:
+            Body(const Body&) = delete;
+            Body& operator=(const Body&) = delete;
+
+            Body()
+                : _entry()
+                , _data(nullptr)
+                , _length(0)
+                , _offset(0)
+            {
+            }
+            ~Body() override
+            {
+            }
+
+        public:
+            void Link(const Core::ProxyType<const Entry>& entry, const bool compressed)
+            {
+                _entry = entry;
+                _data = (compressed == true ? entry->Compressed.c_str() : entry->Content.c_str());
+                _length = static_cast<uint32_t>(compressed == true ? entry->Compressed.length() : entry->Content.length());
+                _offset = 0;
+            }
+            // Only serve a part of the content that was linked.
+            void Range(const uint32_t offset, const uint32_t length)
+            {
+                ASSERT((static_cast<uint64_t>(offset) + length) <= _length);
+
+                _data += offset;
+                _length = length;
+            }
+
+        protected:
+            uint32_t Serialize() const override
+            {
+                _offset = 0;
+                return (_length);
+            }
+            uint16_t Serialize(uint8_t stream[], const uint16_t maxLength) const override
+            {
+                uint16_t loaded = static_cast<uint16_t>(std::min(static_cast<uint32_t>(maxLength), _length - _offset));
+
+                ::memcpy(stream, &(_data[_offset]), loaded);
+                _offset += loaded;
+
+                return (loaded);
+            }
+            uint32_t Deserialize() override
+            {
+                // Cached content is read-only.
+                ASSERT(false);
+                return (0);
+            }
+            uint16_t Deserialize(const uint8_t[], const uint16_t) override
+            {
+                ASSERT(false);
+                return (0);
+            }
+            void End() const override
+            {
+            }
+
+        private:
+            Core::ProxyType<const Entry> _entry;
+            const char* _data;
+            uint32_t _length;
+            mutable uint32_t _offset;
+        };
+
+    private:
+        using LRUList = std::list<string>;
+        using Map = std::unordered_map<string, std::pair<Core::ProxyType<const Entry>, LRUList::iterator>>;
+
+    public:
+        FileCache(const FileCache&) = delete;
+        FileCache& operator=(const FileCache&) = delete;
+
+        FileCache()
+            : _entries()
+            , _lru()
+            , _capacity(0)
+            , _maxFileSize(0)
+            , _size(0)
+            , _hits(0)
+            , _misses(0)
+        {
+        }
+        ~FileCache()
+        {
+        }
+
+    public:
+        inline void Configure(const uint32_t capacity, const uint32_t maxFileSize)
+        {
+            _capacity = capacity;
+            _maxFileSize = std::min(capacity, maxFileSize);
+
+            Evict(0);
+        }
+        inline bool IsEnabled() const
+        {
+            return (_capacity != 0);
+        }
+        inline uint32_t Hits() const
+        {
+            return (_hits.load(std::memory_order_relaxed));
+        }
+        inline uint32_t Misses() const
+        {
+            return (_misses.load(std::memory_order_relaxed));
+        }
+
+        // Returns an invalid proxy if the file does not exist, or is too big to be cached.
+        Core::ProxyType<const Entry> Get(const string& fileName, const Web::MIMETypes type, const Web::EncodingTypes encoding)
+        {
+            Core::ProxyType<const Entry> result;
+            Core::File file(fileName);
+
+            if ((file.Exists() == true) && (file.IsDirectory() == false)) {
+                Map::iterator index(_entries.find(fileName));
+
+                if (index != _entries.end()) {
+                    const Entry& entry(*(index->second.first));
+                    Core::Time siblingModified;
+                    uint64_t siblingSize = 0;
+
+                    if (entry.Encoding == Web::ENCODING_UNKNOWN) {
+                        Sibling(fileName, siblingModified, siblingSize);
+                    }
+
+                    if ((entry.Size == file.Size()) && (entry.Modified == file.LastChange()) && (entry.SiblingSize == siblingSize) && (entry.SiblingModified == siblingModified)) {
+                        // Still valid, mark it as the most recently used.
+                        _lru.splice(_lru.begin(), _lru, index->second.second);
+                        result = index->second.first;
+                        _hits.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        Remove(index);
+                    }
+                }
+
+                if ((result.IsValid() == false) && (file.Size() <= _maxFileSize)) {
+                    _misses.fetch_add(1, std::memory_order_relaxed);
+                    result = Load(file, type, encoding);
+                }
+            }
+
+            return (result);
+        }
+
+    private:
+        Core::ProxyType<const Entry> Load(Core::File& file, const Web::MIMETypes type, const Web::EncodingTypes encoding)
+        {
+            Core::ProxyType<Entry> entry(Core::ProxyType<Entry>::Create(type, encoding, file.LastChange(), static_cast<uint32_t>(file.Size())));
+            Core::ProxyType<const Entry> result;
+
+            if (Read(file, entry->Content) == true) {
+                // Only the uncompressed files can have a precompressed variant
+                if ((encoding == Web::ENCODING_UNKNOWN) && (Sibling(file.Name(), entry->SiblingModified, entry->SiblingSize) == true)) {
+                    Core::File compressed(file.Name() + _T(".gz"));
+
+                    if ((entry->SiblingSize < file.Size()) && (entry->SiblingModified >= file.LastChange())) {
+                        Read(compressed, entry->Compressed);
+                    }
+                }
+
+                Evict(entry->Footprint());
+
+                _lru.push_front(file.Name());
+                result = Core::ProxyType<const Entry>(entry);
+                _entries.emplace(std::piecewise_construct,
+                    std::forward_as_tuple(file.Name()),
+                    std::forward_as_tuple(result, _lru.begin()));
+                _size += entry->Footprint();
+            }
+
+            return (result);
+        }
+        // Returns false if there is no precompressed sibling, its time and size are left untouched in that case.
+        static bool Sibling(const string& fileName, Core::Time& modified, uint64_t& size)
+        {
+            Core::File compressed(fileName + _T(".gz"));
+            const bool exists((compressed.Exists() == true) && (compressed.IsDirectory() == false));
+
+            if (exists == true) {
+                modified = compressed.LastChange();
+                size = compressed.Size();
+            }
+
+            return (exists);
+        }
+        bool Read(Core::File& file, string& content) const
+        {
+            bool loaded = false;
+
+            if (file.Open(true) == true) {
+                uint32_t size = static_cast<uint32_t>(file.Size());
+
+                content.resize(size);
+
+                loaded = (file.Read(reinterpret_cast<uint8_t*>(&content[0]), size) == size);
+
+                file.Close();
+
+                if (loaded == false) {
+                    content.clear();
+                }
+            }
+
+            return (loaded);
+        }
+        void Evict(const uint32_t required)
+        {
+            while ((_lru.empty() == false) && ((_size + required) > _capacity)) {
+                Remove(_entries.find(_lru.back()));
+            }
+        }
+        void Remove(Map::iterator index)
+        {
+            ASSERT(index != _entries.end());
+
+            _size -= index->second.first->Footprint();
+            _lru.erase(index->second.second);
+            _entries.erase(index);
+        }
+
+    private:
+        Map _entries;
+        LRUList _lru;
+        uint32_t _capacity;
+        uint32_t _maxFileSize;
+        uint32_t _size;
+        std::atomic<uint32_t> _hits;
+        std::atomic<uint32_t> _misses;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
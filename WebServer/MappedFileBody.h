@@ -0,0 +1,214 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+#ifndef __WINDOWS__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Serves (a range of) a file straight from a memory mapping of that file. Compared to a Web::FileBody this
+    // saves the read into an intermediate buffer, the data is copied once, from the page cache into the send
+    // buffer of the socket. Only a window of the file is mapped at a time, which slides along while the response
+    // is sent, so a file larger than the address space can be served as well. If the file can not be mapped at
+    // all, Link fails and the caller falls back to a Web::FileBody. Should a later window fail to map, that part
+    // is read instead. The file is closed as soon as the response is sent, a pooled body does not keep it open.
+    // Mapping is only supported on POSIX systems, elsewhere Link always fails.
+    class MappedFileBody : public Web::IBody {
+    private:
+        static constexpr uint32_t Window = 4 * 1024 * 1024;
+
+    public:
+        MappedFileBody(const MappedFileBody&) = delete;
+        MappedFileBody& operator=(const MappedFileBody&) = delete;
+
+        MappedFileBody()
+            : _fd(-1)
+            , _size(0)
+            , _offset(0)
+            , _length(0)
+            , _position(0)
+            , _map(nullptr)
+            , _mapOffset(0)
+            , _mapLength(0)
+        {
+        }
+        ~MappedFileBody() override
+        {
+            Unlink();
+        }
+
+    public:
+        // Size of the file that is linked, the full file, not the range that is served.
+        inline uint64_t FileSize() const
+        {
+            return (_size);
+        }
+        bool Link(const string& fileName VARIABLE_IS_NOT_USED)
+        {
+            Unlink();
+
+#ifndef __WINDOWS__
+            struct stat info;
+
+            _fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if ((_fd != -1) && (::fstat(_fd, &info) == 0) && (info.st_size > 0)) {
+                _size = static_cast<uint64_t>(info.st_size);
+                _offset = 0;
+                _length = static_cast<uint32_t>(std::min(_size, static_cast<uint64_t>(0xFFFFFFFF)));
+
+                // Find out right away if the file can be mapped, while there is still a way back.
+                if (Map(0) == false) {
+                    TRACE_L1("Could not map [%s], falling back to reading it.", fileName.c_str());
+                    Unlink();
+                }
+            } else {
+                Unlink();
+            }
+#endif
+
+            return (_fd != -1);
+        }
+        // A body can carry at most 4GB, but that part can be anywhere in the file.
+        void Range(const uint64_t offset, const uint32_t length)
+        {
+            ASSERT(_fd != -1);
+            ASSERT((offset + length) <= _size);
+
+            _offset = offset;
+            _length = length;
+        }
+        void Unlink()
+        {
+#ifndef __WINDOWS__
+            Unmap();
+
+            if (_fd != -1) {
+                ::close(_fd);
+                _fd = -1;
+            }
+#endif
+            _size = 0;
+            _offset = 0;
+            _length = 0;
+            _position = 0;
+        }
+
+    protected:
+        uint32_t Serialize() const override
+        {
+            _position = 0;
+            return (_length);
+        }
+        uint16_t Serialize(uint8_t stream[] VARIABLE_IS_NOT_USED, const uint16_t maxLength VARIABLE_IS_NOT_USED) const override
+        {
+            ASSERT(_fd != -1);
+
+            uint16_t loaded = 0;
+
+#ifndef __WINDOWS__
+            const uint64_t position(_offset + _position);
+            const uint32_t wanted(std::min(static_cast<uint32_t>(maxLength), _length - _position));
+
+            if (((position < _mapOffset) || (position >= (_mapOffset + _mapLength))) && (Map(position) == false)) {
+                const ssize_t size = ::pread(_fd, stream, wanted, static_cast<off_t>(position));
+
+                loaded = static_cast<uint16_t>(size > 0 ? size : 0);
+            } else {
+                loaded = static_cast<uint16_t>(std::min(static_cast<uint64_t>(wanted), (_mapOffset + _mapLength) - position));
+
+                ::memcpy(stream, &(_map[position - _mapOffset]), loaded);
+            }
+#endif
+
+            _position += loaded;
+
+            return (loaded);
+        }
+        uint32_t Deserialize() override
+        {
+            // Files are only served, never received.
+            ASSERT(false);
+            return (0);
+        }
+        uint16_t Deserialize(const uint8_t[], const uint16_t) override
+        {
+            ASSERT(false);
+            return (0);
+        }
+        void End() const override
+        {
+            const_cast<MappedFileBody*>(this)->Unlink();
+        }
+
+    private:
+#ifndef __WINDOWS__
+        // Maps the window holding the given position, which starts at a page boundary.
+        bool Map(const uint64_t position) const
+        {
+            static const uint64_t PageSize(static_cast<uint64_t>(::sysconf(_SC_PAGESIZE)));
+
+            const uint64_t start(position - (position % PageSize));
+            const uint32_t length(static_cast<uint32_t>(std::min(_size - start, static_cast<uint64_t>(Window))));
+
+            Unmap();
+
+            void* map = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, _fd, static_cast<off_t>(start));
+
+            if (map != MAP_FAILED) {
+                _map = static_cast<const uint8_t*>(map);
+                _mapOffset = start;
+                _mapLength = length;
+            }
+
+            return (_map != nullptr);
+        }
+        void Unmap() const
+        {
+            if (_map != nullptr) {
+                ::munmap(const_cast<uint8_t*>(_map), _mapLength);
+                _map = nullptr;
+            }
+            _mapOffset = 0;
+            _mapLength = 0;
+        }
+#endif
+
+    private:
+        int _fd;
+        uint64_t _size;
+        uint64_t _offset;
+        uint32_t _length;
+        mutable uint32_t _position;
+        mutable const uint8_t* _map;
+        mutable uint64_t _mapOffset;
+        mutable uint32_t _mapLength;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,160 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Longest prefix match of request paths on a set of registered paths. The paths are split on '/'
+    // and every segment is a level in the tree, so a lookup costs one map search per segment of the
+    // request path, independent of the number of registered paths. A path only matches on complete
+    // segments: "/a" matches "/a" and "/a/b", but not "/ab".
+    template <typename TARGET>
+    class RouteTreeType {
+    private:
+        class Node {
+        public:
+            Node(const Node&) = delete;
+            Node& operator=(const Node&) = delete;
+
+            Node()
+                : Children()
+                , Target(nullptr)
+            {
+            }
+            ~Node()
+            {
+                for (std::pair<const string, Node*>& child : Children) {
+                    delete child.second;
+                }
+            }
+
+        public:
+            std::map<string, Node*> Children;
+            TARGET* Target;
+        };
+
+    public:
+        RouteTreeType(const RouteTreeType<TARGET>&) = delete;
+        RouteTreeType<TARGET>& operator=(const RouteTreeType<TARGET>&) = delete;
+
+        RouteTreeType()
+            : _root()
+        {
+        }
+        ~RouteTreeType()
+        {
+        }
+
+    public:
+        // Returns the target that was previously registered for this path, if any.
+        TARGET* Insert(const string& path, TARGET* target)
+        {
+            Node* node(&_root);
+            string::size_type start = 0;
+            string::size_type end;
+
+            do {
+                end = path.find('/', start);
+
+                const string segment(path.substr(start, (end == string::npos ? string::npos : end - start)));
+                typename std::map<string, Node*>::iterator index(node->Children.find(segment));
+
+                if (index == node->Children.end()) {
+                    index = node->Children.emplace(segment, new Node()).first;
+                }
+
+                node = index->second;
+                start = end + 1;
+
+            } while (end != string::npos);
+
+            TARGET* previous(node->Target);
+            node->Target = target;
+
+            return (previous);
+        }
+        TARGET* Remove(const string& path)
+        {
+            return (Remove(_root, path, 0));
+        }
+        TARGET* Find(const string& path) const
+        {
+            const Node* node(&_root);
+            TARGET* result(nullptr);
+            string::size_type start = 0;
+            string::size_type end;
+
+            do {
+                end = path.find('/', start);
+
+                typename std::map<string, Node*>::const_iterator index(node->Children.find(path.substr(start, (end == string::npos ? string::npos : end - start))));
+
+                if (index == node->Children.end()) {
+                    node = nullptr;
+                } else {
+                    node = index->second;
+                    start = end + 1;
+
+                    if (node->Target != nullptr) {
+                        result = node->Target;
+                    }
+                }
+
+            } while ((node != nullptr) && (end != string::npos));
+
+            return (result);
+        }
+
+    private:
+        // Clears the target for the path and prunes the nodes that no longer lead to a target.
+        TARGET* Remove(Node& node, const string& path, const string::size_type start)
+        {
+            TARGET* result(nullptr);
+            string::size_type end(path.find('/', start));
+            typename std::map<string, Node*>::iterator index(node.Children.find(path.substr(start, (end == string::npos ? string::npos : end - start))));
+
+            if (index != node.Children.end()) {
+                Node* child(index->second);
+
+                if (end == string::npos) {
+                    result = child->Target;
+                    child->Target = nullptr;
+                } else {
+                    result = Remove(*child, path, end + 1);
+                }
+
+                if ((child->Target == nullptr) && (child->Children.empty() == true)) {
+                    delete child;
+                    node.Children.erase(index);
+                }
+            }
+
+            return (result);
+        }
+
+    private:
+        Node _root;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
@@ -0,0 +1,167 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Module.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Relays the body of an upstream response to the client while it is being received. The data flows through
+    // a fixed ring buffer, which is all the memory a slow client costs. The upstream connection is only relieved of
+    // what fits the ring, the link keeps the rest and offers it again, so a full ring stops reading the upstream
+    // and lets TCP hold back the server. Once the client took data out of a full ring, the upstream is resumed.
+    // Both sides run on the SocketPortMonitor thread, so no locking is required.
+    class StreamBody : public Web::IBody {
+    public:
+        struct ICallback {
+            virtual ~ICallback() = default;
+
+            // Kick the client to pull more of the body, returns false if the client is gone.
+            virtual bool Trigger(const uint32_t channelId) = 0;
+
+            // The ring has room again, kick the upstream to offer what it held back.
+            virtual void Resume(const uint32_t channelId) = 0;
+        };
+
+    public:
+        StreamBody(const StreamBody&) = delete;
+        StreamBody& operator=(const StreamBody&) = delete;
+
+        StreamBody()
+            : _buffer(nullptr)
+            , _capacity(0)
+            , _head(0)
+            , _filled(0)
+            , _stalled(false)
+            , _length(0)
+            , _callback(nullptr)
+            , _channelId(0)
+            , _detached(false)
+        {
+        }
+        ~StreamBody() override
+        {
+            if (_buffer != nullptr) {
+                delete[] _buffer;
+            }
+        }
+
+    public:
+        void Link(ICallback& callback, const uint32_t channelId, const uint32_t length, const uint32_t capacity)
+        {
+            if (capacity != _capacity) {
+                if (_buffer != nullptr) {
+                    delete[] _buffer;
+                }
+                _buffer = new uint8_t[capacity];
+                _capacity = capacity;
+            }
+
+            _head = 0;
+            _filled = 0;
+            _stalled = false;
+            _length = length;
+            _callback = &callback;
+            _channelId = channelId;
+            _detached = false;
+        }
+
+    protected:
+        // Outbound, towards the client.
+        uint32_t Serialize() const override
+        {
+            return (_length);
+        }
+        uint16_t Serialize(uint8_t stream[], const uint16_t maxLength) const override
+        {
+            uint16_t loaded = 0;
+
+            while ((loaded < maxLength) && (_filled > 0)) {
+                uint32_t chunk = std::min(std::min(_filled, _capacity - _head), static_cast<uint32_t>(maxLength - loaded));
+
+                ::memcpy(&stream[loaded], &_buffer[_head], chunk);
+
+                _head = (_head + chunk) % _capacity;
+                _filled -= chunk;
+                loaded += static_cast<uint16_t>(chunk);
+            }
+
+            if ((loaded > 0) && (_stalled == true)) {
+                _stalled = false;
+                _callback->Resume(_channelId);
+            }
+
+            return (loaded);
+        }
+
+        // Inbound, from the upstream server.
+        uint32_t Deserialize() override
+        {
+            return (_length);
+        }
+        uint16_t Deserialize(const uint8_t stream[], const uint16_t maxLength) override
+        {
+            uint16_t handled = maxLength;
+
+            if (_detached == false) {
+                handled = 0;
+
+                while ((handled < maxLength) && (_filled < _capacity)) {
+                    uint32_t tail = (_head + _filled) % _capacity;
+                    uint32_t chunk = std::min(std::min(_capacity - _filled, _capacity - tail), static_cast<uint32_t>(maxLength - handled));
+
+                    ::memcpy(&_buffer[tail], &stream[handled], chunk);
+
+                    _filled += chunk;
+                    handled += static_cast<uint16_t>(chunk);
+                }
+
+                // Whatever did not fit stays with the link, until the client made room for it.
+                _stalled = (handled < maxLength);
+
+                if ((maxLength > 0) && (_callback->Trigger(_channelId) == false)) {
+                    // Nobody is waiting for this data anymore, drain the upstream.
+                    _detached = true;
+                    _stalled = false;
+                    handled = maxLength;
+                }
+            }
+
+            return (handled);
+        }
+        void End() const override
+        {
+        }
+
+    private:
+        uint8_t* _buffer;
+        uint32_t _capacity;
+        mutable uint32_t _head;
+        mutable uint32_t _filled;
+        mutable bool _stalled;
+        uint32_t _length;
+        ICallback* _callback;
+        uint32_t _channelId;
+        bool _detached;
+    };
+
+} // namespace Plugin
+} // namespace WPEFramework
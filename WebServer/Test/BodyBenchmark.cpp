@@ -0,0 +1,233 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares serving a static file from a memory mapping (MappedFileBody) with reading it through an intermediate
+// buffer, the way Web::FileBody does. The body is pulled in send buffer sized pieces, as the web link does, and
+// pushed into a socket that is drained by another thread, so the copy into the kernel is part of the measurement.
+//
+// Usage: WebServerBodyBenchmark [file size in MB] [rounds] [send buffer size]
+
+#include "../MappedFileBody.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Maps the file for every response, as the WebServer does.
+    class MappedFileSource : public MappedFileBody {
+    public:
+        MappedFileSource(const MappedFileSource&) = delete;
+        MappedFileSource& operator=(const MappedFileSource&) = delete;
+
+        MappedFileSource(const string& fileName)
+            : MappedFileBody()
+            , _fileName(fileName)
+        {
+        }
+        ~MappedFileSource() override
+        {
+        }
+
+    public:
+        uint32_t Serialize()
+        {
+            Link(_fileName);
+            return (MappedFileBody::Serialize());
+        }
+        uint16_t Serialize(uint8_t stream[], const uint16_t maxLength)
+        {
+            return (MappedFileBody::Serialize(stream, maxLength));
+        }
+        void End()
+        {
+            MappedFileBody::End();
+        }
+
+    private:
+        const string _fileName;
+    };
+
+    // Reads the file into the stream for every piece, what the FileBody does.
+    class BufferedFileSource {
+    public:
+        BufferedFileSource(const BufferedFileSource&) = delete;
+        BufferedFileSource& operator=(const BufferedFileSource&) = delete;
+
+        BufferedFileSource(const string& fileName)
+            : _file(fileName)
+        {
+        }
+        ~BufferedFileSource()
+        {
+            _file.Close();
+        }
+
+    public:
+        uint32_t Serialize()
+        {
+            _file.Close();
+            _file.Open(true);
+            return (static_cast<uint32_t>(_file.Size()));
+        }
+        uint16_t Serialize(uint8_t stream[], const uint16_t maxLength)
+        {
+            return (static_cast<uint16_t>(_file.Read(stream, maxLength)));
+        }
+        void End()
+        {
+            _file.Close();
+        }
+
+    private:
+        Core::File _file;
+    };
+
+    struct Measurement {
+        uint64_t Bytes;
+        uint64_t Elapsed; // us
+        uint64_t Cpu; // us, user and system
+    };
+
+    static uint64_t CpuTime()
+    {
+        struct rusage usage;
+
+        ::getrusage(RUSAGE_SELF, &usage);
+
+        return ((static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000) + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+    }
+
+    template <typename SOURCE>
+    static Measurement Run(SOURCE& source, const uint32_t rounds, const uint16_t sendBufferSize, const int socket)
+    {
+        uint8_t* buffer = new uint8_t[sendBufferSize];
+        Measurement result = { 0, 0, 0 };
+        const uint64_t start = Core::Time::Now().Ticks();
+        const uint64_t cpu = CpuTime();
+
+        for (uint32_t round = 0; round < rounds; round++) {
+            uint32_t length = source.Serialize();
+
+            while (length > 0) {
+                uint16_t loaded = source.Serialize(buffer, static_cast<uint16_t>(std::min(length, static_cast<uint32_t>(sendBufferSize))));
+                uint16_t sent = 0;
+
+                ASSERT(loaded > 0);
+
+                while (sent < loaded) {
+                    ssize_t written = ::write(socket, &buffer[sent], loaded - sent);
+
+                    ASSERT(written > 0);
+
+                    sent += static_cast<uint16_t>(written);
+                }
+
+                length -= loaded;
+                result.Bytes += loaded;
+            }
+
+            source.End();
+        }
+
+        result.Elapsed = (Core::Time::Now().Ticks() - start) * 1000 / Core::Time::TicksPerMillisecond;
+        result.Cpu = CpuTime() - cpu;
+
+        delete[] buffer;
+
+        return (result);
+    }
+
+    static void Report(const TCHAR name[], const Measurement& measurement)
+    {
+        const double seconds = static_cast<double>(measurement.Elapsed) / 1000000.0;
+        const double gigabytes = static_cast<double>(measurement.Bytes) / (1024.0 * 1024.0 * 1024.0);
+
+        printf(_T("%-10s %8.1f MB/s  %8.1f ms CPU per GB\n"), name,
+            (static_cast<double>(measurement.Bytes) / (1024.0 * 1024.0)) / seconds,
+            (static_cast<double>(measurement.Cpu) / 1000.0) / gigabytes);
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t size = (argc > 1 ? ::atoi(argv[1]) : 64) * 1024 * 1024;
+    const uint32_t rounds = (argc > 2 ? ::atoi(argv[2]) : 16);
+    const uint16_t sendBufferSize = static_cast<uint16_t>(argc > 3 ? ::atoi(argv[3]) : 8192);
+
+    char fileName[] = "/tmp/WebServerBodyBenchmark.XXXXXX";
+    int fd = ::mkstemp(fileName);
+    int sockets[2];
+
+    if ((fd < 0) || (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)) {
+        printf(_T("Could not set up the benchmark\n"));
+        return (1);
+    }
+
+    // Fill the file with something that is not a hole.
+    uint8_t block[64 * 1024];
+    for (uint32_t index = 0; index < sizeof(block); index++) {
+        block[index] = static_cast<uint8_t>(index * 31);
+    }
+    for (uint32_t written = 0; written < size; written += sizeof(block)) {
+        if (::write(fd, block, sizeof(block)) != sizeof(block)) {
+            break;
+        }
+    }
+    ::close(fd);
+
+    // The receiving side of the client connection.
+    std::thread drain([&sockets]() {
+        uint8_t buffer[64 * 1024];
+
+        while (::read(sockets[1], buffer, sizeof(buffer)) > 0) {
+        }
+    });
+
+    printf(_T("File of %u MB, %u rounds, send buffer of %u bytes\n"), size / (1024 * 1024), rounds, sendBufferSize);
+
+    {
+        Plugin::BufferedFileSource buffered(fileName);
+
+        // Warm up the page cache, both variants should read from memory.
+        Plugin::Run(buffered, 1, sendBufferSize, sockets[0]);
+        Plugin::Report(_T("Buffered"), Plugin::Run(buffered, rounds, sendBufferSize, sockets[0]));
+    }
+    {
+        Plugin::MappedFileSource mapped(fileName);
+
+        Plugin::Report(_T("Mapped"), Plugin::Run(mapped, rounds, sendBufferSize, sockets[0]));
+    }
+
+    ::shutdown(sockets[0], SHUT_RDWR);
+    drain.join();
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+    ::unlink(fileName);
+
+    Core::Singleton::Dispose();
+
+    return (0);
+}
@@ -0,0 +1,125 @@
+/*
+ * If not stated otherwise in this file or this component's LICENSE file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2020 Metrological
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of routing a request path to a proxy as a function of the number of configured proxy paths.
+// The route tree used by the ProxyMap is compared with a linear scan over all paths, the way proxies used to be
+// matched. Half of the request paths match a proxy, the other half do not.
+//
+// Usage: WebServerRouteBenchmark [lookups per step]
+
+#include "../RouteTree.h"
+
+#include <list>
+#include <vector>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    struct Target {
+        string Path;
+    };
+
+    // First match wins, on complete segments only.
+    static const Target* Scan(const std::list<Target>& targets, const string& path)
+    {
+        std::list<Target>::const_iterator index(targets.begin());
+
+        while (index != targets.end()) {
+            const uint32_t checkSize(static_cast<uint32_t>(index->Path.length()));
+
+            if (((path.length() == checkSize) || ((path.length() > checkSize) && (path[checkSize] == '/'))) && (path.compare(0, checkSize, index->Path) == 0)) {
+                break;
+            }
+            index++;
+        }
+
+        return (index != targets.end() ? &(*index) : nullptr);
+    }
+
+    static string ProxyPath(const uint32_t index)
+    {
+        // A bit of structure, as in real configurations: a few services with many endpoints each.
+        return (_T("/Service/") + Core::NumberType<uint32_t>(index % 16).Text() + _T("/Endpoint") + Core::NumberType<uint32_t>(index).Text());
+    }
+
+    static double NanoSeconds(const uint64_t start, const uint32_t lookups)
+    {
+        return ((static_cast<double>(Core::Time::Now().Ticks() - start) * 1000000.0) / (static_cast<double>(Core::Time::TicksPerMillisecond) * lookups));
+    }
+}
+}
+
+using namespace WPEFramework;
+
+int main(int argc, char** argv)
+{
+    const uint32_t lookups = (argc > 1 ? ::atoi(argv[1]) : 200000);
+    static const uint32_t Steps[] = { 1, 10, 100, 1000, 10000 };
+
+    printf(_T("%8s %14s %14s\n"), _T("routes"), _T("tree ns/op"), _T("scan ns/op"));
+
+    for (const uint32_t routes : Steps) {
+        std::list<Plugin::Target> targets;
+        Plugin::RouteTreeType<Plugin::Target> tree;
+        std::vector<string> requests;
+        uint32_t found = 0;
+
+        for (uint32_t index = 0; index < routes; index++) {
+            targets.push_back({ Plugin::ProxyPath(index) });
+            tree.Insert(targets.back().Path, &targets.back());
+        }
+
+        // Requests go to random proxies, one level deeper than the proxy path, or to paths nobody serves.
+        for (uint32_t index = 0; index < 1024; index++) {
+            const uint32_t selected = static_cast<uint32_t>(::rand()) % routes;
+
+            if ((index & 1) == 0) {
+                requests.push_back(Plugin::ProxyPath(selected) + _T("/resource/item.json"));
+            } else {
+                requests.push_back(_T("/Static/") + Core::NumberType<uint32_t>(selected).Text() + _T("/index.html"));
+            }
+        }
+
+        uint64_t start = Core::Time::Now().Ticks();
+        for (uint32_t index = 0; index < lookups; index++) {
+            found += (tree.Find(requests[index & 1023]) != nullptr ? 1 : 0);
+        }
+        const double treeTime = Plugin::NanoSeconds(start, lookups);
+
+        // The scan gets too slow for many routes, do less of them.
+        const uint32_t scans = std::max(lookups / std::max(routes / 10, static_cast<uint32_t>(1)), static_cast<uint32_t>(1024));
+
+        start = Core::Time::Now().Ticks();
+        for (uint32_t index = 0; index < scans; index++) {
+            found -= (Plugin::Scan(targets, requests[index & 1023]) != nullptr ? 1 : 0);
+        }
+        const double scanTime = Plugin::NanoSeconds(start, scans);
+
+        printf(_T("%8u %14.1f %14.1f\n"), routes, treeTime, scanTime);
+
+        // Keeps the lookups from being optimized away.
+        if (found == 0xFFFFFFFF) {
+            printf(_T("\n"));
+        }
+    }
+
+    Core::Singleton::Dispose();
+
+    return (0);
+}
@@ -18,6 +18,10 @@
  */
  
 #include "Module.h"
+#include "FileCache.h"
+#include "MappedFileBody.h"
+#include "RouteTree.h"
+#include "StreamBody.h"
 #include <interfaces/IMemory.h>
 #include <interfaces/IWebServer.h>
 
@@ -25,6 +29,145 @@ namespace WPEFramework {
 namespace Plugin {
 
     static Core::ProxyPoolType<Web::TextBody> _textBodies(5);
+    static Core::ProxyPoolType<FileCache::Body> _cachedBodies(5);
+    static Core::ProxyPoolType<MappedFileBody> _mappedBodies(5);
+    static Core::ProxyPoolType<StreamBody> _streamBodies(2);
+
+    static bool ToOffset(const string& text, uint64_t& value)
+    {
+        char* end = nullptr;
+
+        value = ::strtoull(text.c_str(), &end, 10);
+
+        return ((text.empty() == false) && (isdigit(text[0]) != 0) && (end != nullptr) && (*end == '\0'));
+    }
+
+    // Checks if a coding is acceptable according to an Accept-Encoding list, e.g. "deflate, gzip;q=0.8, br".
+    // A coding listed with q=0 is refused, a "*" covers all codings that are not listed explicitly. The coding to
+    // look for is expected in lower case.
+    static bool Accepts(const string& list, const string& coding)
+    {
+        bool explicitly = false;
+        bool wildcard = false;
+        bool accepted = false;
+        string::size_type start = 0;
+
+        while ((start < list.length()) && (explicitly == false)) {
+            string::size_type end = list.find(',', start);
+
+            if (end == string::npos) {
+                end = list.length();
+            }
+
+            string::size_type parameters = list.find(';', start);
+            string::size_type first = list.find_first_not_of(_T(" \t"), start);
+            string::size_type last = std::min(parameters, end);
+            bool refused = false;
+
+            while ((last > first) && ((list[last - 1] == ' ') || (list[last - 1] == '\t'))) {
+                last--;
+            }
+
+            string token(first < last ? list.substr(first, last - first) : string());
+
+            std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+
+            if (parameters < end) {
+                string::size_type q = list.find(_T("q="), parameters);
+
+                if ((q < end) && (::strtod(list.c_str() + q + 2, nullptr) <= 0.0)) {
+                    refused = true;
+                }
+            }
+
+            if (token == coding) {
+                explicitly = true;
+                accepted = !refused;
+            } else if (token == _T("*")) {
+                wildcard = !refused;
+            }
+
+            start = end + 1;
+        }
+
+        return (explicitly == true ? accepted : wildcard);
+    }
+    static bool AcceptsGzip(const Web::Request& request)
+    {
+        return ((request.AcceptEncoding.IsSet() == true) && (Accepts(request.AcceptEncoding.Value(), _T("gzip")) == true));
+    }
+
+    // Applies a (single) "bytes" Range of the request to a resource of the given size. Multiple ranges and other
+    // units are ignored, the full resource is served for those. Returns false if the range can not be satisfied,
+    // the response is complete in that case. Otherwise offset and length describe the part to send.
+    // A body can not carry more than 4GB, larger parts are cut short. The Content-Range tells the client where to
+    // continue, so larger resources can only be fetched in ranges.
+    static bool ApplyRange(const Web::Request& request, Web::Response& response, const uint64_t size, uint64_t& offset, uint32_t& length)
+    {
+        static constexpr uint64_t MaxLength = 0xFFFFFFFF;
+
+        bool satisfiable = true;
+        bool partial = false;
+        uint64_t begin = 0;
+        uint64_t end = (size > 0 ? size - 1 : 0);
+
+        response.AcceptRanges = _T("bytes");
+
+        if ((request.Range.IsSet() == true) && (request.Range.Value().compare(0, 6, _T("bytes=")) == 0) && (request.Range.Value().find(',') == string::npos)) {
+            const string& range(request.Range.Value());
+            size_t dash = range.find('-', 6);
+
+            if (dash != string::npos) {
+                const string first(range.substr(6, dash - 6));
+                const string last(range.substr(dash + 1));
+                uint64_t value = 0;
+
+                if (first.empty() == true) {
+                    // Suffix range, the last N bytes.
+                    if (ToOffset(last, value) == true) {
+                        partial = ((size > 0) && (value > 0));
+                        satisfiable = partial;
+                        begin = (value >= size ? 0 : size - value);
+                    }
+                } else if (ToOffset(first, begin) == true) {
+                    if (last.empty() == true) {
+                        partial = true;
+                    } else if (ToOffset(last, value) == true) {
+                        end = std::min(value, end);
+                        partial = (begin <= end);
+                    }
+                    satisfiable = (begin < size);
+                }
+            }
+        }
+
+        if (satisfiable == false) {
+            response.ErrorCode = Web::STATUS_REQUESTED_RANGE_NOT_SATISFIABLE;
+            response.Message = _T("Range Not Satisfiable");
+            response.ContentRange = _T("bytes */") + Core::NumberType<uint64_t>(size).Text();
+        } else if (partial == false) {
+            begin = 0;
+            end = (size > 0 ? size - 1 : 0);
+
+            if (size > MaxLength) {
+                // Without a range there is no way to tell the client it only got a part.
+                satisfiable = false;
+                response.ErrorCode = Web::STATUS_INTERNAL_SERVER_ERROR;
+                response.Message = _T("Resource too large, request it in ranges");
+            }
+        } else {
+            end = std::min(end, begin + MaxLength - 1);
+
+            response.ErrorCode = Web::STATUS_PARTIAL_CONTENT;
+            response.Message = _T("Partial Content");
+            response.ContentRange = _T("bytes ") + Core::NumberType<uint64_t>(begin).Text() + '-' + Core::NumberType<uint64_t>(end).Text() + '/' + Core::NumberType<uint64_t>(size).Text();
+        }
+
+        offset = begin;
+        length = (size > 0 ? static_cast<uint32_t>(end - begin + 1) : 0);
+
+        return (satisfiable);
+    }
 
     class WebServerImplementation : public Exchange::IWebServer, public PluginHost::IStateControl {
     private:
@@ -101,20 +244,40 @@ namespace Plugin {
                     , Path()
                     , Subst()
                     , Server()
+                    , MinConnections(1)
+                    , MaxConnections(4)
+                    , IdleTime(60)
+                    , Streaming(false)
+                    , StreamBuffer(64 * 1024)
                 {
                     Add(_T("path"), &Path);
                     Add(_T("subst"), &Subst);
                     Add(_T("server"), &Server);
+                    Add(_T("minconnections"), &MinConnections);
+                    Add(_T("maxconnections"), &MaxConnections);
+                    Add(_T("idletime"), &IdleTime);
+                    Add(_T("streaming"), &Streaming);
+                    Add(_T("streambuffer"), &StreamBuffer);
                 }
                 Proxy(const Proxy& copy)
                     : Core::JSON::Container()
                     , Path(copy.Path)
                     , Subst(copy.Subst)
                     , Server(copy.Server)
+                    , MinConnections(copy.MinConnections)
+                    , MaxConnections(copy.MaxConnections)
+                    , IdleTime(copy.IdleTime)
+                    , Streaming(copy.Streaming)
+                    , StreamBuffer(copy.StreamBuffer)
                 {
                     Add(_T("path"), &Path);
                     Add(_T("subst"), &Subst);
                     Add(_T("server"), &Server);
+                    Add(_T("minconnections"), &MinConnections);
+                    Add(_T("maxconnections"), &MaxConnections);
+                    Add(_T("idletime"), &IdleTime);
+                    Add(_T("streaming"), &Streaming);
+                    Add(_T("streambuffer"), &StreamBuffer);
                 }
                 virtual ~Proxy()
                 {
@@ -124,6 +287,11 @@ namespace Plugin {
                 Core::JSON::String Path;
                 Core::JSON::String Subst;
                 Core::JSON::String Server;
+                Core::JSON::DecUInt16 MinConnections;
+                Core::JSON::DecUInt16 MaxConnections;
+                Core::JSON::DecUInt16 IdleTime;
+                Core::JSON::Boolean Streaming;
+                Core::JSON::DecUInt32 StreamBuffer;
             };
 
         public:
@@ -134,12 +302,18 @@ namespace Plugin {
                 , Interface()
                 , Path()
                 , IdleTime(180)
+                , CacheSize(2048)
+                , CacheFileSize(256)
+                , SendBuffer(1024)
             {
                 Add(_T("port"), &Port);
                 Add(_T("binding"), &Binding);
                 Add(_T("interface"), &Interface);
                 Add(_T("path"), &Path);
                 Add(_T("idletime"), &IdleTime);
+                Add(_T("cachesize"), &CacheSize);
+                Add(_T("cachefilesize"), &CacheFileSize);
+                Add(_T("sendbuffer"), &SendBuffer);
                 Add(_T("proxies"), &Proxies);
             }
             ~Config()
@@ -152,6 +326,9 @@ namespace Plugin {
             Core::JSON::String Interface;
             Core::JSON::String Path;
             Core::JSON::DecUInt16 IdleTime;
+            Core::JSON::DecUInt32 CacheSize; // In KB, 0 disables the cache.
+            Core::JSON::DecUInt32 CacheFileSize; // In KB, larger files are always served from disk.
+            Core::JSON::DecUInt16 SendBuffer; // Per client, larger buffers mean less send calls for large files.
             Core::JSON::ArrayType<Proxy> Proxies;
         };
 
@@ -198,17 +375,21 @@ namespace Plugin {
         };
 
         // IMPORTANT NOTE:
-        // There is no need to lock/unlock usage on this server as all action->response senarious take place on
-        // the communication thread from the SoketPortMonitor. There is only 1 such thread per process.
-        // Given this, make sure that all actions done by the ProxyMap are deterministic and short <100ms as it
-        // upholds all other network traffic.
-        class ProxyMap {
+        // All action->response senarious take place on the communication thread from the SoketPortMonitor. There
+        // is only 1 such thread per process. Given this, make sure that all actions done by the ProxyMap are
+        // deterministic and short <100ms as it upholds all other network traffic.
+        // The pools themselves can be changed (AddProxy/RemoveProxy) and inspected (idle connection reaping) from
+        // other threads, so the list of pools, and the queues in them, are guarded by the ProxyMap lock.
+        class ProxyMap : public StreamBody::ICallback {
         private:
+            class Pool;
+
             class OutgoingChannel : public Web::WebLinkType<Core::SocketStream, Web::Response, Web::Request, ResponseFactory> {
             private:
                 struct OutstandingMessage {
                     Core::ProxyType<Web::Request> Request;
                     uint32_t Id;
+                    bool Streamed;
                 };
 
             public:
@@ -216,32 +397,123 @@ namespace Plugin {
                 OutgoingChannel(const OutgoingChannel&) = delete;
                 OutgoingChannel& operator=(const OutgoingChannel&) = delete;
 
-                OutgoingChannel(const string& path, const string& replacement, ProxyMap& proxyMap, const Core::NodeId& remoteId)
+                OutgoingChannel(Pool& pool, const Core::NodeId& remoteId)
                     : Web::WebLinkType<Core::SocketStream, Web::Response, Web::Request, ResponseFactory>(2, false, remoteId.AnyInterface(), remoteId, 1024, 1024)
-                    , _path(path)
-                    , _replacement(replacement)
                     , _outstandingMessages()
-                    , _proxyMap(proxyMap)
+                    , _pool(pool)
+                    , _lastUsed(Core::Time::Now().Ticks())
                 {
                 }
-                
+
                 ~OutgoingChannel() override {
                     Close(Core::infinite);
                 }
 
-                void ProxyRequest(Core::ProxyType<Web::Request>& request, uint32_t id)
+                // Should be called with the ProxyMap lock taken. Returns true if this is the only outstanding
+                // request, in which case the caller should Start() it once the lock is released.
+                bool ProxyRequest(Core::ProxyType<Web::Request>& request, uint32_t id)
                 {
 
-                    OutstandingMessage message = { request, id };
+                    OutstandingMessage message = { request, id, false };
 
                     _outstandingMessages.push_back(message);
+                    _lastUsed = Core::Time::Now().Ticks();
 
-                    if (_outstandingMessages.size() == 1) {
-                        if (IsOpen() == false) {
-                            Open(0);
-                        } else {
-                            Submit(request);
-                        }
+                    return (_outstandingMessages.size() == 1);
+                }
+                // Should be called without the ProxyMap lock taken, the socket callbacks take it as well.
+                void Start(Core::ProxyType<Web::Request>& request)
+                {
+                    if (IsOpen() == false) {
+                        Open(0);
+                    } else {
+                        Submit(request);
+                    }
+                }
+
+            public:
+                inline uint32_t Outstanding() const
+                {
+                    return (static_cast<uint32_t>(_outstandingMessages.size()));
+                }
+                inline uint64_t LastUsed() const
+                {
+                    return (_lastUsed);
+                }
+                // Should be called with the ProxyMap lock taken. Kicks the link to offer the body data it held back,
+                // if this channel is streaming a body to the given client.
+                bool Resume(const uint32_t id)
+                {
+                    bool result = ((_outstandingMessages.empty() == false) && (_outstandingMessages.front().Id == id) && (_outstandingMessages.front().Streamed == true));
+
+                    if (result == true) {
+                        Trigger();
+                    }
+
+                    return (result);
+                }
+                virtual void LinkBody(Core::ProxyType<Web::Response>& response);
+                virtual void Send(const Core::ProxyType<Web::Request>& request);
+                // Whenever there is a state change on the link, it is reported here.
+                virtual void StateChange();
+                virtual void Received(Core::ProxyType<Web::Response>& response);
+
+            private:
+                std::list<OutstandingMessage> _outstandingMessages;
+                Pool& _pool;
+                uint64_t _lastUsed;
+            };
+
+        public:
+            struct Statistics {
+                uint16_t Connections;
+                uint16_t Open;
+                uint16_t Peak;
+                uint32_t Outstanding;
+                uint32_t Relayed;
+                uint32_t Created;
+                uint32_t Reaped;
+            };
+
+        private:
+            // A pool holds all the upstream connections for one configured proxy path. New connections are
+            // created on demand, as long as all existing ones are busy and the maximum is not reached. Each
+            // request is dispatched to the connection with the least outstanding requests.
+            class Pool {
+            public:
+                Pool() = delete;
+                Pool(const Pool&) = delete;
+                Pool& operator=(const Pool&) = delete;
+
+                Pool(const string& path, const string& replacement, ProxyMap& proxyMap, const Core::NodeId& remoteId, const Config::Proxy& config)
+                    : _path(path)
+                    , _replacement(replacement)
+                    , _remoteId(remoteId)
+                    , _minimum(config.MinConnections.Value())
+                    , _maximum(std::max(_minimum, std::max(config.MaxConnections.Value(), static_cast<uint16_t>(1))))
+                    , _idleTime(static_cast<uint64_t>(config.IdleTime.Value()) * Core::Time::TicksPerMillisecond * 1000)
+                    , _streamBuffer(config.Streaming.Value() == true ? std::max(config.StreamBuffer.Value(), static_cast<uint32_t>(1024)) : 0)
+                    , _channels()
+                    , _proxyMap(proxyMap)
+                    , _peak(0)
+                    , _relayed(0)
+                    , _created(0)
+                    , _reaped(0)
+                    , _reported()
+                    , _users(0)
+                    , _retired(false)
+                {
+                    while (_channels.size() < _minimum) {
+                        _channels.push_back(new OutgoingChannel(*this, _remoteId));
+                        _created++;
+                    }
+                    _peak = static_cast<uint16_t>(_channels.size());
+                }
+                ~Pool()
+                {
+                    while (_channels.size() > 0) {
+                        delete _channels.front();
+                        _channels.pop_front();
                     }
                 }
 
@@ -250,41 +522,145 @@ namespace Plugin {
                 {
                     return (_path);
                 }
-                virtual void LinkBody(Core::ProxyType<Web::Response>& response)
+                inline ProxyMap& Map()
+                {
+                    return (_proxyMap);
+                }
+                // Zero if responses should be buffered completely before they are relayed.
+                inline uint32_t StreamBuffer() const
+                {
+                    return (_streamBuffer);
+                }
+                // A pool that is replaced or removed while a request is started on one of its channels, outside of
+                // the ProxyMap lock, is only retired. The last of those requests deletes it. Guarded by the ProxyMap lock.
+                inline void Use()
                 {
-                    response->Body(_textBodies.Element());
+                    _users++;
                 }
-                virtual void Send(const Core::ProxyType<Web::Request>& request)
+                // Returns true if the pool was retired meanwhile, and should now be deleted.
+                inline bool Release()
                 {
-                    std::list<OutstandingMessage>::iterator index(_outstandingMessages.begin());
+                    ASSERT(_users > 0);
+                    _users--;
 
-                    while ((index != _outstandingMessages.end()) && (index->Request.IsValid() == false)) {
+                    return ((_users == 0) && (_retired == true));
+                }
+                // Returns true if the pool is not in use, and can be deleted right away.
+                inline bool Retire()
+                {
+                    _retired = true;
+
+                    return (_users == 0);
+                }
+                // Returns the channel that needs to be started, if any.
+                OutgoingChannel* ProxyRequest(Core::ProxyType<Web::Request>& request, uint32_t id)
+                {
+                    OutgoingChannel* selected = nullptr;
+                    std::list<OutgoingChannel*>::iterator index(_channels.begin());
+
+                    // Least outstanding wins, an idle and open channel is the best we can get.
+                    while (index != _channels.end()) {
+                        if ((selected == nullptr) || ((*index)->Outstanding() < selected->Outstanding()) || (((*index)->Outstanding() == selected->Outstanding()) && ((*index)->IsOpen() == true) && (selected->IsOpen() == false))) {
+                            selected = *index;
+                        }
                         index++;
                     }
 
-                    ASSERT(index != _outstandingMessages.end());
-                    ASSERT(index->Request == request);
+                    if (((selected == nullptr) || (selected->Outstanding() > 0)) && (_channels.size() < _maximum)) {
+                        selected = new OutgoingChannel(*this, _remoteId);
+                        _channels.push_back(selected);
+                        _created++;
 
-                    index->Request.Release();
+                        if (_channels.size() > _peak) {
+                            _peak = static_cast<uint16_t>(_channels.size());
+                        }
+                    }
+
+                    _relayed++;
+
+                    return (selected->ProxyRequest(request, id) == true ? selected : nullptr);
                 }
-                // Whenever there is a state change on the link, it is reported here.
-                virtual void StateChange()
+                bool Resume(const uint32_t id)
                 {
-                    if (IsOpen() == true) {
+                    std::list<OutgoingChannel*>::iterator index(_channels.begin());
+
+                    while ((index != _channels.end()) && ((*index)->Resume(id) == false)) {
+                        index++;
+                    }
 
-                        if (!_outstandingMessages.empty()) {
-                            Submit(_outstandingMessages.front().Request);
+                    return (index != _channels.end());
+                }
+                // Hand out the connections that have not been used for the configured idle time, but always keep
+                // the minimum number of connections around.
+                void Reap(const uint64_t now, std::list<OutgoingChannel*>& reaped)
+                {
+                    if (_idleTime != 0) {
+                        std::list<OutgoingChannel*>::iterator index(_channels.begin());
+
+                        while ((index != _channels.end()) && (_channels.size() > _minimum)) {
+                            OutgoingChannel* channel(*index);
+
+                            if ((channel->Outstanding() == 0) && ((channel->LastUsed() + _idleTime) < now)) {
+                                reaped.push_back(channel);
+                                index = _channels.erase(index);
+                                _reaped++;
+                            } else {
+                                index++;
+                            }
                         }
                     }
                 }
-                virtual void Received(Core::ProxyType<Web::Response>& response);
+                void Snapshot(Statistics& info) const
+                {
+                    std::list<OutgoingChannel*>::const_iterator index(_channels.begin());
+
+                    info.Connections = static_cast<uint16_t>(_channels.size());
+                    info.Open = 0;
+                    info.Outstanding = 0;
+
+                    while (index != _channels.end()) {
+                        if ((*index)->IsOpen() == true) {
+                            info.Open++;
+                        }
+                        info.Outstanding += (*index)->Outstanding();
+                        index++;
+                    }
+
+                    info.Peak = _peak;
+                    info.Relayed = _relayed;
+                    info.Created = _created;
+                    info.Reaped = _reaped;
+                }
+                // Only changes are worth reporting, an idle proxy should not flood the trace on every tick.
+                bool Changed(const Statistics& info)
+                {
+                    const bool changed = (info.Connections != _reported.Connections) || (info.Open != _reported.Open) || (info.Peak != _reported.Peak) || (info.Outstanding != _reported.Outstanding) || (info.Relayed != _reported.Relayed) || (info.Created != _reported.Created) || (info.Reaped != _reported.Reaped);
+
+                    _reported = info;
+
+                    return (changed);
+                }
 
             private:
                 const string _path;
                 const string _replacement;
+                const Core::NodeId _remoteId;
+                const uint16_t _minimum;
+                const uint16_t _maximum;
+                const uint64_t _idleTime;
+                const uint32_t _streamBuffer;
 
-                std::list<OutstandingMessage> _outstandingMessages;
+                std::list<OutgoingChannel*> _channels;
                 ProxyMap& _proxyMap;
+
+                uint16_t _peak;
+                uint32_t _relayed;
+                uint32_t _created;
+                uint32_t _reaped;
+                Statistics _reported;
+
+                uint32_t _users;
+                bool _retired;
             };
 
         private:
@@ -294,18 +670,16 @@ namespace Plugin {
 
         public:
             ProxyMap(ChannelMap& server)
-                : _server(server)
+                : _adminLock()
+                , _server(server)
                 , _proxies()
+                , _routes()
                 , _closures()
             {
             }
             ~ProxyMap()
             {
-                // Clean up channels in map.
-                while (_proxies.size() > 0) {
-                    delete _proxies.front();
-                    _proxies.pop_front();
-                }
+                Destroy();
             }
 
         public:
@@ -316,56 +690,59 @@ namespace Plugin {
 
                 while (index.Next() == true) {
 
-                    const string& path(index.Current().Path.Value());
-                    const string& subst(index.Current().Subst.Value());
-                    const Core::NodeId address(index.Current().Server.Value().c_str());
+                    const Config::Proxy& entry(index.Current());
+                    const Core::NodeId address(entry.Server.Value().c_str());
 
                     if (address.IsValid() == true) {
 
-                        _proxies.push_back(new OutgoingChannel(path, subst, *this, address));
+                        Add(new Pool(entry.Path.Value(), entry.Subst.Value(), *this, address, entry));
                     }
                 }
             }
 
             void Destroy()
             {
+                std::list<Pool*> pools;
 
-                std::list<OutgoingChannel*>::iterator index(_proxies.begin());
+                _adminLock.Lock();
+                pools.swap(_proxies);
 
-                while (index != _proxies.end()) {
+                std::list<Pool*>::iterator index(pools.begin());
 
-                    delete (*index);
+                while (index != pools.end()) {
+                    _routes.Remove((*index)->Path());
 
-                    index++;
+                    if ((*index)->Retire() == true) {
+                        index++;
+                    } else {
+                        index = pools.erase(index);
+                    }
+                }
+
+                _adminLock.Unlock();
+
+                // Closing the channels waits for the SocketPortMonitor, which might be waiting for our lock,
+                // so the pools are destructed outside of the lock.
+                while (pools.size() > 0) {
+                    delete pools.front();
+                    pools.pop_front();
                 }
-                _proxies.clear();
             }
 
             bool Relay(Core::ProxyType<Web::Request>& request, uint32_t channelId)
             {
 
-                bool found = false;
-                const string& originalPath = request->Path;
-                std::list<OutgoingChannel*>::iterator index(_proxies.begin());
-                string proxyPath;
+                _adminLock.Lock();
 
-                while ((found == false) && (index != _proxies.end())) {
-
-                    proxyPath = (*index)->Path();
-
-                    uint32_t checkSize(static_cast<uint32_t>(proxyPath.length()));
-
-                    // If path starts with mapped string, we should relay.
-                    if (((originalPath.length() == checkSize) || ((originalPath.length() > checkSize) && (originalPath[checkSize] == '/'))) && (originalPath.compare(0, checkSize, proxyPath) == 0)) {
-                        found = true;
-                    } else {
-                        index++;
-                    }
-                }
+                Pool* pool(_routes.Find(request->Path));
+                OutgoingChannel* channel(nullptr);
+                bool found = (pool != nullptr);
 
                 // If we didn't find relay instructions for this path, return false.
                 if (found == true) {
 
+                    const string& proxyPath(pool->Path());
+
                     if (request->Connection.Value() == Web::Request::CONNECTION_CLOSE) {
                         // The client allows non-persistant connection, but the closure should not be applied to the relay connection.
                         request->Connection = Web::Request::CONNECTION_UNKNOWN;
@@ -374,7 +751,28 @@ namespace Plugin {
 
                     request->Path = (proxyPath + request->Path.substr(proxyPath.length()));
 
-                    (*index)->ProxyRequest(request, channelId);
+                    channel = pool->ProxyRequest(request, channelId);
+
+                    if (channel != nullptr) {
+                        pool->Use();
+                    }
+                }
+
+                _adminLock.Unlock();
+
+                // Opening or submitting on the channel may call back into the ProxyMap (StateChange, Send) from
+                // the SocketPortMonitor thread, so that is done without holding the lock. Meanwhile the pool is
+                // in use, so a concurrent RemoveProxy or Add does not delete it, and its channels, under our feet.
+                if (channel != nullptr) {
+                    channel->Start(request);
+
+                    _adminLock.Lock();
+                    const bool dispose(pool->Release());
+                    _adminLock.Unlock();
+
+                    if (dispose == true) {
+                        delete pool;
+                    }
                 }
 
                 return (found);
@@ -386,43 +784,146 @@ namespace Plugin {
 
                 if (node.IsValid() == true) {
 
-                    _proxies.push_back(new OutgoingChannel(path, subst, *this, node));
+                    const Config::Proxy defaults;
+
+                    Add(new Pool(path, subst, *this, node, defaults));
                 }
             }
             inline void RemoveProxy(const string& path)
             {
-                std::list<OutgoingChannel*>::iterator index(_proxies.begin());
+                _adminLock.Lock();
+
+                Pool* pool(_routes.Remove(path));
+
+                if (pool != nullptr) {
+                    _proxies.remove(pool);
+
+                    if (pool->Retire() == false) {
+                        pool = nullptr;
+                    }
+                }
+
+                _adminLock.Unlock();
+
+                if (pool != nullptr) {
+                    delete pool;
+                }
+            }
+            // A proxy for a path that is already mapped, replaces the existing one.
+            void Add(Pool* pool)
+            {
+                _adminLock.Lock();
+
+                Pool* previous(_routes.Insert(pool->Path(), pool));
 
-                while ((index != _proxies.end()) && ((*index)->Path() != path)) {
+                _proxies.push_back(pool);
 
+                if (previous != nullptr) {
+                    _proxies.remove(previous);
+
+                    if (previous->Retire() == false) {
+                        previous = nullptr;
+                    }
+                }
+
+                _adminLock.Unlock();
+
+                if (previous != nullptr) {
+                    delete previous;
+                }
+            }
+            void Reap()
+            {
+                const uint64_t now(Core::Time::Now().Ticks());
+                std::list<OutgoingChannel*> reaped;
+
+                _adminLock.Lock();
+
+                std::list<Pool*>::iterator index(_proxies.begin());
+
+                while (index != _proxies.end()) {
+                    (*index)->Reap(now, reaped);
                     index++;
                 }
 
-                if (index != _proxies.end()) {
+                _adminLock.Unlock();
+
+                while (reaped.size() > 0) {
+                    delete reaped.front();
+                    reaped.pop_front();
+                }
+            }
+            void Report()
+            {
+                _adminLock.Lock();
+
+                std::list<Pool*>::iterator index(_proxies.begin());
+
+                while (index != _proxies.end()) {
+                    Statistics info;
 
-                    delete (*index);
-                    _proxies.erase(index);
+                    (*index)->Snapshot(info);
+
+                    if ((*index)->Changed(info) == true) {
+                        TRACE(Trace::Information, (_T("Proxy [%s]: connections %d (open %d, peak %d), outstanding %d, relayed %d, created %d, reaped %d"), (*index)->Path().c_str(), info.Connections, info.Open, info.Peak, info.Outstanding, info.Relayed, info.Created, info.Reaped));
+                    }
+
+                    index++;
                 }
+
+                _adminLock.Unlock();
             }
             inline void Submit(uint32_t channelId, Core::ProxyType<Web::Response>& response)
             {
                 _server.Submit(channelId, response);
             }
+            bool Trigger(const uint32_t channelId) override
+            {
+                return (_server.Trigger(channelId));
+            }
+            void Resume(const uint32_t channelId) override
+            {
+                _adminLock.Lock();
+
+                std::list<Pool*>::iterator index(_proxies.begin());
+
+                while ((index != _proxies.end()) && ((*index)->Resume(channelId) == false)) {
+                    index++;
+                }
+
+                _adminLock.Unlock();
+            }
             inline bool Completed(const uint32_t channelId)
             {
                 // Relay completed; check if we can close the incoming connection
                 bool close = false;
+
+                _adminLock.Lock();
+
                 auto it = std::find(_closures.begin(), _closures.end(), channelId);
                 if (it != _closures.end()) {
                     _closures.erase(it);
                     close = true;
                 }
+
+                _adminLock.Unlock();
+
                 return (close);
             }
+            inline void Lock() const
+            {
+                _adminLock.Lock();
+            }
+            inline void Unlock() const
+            {
+                _adminLock.Unlock();
+            }
 
         private:
+            mutable Core::CriticalSection _adminLock;
             ChannelMap& _server;
-            std::list<OutgoingChannel*> _proxies;
+            std::list<Pool*> _proxies;
+            RouteTreeType<Pool> _routes;
             std::list<uint32_t> _closures;
         };
 
@@ -433,7 +934,7 @@ namespace Plugin {
             IncomingChannel& operator=(const IncomingChannel&) = delete;
             
             IncomingChannel(const SOCKET& connector, const Core::NodeId& remoteId, Core::SocketServerType<IncomingChannel>* parent)
-                : Web::WebLinkType<Core::SocketStream, Web::Request, Web::Response, RequestFactory>(2, false, connector, remoteId, 1024, 1024)
+                : Web::WebLinkType<Core::SocketStream, Web::Request, Web::Response, RequestFactory>(2, false, connector, remoteId, static_cast<ChannelMap&>(*parent).SendBufferSize(), 1024)
                 , _id(0)
                 , _parent(static_cast<ChannelMap&>(*parent))
             {
@@ -536,7 +1037,10 @@ namespace Plugin {
                 , _prefixPath()
                 , _connectionCheckTimer(0)
                 , _cleanupTimer(Core::Thread::DefaultStackSize(), _T("ConnectionChecker"))
+                , _sendBufferSize(1024)
                 , _proxyMap(*this)
+                , _fileCache()
+                , _reportedLookups(0)
             {
             }
 #ifdef __WINDOWS__
@@ -580,6 +1084,10 @@ namespace Plugin {
 
                 _proxyMap.Create(index);
 
+                _sendBufferSize = std::max(configuration.SendBuffer.Value(), static_cast<uint16_t>(1024));
+
+                _fileCache.Configure(configuration.CacheSize.Value() * 1024, configuration.CacheFileSize.Value() * 1024);
+
                 if (configuration.Interface.Value().empty() == false) {
                     Core::NodeId selectedNode = Plugin::Config::IPV4UnicastNode(configuration.Interface.Value());
 
@@ -644,6 +1152,17 @@ namespace Plugin {
             {
                 return (_proxyMap.Completed(id));
             }
+            // Kick the client to pull more of a streamed body, returns false if the client is gone.
+            inline bool Trigger(const uint32_t id)
+            {
+                Core::ProxyType<IncomingChannel> client(BaseClass::Client(id));
+
+                if (client.IsValid() == true) {
+                    client->Trigger();
+                }
+
+                return (client.IsValid());
+            }
             inline string Accessor() const
             {
                 return (_accessor);
@@ -659,6 +1178,14 @@ namespace Plugin {
             {
                 _proxyMap.RemoveProxy(path);
             }
+            inline uint16_t SendBufferSize() const
+            {
+                return (_sendBufferSize);
+            }
+            inline FileCache& Cache()
+            {
+                return (_fileCache);
+            }
             inline bool IsFileServerEnabled()
             {
                 return (_prefixPath.empty() == false);
@@ -673,6 +1200,20 @@ namespace Plugin {
                 // First clear all shit from last time..
                 Cleanup();
 
+                // Drop the upstream connections that are idle for too long..
+                _proxyMap.Reap();
+                _proxyMap.Report();
+
+                if (_fileCache.IsEnabled() == true) {
+                    const uint32_t hits(_fileCache.Hits());
+                    const uint32_t misses(_fileCache.Misses());
+
+                    if ((hits + misses) != _reportedLookups) {
+                        _reportedLookups = hits + misses;
+                        TRACE(Trace::Information, (_T("File cache: %d hits, %d misses"), hits, misses));
+                    }
+                }
+
                 // Now suspend those that have no activity.
                 BaseClass::Iterator index(BaseClass::Clients());
 
@@ -695,7 +1236,10 @@ namespace Plugin {
             string _prefixPath;
             uint32_t _connectionCheckTimer;
             Core::TimerType<TimeHandler> _cleanupTimer;
+            uint16_t _sendBufferSize;
             ProxyMap _proxyMap;
+            FileCache _fileCache;
+            uint32_t _reportedLookups;
         };
 
     private:
@@ -806,21 +1350,80 @@ namespace Plugin {
                 Web::MIMETypes result;
                 Web::EncodingTypes encoding;
                 string fileToService = _parent.PrefixPath();
+                Core::ProxyType<const FileCache::Entry> cached;
 
                 if (Web::MIMETypeAndEncodingForFile(request->Path, fileToService, result, encoding) == false) {
-                    string fullPath = fileToService + _T("index.html");
-
                     // No filename gives, be default, we go for the index.html page..
-                    *fileBody = fileToService + _T("index.html");
-                    response->ContentType = Web::MIME_HTML;
-                    response->Body<Web::FileBody>(fileBody);
-                } else {
-                    *fileBody = fileToService;
+                    fileToService += _T("index.html");
+                    result = Web::MIME_HTML;
+                    encoding = Web::ENCODING_UNKNOWN;
+                }
+
+                if (_parent.Cache().IsEnabled() == true) {
+                    cached = _parent.Cache().Get(fileToService, result, encoding);
+                }
+
+                if (cached.IsValid() == false) {
+                    Core::ProxyType<MappedFileBody> mapped(_mappedBodies.Element());
+                    uint64_t offset;
+                    uint32_t length;
+
                     response->ContentType = result;
                     if (encoding != Web::ENCODING_UNKNOWN) {
                         response->ContentEncoding = encoding;
                     }
-                    response->Body<Web::FileBody>(fileBody);
+
+                    if (mapped->Link(fileToService) == false) {
+                        // Nothing to map (empty, missing or unmappable file), let the FileBody serve or report on it.
+                        *fileBody = fileToService;
+                        response->Body<Web::FileBody>(fileBody);
+                    } else if (ApplyRange(*request, *response, mapped->FileSize(), offset, length) == true) {
+                        mapped->Range(offset, length);
+                        response->Body(Core::ProxyType<Web::IBody>(mapped));
+                    } else {
+                        mapped->Unlink();
+                    }
+                } else {
+                    // HTTP dates have a resolution of seconds, so compare on that.
+                    const uint64_t modified(cached->Modified.Ticks() / (Core::Time::TicksPerMillisecond * 1000));
+
+                    response->ETag = cached->ETag;
+                    response->LastModified = cached->Modified;
+
+                    // The content depends on the Accept-Encoding of the request if there is a compressed variant,
+                    // caches in between should not hand the one variant to a client asking for the other.
+                    if (cached->Compressed.empty() == false) {
+                        response->Vary = _T("Accept-Encoding");
+                    }
+
+                    if ( ((request->IfNoneMatch.IsSet() == true) && (request->IfNoneMatch.Value() == cached->ETag)) ||
+                         ((request->IfNoneMatch.IsSet() == false) && (request->IfModifiedSince.IsSet() == true) && (modified <= (request->IfModifiedSince.Value().Ticks() / (Core::Time::TicksPerMillisecond * 1000)))) ) {
+                        response->ErrorCode = Web::STATUS_NOT_MODIFIED;
+                        response->Message = _T("Not Modified");
+                    } else {
+                        // Ranges are always applied to the original content, never to the compressed variant.
+                        const bool compressed((cached->Compressed.empty() == false) && (request->Range.IsSet() == false) && (AcceptsGzip(*request) == true));
+                        uint64_t offset;
+                        uint32_t length;
+
+                        response->ContentType = cached->Type;
+                        if (compressed == true) {
+                            response->ContentEncoding = Web::ENCODING_GZIP;
+                        } else if (cached->Encoding != Web::ENCODING_UNKNOWN) {
+                            response->ContentEncoding = cached->Encoding;
+                        }
+
+                        if ((compressed == true) || (ApplyRange(*request, *response, cached->Size, offset, length) == true)) {
+                            Core::ProxyType<FileCache::Body> body(_cachedBodies.Element());
+
+                            body->Link(cached, compressed);
+
+                            if (compressed == false) {
+                                body->Range(static_cast<uint32_t>(offset), length);
+                            }
+                            response->Body(Core::ProxyType<Web::IBody>(body));
+                        }
+                    }
                 }
                 Submit(response);
             } else {
@@ -830,23 +1433,107 @@ namespace Plugin {
         }
     }
 
+    /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::LinkBody(Core::ProxyType<Web::Response>& response)
+    {
+        const uint32_t capacity(_pool.StreamBuffer());
+
+        _pool.Map().Lock();
+
+        // Only bodies that would not fit the stream buffer anyway, and of which the size is known up front, are
+        // streamed. All others are relayed once they are received completely.
+        if ((capacity != 0) && (response->ContentLength.IsSet() == true) && (response->ContentLength.Value() > capacity) && (_outstandingMessages.empty() == false)) {
+            Core::ProxyType<StreamBody> body(_streamBodies.Element());
+            OutstandingMessage& message(_outstandingMessages.front());
+            const uint32_t id(message.Id);
+
+            body->Link(_pool.Map(), id, static_cast<uint32_t>(response->ContentLength.Value()), capacity);
+            response->Body(Core::ProxyType<Web::IBody>(body));
+            message.Streamed = true;
+
+            _pool.Map().Unlock();
+
+            // The header is complete, so it can be send to the client, the body follows as it comes in.
+            _pool.Map().Submit(id, response);
+        } else {
+            _pool.Map().Unlock();
+
+            response->Body(_textBodies.Element());
+        }
+    }
+
+    /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::Send(const Core::ProxyType<Web::Request>& request)
+    {
+        _pool.Map().Lock();
+
+        std::list<OutstandingMessage>::iterator index(_outstandingMessages.begin());
+
+        while ((index != _outstandingMessages.end()) && (index->Request.IsValid() == false)) {
+            index++;
+        }
+
+        ASSERT(index != _outstandingMessages.end());
+        ASSERT(index->Request == request);
+
+        index->Request.Release();
+
+        _pool.Map().Unlock();
+    }
+
+    /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::StateChange()
+    {
+        if (IsOpen() == true) {
+            Core::ProxyType<Web::Request> request;
+
+            _pool.Map().Lock();
+
+            if (!_outstandingMessages.empty()) {
+                request = _outstandingMessages.front().Request;
+            }
+
+            _pool.Map().Unlock();
+
+            if (request.IsValid() == true) {
+                Submit(request);
+            }
+        }
+    }
+
     /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::Received(Core::ProxyType<Web::Response>& response)
     {
+        _pool.Map().Lock();
+
         // Is response to our front of the list
         ASSERT(_outstandingMessages.empty() == false);
         ASSERT(_outstandingMessages.front().Request.IsValid() == false);
 
         if (_outstandingMessages.empty() == false) {
-            _proxyMap.Submit(_outstandingMessages.front().Id, response);
+            uint32_t id = _outstandingMessages.front().Id;
+            bool streamed = _outstandingMessages.front().Streamed;
+            Core::ProxyType<Web::Request> next;
+
             _outstandingMessages.pop_front();
+            _lastUsed = Core::Time::Now().Ticks();
 
             // See if ther is a next one to send.
             if (_outstandingMessages.size() > 0) {
 
                 ASSERT(_outstandingMessages.front().Request.IsValid() == true);
 
-                Submit(_outstandingMessages.front().Request);
+                next = _outstandingMessages.front().Request;
+            }
+
+            _pool.Map().Unlock();
+
+            if (next.IsValid() == true) {
+                Submit(next);
+            }
+
+            // Streamed responses were already handed to the client when the header came in.
+            if (streamed == false) {
+                _pool.Map().Submit(id, response);
             }
+        } else {
+            _pool.Map().Unlock();
         }
     }
 